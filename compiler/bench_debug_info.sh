@@ -0,0 +1,56 @@
+#!/usr/bin/env bash
+# Compile time and executable size of each debug info level, at -O0 and -O2.
+# bench_debug_info.sh <path to potatoscript> [file.potato]
+# Without a file it generates the 1500 fn program the numbers in the -g commit were measured on. Times are the
+# fastest of 3 compiles, so they're mostly the compiler and not the disk.
+
+set -eu
+
+POTATO=$(realpath "$1")
+RUNS=3
+FNS=1500
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+if [ $# -ge 2 ]; then
+	SOURCE=$(realpath "$2")
+else
+	SOURCE="$WORK/bench.potato"
+	{
+		printf 'struct Vec3 {\n\tf32 x\n\tf32 y\n\tf32 z\n}\n'
+		for ((i = 0; i < FNS; i++)); do
+			printf 'export fn work%d(i32 n, Vec3 v) i64 {\n' $i
+			printf '\ti64 total = 0\n'
+			printf '\tfor i32 i = 0; i < n; i += 1 {\n'
+			printf '\t\tif i %% 3 == 0 {\n\t\t\ttotal += i * %d\n\t\t}\n\t\telse {\n\t\t\ttotal -= 1\n\t\t}\n' $i
+			printf '\t}\n'
+			printf '\tf32 l = v.x * v.y + v.z\n'
+			printf '\t[]u8 bytes = alloc<u8>(8)\n\tbytes[0] = 1u8\n\tfree(bytes)\n'
+			printf '\treturn total\n}\n'
+		done
+		printf 'fn main() i32 {\n\tVec3 v\n\ti64 total = 0\n'
+		for ((i = 0; i < FNS; i++)); do
+			printf '\ttotal += work%d(10, v)\n' $i
+		done
+		printf '\tprintln("{}", total)\n\treturn 0\n}\n'
+	} > "$SOURCE"
+fi
+
+for O in -O0 -O2; do
+	for G in none -gline-tables-only -g; do
+		FLAG=$G
+		[ "$G" = none ] && FLAG=
+
+		best=
+		for ((run = 0; run < RUNS; run++)); do
+			start=$(date +%s%N)
+			"$POTATO" "$SOURCE" --quiet $O $FLAG -o "$WORK/bench" >/dev/null
+			ms=$((($(date +%s%N) - start) / 1000000))
+			if [ -z "$best" ] || [ $ms -lt $best ]; then
+				best=$ms
+			fi
+		done
+
+		echo "$O $G: $best ms, exe $(wc -c < "$WORK/bench") bytes"
+	done
+done
@@ -0,0 +1,374 @@
+#include "abi.h"
+
+#include "llvm/ADT/Triple.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+
+using namespace lang::abi;
+
+unsigned FunctionInfo::loweredIndex(size_t argument) const
+{
+	unsigned index = result.kind == PassKind::Indirect ? 1 : 0;
+	for (size_t i = 0; i < argument; i++) {
+		index += arguments[i].kind == PassKind::Coerced ? static_cast<unsigned>(arguments[i].parts.size()) : 1;
+	}
+
+	return index;
+}
+
+// SysV x86-64 classes of an eightbyte, the 8 byte chunks a struct of up to 16 bytes is split into
+enum class Class {
+	None, // Only padding
+	Integer,
+	Sse,
+	Memory,
+};
+
+struct Eightbyte {
+	Class type = Class::None;
+	bool floatAtLow = false; // f32 at offset 0, with floatAtHigh the chunk travels as <2 x float>
+	bool floatAtHigh = false;
+	bool highUsed = false; // Data in bytes 4..8
+	llvm::Type* pointer = nullptr; // Pointer filling the whole chunk, it stays a pointer instead of becoming an i64
+};
+
+static Class merge(Class a, Class b) {
+	if (a == b || b == Class::None) return a;
+	if (a == Class::None) return b;
+	if (a == Class::Memory || b == Class::Memory) return Class::Memory;
+	if (a == Class::Integer || b == Class::Integer) return Class::Integer;
+	return Class::Sse;
+}
+
+// Merges every scalar in type, placed at offset, into the eightbyte it occupies. False if the type has to go in memory.
+static bool classifyScalars(const llvm::DataLayout& dataLayout, llvm::Type* type, u64 offset, Eightbyte (&chunks)[2]) {
+	if (auto* strukt = llvm::dyn_cast<llvm::StructType>(type)) {
+		const llvm::StructLayout* layout = dataLayout.getStructLayout(strukt);
+		for (unsigned i = 0; i < strukt->getNumElements(); i++) {
+			if (classifyScalars(dataLayout, strukt->getElementType(i), offset + layout->getElementOffset(i), chunks) == false) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	if (auto* array = llvm::dyn_cast<llvm::ArrayType>(type)) {
+		// i8 arrays are the explicit padding of over-aligned and padded structs, they hold no data
+		if (array->getElementType()->isIntegerTy(8)) {
+			return true;
+		}
+
+		u64 stride = dataLayout.getTypeAllocSize(array->getElementType());
+		for (u64 i = 0; i < array->getNumElements(); i++) {
+			if (classifyScalars(dataLayout, array->getElementType(), offset + i * stride, chunks) == false) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	if (auto* vector = llvm::dyn_cast<llvm::FixedVectorType>(type)) {
+		u64 stride = dataLayout.getTypeStoreSize(vector->getElementType());
+		for (u32 i = 0; i < vector->getNumElements(); i++) {
+			if (classifyScalars(dataLayout, vector->getElementType(), offset + i * stride, chunks) == false) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Misaligned fields only occur in packed structs, C passes those in memory
+	if (offset % dataLayout.getABITypeAlignment(type) != 0) {
+		return false;
+	}
+
+	Eightbyte& chunk = chunks[offset / 8];
+	u64 offsetInChunk = offset % 8;
+	chunk.type = merge(chunk.type, type->isFloatingPointTy() ? Class::Sse : Class::Integer);
+	chunk.highUsed |= offsetInChunk + dataLayout.getTypeStoreSize(type) > 4;
+	if (type->isFloatTy()) {
+		(offsetInChunk == 0 ? chunk.floatAtLow : chunk.floatAtHigh) = true;
+	}
+	if (type->isPointerTy() && offsetInChunk == 0 && dataLayout.getTypeStoreSize(type) == 8) {
+		chunk.pointer = type;
+	}
+
+	return true;
+}
+
+// Register type of one eightbyte, size is the number of bytes of the struct it covers.
+static llvm::Type* partType(llvm::LLVMContext& context, const Eightbyte& chunk, u64 size) {
+	if (chunk.type == Class::Sse) {
+		if (chunk.highUsed == false) {
+			return llvm::Type::getFloatTy(context);
+		}
+		if (chunk.floatAtLow && chunk.floatAtHigh) {
+			return llvm::FixedVectorType::get(llvm::Type::getFloatTy(context), 2);
+		}
+		return llvm::Type::getDoubleTy(context);
+	}
+
+	if (chunk.pointer) {
+		return chunk.pointer;
+	}
+
+	return llvm::Type::getIntNTy(context, static_cast<unsigned>(size * 8));
+}
+
+// Registers left for arguments, SysV passes a struct in memory when all of its parts don't fit anymore
+struct Registers {
+	u32 integer = 6;
+	u32 sse = 8;
+};
+
+static PassInfo classifySysV(const llvm::DataLayout& dataLayout, llvm::Type* type, u64 alignment, Registers* registers) {
+	PassInfo info;
+	info.type = type;
+	info.alignment = alignment;
+
+	if (type->isStructTy() == false) {
+		if (registers && type->isVoidTy() == false) {
+			u32& count = type->isFloatingPointTy() || type->isVectorTy() ? registers->sse : registers->integer;
+			count -= count > 0 ? 1 : 0;
+		}
+		return info;
+	}
+
+	u64 size = dataLayout.getTypeAllocSize(type);
+	if (size == 0) {
+		return info;
+	}
+
+	Eightbyte chunks[2];
+	if (size > 16 || classifyScalars(dataLayout, type, 0, chunks) == false || chunks[0].type == Class::Memory || chunks[1].type == Class::Memory) {
+		info.kind = PassKind::Indirect;
+		info.byval = true;
+		return info;
+	}
+
+	u32 integerCount = 0;
+	u32 sseCount = 0;
+	size_t chunkCount = size > 8 ? 2 : 1;
+	if (chunkCount == 2 && chunks[1].type == Class::None) {
+		chunkCount = 1; // Tail padding, e.g. from align(16)
+	}
+
+	for (size_t i = 0; i < chunkCount; i++) {
+		(chunks[i].type == Class::Sse ? sseCount : integerCount)++;
+	}
+
+	if (registers) {
+		if (registers->integer < integerCount || registers->sse < sseCount) {
+			info.kind = PassKind::Indirect;
+			info.byval = true;
+			return info;
+		}
+
+		registers->integer -= integerCount;
+		registers->sse -= sseCount;
+	}
+
+	llvm::LLVMContext& context = type->getContext();
+	info.kind = PassKind::Coerced;
+	for (size_t i = 0; i < chunkCount; i++) {
+		u64 bytes = std::min<u64>(8, size - i * 8);
+
+		// With two parts the second one has to start at offset 8, so the first is widened to a full eightbyte
+		Eightbyte chunk = chunks[i];
+		if (chunkCount == 2 && i == 0) {
+			chunk.highUsed = true;
+		}
+
+		info.parts.push_back(partType(context, chunk, bytes));
+	}
+
+	return info;
+}
+
+// Win64 passes structs of 1, 2, 4 or 8 bytes as an integer and everything else through a pointer
+static PassInfo classifyWin64(const llvm::DataLayout& dataLayout, llvm::Type* type, u64 alignment) {
+	PassInfo info;
+	info.type = type;
+	info.alignment = alignment;
+
+	if (type->isStructTy() == false) {
+		return info;
+	}
+
+	u64 size = dataLayout.getTypeAllocSize(type);
+	if (size == 1 || size == 2 || size == 4 || size == 8) {
+		info.kind = PassKind::Coerced;
+		info.parts.push_back(llvm::Type::getIntNTy(type->getContext(), static_cast<unsigned>(size * 8)));
+		return info;
+	}
+
+	info.kind = PassKind::Indirect;
+	return info;
+}
+
+FunctionInfo lang::abi::direct(llvm::Type* result, u64 resultAlignment, const std::vector<llvm::Type*>& arguments, const std::vector<u64>& argumentAlignments)
+{
+	FunctionInfo info;
+	info.result = PassInfo{ PassKind::Direct, result, {}, false, resultAlignment };
+	for (size_t i = 0; i < arguments.size(); i++) {
+		info.arguments.push_back(PassInfo{ PassKind::Direct, arguments[i], {}, false, argumentAlignments[i] });
+	}
+
+	return info;
+}
+
+// Larger aggregates are copied around as memory, as values LLVM would shuffle them through registers
+static const u64 maxDirectAggregateSize = 16;
+
+FunctionInfo lang::abi::internal(const llvm::DataLayout& dataLayout, llvm::Type* result, u64 resultAlignment,
+	const std::vector<llvm::Type*>& arguments, const std::vector<u64>& argumentAlignments)
+{
+	FunctionInfo info = direct(result, resultAlignment, arguments, argumentAlignments);
+
+	auto lower = [&](PassInfo& pass) {
+		llvm::Type* type = pass.type;
+		if ((type->isStructTy() || type->isArrayTy()) && dataLayout.getTypeAllocSize(type) > maxDirectAggregateSize) {
+			pass.kind = PassKind::Indirect;
+		}
+	};
+
+	lower(info.result);
+	for (auto& a : info.arguments) {
+		lower(a);
+	}
+
+	return info;
+}
+
+FunctionInfo lang::abi::classify(const llvm::DataLayout& dataLayout, const llvm::Triple& triple, llvm::Type* result, u64 resultAlignment,
+	const std::vector<llvm::Type*>& arguments, const std::vector<u64>& argumentAlignments)
+{
+	if (triple.getArch() != llvm::Triple::x86_64) {
+		return direct(result, resultAlignment, arguments, argumentAlignments);
+	}
+
+	FunctionInfo info;
+
+	if (triple.isOSWindows()) {
+		info.result = classifyWin64(dataLayout, result, resultAlignment);
+		for (size_t i = 0; i < arguments.size(); i++) {
+			info.arguments.push_back(classifyWin64(dataLayout, arguments[i], argumentAlignments[i]));
+		}
+		return info;
+	}
+
+	Registers registers;
+	info.result = classifySysV(dataLayout, result, resultAlignment, nullptr);
+	if (info.result.kind == PassKind::Indirect) {
+		info.result.byval = false;
+		registers.integer--; // The sret pointer
+	}
+
+	for (size_t i = 0; i < arguments.size(); i++) {
+		info.arguments.push_back(classifySysV(dataLayout, arguments[i], argumentAlignments[i], &registers));
+	}
+
+	return info;
+}
+
+llvm::Type* lang::abi::coercedResultType(llvm::LLVMContext& context, const PassInfo& info)
+{
+	return info.parts.size() == 1 ? info.parts[0] : llvm::StructType::get(context, info.parts);
+}
+
+llvm::FunctionType* lang::abi::loweredType(llvm::LLVMContext& context, const FunctionInfo& info)
+{
+	std::vector<llvm::Type*> parameters;
+	llvm::Type* result = info.result.type;
+
+	switch (info.result.kind) {
+	case PassKind::Indirect:
+		parameters.push_back(result->getPointerTo());
+		result = llvm::Type::getVoidTy(context);
+		break;
+	case PassKind::Coerced:
+		result = coercedResultType(context, info.result);
+		break;
+	default:
+		break;
+	}
+
+	for (auto& a : info.arguments) {
+		switch (a.kind) {
+		case PassKind::Direct:
+			parameters.push_back(a.type);
+			break;
+		case PassKind::Coerced:
+			parameters.insert(parameters.end(), a.parts.begin(), a.parts.end());
+			break;
+		case PassKind::Indirect:
+			parameters.push_back(a.type->getPointerTo());
+			break;
+		}
+	}
+
+	return llvm::FunctionType::get(result, parameters, false);
+}
+
+void lang::abi::addAttributes(llvm::Function* function, const FunctionInfo& info)
+{
+	llvm::LLVMContext& context = function->getContext();
+
+	if (info.result.kind == PassKind::Indirect) {
+#if LLVM_VERSION_MAJOR >= 12
+		function->addParamAttr(0, llvm::Attribute::getWithStructRetType(context, info.result.type));
+#else
+		function->addParamAttr(0, llvm::Attribute::StructRet);
+#endif
+		function->addParamAttr(0, llvm::Attribute::NoAlias);
+		function->addParamAttr(0, llvm::Attribute::getWithAlignment(context, llvm::Align(info.result.alignment)));
+	}
+
+	for (size_t i = 0; i < info.arguments.size(); i++) {
+		auto& a = info.arguments[i];
+		if (a.kind != PassKind::Indirect) {
+			continue;
+		}
+
+		unsigned index = info.loweredIndex(i);
+		if (a.byval) {
+			// SysV keeps byval arguments 8 byte aligned on the stack
+			function->addParamAttr(index, llvm::Attribute::getWithByValType(context, a.type));
+			function->addParamAttr(index, llvm::Attribute::getWithAlignment(context, llvm::Align(std::max<u64>(a.alignment, 8))));
+		}
+		else {
+			// Copy made by the caller for this call only
+			function->addParamAttr(index, llvm::Attribute::NoAlias);
+			function->addParamAttr(index, llvm::Attribute::getWithAlignment(context, llvm::Align(a.alignment)));
+		}
+	}
+}
+
+// Address of part i of a coerced struct at address, parts after the first start at offset 8
+static llvm::Value* partAddress(llvm::IRBuilderBase& builder, llvm::Value* address, const PassInfo& info, size_t i) {
+	llvm::Type* layout = info.parts.size() == 1 ? info.parts[0] : llvm::StructType::get(builder.getContext(), info.parts);
+	llvm::Value* cast = builder.CreateBitCast(address, layout->getPointerTo());
+	return info.parts.size() == 1 ? cast : builder.CreateStructGEP(layout, cast, static_cast<unsigned>(i));
+}
+
+std::vector<llvm::Value*> lang::abi::loadParts(llvm::IRBuilderBase& builder, llvm::Value* address, const PassInfo& info)
+{
+	std::vector<llvm::Value*> parts;
+	for (size_t i = 0; i < info.parts.size(); i++) {
+		llvm::Align alignment = llvm::commonAlignment(llvm::Align(info.alignment), i * 8);
+		parts.push_back(builder.CreateAlignedLoad(info.parts[i], partAddress(builder, address, info, i), alignment));
+	}
+
+	return parts;
+}
+
+void lang::abi::storeParts(llvm::IRBuilderBase& builder, llvm::Value* address, const PassInfo& info, const std::vector<llvm::Value*>& parts)
+{
+	for (size_t i = 0; i < info.parts.size(); i++) {
+		llvm::Align alignment = llvm::commonAlignment(llvm::Align(info.alignment), i * 8);
+		builder.CreateAlignedStore(parts[i], partAddress(builder, address, info, i), alignment);
+	}
+}
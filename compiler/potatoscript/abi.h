@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "types.h"
+
+namespace llvm {
+	class Type;
+	class Value;
+	class Function;
+	class FunctionType;
+	class DataLayout;
+	class Triple;
+	class LLVMContext;
+	class IRBuilderBase;
+}
+
+namespace lang::abi {
+
+	// How a value crosses a call, following the C calling convention of the target so extern fns interoperate.
+	enum class PassKind {
+		Direct, // As its own LLVM type: scalars, vectors and aggregates on targets without rules here
+		Coerced, // Struct travels in one or two registers as the parts below
+		Indirect, // Struct travels in memory: sret for results, byval or a pointer to a caller owned copy for arguments
+	};
+
+	struct PassInfo {
+		PassKind kind = PassKind::Direct;
+		llvm::Type* type = nullptr; // As seen by the language
+		std::vector<llvm::Type*> parts; // Register types of a coerced struct, in memory order
+		bool byval = false; // Indirect argument the callee receives its own copy of (SysV), otherwise a pointer to the caller's copy (Win64)
+		u64 alignment = 0; // Of type in memory, including align(N) on structs
+	};
+
+	struct FunctionInfo {
+		PassInfo result;
+		std::vector<PassInfo> arguments;
+
+		// Index of the first LLVM argument argument i is lowered to, the sret pointer comes first.
+		unsigned loweredIndex(size_t argument) const;
+	};
+
+	// Every value as its own LLVM type.
+	FunctionInfo direct(llvm::Type* result, u64 resultAlignment, const std::vector<llvm::Type*>& arguments, const std::vector<u64>& argumentAlignments);
+
+	// For fns only called from potato code, where no C convention has to be met. Structs and arrays above two
+	// eightbytes travel in memory like C passes them, the result through sret and arguments as a pointer to a copy
+	// the caller makes. Everything else is passed directly, strings and slices stay a {ptr, len} pair.
+	FunctionInfo internal(const llvm::DataLayout& dataLayout, llvm::Type* result, u64 resultAlignment,
+		const std::vector<llvm::Type*>& arguments, const std::vector<u64>& argumentAlignments);
+
+	// Classifies the result and arguments of a function, alignments include align(N) on structs.
+	// x86-64 follows the SysV and Win64 conventions, other targets pass everything directly.
+	FunctionInfo classify(const llvm::DataLayout& dataLayout, const llvm::Triple& triple, llvm::Type* result, u64 resultAlignment,
+		const std::vector<llvm::Type*>& arguments, const std::vector<u64>& argumentAlignments);
+
+	// LLVM function type after lowering.
+	llvm::FunctionType* loweredType(llvm::LLVMContext& context, const FunctionInfo& info);
+
+	// sret, byval and alignment attributes of the lowered arguments.
+	void addAttributes(llvm::Function* function, const FunctionInfo& info);
+
+	// Reads the parts of a coerced struct stored at address.
+	std::vector<llvm::Value*> loadParts(llvm::IRBuilderBase& builder, llvm::Value* address, const PassInfo& info);
+
+	// Writes the parts of a coerced struct to address, which has room for info.type.
+	void storeParts(llvm::IRBuilderBase& builder, llvm::Value* address, const PassInfo& info, const std::vector<llvm::Value*>& parts);
+
+	// Type a coerced struct result is returned as, a single part or a pair of them.
+	llvm::Type* coercedResultType(llvm::LLVMContext& context, const PassInfo& info);
+}
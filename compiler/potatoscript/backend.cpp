@@ -0,0 +1,176 @@
+#include "backend.h"
+
+#include <fstream>
+#include "llvm/Analysis/ModuleSummaryAnalysis.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/CodeGen.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
+#include "llvm/Transforms/IPO/Internalize.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/Scalar.h"
+
+class LLVMOutputStream : public llvm::raw_ostream {
+public:
+
+	std::ofstream outputFile;
+
+	LLVMOutputStream(const std::string& filename, bool binary = false) {
+		outputFile.open(filename, binary ? std::ios::out | std::ios::binary : std::ios::out);
+	}
+
+	~LLVMOutputStream() {
+		flush();
+		outputFile.close();
+	}
+
+	// Inherited via raw_ostream
+	virtual void write_impl(const char* ptr, size_t size) override
+	{
+		outputFile.write(ptr, static_cast<std::streamsize>(size));
+	}
+
+	virtual uint64_t current_pos() const override
+	{
+		return outputFile.cur;
+	}
+};
+
+void lang::backend::optimizeModule(llvm::Module& module, llvm::TargetMachine* targetMachine, u32 level, const Profile& profile, bool prepareForLTO)
+{
+	if (level == 0) {
+		// inline fns are inlined even in unoptimized builds
+		llvm::legacy::PassManager modulePasses;
+		modulePasses.add(llvm::createAlwaysInlinerLegacyPass());
+		modulePasses.run(module);
+		return;
+	}
+
+	llvm::PassManagerBuilder builder;
+	builder.OptLevel = level;
+	builder.Inliner = llvm::createFunctionInliningPass(level, 0, false);
+	builder.LoopVectorize = level >= 2;
+	builder.SLPVectorize = level >= 2;
+	builder.PrepareForThinLTO = prepareForLTO;
+
+	// Profiles drive branch weights, block layout and which call sites are hot enough to inline
+	builder.EnablePGOInstrGen = profile.generatePath.empty() == false;
+	builder.PGOInstrGen = profile.generatePath;
+	builder.PGOInstrUse = profile.usePath;
+
+	llvm::legacy::FunctionPassManager functionPasses(&module);
+	llvm::legacy::PassManager modulePasses;
+
+	// Without target info the vectorizer has no idea how wide vectors are
+	if (targetMachine) {
+		targetMachine->adjustPassManager(builder);
+		functionPasses.add(llvm::createTargetTransformInfoWrapperPass(targetMachine->getTargetIRAnalysis()));
+		modulePasses.add(llvm::createTargetTransformInfoWrapperPass(targetMachine->getTargetIRAnalysis()));
+	}
+
+	// Bounds checks on induction variables that loop conditions don't already cover are hoisted out of the loop
+	builder.addExtension(llvm::PassManagerBuilder::EP_LoopOptimizerEnd, [](const llvm::PassManagerBuilder&, llvm::legacy::PassManagerBase& passes) {
+		passes.add(llvm::createInductiveRangeCheckEliminationPass());
+	});
+
+	// Blocks the profile never saw run are moved out of their fn, keeping the hot part small and dense.
+	// With --thin-lto this waits for the link step, where inlining across modules has already happened.
+	if (profile.usePath.empty() == false && prepareForLTO == false) {
+		builder.addExtension(llvm::PassManagerBuilder::EP_OptimizerLast, [](const llvm::PassManagerBuilder&, llvm::legacy::PassManagerBase& passes) {
+			passes.add(llvm::createHotColdSplittingPass());
+		});
+	}
+
+	builder.populateFunctionPassManager(functionPasses);
+	builder.populateModulePassManager(modulePasses);
+
+	functionPasses.doInitialization();
+	for (auto& f : module) {
+		functionPasses.run(f);
+	}
+	functionPasses.doFinalization();
+
+	modulePasses.run(module);
+}
+
+std::unique_ptr<llvm::Module> lang::backend::linkModules(llvm::LLVMContext& context, llvm::TargetMachine* targetMachine, const std::vector<std::string>& paths)
+{
+	auto linked = std::make_unique<llvm::Module>("potatoscript", context);
+	llvm::Linker linker(*linked);
+
+	for (auto& path : paths) {
+		llvm::SMDiagnostic error;
+		auto module = llvm::parseIRFile(path, error, context);
+		if (module == nullptr) {
+			error.print("potato", llvm::errs());
+			return nullptr;
+		}
+
+		if (linker.linkInModule(std::move(module))) {
+			llvm::errs() << "Failed to link " << path << "\n";
+			return nullptr;
+		}
+	}
+
+	// The linked module is the whole program apart from C code calling export fns. Modules only give those and main
+	// external linkage, everything else (generic instances, the runtime) becomes internal.
+	llvm::internalizeModule(*linked, [](const llvm::GlobalValue& gv) {
+		return gv.hasExternalLinkage();
+	});
+
+	if (targetMachine) {
+		linked->setTargetTriple(targetMachine->getTargetTriple().str());
+		linked->setDataLayout(targetMachine->createDataLayout());
+	}
+
+	return linked;
+}
+
+void lang::backend::writeModule(llvm::Module& module, const std::string& path)
+{
+	if (path.size() >= 3 && path.compare(path.size() - 3, 3, ".bc") == 0) {
+		LLVMOutputStream output(path, true);
+		llvm::ProfileSummaryInfo profileSummary(module);
+		auto index = llvm::buildModuleSummaryIndex(module, nullptr, &profileSummary);
+		llvm::WriteBitcodeToFile(module, output, false, &index);
+		return;
+	}
+
+	LLVMOutputStream output(path);
+	module.print(output, nullptr, false, true);
+}
+
+bool lang::backend::emitObject(llvm::Module& module, llvm::TargetMachine* targetMachine, const std::string& path)
+{
+	if (targetMachine == nullptr) {
+		llvm::errs() << "No target machine to emit an object for\n";
+		return false;
+	}
+
+	std::error_code error;
+	llvm::raw_fd_ostream output(path, error, llvm::sys::fs::OF_None);
+	if (error) {
+		llvm::errs() << "Can't open " << path << ": " << error.message() << "\n";
+		return false;
+	}
+
+	llvm::legacy::PassManager passes;
+	if (targetMachine->addPassesToEmitFile(passes, output, nullptr, llvm::CGFT_ObjectFile)) {
+		llvm::errs() << "The target can't emit object files\n";
+		return false;
+	}
+
+	passes.run(module);
+	return true;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+namespace llvm {
+	class LLVMContext;
+	class Module;
+	class TargetMachine;
+}
+
+namespace lang::backend {
+
+	// Profile-guided optimization, an empty path turns that side off.
+	// generatePath instruments the module to write a raw profile there when it exits (needs the profile runtime),
+	// usePath is a .profdata merged from such runs with llvm-profdata.
+	struct Profile {
+		std::string generatePath;
+		std::string usePath;
+	};
+
+	// Runs the default -O<level> pipeline over module, 0 only inlines inline fns. Without a target machine the
+	// vectorizer has no idea how wide vectors are.
+	// prepareForLTO stops short of inlining and the late loop passes, linkModules does those once every module is in.
+	void optimizeModule(llvm::Module& module, llvm::TargetMachine* targetMachine, u32 level, const Profile& profile, bool prepareForLTO = false);
+
+	// Links the bitcode or IR files at paths into one module in context. Everything but main and export fns
+	// becomes internal, so optimizeModule can inline and drop fns across the original modules.
+	// Returns nullptr when a file can't be read or linked.
+	std::unique_ptr<llvm::Module> linkModules(llvm::LLVMContext& context, llvm::TargetMachine* targetMachine, const std::vector<std::string>& paths);
+
+	// Writes module as bitcode with a ThinLTO summary when path ends in .bc, as textual IR otherwise.
+	void writeModule(llvm::Module& module, const std::string& path);
+
+	// Compiles module to a native object file for the target machine.
+	// Returns false when the file can't be written or the target can't emit objects.
+	bool emitObject(llvm::Module& module, llvm::TargetMachine* targetMachine, const std::string& path);
+}
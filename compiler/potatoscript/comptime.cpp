@@ -0,0 +1,496 @@
+#include "comptime.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "parser.h"
+#include "typechecker.h"
+
+using namespace lang::parser;
+using namespace lang::comptime;
+using namespace lang::typechecker;
+
+void Evaluator::step()
+{
+	if (++steps > maxSteps) {
+		fail("exceeded " + std::to_string(maxSteps) + " evaluation steps");
+	}
+}
+
+void Evaluator::fail(const std::string& message)
+{
+	throw EvaluationError{ message };
+}
+
+void Evaluator::pushScope()
+{
+	frames.back().emplace_back();
+}
+
+void Evaluator::popScope()
+{
+	variableCount -= frames.back().back().size();
+	frames.back().pop_back();
+}
+
+void Evaluator::declare(const std::string& name, const Value& value)
+{
+	if (isNumeric(value.type) == false && value.type != "bool") {
+		fail("only numbers and bools are supported at compile time, " + name + " is " + value.type);
+	}
+
+	if (++variableCount > maxVariables) {
+		fail("exceeded " + std::to_string(maxVariables) + " live variables");
+	}
+
+	frames.back().back()[name] = value;
+}
+
+Value& Evaluator::lookup(const std::string& name)
+{
+	// Only the current call is visible, there are no globals or closures
+	auto& scopes = frames.back();
+	for (auto it = scopes.rbegin(); it != scopes.rend(); it++) {
+		auto found = it->find(name);
+		if (found != it->end()) {
+			return found->second;
+		}
+	}
+
+	fail(name + " isn't known at compile time");
+}
+
+Value Evaluator::call(FunctionAST* function, const std::vector<Value>& arguments)
+{
+	if (frames.size() >= maxCallDepth) {
+		fail("exceeded call depth of " + std::to_string(maxCallDepth));
+	}
+
+	auto* signature = function->getSignature();
+	frames.emplace_back();
+	pushScope();
+
+	for (size_t i = 0; i < arguments.size(); i++) {
+		auto* parameter = static_cast<VariableExprAST*>(signature->args->arguments[i]);
+		declare(parameter->name, arguments[i]);
+	}
+
+	function->getBody()->evaluate(*this);
+
+	// Falling off the end of the body returns the zero value
+	Value result = flow == Flow::Return ? returnValue : Value{ signature->returnTypeName() };
+	flow = Flow::Normal;
+
+	while (frames.back().empty() == false) {
+		popScope();
+	}
+	frames.pop_back();
+
+	return result;
+}
+
+Value lang::comptime::wrap(Value v)
+{
+	if (v.type == "bool") {
+		v.integer = v.integer != 0;
+		return v;
+	}
+
+	if (v.type == "f32") {
+		v.floating = static_cast<float>(v.floating);
+		return v;
+	}
+
+	u32 bits = bitWidth(v.type);
+	if (isInteger(v.type) && bits < 64) {
+		u64 mask = (u64(1) << bits) - 1;
+		u64 value = static_cast<u64>(v.integer) & mask;
+
+		if (isSignedInteger(v.type) && (value >> (bits - 1)) != 0) {
+			value |= ~mask; // Sign extend
+		}
+
+		v.integer = static_cast<int64_t>(value);
+	}
+
+	return v;
+}
+
+ExprAST* lang::comptime::constantFromValue(const Value& v)
+{
+	ExprAST* constant = nullptr;
+
+	if (v.type == "bool") {
+		auto* b = createAst<VariableExprAST>("bool", v.integer ? "1" : "0", nullptr);
+		b->isConstant = true;
+		constant = b;
+	}
+	else if (isFloat(v.type)) {
+		constant = createAst<NumberExprAST>(v.floating);
+	}
+	else {
+		constant = createAst<NumberExprAST>(v.integer);
+	}
+
+	constant->resolvedType = v.type;
+	return constant;
+}
+
+void lang::comptime::foldCalls(TypeScope& scope, const std::vector<ExprAST*>& nodes)
+{
+	Evaluator evaluator;
+	std::vector<FunctionAST*> functions;
+	for (auto* n : nodes) {
+		auto* impl = dynamic_cast<ImplAST*>(n);
+		if (impl) {
+			functions.insert(functions.end(), impl->methods.begin(), impl->methods.end());
+		}
+		else if (auto* fn = dynamic_cast<FunctionAST*>(n)) {
+			functions.push_back(fn);
+		}
+	}
+
+	for (auto* fn : functions) {
+		if (fn->getBody() && fn->isGeneric() == false) {
+			evaluator.functions[fn->getSignature()->name] = fn;
+		}
+	}
+
+	for (auto* call : scope.comptimeCalls) {
+		// Arguments are evaluated in an empty frame, so anything but constants and other comptime calls fails
+		evaluator.frames.emplace_back();
+		evaluator.pushScope();
+		scope.location = call->offset;
+
+		try {
+			call->comptimeValue = constantFromValue(call->evaluate(evaluator));
+		}
+		catch (const EvaluationError& e) {
+			scope.error("couldn't evaluate comptime call: " + e.message);
+		}
+
+		evaluator.frames.clear();
+		evaluator.flow = Flow::Normal;
+		evaluator.steps = 0;
+		evaluator.variableCount = 0;
+	}
+}
+
+Value ExprAST::evaluate(Evaluator& evaluator)
+{
+	evaluator.fail(prettyName() + " can't be evaluated at compile time");
+}
+
+Value NumberExprAST::evaluate(Evaluator& evaluator)
+{
+	evaluator.step();
+
+	lang::comptime::Value v{ resolvedType }; // Value alone is the literal's own storage union here
+	if (isFloat(resolvedType)) {
+		v.floating = floatValue();
+	}
+	else {
+		v.integer = integerValue();
+	}
+
+	return wrap(v);
+}
+
+Value VariableExprAST::evaluate(Evaluator& evaluator)
+{
+	evaluator.step();
+
+	if (isConstant) {
+		return Value{ "bool", name == "1" };
+	}
+
+	if (isDeclaration()) {
+		Value v = assignment ? assignment->evaluate(evaluator) : Value{ type };
+		evaluator.declare(name, v);
+		return v;
+	}
+
+	Value& slot = evaluator.lookup(name);
+	if (assignment) {
+		slot = assignment->evaluate(evaluator);
+	}
+
+	return slot;
+}
+
+Value BinaryExprAST::evaluate(Evaluator& evaluator)
+{
+	evaluator.step();
+
+	Value l = left->evaluate(evaluator);
+	Value r = right->evaluate(evaluator);
+
+	const std::string& operandType = left->resolvedType;
+	if (isVector(operandType)) {
+		evaluator.fail("vectors can't be evaluated at compile time");
+	}
+
+	Value result{ resolvedType };
+
+	if (isFloat(operandType)) {
+		double a = l.floating;
+		double b = r.floating;
+
+		switch (type) {
+		case TokenType::PLUS: result.floating = a + b; break;
+		case TokenType::MINUS: result.floating = isNegation ? -b : a - b; break;
+		case TokenType::STAR: result.floating = a * b; break;
+		case TokenType::SLASH: result.floating = a / b; break;
+		case TokenType::PERCENT: result.floating = std::fmod(a, b); break;
+		case TokenType::LEFT_ANGLE: result.integer = a < b; break;
+		case TokenType::RIGHT_ANGLE: result.integer = a > b; break;
+		case TokenType::LE_OP: result.integer = a <= b; break;
+		case TokenType::GE_OP: result.integer = a >= b; break;
+		case TokenType::EQ_OP: result.integer = a == b; break;
+		case TokenType::NE_OP: result.integer = a != b; break;
+		default:
+			evaluator.fail(std::string(TokenType::spelling(type)) + " isn't supported on floats");
+		}
+
+		return wrap(result);
+	}
+
+	// Integer math is done on u64 so overflow wraps instead of being undefined, wrap() then truncates to the real width
+	bool isSigned = isSignedInteger(operandType);
+	u64 a = static_cast<u64>(l.integer);
+	u64 b = static_cast<u64>(r.integer);
+	int64_t sa = l.integer;
+	int64_t sb = r.integer;
+
+	switch (type) {
+	case TokenType::SLASH:
+	case TokenType::PERCENT:
+		if (b == 0) {
+			evaluator.fail("division by zero");
+		}
+		if (isSigned && sa == static_cast<int64_t>(~u64(0) << (bitWidth(operandType) - 1)) && sb == -1) {
+			evaluator.fail("signed division overflow");
+		}
+		break;
+	case TokenType::DEREFERENCE_OR_SHIFT:
+	case TokenType::RIGHT_SHIFT:
+		if (b >= bitWidth(operandType)) {
+			evaluator.fail("shift by " + std::to_string(b) + " is out of range for " + operandType);
+		}
+		break;
+	default:
+		break;
+	}
+
+	switch (type) {
+	case TokenType::PLUS: result.integer = static_cast<int64_t>(a + b); break;
+	case TokenType::MINUS: result.integer = static_cast<int64_t>(a - b); break;
+	case TokenType::STAR: result.integer = static_cast<int64_t>(a * b); break;
+	case TokenType::SLASH: result.integer = isSigned ? sa / sb : static_cast<int64_t>(a / b); break;
+	case TokenType::PERCENT: result.integer = isSigned ? sa % sb : static_cast<int64_t>(a % b); break;
+	case TokenType::AMPERSAND:
+	case TokenType::AND_OP: result.integer = static_cast<int64_t>(a & b); break;
+	case TokenType::VERTICAL_BAR:
+	case TokenType::OR_OP: result.integer = static_cast<int64_t>(a | b); break;
+	case TokenType::CARET:
+	case TokenType::XOR_OP: result.integer = static_cast<int64_t>(a ^ b); break;
+	case TokenType::DEREFERENCE_OR_SHIFT: result.integer = static_cast<int64_t>(a << b); break;
+	case TokenType::RIGHT_SHIFT: result.integer = isSigned ? sa >> sb : static_cast<int64_t>(a >> b); break;
+	case TokenType::LEFT_ANGLE: result.integer = isSigned ? sa < sb : a < b; break;
+	case TokenType::RIGHT_ANGLE: result.integer = isSigned ? sa > sb : a > b; break;
+	case TokenType::LE_OP: result.integer = isSigned ? sa <= sb : a <= b; break;
+	case TokenType::GE_OP: result.integer = isSigned ? sa >= sb : a >= b; break;
+	case TokenType::EQ_OP: result.integer = a == b; break;
+	case TokenType::NE_OP: result.integer = a != b; break;
+	default:
+		evaluator.fail(std::string(TokenType::spelling(type)) + " isn't supported at compile time");
+	}
+
+	return wrap(result);
+}
+
+Value CastExprAST::evaluate(Evaluator& evaluator)
+{
+	evaluator.step();
+
+	Value v = value->evaluate(evaluator);
+	const std::string& from = value->resolvedType;
+	const std::string& to = resolvedType;
+
+	if (isVector(from) || isVector(to)) {
+		evaluator.fail("vectors can't be evaluated at compile time");
+	}
+
+	Value result{ to };
+	if (isFloat(from) && isFloat(to)) {
+		result.floating = v.floating;
+	}
+	else if (isFloat(from)) {
+		// Out of range conversions are poison in the generated code, so they're an error here
+		double limit = std::ldexp(1.0, static_cast<int>(bitWidth(to)) - (isSignedInteger(to) ? 1 : 0));
+		double lower = isSignedInteger(to) ? -limit : 0.0;
+		if (std::isnan(v.floating) || v.floating >= limit || std::trunc(v.floating) < lower) {
+			evaluator.fail("can't convert " + std::to_string(v.floating) + " to " + to);
+		}
+
+		if (isSignedInteger(to)) {
+			result.integer = static_cast<int64_t>(v.floating);
+		}
+		else {
+			result.integer = static_cast<int64_t>(static_cast<u64>(v.floating));
+		}
+	}
+	else if (isFloat(to)) {
+		result.floating = isSignedInteger(from) ? static_cast<double>(v.integer) : static_cast<double>(static_cast<u64>(v.integer));
+	}
+	else {
+		result.integer = v.integer; // Already sign or zero extended to 64 bits, wrap() truncates
+	}
+
+	return wrap(result);
+}
+
+Value CallExprAST::evaluate(Evaluator& evaluator)
+{
+	evaluator.step();
+
+	if (comptimeValue) {
+		return comptimeValue->evaluate(evaluator);
+	}
+
+	if (isNumeric(callee)) {
+		return args->arguments[0]->evaluate(evaluator); // Conversion, the type checker made the argument a cast
+	}
+
+	if (isBuiltin || isVector(callee)) {
+		evaluator.fail(callee + " can't be evaluated at compile time");
+	}
+
+	auto function = evaluator.functions.find(callee);
+	if (function == evaluator.functions.end()) {
+		evaluator.fail("calls " + callee + " which has no body");
+	}
+
+	std::vector<Value> arguments;
+	for (auto* a : args->arguments) {
+		arguments.push_back(a->evaluate(evaluator));
+	}
+
+	return evaluator.call(function->second, arguments);
+}
+
+Value CodeBlockAST::evaluate(Evaluator& evaluator)
+{
+	evaluator.step();
+	evaluator.pushScope();
+
+	for (auto* n : body) {
+		if (n) {
+			n->evaluate(evaluator);
+		}
+
+		if (evaluator.flow != Flow::Normal) {
+			break;
+		}
+	}
+
+	if (returnValue && evaluator.flow == Flow::Normal) {
+		returnValue->evaluate(evaluator);
+	}
+
+	evaluator.popScope();
+	return Value{ "void" };
+}
+
+Value ReturnAST::evaluate(Evaluator& evaluator)
+{
+	evaluator.step();
+
+	evaluator.returnValue = value ? value->evaluate(evaluator) : Value{ "void" };
+
+	evaluator.flow = Flow::Return;
+	return evaluator.returnValue;
+}
+
+Value IfAST::evaluate(Evaluator& evaluator)
+{
+	evaluator.step();
+
+	for (auto& c : chain) {
+		if (c.condition->evaluate(evaluator).integer) {
+			return c.body->evaluate(evaluator);
+		}
+	}
+
+	if (elseBody) {
+		return elseBody->evaluate(evaluator);
+	}
+
+	return Value{ "void" };
+}
+
+Value SwitchAST::evaluate(Evaluator& evaluator)
+{
+	evaluator.step();
+
+	int64_t v = value->evaluate(evaluator).integer;
+	for (auto& c : cases) {
+		if (std::find(c.constants.begin(), c.constants.end(), v) != c.constants.end()) {
+			return c.body->evaluate(evaluator);
+		}
+	}
+
+	if (defaultBody) {
+		return defaultBody->evaluate(evaluator);
+	}
+
+	return Value{ "void" };
+}
+
+Value FieldExprAST::evaluate(Evaluator& evaluator)
+{
+	evaluator.step();
+
+	if (constantValue) {
+		return constantValue->evaluate(evaluator);
+	}
+
+	evaluator.fail("fields can't be evaluated at compile time");
+}
+
+Value LoopAST::evaluate(Evaluator& evaluator)
+{
+	evaluator.step();
+	evaluator.pushScope(); // For variables declared in init
+
+	if (init) {
+		init->evaluate(evaluator);
+	}
+
+	while (condition == nullptr || condition->evaluate(evaluator).integer) {
+		body->evaluate(evaluator);
+
+		if (evaluator.flow == Flow::Break) {
+			evaluator.flow = Flow::Normal;
+			break;
+		}
+		if (evaluator.flow == Flow::Return) {
+			break;
+		}
+		evaluator.flow = Flow::Normal; // continue
+
+		if (step) {
+			step->evaluate(evaluator);
+		}
+	}
+
+	evaluator.popScope();
+	return Value{ "void" };
+}
+
+Value LoopControlAST::evaluate(Evaluator& evaluator)
+{
+	evaluator.step();
+	evaluator.flow = isBreak() ? Flow::Break : Flow::Continue;
+	return Value{ "void" };
+}
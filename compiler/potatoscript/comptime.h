@@ -0,0 +1,77 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+namespace lang::parser {
+	class ExprAST;
+	class FunctionAST;
+}
+
+namespace lang::typechecker {
+	class TypeScope;
+}
+
+namespace lang::comptime {
+
+	// Scalar produced by the evaluator. Integers and bools live in integer, wrapped to the width of type.
+	struct Value {
+		std::string type;
+		int64_t integer = 0;
+		double floating = 0.0;
+	};
+
+	// Thrown when something can't be evaluated, e.g. a call to an extern fn or running out of steps.
+	struct EvaluationError {
+		std::string message;
+	};
+
+	// How control leaves the statement that was just evaluated.
+	enum class Flow {
+		Normal,
+		Break,
+		Continue,
+		Return,
+	};
+
+	class Evaluator {
+	public:
+		// Limits that keep a runaway comptime fn from hanging or exhausting the compiler
+		static constexpr u64 maxSteps = 10'000'000;
+		static constexpr size_t maxCallDepth = 512;
+		static constexpr size_t maxVariables = 1 << 20;
+
+		std::map<std::string, lang::parser::FunctionAST*> functions; // Every fn with a body
+		std::vector<std::vector<std::map<std::string, Value>>> frames; // One per call, innermost scope last
+
+		Flow flow = Flow::Normal;
+		Value returnValue;
+
+		u64 steps = 0;
+		size_t variableCount = 0;
+
+		// Counts one evaluation step, fails once maxSteps is exceeded.
+		void step();
+
+		[[noreturn]] void fail(const std::string& message);
+
+		void pushScope();
+		void popScope();
+		void declare(const std::string& name, const Value& value);
+		Value& lookup(const std::string& name);
+
+		Value call(lang::parser::FunctionAST* function, const std::vector<Value>& arguments);
+	};
+
+	// Truncates and sign or zero extends v.integer to v.type, rounds f32 values to float precision.
+	Value wrap(Value v);
+
+	// Literal node holding v, typed as v.type.
+	lang::parser::ExprAST* constantFromValue(const Value& v);
+
+	// Evaluates the comptime fn calls the type checker collected and stores their results as constants on the call.
+	void foldCalls(lang::typechecker::TypeScope& scope, const std::vector<lang::parser::ExprAST*>& nodes);
+}
@@ -0,0 +1,275 @@
+#define _SILENCE_CXX17_ITERATOR_BASE_CLASS_DEPRECATION_WARNING 1
+
+#include "driver.h"
+
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <limits>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/Module.h"
+#if LLVM_VERSION_MAJOR >= 14
+#include "llvm/MC/TargetRegistry.h"
+#else
+#include "llvm/Support/TargetRegistry.h"
+#endif
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+
+#include "types.h"
+#include "util.h"
+#include "source.h"
+#include "lexer.h"
+#include "parser.h"
+#include "backend.h"
+#include "linker.h"
+
+static bool startsWith(const std::string& s, const char* prefix) {
+	return s.rfind(prefix, 0) == 0;
+}
+
+static bool endsWith(const std::string& s, const char* suffix) {
+	size_t length = strlen(suffix);
+	return s.size() >= length && s.compare(s.size() - length, length, suffix) == 0;
+}
+
+// Writes the optimized module in the form the output path asks for. Executables are emitted as an object
+// in a temporary file first and linked in-process, with the profile runtime when they're instrumented.
+static int writeOutput(const std::string& path, bool instrumented)
+{
+	llvm::Module& module = *lang::parser::currentModule();
+	llvm::TargetMachine* targetMachine = lang::driver::initializeTarget();
+
+	if (endsWith(path, ".ll") || endsWith(path, ".bc")) {
+		lang::backend::writeModule(module, path);
+		return 0;
+	}
+
+	if (endsWith(path, ".o") || endsWith(path, ".obj")) {
+		return lang::backend::emitObject(module, targetMachine, path) ? 0 : 1;
+	}
+
+	llvm::SmallString<128> objectPath;
+	if (llvm::sys::fs::createTemporaryFile("potato", "o", objectPath)) {
+		std::cerr << "couldn't create a temporary object file\n";
+		return 1;
+	}
+
+	std::string error;
+	bool linked = lang::backend::emitObject(module, targetMachine, objectPath.str().str()) && lang::linker::linkExecutable(objectPath.str().str(), path, instrumented, &error);
+	llvm::sys::fs::remove(objectPath);
+
+	if (linked == false) {
+		std::cerr << error;
+		return 1;
+	}
+
+	return 0;
+}
+
+bool lang::driver::parseArguments(const std::vector<std::string>& args, Options* outOptions, std::string* outError)
+{
+	bool isLinking = false;
+	for (size_t i = 0; i < args.size(); i++) {
+		const std::string& a = args[i];
+
+		if (a == "-o") {
+			if (i + 1 >= args.size()) {
+				*outError = "-o expects an output path";
+				return false;
+			}
+
+			outOptions->outputPath = args[++i];
+		}
+		else if (startsWith(a, "-o=")) {
+			outOptions->outputPath = a.substr(3);
+		}
+		else if (a == "--quiet") {
+			outOptions->verbose = false;
+		}
+		else if (a == "--no-bounds-checks") {
+			outOptions->boundsChecks = false;
+		}
+		else if (a == "--thin-lto") {
+			outOptions->prepareForLTO = true;
+		}
+		else if (a == "--link") {
+			isLinking = true;
+		}
+		else if (a == "--profile-generate") {
+			outOptions->profileGenerate = "default.profraw";
+		}
+		else if (startsWith(a, "--profile-generate=")) {
+			outOptions->profileGenerate = a.substr(19);
+		}
+		else if (startsWith(a, "--profile-use=")) {
+			outOptions->profileUse = a.substr(14);
+		}
+		else if (a == "-g") {
+			outOptions->debugInfo = lang::source::DebugInfo::Full;
+		}
+		else if (a == "-gline-tables-only") {
+			outOptions->debugInfo = lang::source::DebugInfo::LineTablesOnly;
+		}
+		else if (a.size() == 3 && startsWith(a, "-O") && a[2] >= '0' && a[2] <= '3') {
+			outOptions->optimizationLevel = static_cast<u32>(a[2] - '0');
+		}
+		else if (startsWith(a, "-")) {
+			*outError = "unknown flag: " + a;
+			return false;
+		}
+		else if (isLinking) {
+			outOptions->linkInputs.push_back(a);
+		}
+		else {
+			outOptions->inputPath = a;
+		}
+	}
+
+	bool hasProfile = outOptions->profileGenerate.empty() == false || outOptions->profileUse.empty() == false;
+	if (hasProfile && outOptions->optimizationLevel == 0) {
+		*outError = "--profile-generate and --profile-use need -O1 or above";
+		return false;
+	}
+
+	if (outOptions->profileUse.empty() == false && std::ifstream(outOptions->profileUse).good() == false) {
+		*outError = "can't open profile " + outOptions->profileUse;
+		return false;
+	}
+
+	if (isLinking) {
+		if (outOptions->linkInputs.empty()) {
+			*outError = "--link expects the bitcode modules to link";
+			return false;
+		}
+		return true;
+	}
+
+	if (outOptions->inputPath.empty()) {
+		*outError = "you have to pass in an entry point for compilation";
+		return false;
+	}
+
+	return true;
+}
+
+llvm::TargetMachine* lang::driver::initializeTarget()
+{
+	static llvm::TargetMachine* targetMachine = nullptr;
+	static bool initialized = false;
+
+	if (initialized) {
+		return targetMachine;
+	}
+
+	initialized = true;
+
+	llvm::InitializeNativeTarget();
+	llvm::InitializeNativeTargetAsmPrinter();
+
+	std::string triple = llvm::sys::getDefaultTargetTriple();
+	std::string error;
+	const llvm::Target* target = llvm::TargetRegistry::lookupTarget(triple, error);
+	if (target == nullptr) {
+		std::cerr << "couldn't find target " << triple << ": " << error << "\n";
+		return nullptr;
+	}
+
+	llvm::TargetOptions options;
+	targetMachine = target->createTargetMachine(triple, llvm::sys::getHostCPUName(), "", options, llvm::Reloc::PIC_);
+	return targetMachine;
+}
+
+// Links the modules given to --link and optimizes them as one, so calls between modules can be inlined.
+static int linkModules(const lang::driver::Options& options)
+{
+	llvm::TargetMachine* targetMachine = lang::driver::initializeTarget();
+	lang::parser::setTargetMachine(targetMachine);
+	std::unique_ptr<llvm::Module> linked = lang::backend::linkModules(lang::parser::currentContext(), targetMachine, options.linkInputs);
+	if (linked == nullptr) {
+		return 1;
+	}
+
+	lang::parser::setModule(std::move(linked));
+	lang::backend::optimizeModule(*lang::parser::currentModule(), targetMachine, options.optimizationLevel, { options.profileGenerate, options.profileUse });
+	return writeOutput(options.outputPath, options.profileGenerate.empty() == false);
+}
+
+int lang::driver::compile(const Options& options)
+{
+	if (options.linkInputs.empty() == false) {
+		return linkModules(options);
+	}
+
+	using hc = std::chrono::high_resolution_clock;
+	hc::time_point startTime = hc::now();
+
+	if (options.verbose) {
+		std::cout << "Starting compilation of " << options.inputPath << "\n";
+	}
+
+	std::string text;
+	if (lang::fsutil::tryReadTextFile(options.inputPath, &text) == false) {
+		std::cerr << "couldn't read " << options.inputPath << "\n";
+		return 1;
+	}
+
+	lang::source::File file(options.inputPath, std::move(text));
+	if (file.text.size() > std::numeric_limits<lang::source::Offset>::max()) {
+		std::cerr << options.inputPath << " is larger than 4 GiB\n";
+		return 1;
+	}
+
+	std::vector<lang::lexer::Token> tokens = lang::lexer::parse(file.text);
+
+	hc::time_point endLexingTime = hc::now();
+
+	if (options.verbose) {
+		std::cout << "----------------- LEXER ----------------- " << "\n";
+		for (lang::lexer::Token& t : tokens) {
+			std::cout << "\"" << t.span.string << "\":" << lang::lexer::TokenType::toString(t.type) << " " << t.span.offset << ":" << t.span.end() << "\n";
+		}
+
+		std::cout << "----------------- PARSER ----------------- " << "\n";
+	}
+
+	llvm::TargetMachine* targetMachine = initializeTarget();
+	lang::parser::setTargetMachine(targetMachine);
+	lang::parser::setBoundsChecks(options.boundsChecks);
+	lang::parser::setSourceFile(&file);
+	lang::parser::setDebugInfo(options.debugInfo);
+	auto nodes = lang::parser::parse(tokens);
+	lang::parser::setSourceFile(nullptr);
+
+	if (options.verbose) {
+		for (auto* node : nodes) {
+			if (node == nullptr) { continue; }
+
+			lang::parser::AstPrinter printer{};
+			node->print(printer);
+			std::cout << printer.buffer << "\n";
+		}
+	}
+
+	if (lang::parser::hadErrors()) {
+		return 1;
+	}
+
+	lang::backend::optimizeModule(*lang::parser::currentModule(), targetMachine, options.optimizationLevel, { options.profileGenerate, options.profileUse }, options.prepareForLTO);
+	if (int result = writeOutput(options.outputPath, options.profileGenerate.empty() == false); result != 0) {
+		return result;
+	}
+
+	if (options.verbose) {
+		f64 microSeconds = (f64)std::chrono::duration_cast<std::chrono::microseconds>((endLexingTime - startTime)).count();
+		std::cout << "Compile time:: " << (microSeconds * 1000) << "ms\n";
+	}
+
+	return 0;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "types.h"
+#include "source.h"
+
+namespace llvm {
+	class TargetMachine;
+}
+
+namespace lang::driver {
+
+	struct Options {
+		std::string inputPath;
+		// What gets written follows the extension: .ll IR, .bc bitcode, .o an object, anything else an executable.
+		std::string outputPath = "../ir_output.ll";
+
+		// Dumps tokens and AST to stdout, the server turns this off.
+		bool verbose = true;
+
+		// -O0 to -O3, 0 only inlines inline fns.
+		u32 optimizationLevel = 0;
+
+		// Array and slice indexes are checked against the length unless the compiler proves them in range.
+		bool boundsChecks = true;
+
+		// --thin-lto optimizes each module only as far as it can on its own and leaves inlining across modules
+		// to the link step. Pair it with a .bc output path.
+		bool prepareForLTO = false;
+
+		// --link a.bc b.bc links the bitcode of several modules into one and optimizes it as a whole
+		// instead of compiling a source file.
+		std::vector<std::string> linkInputs;
+
+		// --profile-generate[=<file>] instruments the program to write a raw profile on exit, default.profraw by default.
+		// --profile-use=<file> optimizes with the .profdata llvm-profdata merged from those runs. Both need -O1 or above.
+		std::string profileGenerate;
+		std::string profileUse;
+
+		// -g emits full debug info, -gline-tables-only just fns and lines, which is enough for perf and stack traces.
+		lang::source::DebugInfo debugInfo = lang::source::DebugInfo::None;
+	};
+
+	// Parses compiler flags, argument 0 is expected to be the first flag (not the executable name).
+	bool parseArguments(const std::vector<std::string>& args, Options* outOptions, std::string* outError);
+
+	// Initializes the native target once per process and returns the cached target machine.
+	llvm::TargetMachine* initializeTarget();
+
+	// Compiles a single file, or links the modules in linkInputs, returns 0 on success.
+	int compile(const Options& options);
+}
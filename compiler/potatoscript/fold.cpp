@@ -0,0 +1,312 @@
+#include "fold.h"
+
+#include <algorithm>
+
+#include "parser.h"
+#include "comptime.h"
+#include "typechecker.h"
+
+using namespace lang::parser;
+
+bool lang::fold::isConstant(ExprAST* e)
+{
+	auto* variable = dynamic_cast<VariableExprAST*>(e);
+	return dynamic_cast<NumberExprAST*>(e) != nullptr || (variable && variable->isConstant);
+}
+
+// Value of a constant bool condition
+static bool isTrue(ExprAST* e) {
+	return static_cast<VariableExprAST*>(e)->name == "1";
+}
+
+// Evaluates e, which only has constant operands, with the comptime evaluator so folding follows the same
+// wrapping rules as the generated code. Anything that would fail at runtime, e.g. division by zero, is kept.
+static ExprAST* evaluateConstant(ExprAST* e) {
+	if (lang::typechecker::isVector(e->resolvedType)) {
+		return e;
+	}
+
+	lang::comptime::Evaluator evaluator;
+	evaluator.frames.emplace_back();
+	evaluator.pushScope();
+
+	try {
+		return lang::comptime::constantFromValue(e->evaluate(evaluator));
+	}
+	catch (const lang::comptime::EvaluationError&) {
+		return e;
+	}
+}
+
+// Control never reaches the statement after n.
+static bool terminates(ExprAST* n) {
+	if (n->type == "Return" || n->type == "Break" || n->type == "Continue") {
+		return true;
+	}
+
+	auto* block = dynamic_cast<CodeBlockAST*>(n);
+	return block && (block->returnValue || (block->body.empty() == false && terminates(block->body.back())));
+}
+
+void lang::fold::foldConstants(std::vector<ExprAST*>& nodes)
+{
+	for (auto*& n : nodes) {
+		if (n) {
+			n = n->fold();
+		}
+	}
+}
+
+ExprAST* ReturnAST::fold()
+{
+	if (value) {
+		value = value->fold();
+	}
+
+	return this;
+}
+
+ExprAST* TupleExprAST::fold()
+{
+	for (auto*& e : elements) {
+		e = e->fold();
+	}
+
+	return this;
+}
+
+ExprAST* ArrayExprAST::fold()
+{
+	for (auto*& e : elements) {
+		e = e->fold();
+	}
+
+	return this;
+}
+
+ExprAST* IndexExprAST::fold()
+{
+	index = index->fold();
+	if (end) {
+		end = end->fold();
+	}
+	if (assignment) {
+		assignment = assignment->fold();
+	}
+
+	return this;
+}
+
+ExprAST* DestructureAST::fold()
+{
+	value = value->fold();
+	return this;
+}
+
+ExprAST* DeferAST::fold()
+{
+	statement = statement->fold();
+	return statement ? this : nullptr;
+}
+
+ExprAST* VariableExprAST::fold()
+{
+	if (assignment) {
+		assignment = assignment->fold();
+	}
+
+	return this;
+}
+
+ExprAST* FieldExprAST::fold()
+{
+	if (constantValue) {
+		return constantValue;
+	}
+
+	if (assignment) {
+		assignment = assignment->fold();
+	}
+
+	return this;
+}
+
+ExprAST* BinaryExprAST::fold()
+{
+	left = left->fold();
+	right = right->fold();
+
+	if (lang::fold::isConstant(left) && lang::fold::isConstant(right)) {
+		return evaluateConstant(this);
+	}
+
+	return this;
+}
+
+ExprAST* CastExprAST::fold()
+{
+	value = value->fold();
+
+	if (lang::fold::isConstant(value)) {
+		return evaluateConstant(this);
+	}
+
+	return this;
+}
+
+ExprAST* CallExprAST::fold()
+{
+	if (comptimeValue) {
+		return comptimeValue;
+	}
+
+	for (auto*& a : args->arguments) {
+		a = a->fold();
+	}
+
+	return this;
+}
+
+ExprAST* CodeBlockAST::fold()
+{
+	std::vector<ExprAST*> folded;
+	bool isTerminated = false;
+
+	for (auto* n : body) {
+		ExprAST* f = n ? n->fold() : nullptr;
+		if (f == nullptr) {
+			continue; // Dead statement, e.g. if false { }
+		}
+
+		// A return in the middle of a block ends it, everything after is unreachable
+		if (f->type == "Return") {
+			returnValue = f;
+			isTerminated = true;
+			break;
+		}
+
+		folded.push_back(f);
+		if (terminates(f)) {
+			returnValue = nullptr;
+			isTerminated = true;
+			break;
+		}
+	}
+
+	body = std::move(folded);
+
+	if (returnValue && isTerminated == false) {
+		returnValue = returnValue->fold();
+	}
+
+	return this;
+}
+
+ExprAST* FunctionAST::fold()
+{
+	if (body && isGeneric() == false) {
+		body->fold();
+	}
+
+	return this;
+}
+
+ExprAST* ImplAST::fold()
+{
+	for (auto* m : methods) {
+		m->fold();
+	}
+
+	return this;
+}
+
+ExprAST* IfAST::fold()
+{
+	std::vector<ConditionAndBody> arms;
+	bool hasTrueArm = false;
+
+	for (auto& c : chain) {
+		c.condition = c.condition->fold();
+		c.body->fold();
+
+		if (lang::fold::isConstant(c.condition)) {
+			if (isTrue(c.condition) == false) {
+				continue; // Never taken
+			}
+
+			// Always taken, later arms and the else are dead
+			hasTrueArm = true;
+			if (arms.empty()) {
+				return c.body;
+			}
+
+			elseBody = c.body;
+			hasElseAtEnd = true;
+			break;
+		}
+
+		arms.push_back(c);
+	}
+
+	if (hasTrueArm == false && elseBody) {
+		elseBody->fold();
+	}
+
+	chain = std::move(arms);
+	if (chain.empty()) {
+		return hasElseAtEnd ? elseBody : nullptr;
+	}
+
+	return this;
+}
+
+ExprAST* SwitchAST::fold()
+{
+	value = value->fold();
+	for (auto& c : cases) {
+		c.body->fold();
+	}
+	if (defaultBody) {
+		defaultBody->fold();
+	}
+
+	// Switching on a constant leaves only the block it selects
+	auto* number = dynamic_cast<NumberExprAST*>(value);
+	if (number && number->isInteger()) {
+		int64_t selected = lang::comptime::wrap(lang::comptime::Value{ number->resolvedType, number->integerValue() }).integer;
+		for (auto& c : cases) {
+			if (std::find(c.constants.begin(), c.constants.end(), selected) != c.constants.end()) {
+				return c.body;
+			}
+		}
+
+		return defaultBody;
+	}
+
+	return this;
+}
+
+ExprAST* LoopAST::fold()
+{
+	if (init) {
+		init = init->fold();
+	}
+	if (condition) {
+		condition = condition->fold();
+	}
+	if (step) {
+		step = step->fold();
+	}
+	body->fold();
+
+	if (condition && lang::fold::isConstant(condition)) {
+		if (isTrue(condition)) {
+			condition = nullptr; // Runs until break, no need to test anything
+		}
+		else if (init == nullptr) {
+			return nullptr; // Never runs
+		}
+	}
+
+	return this;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <vector>
+
+namespace lang::parser {
+	class ExprAST;
+}
+
+namespace lang::fold {
+
+	// Literal number or bool, the only nodes folding produces and looks through.
+	bool isConstant(lang::parser::ExprAST* e);
+
+	// Folds constant expressions and drops statically dead branches and unreachable statements. Runs after type checking.
+	void foldConstants(std::vector<lang::parser::ExprAST*>& nodes);
+}
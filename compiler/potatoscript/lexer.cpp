@@ -1,6 +1,14 @@
 #include "lexer.h"
 
 #include <iostream>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <mutex>
+#include <set>
+#include <string_view>
 
 using namespace lang::lexer;
 
@@ -25,27 +33,18 @@ static bool isLetter(int c) {
 
 static bool isDigit(int c, int baseCount = 10) {
 
-    if (baseCount != 10) {
-        std::cerr << "only base 10 is allowed atm";
+    if (baseCount == 2) {
+        return c >= '0' && c <= '1';
     }
 
-    //if (baseCount == 2) {
-    //    return c >= '0' && c <= '1';
-    //}
-
-    //if (baseCount == 16) {
-    //    int l = toLower(c);
-    //    if (l >= 'a' && l <= 'f') return true;
-    //}
+    if (baseCount == 16) {
+        int l = toLower(c);
+        if (l >= 'a' && l <= 'f') return true;
+    }
 
     return c >= '0' && c <= '9';
 }
 
-static bool continuesDigit(char c, int baseCount = 10) {
-
-    return isDigit(c, baseCount) || c == '.' || c == 'f' || c == 'u' || c == 'i';
-}
-
 static bool startsIdentifier(char c) {
     return c == '_' || isLetter(c);
 }
@@ -97,16 +96,13 @@ static bool isKeyword(const std::string& s, size_t index, const std::string& con
     return true;
 }
 
-static Token createSingleToken(TokenType::Type t, const std::string& s, size_t lineNumber, size_t index, size_t length) {
+static Token createSingleToken(TokenType::Type t, const std::string& s, size_t index, size_t length) {
     Token res{
         .type = t,
         .span = TextSpan {
-            .string = s.substr(index, length),
-            .line = lineNumber,
-            .from = index,
-            .to = index + length,
+            .string = std::string_view(s).substr(index, length),
+            .offset = static_cast<lang::source::Offset>(index),
         },
-        .fileName = "undefined", // TODO: Assign...
     };
 
     return res;
@@ -127,7 +123,7 @@ static size_t minButNot0(size_t a, size_t b) {
     return b;
 }
 
-static bool tryGetReservedBasicType(const std::string& s, TokenType::Type* outResult) {
+static bool tryGetReservedBasicType(std::string_view s, TokenType::Type* outResult) {
    
     if (s == "u8") { *outResult = TokenType::KEYWORD_UINT8; return true; }
     if (s == "u16") { *outResult = TokenType::KEYWORD_UINT16; return true; }
@@ -146,25 +142,294 @@ static bool tryGetReservedBasicType(const std::string& s, TokenType::Type* outRe
     if (s == "string") { *outResult = TokenType::KEYWORD_STRING; return true; }
     if (s == "void") { *outResult = TokenType::KEYWORD_VOID; return true; }
 
+    // SIMD vectors are <numeric type>x<lanes>, e.g. f32x4 or u8x16
+    size_t x = s.rfind('x');
+    if (x != std::string_view::npos && x > 0) {
+        TokenType::Type element;
+        std::string_view lanes = s.substr(x + 1);
+        bool isNumericElement = tryGetReservedBasicType(s.substr(0, x), &element)
+            && element >= TokenType::KEYWORD_UINT8 && element <= TokenType::KEYWORD_FLOAT64;
+        bool isValidLanes = lanes == "2" || lanes == "4" || lanes == "8" || lanes == "16" || lanes == "32" || lanes == "64";
+
+        if (isNumericElement && isValidLanes) {
+            *outResult = TokenType::KEYWORD_VECTOR;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Keywords that are matched as whole identifiers
+static bool tryGetReservedKeyword(std::string_view s, TokenType::Type* outResult) {
+
+    if (s == "sizeof") { *outResult = TokenType::KEYWORD_SIZEOF; return true; }
+    if (s == "var") { *outResult = TokenType::KEYWORD_VAR; return true; }
+    if (s == "comptime") { *outResult = TokenType::KEYWORD_COMPTIME; return true; }
+    if (s == "trait") { *outResult = TokenType::KEYWORD_TRAIT; return true; }
+    if (s == "impl") { *outResult = TokenType::KEYWORD_IMPL; return true; }
+    if (s == "defer") { *outResult = TokenType::KEYWORD_DEFER; return true; }
+    if (s == "export") { *outResult = TokenType::KEYWORD_EXPORT; return true; }
+    if (s == "inline") { *outResult = TokenType::KEYWORD_INLINE; return true; }
+    if (s == "noinline") { *outResult = TokenType::KEYWORD_NOINLINE; return true; }
+    if (s == "else") { *outResult = TokenType::KEYWORD_ELSE; return true; }
+    if (s == "enum") { *outResult = TokenType::KEYWORD_ENUM; return true; }
+    if (s == "switch") { *outResult = TokenType::KEYWORD_SWITCH; return true; }
+    if (s == "case") { *outResult = TokenType::KEYWORD_CASE; return true; }
+    if (s == "default") { *outResult = TokenType::KEYWORD_DEFAULT; return true; }
+    if (s == "while") { *outResult = TokenType::KEYWORD_WHILE; return true; }
+    if (s == "for") { *outResult = TokenType::KEYWORD_FOR; return true; }
+    if (s == "break") { *outResult = TokenType::KEYWORD_BREAK; return true; }
+    if (s == "continue") { *outResult = TokenType::KEYWORD_CONTINUE; return true; }
+
+    return false;
+}
+
+static bool tryGetTwoCharacterOperator(const std::string& s, size_t index, TokenType::Type* outResult) {
+
+    if (isKeyword(s, index, "==")) { *outResult = TokenType::EQ_OP; return true; }
+    if (isKeyword(s, index, "!=")) { *outResult = TokenType::NE_OP; return true; }
+    if (isKeyword(s, index, ">=")) { *outResult = TokenType::GE_OP; return true; }
+    if (isKeyword(s, index, "<=")) { *outResult = TokenType::LE_OP; return true; }
+    if (isKeyword(s, index, "&&")) { *outResult = TokenType::AND_OP; return true; }
+    if (isKeyword(s, index, "||")) { *outResult = TokenType::OR_OP; return true; }
+    if (isKeyword(s, index, "^^")) { *outResult = TokenType::XOR_OP; return true; }
+    if (isKeyword(s, index, "<<")) { *outResult = TokenType::DEREFERENCE_OR_SHIFT; return true; }
+    if (isKeyword(s, index, ">>")) { *outResult = TokenType::RIGHT_SHIFT; return true; }
+    if (isKeyword(s, index, "+=")) { *outResult = TokenType::PLUS_EQ; return true; }
+    if (isKeyword(s, index, "-=")) { *outResult = TokenType::MINUS_EQ; return true; }
+    if (isKeyword(s, index, "*=")) { *outResult = TokenType::STAR_EQ; return true; }
+    if (isKeyword(s, index, "/=")) { *outResult = TokenType::SLASH_EQ; return true; }
+    if (isKeyword(s, index, "%=")) { *outResult = TokenType::PERCENT_EQ; return true; }
+    if (isKeyword(s, index, "&=")) { *outResult = TokenType::AMPERSAND_EQ; return true; }
+    if (isKeyword(s, index, "|=")) { *outResult = TokenType::VERTICAL_BAR_EQ; return true; }
+    if (isKeyword(s, index, "^=")) { *outResult = TokenType::CARET_EQ; return true; }
+    if (isKeyword(s, index, "++")) { *outResult = TokenType::INCREMENT; return true; }
+    if (isKeyword(s, index, "--")) { *outResult = TokenType::DECREMENT; return true; }
+
+    return false;
+}
+
+static const char* suffixNames[] = { "", "u8", "u16", "u32", "u64", "i8", "i16", "i32", "i64", "f32", "f64" };
+
+const char* lang::lexer::suffixName(NumberSuffix suffix)
+{
+    return suffixNames[static_cast<size_t>(suffix)];
+}
+
+// False if text isn't empty and not one of the suffixes.
+static bool parseSuffix(std::string_view text, NumberSuffix* outSuffix) {
+    for (size_t i = 0; i < std::size(suffixNames); i++) {
+        if (text == suffixNames[i]) {
+            *outSuffix = static_cast<NumberSuffix>(i);
+            return true;
+        }
+    }
+
     return false;
 }
 
+// Lexes the number literal starting at s[index] in one pass: 123, 1_000_000, 0xFF, 0b1010, 1.5, 2.5e-3,
+// each with an optional type suffix (255u8, 1f32, 0xFFu64). Returns the literal's length.
+static size_t lexNumber(const std::string& s, size_t index, size_t end, TokenType::Type* outType, NumberLiteral* outNumber, const char** outError) {
+    size_t i = index;
+    int base = 10;
+    if (s[i] == '0' && i + 2 < end && (toLower(s[i + 1]) == 'x' || toLower(s[i + 1]) == 'b') && isDigit(s[i + 2], toLower(s[i + 1]) == 'x' ? 16 : 2)) {
+        base = toLower(s[i + 1]) == 'x' ? 16 : 2;
+        i += 2;
+    }
+
+    // Digits with separators stripped, from_chars needs them contiguous
+    char digits[128];
+    size_t digitCount = 0;
+    bool isFloat = false;
+    bool tooLong = false;
+    bool misplacedSeparator = false;
+
+    auto append = [&](char c) {
+        if (digitCount < sizeof(digits)) {
+            digits[digitCount++] = c;
+        }
+        else {
+            tooLong = true;
+        }
+    };
+
+    while (i < end) {
+        char c = s[i];
+        if (isDigit(c, base)) {
+            append(c);
+        }
+        else if (c == '_' && digitCount > 0) {
+            // Separator, ignored. Only allowed between two digits, so 1_ and 1__0 are errors
+            misplacedSeparator |= isDigit(s[i - 1], base) == false || i + 1 >= end || isDigit(s[i + 1], base) == false;
+        }
+        else if (base == 10 && c == '.' && isFloat == false && i + 1 < end && isDigit(s[i + 1])) {
+            append(c);
+            isFloat = true;
+        }
+        else if (base == 10 && toLower(c) == 'e' && i + 1 < end && (isDigit(s[i + 1]) || ((s[i + 1] == '-' || s[i + 1] == '+') && i + 2 < end && isDigit(s[i + 2])))) {
+            append(c);
+            append(s[++i]); // Sign or first exponent digit
+            isFloat = true;
+        }
+        else {
+            break;
+        }
+
+        i++;
+    }
+
+    // Type suffix, hex digits already took a-f so f32/f64 can't follow a hex literal
+    size_t suffixStart = i;
+    while (i < end && (isLetter(s[i]) || isDigit(s[i]))) {
+        i++;
+    }
+    bool isKnownSuffix = parseSuffix(std::string_view(s).substr(suffixStart, i - suffixStart), &outNumber->suffix);
+
+    NumberSuffix suffix = outNumber->suffix;
+    bool isFloatSuffix = suffix == NumberSuffix::F32 || suffix == NumberSuffix::F64;
+    bool isIntegerSuffix = suffix != NumberSuffix::None && isFloatSuffix == false;
+
+    const char*& error = *outError;
+    if (isKnownSuffix == false) {
+        error = "Unknown number literal suffix";
+    }
+    else if (isFloat && isIntegerSuffix) {
+        error = "Float literal can't have an integer suffix";
+    }
+    else if (tooLong) {
+        error = "Number literal is too long";
+    }
+    else if (misplacedSeparator) {
+        error = "Digit separators have to be between two digits";
+    }
+
+    const char* first = digits;
+    const char* last = digits + digitCount;
+
+    if (isFloat || isFloatSuffix) {
+        if (base != 10) {
+            error = "Float literals have to be decimal";
+        }
+
+        // f32 literals are rounded straight to float, not via double. Unsuffixed ones are f64 unless they're used
+        // as f32, the type checker rounds them then and reports the ones that overflow.
+        std::from_chars_result result;
+        if (suffix == NumberSuffix::F32) {
+            float f = 0.0f;
+            result = std::from_chars(first, last, f);
+            outNumber->floating = f;
+        }
+        else {
+            result = std::from_chars(first, last, outNumber->floating);
+        }
+
+        // from_chars reports underflow as out of range as well. Magnitudes too small for the type round to a
+        // subnormal or 0 like in C, only literals that would become infinity are errors.
+        if (result.ec == std::errc::result_out_of_range) {
+            std::string text(first, last);
+            outNumber->floating = suffix == NumberSuffix::F32 ? std::strtof(text.c_str(), nullptr) : std::strtod(text.c_str(), nullptr);
+            if (std::isinf(outNumber->floating) && error == nullptr) {
+                error = "Float literal is out of range";
+            }
+        }
+
+        *outType = suffix == NumberSuffix::F32 ? TokenType::FLOAT32 : TokenType::FLOAT64;
+    }
+    else {
+        auto result = std::from_chars(first, last, outNumber->integer, base);
+        if (result.ec == std::errc::result_out_of_range && error == nullptr) {
+            error = "Integer literal doesn't fit in 64 bits";
+        }
+
+        bool is64 = suffix == NumberSuffix::I64 || suffix == NumberSuffix::U64 || outNumber->integer > 0x7FFFFFFF;
+        *outType = is64 ? TokenType::INTEGER64 : TokenType::INTEGER32;
+    }
+
+    return i - index;
+}
+
+static int hexValue(char c) {
+    int l = toLower(c);
+    return l >= 'a' ? l - 'a' + 10 : l - '0';
+}
+
+// Scans the string literal whose contents start at s[index], just after the opening quote, decoding
+// \n \t \r \0 \\ \" \' and \xNN into outText unless it's nullptr. Returns the length of the contents,
+// excluding the closing quote.
+static size_t lexString(const std::string_view s, size_t index, size_t end, std::string* outText, const char** outError) {
+    auto append = [&](char c) {
+        if (outText) {
+            *outText += c;
+        }
+    };
+
+    size_t i = index;
+    while (i < end && s[i] != '"') {
+        char c = s[i++];
+        if (c != '\\') {
+            append(c);
+            continue;
+        }
+
+        char escaped = i < end ? s[i++] : '\0';
+        switch (escaped) {
+        case 'n': append('\n'); break;
+        case 't': append('\t'); break;
+        case 'r': append('\r'); break;
+        case '0': append('\0'); break;
+        case '\\': append('\\'); break;
+        case '"': append('"'); break;
+        case '\'': append('\''); break;
+        case 'x':
+            if (i + 1 < end && isDigit(s[i], 16) && isDigit(s[i + 1], 16)) {
+                append(static_cast<char>(hexValue(s[i]) * 16 + hexValue(s[i + 1])));
+                i += 2;
+                break;
+            }
+            *outError = "\\x expects two hex digits";
+            break;
+        default:
+            *outError = "Unknown escape sequence";
+            break;
+        }
+    }
+
+    if (i >= end) {
+        *outError = "Unterminated string literal";
+    }
+
+    return i - index;
+}
+
+std::string lang::lexer::stringValue(const Token& token)
+{
+    // The span holds the contents without quotes, the lexer already reported anything malformed
+    std::string text;
+    const char* error = nullptr;
+    lexString(token.span.string, 0, token.span.string.size(), &text, &error);
+    return text;
+}
+
 const char eol = '\n';
 using namespace lang::lexer;
 
 std::vector<Token> lang::lexer::parse(const std::string& s) noexcept
 {
-    size_t lineNumber = 0;
+    return parse(s, 0, s.size());
+}
 
+std::vector<Token> lang::lexer::parse(const std::string& s, size_t from, size_t to) noexcept
+{
     std::vector<Token> token;
-    size_t i = 0;
+    size_t i = from;
 
-    while(i < s.size()) {
+    while(i < to) {
     //for (size_t i = 0; i < s.size(); i++) {
         char c = s[i];
 
         if (isLineBreak(c)) {
-            lineNumber++;
             i++;
             continue;
         }
@@ -181,29 +446,27 @@ std::vector<Token> lang::lexer::parse(const std::string& s) noexcept
                 commentLength = s.size() - i; // Go to end of the file
             }
 
-            std::string s2 = s.substr(i, commentLength);
             Token t{
                 .type = TokenType::COMMENT,
                 .span = TextSpan {
-                    .string = s2,
-                    .line = lineNumber,
-                    .from = i,
-                    .to = i + commentLength,
+                    .string = std::string_view(s).substr(i, commentLength),
+                    .offset = static_cast<lang::source::Offset>(i),
                 },
-                .fileName = "undefined", // TODO: Assign...
             };
 
             token.push_back(t);
 
             i += commentLength;
-            lineNumber++;
             continue;
         }
 
         if (c == '"') {
-            size_t stringLength = countUntilCharacter(s, i + 1, '"');
+            const char* error = nullptr;
+            size_t stringLength = lexString(s, i + 1, to, nullptr, &error);
             i += 1; // + 1 for "
-            token.push_back(createSingleToken(TokenType::STRING, s, lineNumber, i, stringLength));
+            Token t = createSingleToken(TokenType::STRING, s, i, stringLength);
+            t.error = error;
+            token.push_back(t);
             i += 1; // + 1 for "
             i += stringLength;
             continue;
@@ -211,49 +474,49 @@ std::vector<Token> lang::lexer::parse(const std::string& s) noexcept
 
         if (isKeyword(s, i, "fn")) {
             size_t identifierLength = 2;
-            token.push_back(createSingleToken(TokenType::KEYWORD_FUNC, s, lineNumber, i, identifierLength));
+            token.push_back(createSingleToken(TokenType::KEYWORD_FUNC, s, i, identifierLength));
             i += identifierLength;
             continue;
         }
 
         if (isKeyword(s, i, "return")) {
             size_t identifierLength = 6;
-            token.push_back(createSingleToken(TokenType::KEYWORD_RETURN, s, lineNumber, i, identifierLength));
+            token.push_back(createSingleToken(TokenType::KEYWORD_RETURN, s, i, identifierLength));
             i += identifierLength;
             continue;
         }
 
         if (isKeyword(s, i, "if")) {
             size_t identifierLength = 2;
-            token.push_back(createSingleToken(TokenType::KEYWORD_IF, s, lineNumber, i, identifierLength));
+            token.push_back(createSingleToken(TokenType::KEYWORD_IF, s, i, identifierLength));
             i += identifierLength;
             continue;
         }
 
         if (isKeyword(s, i, "extern")) {
             size_t identifierLength = 6;
-            token.push_back(createSingleToken(TokenType::KEYWORD_EXTERN, s, lineNumber, i, identifierLength));
+            token.push_back(createSingleToken(TokenType::KEYWORD_EXTERN, s, i, identifierLength));
             i += identifierLength;
             continue;
         }
 
         if (isKeyword(s, i, "struct")) {
             size_t identifierLength = 6;
-            token.push_back(createSingleToken(TokenType::KEYWORD_STRUCT, s, lineNumber, i, identifierLength));
+            token.push_back(createSingleToken(TokenType::KEYWORD_STRUCT, s, i, identifierLength));
             i += identifierLength;
             continue;
         }
 
         if (isKeyword(s, i, "true")) {
             size_t identifierLength = 4;
-            token.push_back(createSingleToken(TokenType::KEYWORD_TRUE, s, lineNumber, i, identifierLength));
+            token.push_back(createSingleToken(TokenType::KEYWORD_TRUE, s, i, identifierLength));
             i += identifierLength;
             continue;
         }
 
         if (isKeyword(s, i, "false")) {
             size_t identifierLength = 5;
-            token.push_back(createSingleToken(TokenType::KEYWORD_FALSE, s, lineNumber, i, identifierLength));
+            token.push_back(createSingleToken(TokenType::KEYWORD_FALSE, s, i, identifierLength));
             i += identifierLength;
             continue;
         }
@@ -272,18 +535,15 @@ std::vector<Token> lang::lexer::parse(const std::string& s) noexcept
                 length++;
             }
 
-            std::string str = s.substr(i, length);
+            std::string_view str = std::string_view(s).substr(i, length);
             TokenType::Type type;
-            if (tryGetReservedBasicType(str, &type)) {
+            if (tryGetReservedBasicType(str, &type) || tryGetReservedKeyword(str, &type)) {
                 Token t{
                     .type = type,
                     .span = TextSpan {
                         .string = str,
-                        .line = lineNumber,
-                        .from = i,
-                        .to = i + length,
+                        .offset = static_cast<lang::source::Offset>(i),
                     },
-                    .fileName = "undefined", // TODO: Assign...
                 };
 
                 i += length;
@@ -295,11 +555,8 @@ std::vector<Token> lang::lexer::parse(const std::string& s) noexcept
                 .type = TokenType::IDENTIFIER,
                 .span = TextSpan {
                     .string = str,
-                    .line = lineNumber,
-                    .from = i,
-                    .to = i + length,
+                    .offset = static_cast<lang::source::Offset>(i),
                 },
-                .fileName = "undefined", // TODO: Assign...
             };
 
             i += length;
@@ -308,78 +565,78 @@ std::vector<Token> lang::lexer::parse(const std::string& s) noexcept
         }
 
 
-        if (isKeyword(s, i, "==")) {
-            size_t identifierLength = 2;
-            token.push_back(createSingleToken(TokenType::EQ_OP, s, lineNumber, i, identifierLength));
-            i += identifierLength;
-            continue;
-        }
-
-        if (isKeyword(s, i, "!=")) {
+        TokenType::Type operatorType;
+        if (tryGetTwoCharacterOperator(s, i, &operatorType)) {
             size_t identifierLength = 2;
-            token.push_back(createSingleToken(TokenType::NE_OP, s, lineNumber, i, identifierLength));
+            token.push_back(createSingleToken(operatorType, s, i, identifierLength));
             i += identifierLength;
             continue;
         }
 
         if (c == ',') {
-            token.push_back(createSingleToken(TokenType::COMMA, s, lineNumber, i, 1));
+            token.push_back(createSingleToken(TokenType::COMMA, s, i, 1));
             i++;
             continue;
         }
 
         if (c == '(') {
-            token.push_back(createSingleToken(TokenType::LEFT_PAREN, s, lineNumber, i, 1));
+            token.push_back(createSingleToken(TokenType::LEFT_PAREN, s, i, 1));
             i++;
             continue;
         }
         else if (c == ')') {
-            token.push_back(createSingleToken(TokenType::RIGHT_PAREN, s, lineNumber, i, 1));
+            token.push_back(createSingleToken(TokenType::RIGHT_PAREN, s, i, 1));
             i++;
             continue;
         }
         else if (c == '{') {
-            token.push_back(createSingleToken(TokenType::LEFT_CURLY, s, lineNumber, i, 1));
+            token.push_back(createSingleToken(TokenType::LEFT_CURLY, s, i, 1));
             i++;
             continue;
         }
         else if (c == '}') {
-            token.push_back(createSingleToken(TokenType::RIGHT_CURLY, s, lineNumber, i, 1));
+            token.push_back(createSingleToken(TokenType::RIGHT_CURLY, s, i, 1));
             i++;
             continue;
         }
         else if (c == '[') {
-            token.push_back(createSingleToken(TokenType::LEFT_BRACKET, s, lineNumber, i, 1));
+            token.push_back(createSingleToken(TokenType::LEFT_BRACKET, s, i, 1));
             i++;
             continue;
         }
         else if (c == ']') {
-            token.push_back(createSingleToken(TokenType::RIGHT_BRACKET, s, lineNumber, i, 1));
+            token.push_back(createSingleToken(TokenType::RIGHT_BRACKET, s, i, 1));
             i++;
             continue;
         }
         else if (c == '+') {
-            token.push_back(createSingleToken(TokenType::PLUS, s, lineNumber, i, 1));
+            token.push_back(createSingleToken(TokenType::PLUS, s, i, 1));
             i++;
             continue;
         }
         else if (c == '-') {
-            token.push_back(createSingleToken(TokenType::MINUS, s, lineNumber, i, 1));
+            token.push_back(createSingleToken(TokenType::MINUS, s, i, 1));
             i++;
             continue;
         }
         else if (c == '=') {
-            token.push_back(createSingleToken(TokenType::EQUALS, s, lineNumber, i, 1));
+            token.push_back(createSingleToken(TokenType::EQUALS, s, i, 1));
             i++;
             continue;
         }
         else if (c == '<') {
-            token.push_back(createSingleToken(TokenType::LEFT_ANGLE, s, lineNumber, i, 1));
+            token.push_back(createSingleToken(TokenType::LEFT_ANGLE, s, i, 1));
             i++;
             continue;
         }
         else if (c == '>') {
-            token.push_back(createSingleToken(TokenType::RIGHT_ANGLE, s, lineNumber, i, 1));
+            token.push_back(createSingleToken(TokenType::RIGHT_ANGLE, s, i, 1));
+            i++;
+            continue;
+        }
+        else if (c == '*' || c == '/' || c == '%' || c == '&' || c == '|' || c == '^' || c == '!' || c == '~' || c == '.' || c == ':' || c == ';') {
+            // Token type values of single character operators are the character itself
+            token.push_back(createSingleToken(static_cast<TokenType::Type>(c), s, i, 1));
             i++;
             continue;
         }
@@ -388,37 +645,19 @@ std::vector<Token> lang::lexer::parse(const std::string& s) noexcept
 
 
         if (isDigit(c)) {
-            size_t length = 0;
-            while (continuesDigit(s[i + length])) {
-                length++;
-            }
-
-            std::string s2 = s.substr(i, length);
-
-            TokenType::Type type = TokenType::INTEGER32;
-            if (s2.find(".") != -1) type = TokenType::FLOAT32;
-            if (s2.ends_with("f32")) type = TokenType::FLOAT32;
-            if (s2.ends_with("f64")) type = TokenType::FLOAT64;
-
-            if (s2.ends_with("u8")) type = TokenType::INTEGER32;
-            if (s2.ends_with("u16")) type = TokenType::INTEGER32;
-            if (s2.ends_with("u32")) type = TokenType::INTEGER32;
-            if (s2.ends_with("u64")) type = TokenType::INTEGER64;
-
-            if (s2.ends_with("i8")) type = TokenType::INTEGER32;
-            if (s2.ends_with("i16")) type = TokenType::INTEGER32;
-            if (s2.ends_with("i32")) type = TokenType::INTEGER32;
-            if (s2.ends_with("i64")) type = TokenType::INTEGER64;
+            TokenType::Type type;
+            NumberLiteral number;
+            const char* error = nullptr;
+            size_t length = lexNumber(s, i, to, &type, &number, &error);
 
             Token t{
                 .type = type,
                 .span = TextSpan {
-                    .string = s2,
-                    .line = lineNumber,
-                    .from = i,
-                    .to = i + length,
+                    .string = std::string_view(s).substr(i, length),
+                    .offset = static_cast<lang::source::Offset>(i),
                 },
-                .fileName = "undefined", // TODO: Assign...
+                .number = number,
+                .error = error,
             };
 
             token.push_back(t);
@@ -428,8 +667,25 @@ std::vector<Token> lang::lexer::parse(const std::string& s) noexcept
         }
 
         i++;
-        std::cout << "couldn't identify: " << c << " (ignoring)" << "\n";
+        std::cerr << "couldn't identify: " << c << " (ignoring)" << "\n";
+    }
+
+    // The parser only needs to know whether tokens are on the same line, so that's all spans keep about lines
+    size_t previousEnd = from;
+    for (Token& t : token) {
+        t.span.startsLine = &t == &token.front() || std::memchr(s.data() + previousEnd, eol, t.span.offset - previousEnd) != nullptr;
+        previousEnd = t.span.end();
     }
 
     return std::move(token);
 }
+
+std::string_view lang::lexer::intern(const std::string& text)
+{
+    // Set nodes don't move, so views of them stay valid as it grows
+    static std::mutex mutex;
+    static std::set<std::string, std::less<>> texts;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    return *texts.insert(text).first;
+}
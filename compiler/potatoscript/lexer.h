@@ -1,18 +1,24 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cstdint>
 
 #include "types.h"
+#include "source.h"
 
 namespace lang::lexer {
 
+	// Text of a token and where it starts. Line and column are looked up in a lang::source::LineTable when
+	// something needs them, which is mostly diagnostics. The text points into the source the token was lexed
+	// from, which has to outlive it, or into intern().
 	struct TextSpan {
-		std::string string;
-        size_t line;
-		size_t from;
-        size_t to;
+		std::string_view string;
+		lang::source::Offset offset;
+		bool startsLine = false; // A line break separates it from the token before it
+
+		lang::source::Offset end() const { return offset + static_cast<lang::source::Offset>(string.size()); }
 	};
 
 	namespace TokenType {
@@ -20,7 +26,7 @@ namespace lang::lexer {
             DOT = '.',
             COMMA = ',',
             EQUALS = '=',
-            //SEMICOLON = ';',
+            SEMICOLON = ';',
             COLON = ':',
             LEFT_PAREN = '(',
             RIGHT_PAREN = ')',
@@ -62,6 +68,13 @@ namespace lang::lexer {
             KEYWORD_ENUM,
             KEYWORD_OPERATOR,
             KEYWORD_EXTERN,
+            KEYWORD_COMPTIME,
+            KEYWORD_TRAIT,
+            KEYWORD_IMPL,
+            KEYWORD_DEFER,
+            KEYWORD_EXPORT,
+            KEYWORD_INLINE,
+            KEYWORD_NOINLINE,
 
             KEYWORD_IF,
             //KEYWORD_WHEN,
@@ -91,6 +104,7 @@ namespace lang::lexer {
             KEYWORD_INT64,
             KEYWORD_FLOAT32,
             KEYWORD_FLOAT64,
+            KEYWORD_VECTOR, // SIMD vector types, e.g. f32x4, i32x8
 
             KEYWORD_BOOL,
             KEYWORD_TRUE,
@@ -125,6 +139,8 @@ namespace lang::lexer {
             AMPERSAND_EQ,         // &=
             VERTICAL_BAR_EQ,      // |=
             CARET_EQ,             // ^=
+            INCREMENT,            // ++
+            DECREMENT,            // --
 
             //DOTDOT,               // ..
             //DOTDOTLT,             // ..<
@@ -139,6 +155,7 @@ namespace lang::lexer {
             case TokenType::COMMA: return "COMMA";
             case TokenType::EQUALS: return "EQUALS";
             case TokenType::COLON: return "COLON";
+            case TokenType::SEMICOLON: return "SEMICOLON";
             case TokenType::LEFT_PAREN: return "LEFT_PAREN";
             case TokenType::RIGHT_PAREN: return "RIGHT_PAREN";
             case TokenType::STAR: return "STAR";
@@ -169,6 +186,13 @@ namespace lang::lexer {
             case TokenType::KEYWORD_STRUCT: return "KEYWORD_STRUCT";
             case TokenType::KEYWORD_ENUM: return "KEYWORD_ENUM";
             case TokenType::KEYWORD_OPERATOR: return "KEYWORD_OPERATOR";
+            case TokenType::KEYWORD_COMPTIME: return "KEYWORD_COMPTIME";
+            case TokenType::KEYWORD_TRAIT: return "KEYWORD_TRAIT";
+            case TokenType::KEYWORD_IMPL: return "KEYWORD_IMPL";
+            case TokenType::KEYWORD_DEFER: return "KEYWORD_DEFER";
+            case TokenType::KEYWORD_EXPORT: return "KEYWORD_EXPORT";
+            case TokenType::KEYWORD_INLINE: return "KEYWORD_INLINE";
+            case TokenType::KEYWORD_NOINLINE: return "KEYWORD_NOINLINE";
             case TokenType::KEYWORD_IF: return "KEYWORD_IF";
             case TokenType::KEYWORD_ELSE: return "KEYWORD_ELSE";
             case TokenType::KEYWORD_WHILE: return "KEYWORD_WHILE";
@@ -191,6 +215,7 @@ namespace lang::lexer {
             case TokenType::KEYWORD_INT64: return "KEYWORD_INT64";
             case TokenType::KEYWORD_FLOAT32: return "KEYWORD_FLOAT32";
             case TokenType::KEYWORD_FLOAT64: return "KEYWORD_FLOAT64";
+            case TokenType::KEYWORD_VECTOR: return "KEYWORD_VECTOR";
             case TokenType::KEYWORD_BOOL: return "KEYWORD_BOOL";
             case TokenType::KEYWORD_TRUE: return "KEYWORD_TRUE";
             case TokenType::KEYWORD_FALSE: return "KEYWORD_FALSE";
@@ -214,6 +239,8 @@ namespace lang::lexer {
             case TokenType::AMPERSAND_EQ: return "AMPERSAND_EQ";
             case TokenType::VERTICAL_BAR_EQ: return "VERTICAL_BAR_EQ";
             case TokenType::CARET_EQ: return "CARET_EQ";
+            case TokenType::INCREMENT: return "INCREMENT";
+            case TokenType::DECREMENT: return "DECREMENT";
             case TokenType::COMMENT: return "COMMENT";
             default:
                 return "Undefined";
@@ -221,15 +248,88 @@ namespace lang::lexer {
             }
         }
 
+        // How an operator is written in source, for diagnostics. Other tokens are named by toString.
+        static const char* spelling(Type t) {
+            switch (t)
+            {
+            case TokenType::DOT: return ".";
+            case TokenType::COMMA: return ",";
+            case TokenType::EQUALS: return "=";
+            case TokenType::COLON: return ":";
+            case TokenType::SEMICOLON: return ";";
+            case TokenType::STAR: return "*";
+            case TokenType::SLASH: return "/";
+            case TokenType::PERCENT: return "%";
+            case TokenType::PLUS: return "+";
+            case TokenType::MINUS: return "-";
+            case TokenType::VERTICAL_BAR: return "|";
+            case TokenType::CARET: return "^";
+            case TokenType::AMPERSAND: return "&";
+            case TokenType::LEFT_ANGLE: return "<";
+            case TokenType::RIGHT_ANGLE: return ">";
+            case TokenType::EXCLAMATION: return "!";
+            case TokenType::TILDE: return "~";
+            case TokenType::GE_OP: return ">=";
+            case TokenType::LE_OP: return "<=";
+            case TokenType::NE_OP: return "!=";
+            case TokenType::EQ_OP: return "==";
+            case TokenType::AND_OP: return "&&";
+            case TokenType::XOR_OP: return "^^";
+            case TokenType::OR_OP: return "||";
+            case TokenType::DEREFERENCE_OR_SHIFT: return "<<";
+            case TokenType::RIGHT_SHIFT: return ">>";
+            case TokenType::PLUS_EQ: return "+=";
+            case TokenType::MINUS_EQ: return "-=";
+            case TokenType::STAR_EQ: return "*=";
+            case TokenType::SLASH_EQ: return "/=";
+            case TokenType::PERCENT_EQ: return "%=";
+            case TokenType::AMPERSAND_EQ: return "&=";
+            case TokenType::VERTICAL_BAR_EQ: return "|=";
+            case TokenType::CARET_EQ: return "^=";
+            case TokenType::INCREMENT: return "++";
+            case TokenType::DECREMENT: return "--";
+            default:
+                return toString(t);
+            }
+        }
+
 	}
 
+	// Explicit type of a number literal, e.g. U8 in 255u8.
+	enum class NumberSuffix : u8 { None, U8, U16, U32, U64, I8, I16, I32, I64, F32, F64 };
+
+	// The suffix as written and as a type name, "" for None.
+	const char* suffixName(NumberSuffix suffix);
+
+	// Value of INTEGER and FLOAT tokens, parsed once by the lexer. The token type tells which member is set.
+	struct NumberLiteral {
+		union {
+			u64 integer = 0; // Integer literals are never negative, unary minus is a separate token
+			double floating; // 1.5f32 holds the value rounded to float, unsuffixed floats are f64
+		};
+		NumberSuffix suffix = NumberSuffix::None;
+	};
+
+	// Every source byte ends up in some token's span, so tokens stay small: string literals are checked by the
+	// lexer but only decoded by stringValue when the parser needs them.
 	struct Token {
         TokenType::Type type;
 		TextSpan span;
-        std::string fileName;
-
+		NumberLiteral number;
+		const char* error = nullptr; // Malformed or out of range number, unknown escape or unterminated string
 	};
 
+	// Text of a STRING token with escape sequences decoded, e.g. "a\n" holds a line break.
+	std::string stringValue(const Token& token);
+
 	std::vector<Token> parse(const std::string& contents) noexcept;
 
+	// Lexes contents[from, to), spans keep their offsets into contents. Used to re-lex edited lines, from has
+	// to be the start of a line.
+	std::vector<Token> parse(const std::string& contents, size_t from, size_t to) noexcept;
+
+	// Copy of text that lives as long as the program, for tokens that aren't in any source, e.g. the type
+	// arguments substituted into a generic fn. Thread safe, each distinct text is stored once.
+	std::string_view intern(const std::string& text);
+
 }
\ No newline at end of file
@@ -0,0 +1,181 @@
+#include "linker.h"
+
+#ifndef __linux__
+
+bool lang::linker::linkExecutable(const std::string& objectPath, const std::string& outputPath, bool profileRuntime, std::string* outError)
+{
+	*outError = "linking executables is only supported on linux, use build_exe.bat";
+	return false;
+}
+
+#else
+
+#include <vector>
+
+#ifdef POTATO_HAVE_LLD
+#include "lld/Common/Driver.h"
+#endif
+#include "llvm/ADT/Triple.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/raw_ostream.h"
+
+// Directory holding the libc startup files and libraries for the host, e.g. /usr/lib/x86_64-linux-gnu.
+static std::string findLibcDirectory(const llvm::Triple& triple)
+{
+	std::string multiarch = triple.getArchName().str() + "-linux-gnu";
+	for (std::string directory : { "/usr/lib/" + multiarch, std::string("/usr/lib64"), std::string("/usr/lib") }) {
+		if (llvm::sys::fs::exists(directory + "/Scrt1.o")) {
+			return directory;
+		}
+	}
+
+	return "";
+}
+
+// Directory of the newest GCC install for the host, it has crtbeginS.o and crtendS.o. atexit in libc_nonshared needs
+// the __dso_handle they define, like every executable gcc and clang link.
+static std::string findGccDirectory(const llvm::Triple& triple)
+{
+	std::string best;
+	int bestMajor = -1;
+	for (std::string root : { "/usr/lib/gcc/" + triple.getArchName().str() + "-linux-gnu", std::string("/usr/lib64/gcc/") + triple.getArchName().str() + "-linux-gnu" }) {
+		std::error_code ec;
+		for (llvm::sys::fs::directory_iterator it(root, ec), end; it != end && !ec; it.increment(ec)) {
+			int major = std::atoi(llvm::sys::path::filename(it->path()).str().c_str());
+			if (major > bestMajor && llvm::sys::fs::exists(it->path() + "/crtbeginS.o")) {
+				best = it->path();
+				bestMajor = major;
+			}
+		}
+	}
+
+	return best;
+}
+
+// compiler-rt's profile runtime, which writes the .profraw of --profile-generate at exit. Looked for where the LLVM
+// packages install clang's runtimes, newer versions name the directory after the major version only.
+static std::string findProfileRuntime(const llvm::Triple& triple)
+{
+	std::string major = std::to_string(LLVM_VERSION_MAJOR);
+	std::string file = "/lib/linux/libclang_rt.profile-" + triple.getArchName().str() + ".a";
+	for (std::string version : { std::string(LLVM_VERSION_STRING), major }) {
+		for (std::string prefix : { "/usr/lib/llvm-" + major + "/lib/clang/", std::string("/usr/lib/clang/"), std::string("/usr/local/lib/clang/") }) {
+			if (llvm::sys::fs::exists(prefix + version + file)) {
+				return prefix + version + file;
+			}
+		}
+	}
+
+	return "";
+}
+
+static const char* dynamicLinker(const llvm::Triple& triple)
+{
+	switch (triple.getArch()) {
+	case llvm::Triple::x86_64: return "/lib64/ld-linux-x86-64.so.2";
+	case llvm::Triple::aarch64: return "/lib/ld-linux-aarch64.so.1";
+	default: return nullptr;
+	}
+}
+
+bool lang::linker::linkExecutable(const std::string& objectPath, const std::string& outputPath, bool profileRuntime, std::string* outError)
+{
+	llvm::Triple triple(llvm::sys::getDefaultTargetTriple());
+
+	const char* loader = dynamicLinker(triple);
+	if (loader == nullptr) {
+		*outError = "don't know how to link executables for " + triple.str();
+		return false;
+	}
+
+	std::string libc = findLibcDirectory(triple);
+	if (libc.empty()) {
+		*outError = "couldn't find the libc startup files (Scrt1.o), is libc6-dev installed?";
+		return false;
+	}
+
+	std::string gcc = findGccDirectory(triple);
+	if (gcc.empty()) {
+		*outError = "couldn't find crtbeginS.o in /usr/lib/gcc, is gcc installed?";
+		return false;
+	}
+
+	// Objects are PIC, so this links a position independent executable the way gcc and clang do by default
+	std::string startFile = libc + "/Scrt1.o";
+	std::string initFile = libc + "/crti.o";
+	std::string finiFile = libc + "/crtn.o";
+	std::string beginFile = gcc + "/crtbeginS.o";
+	std::string endFile = gcc + "/crtendS.o";
+	std::string libraryPath = "-L" + libc;
+
+	std::vector<const char*> args = {
+		"ld.lld",
+		"-pie",
+		"--eh-frame-hdr",
+		"-dynamic-linker", loader,
+		"-o", outputPath.c_str(),
+		startFile.c_str(),
+		initFile.c_str(),
+		beginFile.c_str(),
+		objectPath.c_str(),
+		libraryPath.c_str(),
+		"-lc",
+		"-lm", // log10 and pow, for formatting floats in core.fmt
+		endFile.c_str(),
+		finiFile.c_str(),
+	};
+
+	std::string profileLibrary;
+	if (profileRuntime) {
+		profileLibrary = findProfileRuntime(triple);
+		if (profileLibrary.empty()) {
+			*outError = "couldn't find libclang_rt.profile for --profile-generate, is compiler-rt installed?";
+			return false;
+		}
+
+		// The instrumented object doesn't reference the runtime on Linux, -u pulls in its registration like clang does
+		args.insert(args.end() - 2, { "-u__llvm_profile_runtime", profileLibrary.c_str() }); // Before crtendS.o and crtn.o
+	}
+
+#ifdef POTATO_HAVE_LLD
+	std::string diagnostics;
+	llvm::raw_string_ostream errors(diagnostics);
+#if LLVM_VERSION_MAJOR >= 14
+	bool linked = lld::elf::link(args, llvm::outs(), errors, false, false);
+#else
+	bool linked = lld::elf::link(args, false, llvm::outs(), errors);
+#endif
+
+	if (linked == false) {
+		*outError = errors.str();
+	}
+
+	return linked;
+#else
+	// Built without the LLD libraries, the same arguments go to ld.lld or the system ld
+	auto linker = llvm::sys::findProgramByName("ld.lld");
+	if (!linker) {
+		linker = llvm::sys::findProgramByName("ld");
+	}
+	if (!linker) {
+		*outError = "couldn't find ld.lld or ld, this build of potatoscript has no LLD linked in";
+		return false;
+	}
+
+	std::vector<llvm::StringRef> commandLine(args.begin(), args.end());
+	commandLine[0] = *linker;
+	std::string message;
+	if (llvm::sys::ExecuteAndWait(*linker, commandLine, llvm::None, {}, 0, 0, &message) != 0) {
+		*outError = message.empty() ? "linking with " + *linker + " failed\n" : message + "\n";
+		return false;
+	}
+
+	return true;
+#endif
+}
+
+#endif
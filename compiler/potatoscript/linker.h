@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+
+namespace lang::linker {
+
+	// Links an object file into an executable against the system libc and libm by calling LLD in-process, no external tools run.
+	// Builds without the LLD libraries (POTATO_HAVE_LLD unset) run ld.lld or ld with the same arguments instead.
+	// Objects linked some other way need -lm as well when they print floats.
+	// profileRuntime links compiler-rt's profile runtime for objects built with --profile-generate.
+	// Only ELF on Linux is supported, elsewhere this fails. Returns false and fills outError on failure.
+	bool linkExecutable(const std::string& objectPath, const std::string& outputPath, bool profileRuntime, std::string* outError);
+}
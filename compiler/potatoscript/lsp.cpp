@@ -0,0 +1,708 @@
+#define _SILENCE_CXX17_ITERATOR_BASE_CLASS_DEPRECATION_WARNING 1
+
+#include "lsp.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "lexer.h"
+#include "parser.h"
+
+using namespace lang::lexer;
+using namespace lang::parser;
+
+// Minimal JSON value, only what the protocol messages need.
+struct Json {
+	enum class Kind { Null, Bool, Number, String, Array, Object };
+
+	Kind kind = Kind::Null;
+	bool boolValue = false;
+	f64 numberValue = 0;
+	std::string stringValue;
+	std::vector<Json> arrayValue;
+	std::vector<std::pair<std::string, Json>> objectValue;
+
+	static Json number(f64 v) { Json j; j.kind = Kind::Number; j.numberValue = v; return j; }
+	static Json string(const std::string& v) { Json j; j.kind = Kind::String; j.stringValue = v; return j; }
+	static Json boolean(bool v) { Json j; j.kind = Kind::Bool; j.boolValue = v; return j; }
+	static Json array() { Json j; j.kind = Kind::Array; return j; }
+	static Json object() { Json j; j.kind = Kind::Object; return j; }
+
+	const Json& operator[](const std::string& key) const {
+		static Json null;
+		for (auto& kv : objectValue) {
+			if (kv.first == key) {
+				return kv.second;
+			}
+		}
+		return null;
+	}
+
+	Json& set(const std::string& key, Json value) {
+		objectValue.emplace_back(key, std::move(value));
+		return *this;
+	}
+
+	bool has(const std::string& key) const {
+		return (*this)[key].kind != Kind::Null;
+	}
+
+	// Negative, fractional or huge numbers from the client are clamped, they index into the document
+	size_t asSize() const {
+		return numberValue > 0 && numberValue < 9007199254740992.0 ? static_cast<size_t>(numberValue) : 0;
+	}
+};
+
+static void skipWhitespace(const std::string& s, size_t& i) {
+	while (i < s.size() && (s[i] == ' ' || s[i] == '\t' || s[i] == '\n' || s[i] == '\r')) {
+		i++;
+	}
+}
+
+static void appendUtf8(std::string& out, u32 codepoint) {
+	if (codepoint < 0x80) {
+		out += static_cast<char>(codepoint);
+	}
+	else if (codepoint < 0x800) {
+		out += static_cast<char>(0xC0 | (codepoint >> 6));
+		out += static_cast<char>(0x80 | (codepoint & 0x3F));
+	}
+	else {
+		out += static_cast<char>(0xE0 | (codepoint >> 12));
+		out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+		out += static_cast<char>(0x80 | (codepoint & 0x3F));
+	}
+}
+
+// Whether s[i] is c, skipping whitespace before it and c itself when it matches.
+static bool expect(const std::string& s, size_t& i, char c) {
+	skipWhitespace(s, i);
+	if (i < s.size() && s[i] == c) {
+		i++;
+		return true;
+	}
+	return false;
+}
+
+// Sets failed for malformed JSON, the client gets a parse error instead of the server going down.
+static Json parseJson(const std::string& s, size_t& i, bool& failed, u32 depth = 0) {
+	skipWhitespace(s, i);
+	if (i >= s.size() || depth > 256) {
+		failed = true;
+		return Json{};
+	}
+
+	char c = s[i];
+	if (c == '{') {
+		Json j = Json::object();
+		i++;
+		if (expect(s, i, '}')) { return j; }
+
+		while (failed == false) {
+			skipWhitespace(s, i);
+			Json key = i < s.size() && s[i] == '"' ? parseJson(s, i, failed, depth + 1) : Json{};
+			if (key.kind != Json::Kind::String || expect(s, i, ':') == false) {
+				failed = true;
+				break;
+			}
+
+			Json value = parseJson(s, i, failed, depth + 1);
+			j.set(key.stringValue, std::move(value));
+			if (expect(s, i, ',')) { continue; }
+			failed = failed || expect(s, i, '}') == false;
+			break;
+		}
+		return j;
+	}
+
+	if (c == '[') {
+		Json j = Json::array();
+		i++;
+		if (expect(s, i, ']')) { return j; }
+
+		while (failed == false) {
+			j.arrayValue.push_back(parseJson(s, i, failed, depth + 1));
+			if (expect(s, i, ',')) { continue; }
+			failed = failed || expect(s, i, ']') == false;
+			break;
+		}
+		return j;
+	}
+
+	if (c == '"') {
+		std::string str;
+		i++;
+		while (i < s.size() && s[i] != '"') {
+			if (s[i] == '\\' && i + 1 < s.size()) {
+				i++;
+				switch (s[i]) {
+				case 'n': str += '\n'; break;
+				case 't': str += '\t'; break;
+				case 'r': str += '\r'; break;
+				case 'b': str += '\b'; break;
+				case 'f': str += '\f'; break;
+				case 'u': {
+					u32 codepoint = 0;
+					const char* digits = s.data() + i + 1;
+					auto [end, error] = std::from_chars(digits, s.data() + std::min(i + 5, s.size()), codepoint, 16);
+					if (error != std::errc{} || end != digits + 4) {
+						failed = true;
+						return Json{};
+					}
+					appendUtf8(str, codepoint);
+					i += 4;
+					break;
+				}
+				default: str += s[i]; break;
+				}
+				i++;
+				continue;
+			}
+
+			str += s[i];
+			i++;
+		}
+
+		if (i >= s.size()) {
+			failed = true; // Unterminated
+		}
+		i++; // "
+		return Json::string(str);
+	}
+
+	if (s.compare(i, 4, "true") == 0) { i += 4; return Json::boolean(true); }
+	if (s.compare(i, 5, "false") == 0) { i += 5; return Json::boolean(false); }
+	if (s.compare(i, 4, "null") == 0) { i += 4; return Json{}; }
+
+	// Stops at the end of the number, c_str() is NUL terminated
+	const char* start = s.c_str() + i;
+	char* end = nullptr;
+	f64 v = std::strtod(start, &end);
+	if (end == start || (c != '-' && (c < '0' || c > '9'))) {
+		failed = true;
+		return Json{};
+	}
+	i += static_cast<size_t>(end - start);
+	return Json::number(v);
+}
+
+static void writeJson(const Json& j, std::string& out) {
+	switch (j.kind) {
+	case Json::Kind::Null: out += "null"; break;
+	case Json::Kind::Bool: out += j.boolValue ? "true" : "false"; break;
+	case Json::Kind::Number: {
+		// Ids are echoed back as they came, which can be anything strtod parses
+		if (std::isfinite(j.numberValue) == false) {
+			out += "null";
+			break;
+		}
+
+		i64 integer = std::fabs(j.numberValue) < 9.2e18 ? static_cast<i64>(j.numberValue) : 0;
+		if (static_cast<f64>(integer) == j.numberValue) {
+			out += std::to_string(integer);
+		}
+		else {
+			out += std::to_string(j.numberValue);
+		}
+		break;
+	}
+	case Json::Kind::String:
+		out += '"';
+		for (char c : j.stringValue) {
+			switch (c) {
+			case '"': out += "\\\""; break;
+			case '\\': out += "\\\\"; break;
+			case '\n': out += "\\n"; break;
+			case '\r': out += "\\r"; break;
+			case '\t': out += "\\t"; break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20) {
+					char buffer[8];
+					std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+					out += buffer;
+				}
+				else {
+					out += c;
+				}
+			}
+		}
+		out += '"';
+		break;
+	case Json::Kind::Array:
+		out += '[';
+		for (size_t i = 0; i < j.arrayValue.size(); i++) {
+			if (i > 0) out += ',';
+			writeJson(j.arrayValue[i], out);
+		}
+		out += ']';
+		break;
+	case Json::Kind::Object:
+		out += '{';
+		for (size_t i = 0; i < j.objectValue.size(); i++) {
+			if (i > 0) out += ',';
+			writeJson(Json::string(j.objectValue[i].first), out);
+			out += ':';
+			writeJson(j.objectValue[i].second, out);
+		}
+		out += '}';
+		break;
+	}
+}
+
+struct Document {
+	std::string text;
+	lang::source::LineTable lines; // Positions are converted with it, ranged edits only shift the lines after them
+	std::vector<Token> tokens;
+	std::vector<TopLevelNode> nodes; // With the syntax errors in each of them
+};
+
+static std::map<std::string, std::unique_ptr<Document>> documents;
+
+static void computeLineOffsets(Document& d) {
+	d.lines = lang::source::LineTable(d.text);
+}
+
+// NOTE: LSP characters are UTF-16 code units, sources are assumed to be ASCII so bytes are used as is.
+static size_t toOffset(const Document& d, const Json& position) {
+	size_t line = position["line"].asSize();
+	if (line >= d.lines.lineCount()) {
+		return d.text.size();
+	}
+
+	size_t offset = d.lines.lineStart(static_cast<u32>(line)) + position["character"].asSize();
+	return offset < d.text.size() ? offset : d.text.size();
+}
+
+static Json toPosition(const Document& d, lang::source::Offset offset) {
+	lang::source::Location location = d.lines.locate(offset);
+	return Json::object()
+		.set("line", Json::number(static_cast<f64>(location.line)))
+		.set("character", Json::number(static_cast<f64>(location.column)));
+}
+
+static Json toRange(const Document& d, const TextSpan& from, const TextSpan& to) {
+	return Json::object()
+		.set("start", toPosition(d, from.offset))
+		.set("end", toPosition(d, to.end()));
+}
+
+// Points the text of a span kept across an edit back into the text, which the edit may have moved. Its offset
+// already is where it is now.
+static void rebase(const Document& d, TextSpan& span) {
+	span.string = std::string_view(d.text).substr(span.offset, span.string.size());
+}
+
+static void fullParse(Document& d) {
+	d.tokens = lang::lexer::parse(d.text);
+	d.nodes = lang::parser::parseSyntax(d.tokens, 0, d.tokens.size());
+}
+
+// Applies a ranged edit, re-lexing the touched lines and re-parsing the root nodes they belong to, broken ones
+// included. Falls back to a full parse when a token crosses the edited lines, or the re-parsed nodes end in a
+// syntax error that may have gone on past them.
+static void applyEdit(Document& d, const Json& range, const std::string& newText) {
+	size_t startLine = range["start"]["line"].asSize();
+	size_t oldEndLine = range["end"]["line"].asSize();
+	size_t startOffset = toOffset(d, range["start"]);
+	size_t endOffset = toOffset(d, range["end"]);
+
+	bool canBeIncremental = startLine < d.lines.lineCount() && oldEndLine < d.lines.lineCount();
+
+	// Tokens starting before the line after the edit are replaced, the ones after it only move. Without a line after
+	// it every token is, including an empty one at the end of the text like that of an unterminated string.
+	size_t oldRegionTo = oldEndLine + 1 < d.lines.lineCount() ? d.lines.lineStart(static_cast<u32>(oldEndLine + 1)) : SIZE_MAX;
+
+	d.text.replace(startOffset, endOffset - startOffset, newText);
+	d.lines.replace(d.text, static_cast<lang::source::Offset>(startOffset), static_cast<lang::source::Offset>(endOffset), static_cast<lang::source::Offset>(startOffset + newText.size()));
+
+	if (canBeIncremental == false) {
+		fullParse(d);
+		return;
+	}
+
+	size_t newLineCount = 0;
+	for (char c : newText) {
+		if (c == '\n') newLineCount++;
+	}
+
+	size_t newEndLine = startLine + newLineCount;
+	i64 offsetDelta = static_cast<i64>(newText.size()) - static_cast<i64>(endOffset - startOffset);
+
+	size_t regionFrom = d.lines.lineStart(static_cast<u32>(startLine));
+	size_t regionTo = newEndLine + 1 < d.lines.lineCount() ? d.lines.lineStart(static_cast<u32>(newEndLine + 1)) : d.text.size();
+
+	// Tokens on the edited lines get replaced, everything after them is shifted.
+	size_t firstRemoved = 0;
+	while (firstRemoved < d.tokens.size() && d.tokens[firstRemoved].span.offset < regionFrom) {
+		if (d.tokens[firstRemoved].span.end() > regionFrom) {
+			fullParse(d);
+			return;
+		}
+		firstRemoved++;
+	}
+
+	size_t lastRemoved = firstRemoved;
+	while (lastRemoved < d.tokens.size() && d.tokens[lastRemoved].span.offset < oldRegionTo) {
+		lastRemoved++;
+	}
+
+	std::vector<Token> relexed = lang::lexer::parse(d.text, regionFrom, regionTo);
+	if (relexed.size() > 0 && relexed.back().span.end() > regionTo) {
+		fullParse(d);
+		return;
+	}
+
+	for (size_t i = lastRemoved; i < d.tokens.size(); i++) {
+		auto& span = d.tokens[i].span;
+		span.offset = static_cast<lang::source::Offset>(static_cast<i64>(span.offset) + offsetDelta);
+	}
+
+	size_t removedCount = lastRemoved - firstRemoved;
+	i64 tokenDelta = static_cast<i64>(relexed.size()) - static_cast<i64>(removedCount);
+
+	d.tokens.erase(d.tokens.begin() + firstRemoved, d.tokens.begin() + lastRemoved);
+	d.tokens.insert(d.tokens.begin() + firstRemoved, relexed.begin(), relexed.end());
+	for (auto& t : d.tokens) {
+		rebase(d, t.span);
+	}
+
+	// Find the root nodes overlapping the replaced tokens, [firstNode, lastNode). The node right before them counts
+	// too, where it ends depends on the token after it, and a broken one can have its error there.
+	size_t firstNode = 0;
+	while (firstNode < d.nodes.size() && d.nodes[firstNode].lastToken < firstRemoved) {
+		firstNode++;
+	}
+
+	size_t lastNode = firstNode;
+	while (lastNode < d.nodes.size() && (d.nodes[lastNode].firstToken < lastRemoved || (removedCount == 0 && d.nodes[lastNode].firstToken < firstRemoved))) {
+		lastNode++;
+	}
+
+	size_t parseFrom = firstRemoved;
+	size_t parseTo = lastRemoved;
+	if (firstNode < lastNode) {
+		parseFrom = std::min(parseFrom, d.nodes[firstNode].firstToken);
+		parseTo = std::max(parseTo, d.nodes[lastNode - 1].lastToken);
+	}
+	parseTo = static_cast<size_t>(static_cast<i64>(parseTo) + tokenDelta);
+
+	std::vector<TopLevelNode> reparsed = lang::parser::parseSyntax(d.tokens, parseFrom, parseTo);
+	bool endsBroken = reparsed.empty() == false && reparsed.back().node == nullptr && reparsed.back().lastToken == parseTo;
+	if (endsBroken && parseTo < d.tokens.size()) {
+		fullParse(d);
+		return;
+	}
+
+	for (size_t i = lastNode; i < d.nodes.size(); i++) {
+		d.nodes[i].firstToken = static_cast<size_t>(static_cast<i64>(d.nodes[i].firstToken) + tokenDelta);
+		d.nodes[i].lastToken = static_cast<size_t>(static_cast<i64>(d.nodes[i].lastToken) + tokenDelta);
+		for (auto& diagnostic : d.nodes[i].diagnostics) {
+			diagnostic.span.offset = static_cast<lang::source::Offset>(static_cast<i64>(diagnostic.span.offset) + offsetDelta);
+		}
+	}
+
+	d.nodes.erase(d.nodes.begin() + firstNode, d.nodes.begin() + lastNode);
+	d.nodes.insert(d.nodes.begin() + firstNode, reparsed.begin(), reparsed.end());
+
+	for (auto& n : d.nodes) {
+		for (auto& diagnostic : n.diagnostics) {
+			rebase(d, diagnostic.span);
+		}
+	}
+}
+
+static bool isDeclarationType(const Token& t) {
+	switch (t.type) {
+	case TokenType::KEYWORD_FLOAT32:
+	case TokenType::KEYWORD_FLOAT64:
+	case TokenType::KEYWORD_VECTOR:
+	case TokenType::KEYWORD_UINT8:
+	case TokenType::KEYWORD_UINT16:
+	case TokenType::KEYWORD_UINT32:
+	case TokenType::KEYWORD_UINT64:
+	case TokenType::KEYWORD_INT8:
+	case TokenType::KEYWORD_INT16:
+	case TokenType::KEYWORD_INT32:
+	case TokenType::KEYWORD_INT64:
+	case TokenType::KEYWORD_BOOL:
+	case TokenType::KEYWORD_STRING:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Name token of a root fn/struct node, or nullptr for anything else.
+static const Token* nameToken(const Document& d, const TopLevelNode& n) {
+	for (size_t i = n.firstToken; i + 1 < n.lastToken; i++) {
+		auto type = d.tokens[i].type;
+		if (type == TokenType::COMMENT || type == TokenType::KEYWORD_EXTERN || type == TokenType::KEYWORD_COMPTIME
+			|| type == TokenType::KEYWORD_EXPORT || type == TokenType::KEYWORD_INLINE || type == TokenType::KEYWORD_NOINLINE) {
+			continue;
+		}
+
+		if ((type == TokenType::KEYWORD_FUNC || type == TokenType::KEYWORD_STRUCT || type == TokenType::KEYWORD_ENUM || type == TokenType::KEYWORD_TRAIT) && d.tokens[i + 1].type == TokenType::IDENTIFIER) {
+			return &d.tokens[i + 1];
+		}
+
+		return nullptr;
+	}
+
+	return nullptr;
+}
+
+static Json publishDiagnostics(const std::string& uri, const Document& d) {
+	Json list = Json::array();
+	for (auto& n : d.nodes) {
+		for (auto& diagnostic : n.diagnostics) {
+			list.arrayValue.push_back(Json::object()
+				.set("range", toRange(d, diagnostic.span, diagnostic.span))
+				.set("severity", Json::number(1))
+				.set("source", Json::string("potatoscript"))
+				.set("message", Json::string(diagnostic.message)));
+		}
+	}
+
+	return Json::object()
+		.set("jsonrpc", Json::string("2.0"))
+		.set("method", Json::string("textDocument/publishDiagnostics"))
+		.set("params", Json::object()
+			.set("uri", Json::string(uri))
+			.set("diagnostics", list));
+}
+
+static Json documentSymbols(const Document& d) {
+	Json list = Json::array();
+	for (auto& n : d.nodes) {
+		const Token* name = nameToken(d, n);
+		if (name == nullptr || n.node == nullptr) {
+			continue;
+		}
+
+		const int enumKind = 10;
+		const int interfaceKind = 11;
+		const int functionKind = 12;
+		const int structKind = 23;
+		bool isStruct = dynamic_cast<StructAST*>(n.node) != nullptr;
+		bool isEnum = dynamic_cast<EnumAST*>(n.node) != nullptr;
+		bool isTrait = dynamic_cast<TraitAST*>(n.node) != nullptr;
+
+		list.arrayValue.push_back(Json::object()
+			.set("name", Json::string(std::string(name->span.string)))
+			.set("kind", Json::number(isEnum ? enumKind : isTrait ? interfaceKind : isStruct ? structKind : functionKind))
+			.set("range", toRange(d, d.tokens[n.firstToken].span, d.tokens[n.lastToken - 1].span))
+			.set("selectionRange", toRange(d, name->span, name->span)));
+	}
+
+	return list;
+}
+
+static Json definition(const std::string& uri, const Document& d, const Json& position) {
+	size_t offset = toOffset(d, position);
+
+	size_t tokenIndex = 0;
+	while (tokenIndex < d.tokens.size() && d.tokens[tokenIndex].span.end() < offset) {
+		tokenIndex++;
+	}
+
+	if (tokenIndex >= d.tokens.size() || d.tokens[tokenIndex].span.offset > offset || d.tokens[tokenIndex].type != TokenType::IDENTIFIER) {
+		return Json{};
+	}
+
+	std::string_view name = d.tokens[tokenIndex].span.string;
+	const Token* found = nullptr;
+
+	// Locals and arguments first: the closest declaration before the cursor inside the enclosing root node.
+	for (auto& n : d.nodes) {
+		if (tokenIndex < n.firstToken || tokenIndex >= n.lastToken) {
+			continue;
+		}
+
+		for (size_t i = n.firstToken + 1; i < tokenIndex; i++) {
+			const Token& t = d.tokens[i];
+			const Token& type = d.tokens[i - 1];
+			if (t.type == TokenType::IDENTIFIER && t.span.string == name && (isDeclarationType(type) || type.type == TokenType::IDENTIFIER)) {
+				found = &t;
+			}
+		}
+	}
+
+	if (found == nullptr) {
+		for (auto& n : d.nodes) {
+			const Token* t = nameToken(d, n);
+			if (t && t->span.string == name) {
+				found = t;
+				break;
+			}
+		}
+	}
+
+	if (found == nullptr) {
+		return Json{};
+	}
+
+	return Json::object()
+		.set("uri", Json::string(uri))
+		.set("range", toRange(d, found->span, found->span));
+}
+
+static bool readMessage(std::string* outBody) {
+	size_t contentLength = 0;
+	std::string line;
+	while (std::getline(std::cin, line)) {
+		if (line.size() > 0 && line.back() == '\r') {
+			line.pop_back();
+		}
+
+		if (line.empty()) {
+			break;
+		}
+
+		const char* header = "Content-Length:";
+		if (line.rfind(header, 0) == 0) {
+			size_t value = std::strlen(header);
+			while (value < line.size() && line[value] == ' ') {
+				value++;
+			}
+
+			// A header that isn't a number ends the session like a missing one
+			auto [end, error] = std::from_chars(line.data() + value, line.data() + line.size(), contentLength);
+			if (error != std::errc{} || end != line.data() + line.size()) {
+				contentLength = 0;
+			}
+		}
+	}
+
+	if (std::cin.good() == false || contentLength == 0) {
+		return false;
+	}
+
+	outBody->resize(contentLength);
+	std::cin.read(outBody->data(), static_cast<std::streamsize>(contentLength));
+	return std::cin.good();
+}
+
+static void sendMessage(const Json& message) {
+	std::string body;
+	writeJson(message, body);
+	std::cout << "Content-Length: " << body.size() << "\r\n\r\n" << body;
+	std::cout.flush();
+}
+
+static void sendResult(const Json& id, Json result) {
+	sendMessage(Json::object()
+		.set("jsonrpc", Json::string("2.0"))
+		.set("id", id)
+		.set("result", std::move(result)));
+}
+
+int lang::lsp::run()
+{
+	std::ios::sync_with_stdio(false);
+
+	std::string body;
+	while (readMessage(&body)) {
+		size_t i = 0;
+		bool failed = false;
+		Json message = parseJson(body, i, failed);
+		if (failed || message.kind != Json::Kind::Object) {
+			sendMessage(Json::object()
+				.set("jsonrpc", Json::string("2.0"))
+				.set("id", Json{})
+				.set("error", Json::object()
+					.set("code", Json::number(-32700))
+					.set("message", Json::string("parse error"))));
+			continue;
+		}
+
+		const std::string& method = message["method"].stringValue;
+		const Json& params = message["params"];
+		const Json& id = message["id"];
+
+		if (method == "initialize") {
+			sendResult(id, Json::object()
+				.set("capabilities", Json::object()
+					.set("textDocumentSync", Json::object()
+						.set("openClose", Json::boolean(true))
+						.set("change", Json::number(2))) // Incremental
+					.set("definitionProvider", Json::boolean(true))
+					.set("documentSymbolProvider", Json::boolean(true)))
+				.set("serverInfo", Json::object().set("name", Json::string("potatoscript"))));
+		}
+		else if (method == "shutdown") {
+			sendResult(id, Json{});
+		}
+		else if (method == "exit") {
+			return 0;
+		}
+		else if (method == "textDocument/didOpen") {
+			const Json& textDocument = params["textDocument"];
+			auto d = std::make_unique<Document>();
+			d->text = textDocument["text"].stringValue;
+			computeLineOffsets(*d);
+			fullParse(*d);
+
+			const std::string& uri = textDocument["uri"].stringValue;
+			sendMessage(publishDiagnostics(uri, *d));
+			documents[uri] = std::move(d);
+		}
+		else if (method == "textDocument/didChange") {
+			const std::string& uri = params["textDocument"]["uri"].stringValue;
+			auto it = documents.find(uri);
+			if (it == documents.end()) {
+				continue;
+			}
+
+			Document& d = *it->second;
+			for (auto& change : params["contentChanges"].arrayValue) {
+				if (change.has("range")) {
+					applyEdit(d, change["range"], change["text"].stringValue);
+				}
+				else {
+					d.text = change["text"].stringValue;
+					computeLineOffsets(d);
+					fullParse(d);
+				}
+			}
+
+			sendMessage(publishDiagnostics(uri, d));
+		}
+		else if (method == "textDocument/didClose") {
+			documents.erase(params["textDocument"]["uri"].stringValue);
+		}
+		else if (method == "textDocument/documentSymbol" || method == "textDocument/definition") {
+			const std::string& uri = params["textDocument"]["uri"].stringValue;
+			auto it = documents.find(uri);
+			if (it == documents.end()) {
+				sendResult(id, Json{});
+				continue;
+			}
+
+			if (method == "textDocument/documentSymbol") {
+				sendResult(id, documentSymbols(*it->second));
+			}
+			else {
+				sendResult(id, definition(uri, *it->second, params["position"]));
+			}
+		}
+		else if (id.kind != Json::Kind::Null) {
+			sendMessage(Json::object()
+				.set("jsonrpc", Json::string("2.0"))
+				.set("id", id)
+				.set("error", Json::object()
+					.set("code", Json::number(-32601))
+					.set("message", Json::string("method not found: " + method))));
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+namespace lang::lsp {
+
+	// Runs a language server speaking LSP (JSON-RPC) over stdin/stdout until "exit" is received.
+	// Tokens and root AST nodes are kept per open document. Edits re-lex only the touched lines and
+	// re-parse only the root fn/struct nodes that contain them.
+	int run();
+}
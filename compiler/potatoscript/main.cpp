@@ -1,56 +1,56 @@
 ﻿#define _SILENCE_CXX17_ITERATOR_BASE_CLASS_DEPRECATION_WARNING 1
 
-#include <Windows.h>
 #include <assert.h>
 #include <iostream>
 #include <string>
-#include <chrono>
+#include <vector>
 
 #include "types.h"
-#include "util.h"
-#include "lexer.h"
-#include "parser.h"
+#include "driver.h"
+#include "server.h"
+#include "lsp.h"
+
+static std::string socketPathFromFlag(const std::string& flag) {
+	size_t equals = flag.find('=');
+	if (equals == std::string::npos) {
+		return lang::server::defaultSocketPath;
+	}
 
-int main(int argc, char** argv) {
+	return flag.substr(equals + 1);
+}
 
-	using hc = std::chrono::high_resolution_clock;
-	hc::time_point startTime = hc::now();
+int main(int argc, char** argv) {
 
 	if (argc < 2) {
 		std::cerr << "you have to pass in an entry point for compilation\n";
 		return -1;
 	}
 
-	const char* arg = argv[1];
-	std::cout << "Starting compilation of " << arg << "\n";
-
-	std::string contents = lang::fsutil::readTextFile(arg);
-	std::vector<lang::lexer::Token> tokens = lang::lexer::parse(contents);
-
-
-	hc::time_point endLexingTime = hc::now();
+	std::vector<std::string> args(argv + 1, argv + argc);
 
-	std::cout << "----------------- LEXER ----------------- " << "\n";
-	for (lang::lexer::Token& t : tokens) {
-		std::cout << "\"" << t.span.string << "\":" << lang::lexer::TokenType::toString(t.type) << " " << t.span.from << ":" << t.span.to << "\n";
+	// --server[=socket] keeps LLVM warm and compiles requests coming in over a unix socket.
+	if (args[0].rfind("--server", 0) == 0) {
+		return lang::server::run(socketPathFromFlag(args[0]));
 	}
 
-
-	std::cout << "----------------- PARSER ----------------- " << "\n";
-	auto nodes = lang::parser::parse(tokens);
-	for (auto* node : nodes) {
-		//std::cout << node->type << "\n";
-		if (node == nullptr) { continue; }
-
-		lang::parser::AstPrinter printer{};
-		node->print(printer);
-		std::cout << printer.buffer << "\n";
+	// --lsp speaks the language server protocol over stdin/stdout.
+	if (args[0] == "--lsp") {
+		return lang::lsp::run();
 	}
 
+	// --connect[=socket] forwards the remaining flags to a running compile server.
+	if (args[0].rfind("--connect", 0) == 0) {
+		std::string socketPath = socketPathFromFlag(args[0]);
+		args.erase(args.begin());
+		return lang::server::request(socketPath, args);
+	}
 
+	lang::driver::Options options;
+	std::string error;
+	if (lang::driver::parseArguments(args, &options, &error) == false) {
+		std::cerr << error << "\n";
+		return -1;
+	}
 
-	f64 microSeconds = (f64)std::chrono::duration_cast<std::chrono::microseconds>((endLexingTime - startTime)).count();
-	std::cout << "Compile time:: " << (microSeconds * 1000) << "ms\n";
-
-	return 0;
-}
\ No newline at end of file
+	return lang::driver::compile(options);
+}
@@ -1,22 +1,38 @@
 #define _SILENCE_CXX17_ITERATOR_BASE_CLASS_DEPRECATION_WARNING 1
 
 #include "parser.h"
+#include "typechecker.h"
+#include "fold.h"
+#include "abi.h"
+#include "runtime.h"
 
 #include <iostream>
 #include <fstream>
 #include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/APInt.h"
-#include "llvm/ADT/APSint.h"
+#include "llvm/ADT/APSInt.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/Triple.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/DIBuilder.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Utils.h"
+#include "llvm/Target/TargetMachine.h"
 
 #include <iostream>
 #include "parser.h"
@@ -29,41 +45,55 @@ using namespace lang::parser;
 static llvm::LLVMContext llvmContext;
 static llvm::IRBuilder<> llvmBuilder(llvmContext);
 static std::unique_ptr<llvm::Module> llvmModule;
-static std::map<std::string, llvm::Value*> llvmNamedValues;
-static std::map<std::string, llvm::StructType*> knownStructTypes;
+static std::unique_ptr<llvm::legacy::FunctionPassManager> llvmFunctionPasses;
 
-class LLVMOutputStream : public llvm::raw_ostream {
-public:
-
-	std::ofstream outputFile;
-
-	LLVMOutputStream(const std::string& filename) {
-		outputFile.open(filename);
-	}
-
-	~LLVMOutputStream() {
-		outputFile.close();
-	}
+// Where a local lives. Reference and indirectly passed arguments point at memory owned by the caller.
+struct LocalVariable {
+	llvm::Value* address;
+	llvm::Type* type;
+};
+static std::map<std::string, LocalVariable> llvmNamedValues; // Every visible local and argument
 
-	// Inherited via raw_ostream
-	virtual void write_impl(const char* ptr, size_t size) override
-	{
-		outputFile.write(ptr, static_cast<std::streamsize>(size));
-	}
+// How a declared function's arguments and result are passed, see abi.h
+struct LoweredFunction {
+	FunctionSignatureAST* signature;
+	lang::abi::FunctionInfo abi;
+};
+static std::map<std::string, LoweredFunction> loweredFunctions;
+static std::map<std::string, llvm::StructType*, std::less<>> knownStructTypes; // Looked up with token text
+static std::map<std::string, StructAST*> knownStructs;
+static std::map<std::string, EnumAST*> knownEnums;
+static std::map<std::string, llvm::Constant*> llvmStringPool; // Slice of every distinct string literal in the module
+
+// Deferred statement together with the locals visible where it was deferred, later declarations can shadow them
+struct DeferredStatement {
+	ExprAST* statement;
+	std::map<std::string, LocalVariable> variables;
+};
+static std::vector<std::vector<DeferredStatement>> llvmDeferScopes; // One per code block being generated, innermost last
 
-	virtual uint64_t current_pos() const override
-	{
-		return outputFile.cur;
-	}
+// Innermost loop last, break and continue jump to these
+struct LoopBlocks {
+	llvm::BasicBlock* latch;
+	llvm::BasicBlock* exit;
+	size_t deferScopes; // Code blocks outside of the loop, leaving the loop runs the defers of the ones above
 };
+static std::vector<LoopBlocks> llvmLoops;
+static llvm::TargetMachine* targetMachine = nullptr;
+static bool hasErrors = false;
+static bool boundsChecks = true; // --no-bounds-checks turns them off
+
+// Debug info, llvmDebugBuilder is only set while parse() generates a module with -g or -gline-tables-only
+static lang::source::DebugInfo debugInfo = lang::source::DebugInfo::None;
+static std::unique_ptr<llvm::DIBuilder> llvmDebugBuilder;
+static llvm::DIFile* llvmDebugFile = nullptr;
+static llvm::DISubprogram* llvmSubprogram = nullptr; // Of the fn being generated, null for fns without debug info
+static std::map<std::string, llvm::DIType*> llvmDebugTypes;
 
 static ParserHelper p;
 
-template <typename T, class ...Args>
-static T* createAst(Args&&... args) {
-	auto* a = new T(std::forward<Args>(args)...);
-	p.astNodesFlat.push_back((ExprAST*)a);
-	return a;
+AstPool& lang::parser::currentPool() {
+	return *p.pool;
 }
 
 
@@ -93,6 +123,7 @@ bool isTypeIdentifier(lang::lexer::Token t) {
 	if (t.type == TokenType::KEYWORD_BOOL) return true;
 	if (t.type == TokenType::KEYWORD_FLOAT32) return true;
 	if (t.type == TokenType::KEYWORD_FLOAT64) return true;
+	if (t.type == TokenType::KEYWORD_VECTOR) return true;
 	if (t.type == TokenType::KEYWORD_INT8) return true;
 	if (t.type == TokenType::KEYWORD_INT16) return true;
 	if (t.type == TokenType::KEYWORD_INT32) return true;
@@ -103,30 +134,103 @@ bool isTypeIdentifier(lang::lexer::Token t) {
 	if (t.type == TokenType::KEYWORD_UINT64) return true;
 	if (t.type == TokenType::KEYWORD_STRING) return true;
 	if (t.type == TokenType::KEYWORD_VOID) return true;
+	if (t.type == TokenType::IDENTIFIER && (t.span.string == "Arena" || t.span.string == "Allocator")) return true; // Built into the runtime
 
 	if (knownStructTypes.contains(t.span.string)) {
 		return true;
 	}
 
+	if (std::find(p.structNames.begin(), p.structNames.end(), t.span.string) != p.structNames.end()) {
+		return true;
+	}
+
+	if (std::find(p.enumNames.begin(), p.enumNames.end(), t.span.string) != p.enumNames.end()) {
+		return true;
+	}
+
+	if (std::find(p.typeParameters.begin(), p.typeParameters.end(), t.span.string) != p.typeParameters.end()) {
+		return true;
+	}
+
 	return false;
 }
 
+// When set, syntax errors are thrown as SyntaxError instead of aborting (see parseSyntax).
+static bool recoverFromErrors = false;
+
+static const lang::source::File* sourceFile = nullptr; // Diagnostics are located in it when set
+
+struct SyntaxError {
+	Diagnostic diagnostic;
+};
+
+// Line and column are only looked up here, right before the compiler gives up.
+static void printError(const Token& token, const char* msg) {
+	if (sourceFile) {
+		std::cerr << sourceFile->describe(token.span.offset) << ": ";
+	}
+	std::cerr << "error: " << msg << "\n";
+}
+
 void assert2(bool b, const Token& token, const char* msg) {
 	if (b == false) {
-		std::printf(msg, token.span.line, token.span.from, token.span.to);
-		//std::cerr << buff << '\n';
+		if (recoverFromErrors) {
+			throw SyntaxError{ Diagnostic{ token.span, msg } };
+		}
+
+		printError(token, msg);
 		std::abort();
 	}
 }
 
 void error(bool b, const Token& token, const char* msg) {
 	if (b) {
-		std::printf(msg, token.span.line, token.span.from, token.span.to);
-		//std::cerr << buff << '\n';
+		printError(token, msg);
 		std::abort();
 	}
 }
 
+// Binary operator applied by a compound assignment, END if t isn't one.
+static TokenType::Type compoundAssignmentOperator(TokenType::Type t) {
+	switch (t) {
+	case TokenType::PLUS_EQ: return TokenType::PLUS;
+	case TokenType::MINUS_EQ: return TokenType::MINUS;
+	case TokenType::STAR_EQ: return TokenType::STAR;
+	case TokenType::SLASH_EQ: return TokenType::SLASH;
+	case TokenType::PERCENT_EQ: return TokenType::PERCENT;
+	case TokenType::AMPERSAND_EQ: return TokenType::AMPERSAND;
+	case TokenType::VERTICAL_BAR_EQ: return TokenType::VERTICAL_BAR;
+	case TokenType::CARET_EQ: return TokenType::CARET;
+	default:
+		return TokenType::END;
+	}
+}
+
+// Token count of the explicit type arguments at the current token, e.g. <f32> in sum<f32>(a, b). 0 if there are none.
+static size_t typeArgumentListLength() {
+	if (p.current().type != TokenType::LEFT_ANGLE) {
+		return 0;
+	}
+
+	size_t i = 1;
+	while (true) {
+		if (isTypeIdentifier(p.next(i)) == false && p.next(i).type != TokenType::IDENTIFIER) {
+			return 0;
+		}
+
+		i++;
+		if (p.next(i).type == TokenType::RIGHT_ANGLE) {
+			break;
+		}
+		if (p.next(i).type != TokenType::COMMA) {
+			return 0;
+		}
+		i++;
+	}
+
+	return p.next(i + 1).type == TokenType::LEFT_PAREN ? i + 1 : 0;
+}
+
 ExprAST* lang::parser::identifier() {
 
 	const Token& current = p.current();
@@ -135,26 +239,95 @@ ExprAST* lang::parser::identifier() {
 	const Token& next = p.current();
 	if(isConstant(current.type))
 	{
+		NumberExprAST* number = nullptr;
 		switch (current.type)
 		{
 		case TokenType::FLOAT32:
-			//return createAst<NumberExprAST>(std::stof(current.span.string)); // TODO...
-			return createAst<NumberExprAST>(1.0f);
+			number = createAst<NumberExprAST>(static_cast<float>(current.number.floating));
+			break;
 		case TokenType::FLOAT64:
-			//return createAst<NumberExprAST>(std::stof(current.span.string)); // TODO...
-			return createAst<NumberExprAST>(1.0f);
+			number = createAst<NumberExprAST>(current.number.floating);
+			break;
 		case TokenType::INTEGER32:
-			return createAst<NumberExprAST>(static_cast<int32_t>(std::stoi(current.span.string)));
+			number = createAst<NumberExprAST>(static_cast<int32_t>(current.number.integer));
+			break;
 		case TokenType::INTEGER64:
-			return createAst<NumberExprAST>(static_cast<int64_t>(std::stoi(current.span.string)));
+			number = createAst<NumberExprAST>(static_cast<int64_t>(current.number.integer)); // u64 values keep their bit pattern
+			break;
 		case TokenType::STRING:
-			return createAst<ConstantStringExpr>(current.span.string);
+			assert2(current.error == nullptr, current, current.error ? current.error : "");
+			return createAst<ConstantStringExpr>(lang::lexer::stringValue(current));
 		default:
-			std::abort();
+			assert2(false, current, "Unexpected constant");
+			return nullptr;
 		}
+
+		assert2(current.error == nullptr, current, current.error ? current.error : "");
+		number->suffix = lang::lexer::suffixName(current.number.suffix);
+		return number;
 	}
 	else if (next.type == TokenType::LEFT_PAREN) {
-		return createAst<CallExprAST>(current.span.string, argumentsList(TokenType::RIGHT_PAREN));
+		return createAst<CallExprAST>(std::string(current.span.string), argumentsList(TokenType::RIGHT_PAREN));
+	}
+	else if (size_t length = typeArgumentListLength(); length > 0) {
+		// Generic call with explicit type arguments, e.g. sum<f32>(a, b)
+		std::vector<std::string> typeArguments;
+		for (size_t i = 1; i < length; i += 2) {
+			typeArguments.push_back(std::string(p.next(i).span.string));
+		}
+		p.eat(length);
+
+		auto* call = createAst<CallExprAST>(std::string(current.span.string), argumentsList(TokenType::RIGHT_PAREN));
+		call->typeArguments = typeArguments;
+		return call;
+	}
+	else if (next.type == TokenType::DOT) {
+		// Field access, e.g. v.x or v.position.x = 1
+		std::vector<std::string> fields;
+		while (p.current().type == TokenType::DOT) {
+			p.eat(); // eat .
+			assert2(p.current().type == TokenType::IDENTIFIER, p.current(), "Expected field name after .");
+			fields.push_back(std::string(p.current(true).span.string));
+		}
+
+		ExprAST* assignment = nullptr;
+		if (p.current().type == TokenType::EQUALS) {
+			p.eat(); // eat =
+			assignment = expression();
+		}
+
+		return createAst<FieldExprAST>(std::string(current.span.string), fields, assignment);
+	}
+	else if (next.type == TokenType::LEFT_BRACKET && next.span.startsLine == false) {
+		// Element or sub-slice, e.g. a[i], a[i] = 1, a[i] += 1 or a[1:n]. A [ on the next line starts a declaration.
+		size_t indexStart = p.index;
+		p.eat(); // eat [
+		ExprAST* index = binaryExpression();
+		ExprAST* end = nullptr;
+		if (p.current().type == TokenType::COLON) {
+			p.eat(); // eat :
+			end = binaryExpression();
+		}
+		assert2(p.current().type == TokenType::RIGHT_BRACKET, p.current(), "Expected ]");
+		p.eat(); // eat ]
+
+		ExprAST* assignment = nullptr;
+		if (p.current().type == TokenType::EQUALS) {
+			p.eat(); // eat =
+			assignment = expression();
+		}
+		else if (end == nullptr && compoundAssignmentOperator(p.current().type) != TokenType::END) {
+			// a[i] += b is stored as a[i] = a[i] + b, the index is parsed again for the read
+			size_t indexEnd = p.index;
+			p.index = indexStart + 1;
+			auto* self = createAst<IndexExprAST>(std::string(current.span.string), binaryExpression(), nullptr, nullptr);
+			p.index = indexEnd;
+
+			auto& op = p.current(true);
+			assignment = createAst<BinaryExprAST>(compoundAssignmentOperator(op.type), self, expression());
+		}
+
+		return createAst<IndexExprAST>(std::string(current.span.string), index, end, assignment);
 	}
 	else {
 		// Regular indentifier like a variable
@@ -163,33 +336,195 @@ ExprAST* lang::parser::identifier() {
 			p.eat(); // eat = 
 			assignment = expression();
 		}
+		else if (compoundAssignmentOperator(next.type) != TokenType::END) {
+			// a += b is stored as a = a + b
+			auto& op = p.current(true);
+			auto* self = createAst<VariableExprAST>(std::string(current.span.string), std::string(current.span.string), nullptr);
+			assignment = createAst<BinaryExprAST>(compoundAssignmentOperator(op.type), self, expression());
+		}
+		else if (next.type == TokenType::INCREMENT || next.type == TokenType::DECREMENT) {
+			// i++ is stored as i = i + 1
+			auto& op = p.current(true);
+			auto* self = createAst<VariableExprAST>(std::string(current.span.string), std::string(current.span.string), nullptr);
+			auto* one = createAst<NumberExprAST>(static_cast<int32_t>(1));
+			auto* step = createAst<BinaryExprAST>(op.type == TokenType::INCREMENT ? TokenType::PLUS : TokenType::MINUS, self, one);
+			step->isStep = true;
+			assignment = step;
+		}
+
+		return createAst<VariableExprAST>(std::string(current.span.string), std::string(current.span.string), assignment);
+	}
+}
+
+
+// Higher binds tighter, -1 for tokens that aren't binary operators.
+static int binaryPrecedence(TokenType::Type t) {
+	switch (t) {
+	case TokenType::OR_OP: return 1;
+	case TokenType::AND_OP: return 2;
+	case TokenType::XOR_OP: return 2;
+	case TokenType::VERTICAL_BAR: return 3;
+	case TokenType::CARET: return 4;
+	case TokenType::AMPERSAND: return 5;
+	case TokenType::EQ_OP:
+	case TokenType::NE_OP: return 6;
+	case TokenType::LEFT_ANGLE:
+	case TokenType::RIGHT_ANGLE:
+	case TokenType::LE_OP:
+	case TokenType::GE_OP: return 7;
+	case TokenType::DEREFERENCE_OR_SHIFT:
+	case TokenType::RIGHT_SHIFT: return 8;
+	case TokenType::PLUS:
+	case TokenType::MINUS: return 9;
+	case TokenType::STAR:
+	case TokenType::SLASH:
+	case TokenType::PERCENT: return 10;
+	default:
+		return -1;
+	}
+}
 
-		return createAst<VariableExprAST>(current.span.string, current.span.string, assignment);
+ExprAST* parseSizeof();
+ExprAST* parseDestructuring(bool isDeclaration);
+
+// Operand of a binary expression: literal, variable, call, sizeof, parenthesized or unary expression.
+static ExprAST* primary() {
+	switch (p.current().type) {
+	case TokenType::LEFT_PAREN: {
+		p.eat(); // eat (
+		auto* e = binaryExpression();
+		assert2(p.current().type == TokenType::RIGHT_PAREN, p.current(), "Expected )");
+		p.eat(); // eat )
+		return e;
+	}
+	case TokenType::MINUS: {
+		p.eat();
+		auto* operand = primary();
+		auto* negation = createAst<BinaryExprAST>(TokenType::MINUS, createAst<NumberExprAST>(static_cast<int32_t>(0)), operand);
+		negation->isNegation = true;
+		return negation;
+	}
+	case TokenType::EXCLAMATION: {
+		p.eat();
+		auto* operand = primary();
+		auto* f = createAst<VariableExprAST>("bool", "0", nullptr);
+		f->isConstant = true;
+		return createAst<BinaryExprAST>(TokenType::EQ_OP, operand, f);
+	}
+	case TokenType::KEYWORD_TRUE: {
+		p.eat();
+		auto* a = createAst<VariableExprAST>("bool", "1", nullptr);
+		a->isConstant = true;
+		return a;
+	}
+	case TokenType::KEYWORD_FALSE: {
+		p.eat();
+		auto* a = createAst<VariableExprAST>("bool", "0", nullptr);
+		a->isConstant = true;
+		return a;
+	}
+	case TokenType::KEYWORD_SIZEOF:
+		return parseSizeof();
+	case TokenType::LEFT_BRACKET: {
+		p.eat(); // eat [
+		std::vector<ExprAST*> elements;
+		while (p.current().type != TokenType::RIGHT_BRACKET) {
+			elements.push_back(binaryExpression());
+			if (p.current().type == TokenType::COMMA) {
+				p.eat();
+			}
+			else {
+				assert2(p.current().type == TokenType::RIGHT_BRACKET, p.current(), "Expected , or ] in array literal");
+			}
+		}
+		p.eat(); // eat ]
+		return createAst<ArrayExprAST>(elements);
+	}
+	case TokenType::IDENTIFIER:
+	case TokenType::KEYWORD_VECTOR:
+		return identifier();
+	case TokenType::KEYWORD_FLOAT32:
+	case TokenType::KEYWORD_FLOAT64:
+	case TokenType::KEYWORD_UINT8:
+	case TokenType::KEYWORD_UINT16:
+	case TokenType::KEYWORD_UINT32:
+	case TokenType::KEYWORD_UINT64:
+	case TokenType::KEYWORD_INT8:
+	case TokenType::KEYWORD_INT16:
+	case TokenType::KEYWORD_INT32:
+	case TokenType::KEYWORD_INT64:
+		if (p.next().type == TokenType::LEFT_PAREN) {
+			return identifier(); // Conversion, e.g. i32(x)
+		}
+		break;
+	default:
+		break;
 	}
+
+	assert2(isConstant(p.current().type), p.current(), "Expected expression");
+	return identifier();
 }
 
+// Operator precedence climbing. Operators have to be on the same line as their left operand,
+// a line break ends the expression as there are no statement terminators.
+static ExprAST* binaryOperatorRhs(int minPrecedence, ExprAST* left) {
+	while (true) {
+		const Token& op = p.current();
+		int precedence = binaryPrecedence(op.type);
+		if (precedence < 0 || precedence < minPrecedence || op.span.startsLine) {
+			return left;
+		}
+
+		p.eat(); // eat op
+		ExprAST* right = primary();
 
-BinaryExprAST* lang::parser::binaryExpression(TokenType::Type terminator) {
+		const Token& next = p.current();
+		int nextPrecedence = binaryPrecedence(next.type);
+		if (nextPrecedence > precedence && next.span.startsLine == false) {
+			right = binaryOperatorRhs(precedence + 1, right);
+		}
 
-	auto& current = p.current();
+		left = createAst<BinaryExprAST>(op.type, left, right);
+	}
+}
 
-	ExprAST* left = nullptr;
-	ExprAST* right = nullptr;
+ExprAST* lang::parser::binaryExpression() {
+	return binaryOperatorRhs(0, primary());
+}
 
-	left = expression();
-	auto& op = p.current();
-	p.eat(); // eat Op
-	right = expression();
+// Whether the [ at the current token starts an array or slice type, e.g. [4]f32 or []u8, rather than an array literal.
+static bool isArrayTypeStart() {
+	size_t length = p.next().type == TokenType::INTEGER32 || p.next().type == TokenType::INTEGER64 ? 2 : 1;
+	const Token& afterBracket = p.next(length + 1);
+	return p.next(length).type == TokenType::RIGHT_BRACKET && (isTypeIdentifier(afterBracket) || afterBracket.type == TokenType::LEFT_BRACKET);
+}
 
-	//assert(left->type == "Function call" || left->type == "identifier");
-	//assert2(isOperator(p.next().type), p.next(), "");
-	//assert2(isIdentifier(p.next(2).type) || isConstant(p.next(2).type), p.next(2), "");
+// Type name at the current token including array and slice prefixes, e.g. f32, [4]f32 or [][4]u8.
+static std::string parseTypeName() {
+	std::string prefix;
+	while (p.current().type == TokenType::LEFT_BRACKET) {
+		p.eat(); // eat [
+		prefix += "[";
+		if (p.current().type == TokenType::INTEGER32 || p.current().type == TokenType::INTEGER64) {
+			assert2(p.current().number.suffix == lang::lexer::NumberSuffix::None, p.current(), "Array lengths can't have a type suffix");
+			prefix += std::to_string(p.current(true).number.integer);
+		}
+		assert2(p.current().type == TokenType::RIGHT_BRACKET, p.current(), "Expected ] after array length");
+		p.eat(); // eat ]
+		prefix += "]";
+	}
 
-	return createAst<BinaryExprAST>(op.type, left, right);
+	return prefix + std::string(p.current(true).span.string);
 }
 
 VariableExprAST* variableExpr() {
-	auto& type = p.current(true);
+	// Reference arguments, e.g. &Vec3 v
+	bool isReference = p.current().type == TokenType::AMPERSAND;
+	if (isReference) {
+		p.eat();
+	}
+
+	std::string type = parseTypeName();
 	
 	lang::lexer::Token name;
 	if (p.current().type == TokenType::IDENTIFIER) {
@@ -197,12 +532,12 @@ VariableExprAST* variableExpr() {
 	}
 
 	ExprAST* assignment = nullptr;
-	if (p.next().type == TokenType::EQUALS) {
+	if (p.current().type == TokenType::EQUALS) {
 		p.eat(); // eat = 
 		assignment = expression();
 	}
 
-   	return createAst<VariableExprAST>(type.span.string, name.span.string, assignment);
+   	return createAst<VariableExprAST>(isReference ? "&" + type : type, std::string(name.span.string), assignment);
 }
 
 ArgumentListAST* lang::parser::argumentsDefinitionList(TokenType::Type terminator) {
@@ -223,7 +558,7 @@ ArgumentListAST* lang::parser::argumentsDefinitionList(TokenType::Type terminato
 			continue;
 		}
 
-		std::abort();
+		assert2(false, p.current(), "Expected , or end of argument list");
 	}
 
 	//assert2(p.current().type == TokenType::RIGHT_PAREN, p.current(), "Expected )");
@@ -250,7 +585,7 @@ ArgumentListAST* lang::parser::argumentsList(TokenType::Type terminator) {
 			continue;
 		}
 
-		std::abort();
+		assert2(false, p.current(), "Expected , or end of argument list");
 		//assert2(p.current().type == terminator || p.current().type == TokenType::COMMA, p.current(), "Expected ) or ,");
 	}
 
@@ -260,6 +595,21 @@ ArgumentListAST* lang::parser::argumentsList(TokenType::Type terminator) {
 	return createAst<ArgumentListAST>(args);
 }
 
+// Recovers from an unexpected token by skipping the rest of its statement, up to the next line or the } closing
+// the block. Blocks opened on the way are skipped as a whole.
+static void skipStatement() {
+	size_t depth = 0;
+	do {
+		if (p.current().type == TokenType::LEFT_CURLY) {
+			depth++;
+		}
+		else if (p.current().type == TokenType::RIGHT_CURLY && depth > 0) {
+			depth--;
+		}
+		p.eat();
+	} while (p.index < p.tokens.size() && (depth > 0 || (p.current().span.startsLine == false && p.current().type != TokenType::RIGHT_CURLY)));
+}
+
 CodeBlockAST* lang::parser::codeBlock()
 {
 	size_t scopeDepthBefore = p.scopeDepth;
@@ -270,8 +620,20 @@ CodeBlockAST* lang::parser::codeBlock()
 
 	std::vector<ExprAST*> codeBlock;
 	while (p.scopeDepth != scopeDepthBefore) {
-		auto* e = expression();
-		codeBlock.push_back(e);
+		while (p.current().type == TokenType::COMMENT || p.current().type == TokenType::SEMICOLON) {
+			p.eat();
+		}
+
+		// Empty blocks and trailing comments end up directly at }
+		if (p.current().type != TokenType::RIGHT_CURLY) {
+			// a, b = f() is only a statement, in argument lists the comma separates arguments
+			lang::source::Offset offset = p.current().span.offset;
+			auto* e = p.current().type == TokenType::IDENTIFIER && p.next().type == TokenType::COMMA ? parseDestructuring(false) : expression();
+			if (e) {
+				e->offset = offset;
+				codeBlock.push_back(e);
+			}
+		}
 
 		if (p.current().type == TokenType::RIGHT_CURLY) {
 			p.scopeDepth--;
@@ -294,20 +656,293 @@ ExprAST* parseStruct() {
 	auto& name = p.current();
 	p.eat();
 
+	bool isPacked = false;
+	bool reorderFields = false;
+	u64 alignment = 0;
+
+	// Attributes are contextual identifiers between the name and the body
+	while (p.current().type == TokenType::IDENTIFIER) {
+		auto& attribute = p.current(true);
+
+		if (attribute.span.string == "packed") {
+			isPacked = true;
+		}
+		else if (attribute.span.string == "reorder") {
+			reorderFields = true;
+		}
+		else if (attribute.span.string == "align") {
+			assert2(p.current().type == TokenType::LEFT_PAREN, p.current(), "Expected ( after align");
+			p.eat();
+			assert2(p.current().type == TokenType::INTEGER32, p.current(), "Expected integer alignment");
+			alignment = p.current(true).number.integer;
+			assert2(alignment > 0 && (alignment & (alignment - 1)) == 0, p.prev(), "Alignment has to be a power of 2");
+			assert2(p.current().type == TokenType::RIGHT_PAREN, p.current(), "Expected )");
+			p.eat();
+		}
+		else {
+			assert2(false, attribute, "Unknown struct attribute");
+		}
+	}
+
 	assert2(p.current().type == TokenType::LEFT_CURLY, p.current(), "Expected {");
 
 	CodeBlockAST* body = codeBlock();
 
-	return createAst<StructAST>(name.span.string, body);
+	auto* strukt = createAst<StructAST>(std::string(name.span.string), body);
+	strukt->isPacked = isPacked;
+	strukt->reorderFields = reorderFields;
+	strukt->alignment = alignment;
+
+	for (auto* member : body->body) {
+		auto* field = dynamic_cast<VariableExprAST*>(member);
+		if (field && field->isConstant == false && field->name.empty() == false) {
+			strukt->fields.push_back(StructAST::Field{ field->type, field->name, 0 });
+		}
+	}
+
+	return strukt;
+}
+
+// enum Name [: type] { Member = value, ... }, members are separated by commas or line breaks.
+ExprAST* parseEnum() {
+	p.eat(); // eat enum
+	assert2(p.current().type == TokenType::IDENTIFIER, p.current(), "Expected enum name");
+	std::string name = std::string(p.current(true).span.string);
+
+	std::string underlyingType = "i32";
+	if (p.current().type == TokenType::COLON) {
+		p.eat(); // eat :
+		assert2(isTypeIdentifier(p.current()), p.current(), "Expected underlying type after :");
+		underlyingType = std::string(p.current(true).span.string);
+	}
+
+	assert2(p.current().type == TokenType::LEFT_CURLY, p.current(), "Expected {");
+	p.eat();
+
+	std::vector<EnumAST::Member> members;
+	while (p.current().type != TokenType::RIGHT_CURLY) {
+		if (p.current().type == TokenType::COMMENT || p.current().type == TokenType::COMMA) {
+			p.eat();
+			continue;
+		}
+
+		assert2(p.current().type == TokenType::IDENTIFIER, p.current(), "Expected enum member name");
+		std::string member = std::string(p.current(true).span.string);
+		assert2(p.current().type == TokenType::EQUALS, p.current(), "Enum values have to be set explicitly, e.g. A = 1");
+		p.eat(); // eat =
+
+		bool isNegative = p.current().type == TokenType::MINUS;
+		if (isNegative) {
+			p.eat();
+		}
+
+		auto& value = p.current(true);
+		assert2(value.type == TokenType::INTEGER32 || value.type == TokenType::INTEGER64, value, "Expected integer enum value");
+		assert2(value.error == nullptr, value, value.error ? value.error : "");
+
+		int64_t v = static_cast<int64_t>(value.number.integer);
+		members.push_back(EnumAST::Member{ member, isNegative ? -v : v });
+	}
+	p.eat(); // eat }
+
+	return createAst<EnumAST>(name, underlyingType, members);
+}
+
+// switch value { case 1, 2 { } case 3 { } default { } }
+ExprAST* parseSwitch() {
+	p.eat(); // eat switch
+	auto* value = binaryExpression();
+
+	assert2(p.current().type == TokenType::LEFT_CURLY, p.current(), "Expected { after switch value");
+	p.eat();
+
+	std::vector<SwitchAST::Case> cases;
+	CodeBlockAST* defaultBody = nullptr;
+	while (p.current().type != TokenType::RIGHT_CURLY) {
+		if (p.current().type == TokenType::COMMENT || p.current().type == TokenType::SEMICOLON) {
+			p.eat();
+			continue;
+		}
+
+		if (p.current().type == TokenType::KEYWORD_DEFAULT) {
+			assert2(defaultBody == nullptr, p.current(), "Switch already has a default");
+			p.eat(); // eat default
+			defaultBody = codeBlock();
+			continue;
+		}
+
+		assert2(p.current().type == TokenType::KEYWORD_CASE, p.current(), "Expected case or default");
+		p.eat(); // eat case
+
+		SwitchAST::Case c;
+		c.values.push_back(binaryExpression());
+		while (p.current().type == TokenType::COMMA) {
+			p.eat();
+			c.values.push_back(binaryExpression());
+		}
+
+		c.body = codeBlock();
+		cases.push_back(c);
+	}
+	p.eat(); // eat }
+
+	return createAst<SwitchAST>(value, cases, defaultBody);
+}
+
+// Loop attributes between the loop header and the body: unroll, unroll(N), nounroll, vectorize, novectorize.
+static void parseLoopAttributes(LoopAST* loop) {
+	while (p.current().type == TokenType::IDENTIFIER) {
+		auto& attribute = p.current(true);
+
+		if (attribute.span.string == "unroll") {
+			loop->unroll = true;
+			if (p.current().type == TokenType::LEFT_PAREN) {
+				p.eat();
+				assert2(p.current().type == TokenType::INTEGER32, p.current(), "Expected integer unroll count");
+				loop->unrollCount = static_cast<u32>(p.current(true).number.integer);
+				assert2(p.current().type == TokenType::RIGHT_PAREN, p.current(), "Expected )");
+				p.eat();
+			}
+		}
+		else if (attribute.span.string == "nounroll") {
+			loop->unroll = false;
+		}
+		else if (attribute.span.string == "vectorize") {
+			loop->vectorize = LoopAST::Vectorize::Always;
+		}
+		else if (attribute.span.string == "novectorize") {
+			loop->vectorize = LoopAST::Vectorize::Never;
+		}
+		else {
+			assert2(false, attribute, "Unknown loop attribute");
+		}
+	}
+}
+
+static bool isLoopAttribute(const Token& t) {
+	return t.type == TokenType::IDENTIFIER && (t.span.string == "unroll" || t.span.string == "nounroll" || t.span.string == "vectorize" || t.span.string == "novectorize");
+}
+
+// while condition { }
+// for { }
+// for condition { }
+// for init; condition; step { }
+ExprAST* parseLoop() {
+	auto& keyword = p.current(true);
+
+	ExprAST* init = nullptr;
+	ExprAST* condition = nullptr;
+	ExprAST* step = nullptr;
+
+	if (keyword.type == TokenType::KEYWORD_WHILE) {
+		condition = binaryExpression();
+	}
+	else if (p.current().type != TokenType::LEFT_CURLY && isLoopAttribute(p.current()) == false) {
+		ExprAST* first = expression();
+
+		if (p.current().type == TokenType::SEMICOLON) {
+			p.eat(); // eat ;
+			init = first;
+
+			if (p.current().type != TokenType::SEMICOLON) {
+				condition = binaryExpression();
+			}
+
+			assert2(p.current().type == TokenType::SEMICOLON, p.current(), "Expected ; after loop condition");
+			p.eat(); // eat ;
+
+			if (p.current().type != TokenType::LEFT_CURLY && isLoopAttribute(p.current()) == false) {
+				step = expression();
+			}
+		}
+		else {
+			condition = first;
+		}
+	}
+
+	auto* loop = createAst<LoopAST>(init, condition, step, nullptr);
+	parseLoopAttributes(loop);
+
+	assert2(p.current().type == TokenType::LEFT_CURLY, p.current(), "Expected { after loop header");
+	loop->body = codeBlock();
+	return loop;
+}
+
+ExprAST* parseSizeof() {
+	p.eat(); // eat sizeof
+	assert2(p.current().type == TokenType::LEFT_PAREN, p.current(), "Expected ( after sizeof");
+	p.eat();
+	assert2(isTypeIdentifier(p.current()) || p.current().type == TokenType::IDENTIFIER, p.current(), "Expected type name");
+	auto& typeName = p.current(true);
+	assert2(p.current().type == TokenType::RIGHT_PAREN, p.current(), "Expected )");
+	p.eat();
+
+	return createAst<SizeofExprAST>(std::string(typeName.span.string));
 }
 
 
 
+// var a, b = f() or a, b = f(), unpacks the values of a multi-value return.
+ExprAST* parseDestructuring(bool isDeclaration) {
+	if (isDeclaration) {
+		p.eat(); // eat var
+	}
+
+	std::vector<std::string> names;
+	while (true) {
+		assert2(p.current().type == TokenType::IDENTIFIER, p.current(), "Expected variable name");
+		names.push_back(std::string(p.current(true).span.string));
+
+		if (p.current().type != TokenType::COMMA) {
+			break;
+		}
+		p.eat(); // eat ,
+	}
+
+	assert2(p.current().type == TokenType::EQUALS, p.current(), "Expected = after variable names");
+	p.eat(); // eat =
+
+	return createAst<DestructureAST>(names, expression(), isDeclaration);
+}
+
 ExprAST* parseFunction(bool isExternal) {
+	size_t firstToken = p.index;
 	p.eat(); // eat func
 	auto& name = p.current();
 	p.eat();
 
+	// Type parameters of a generic fn, optionally bound to a trait, e.g. fn sum<T, U: AddTrait>
+	std::vector<FunctionAST::TypeParameter> typeParameters;
+	if (p.current().type == TokenType::LEFT_ANGLE) {
+		assert2(isExternal == false, p.current(), "Extern fns can't be generic");
+		p.eat(); // eat <
+
+		while (true) {
+			assert2(p.current().type == TokenType::IDENTIFIER, p.current(), "Expected type parameter name");
+			FunctionAST::TypeParameter parameter{ std::string(p.current(true).span.string), "" };
+
+			if (p.current().type == TokenType::COLON) {
+				p.eat(); // eat :
+				assert2(p.current().type == TokenType::IDENTIFIER, p.current(), "Expected trait name after :");
+				parameter.bound = std::string(p.current(true).span.string);
+			}
+
+			typeParameters.push_back(parameter);
+			if (p.current().type != TokenType::COMMA) {
+				break;
+			}
+			p.eat(); // eat ,
+		}
+
+		assert2(p.current().type == TokenType::RIGHT_ANGLE, p.current(), "Expected > after type parameters");
+		p.eat(); // eat >
+	}
+
+	std::vector<std::string> outerTypeParameters = p.typeParameters;
+	for (auto& t : typeParameters) {
+		p.typeParameters.push_back(t.name);
+	}
+
 	assert2(p.current().type == TokenType::LEFT_PAREN, p.current(), "Expected (");
 	p.eat(); // Eat (
 	auto args = argumentsDefinitionList(TokenType::RIGHT_PAREN);
@@ -319,10 +954,15 @@ ExprAST* parseFunction(bool isExternal) {
 		returnList = argumentsDefinitionList(TokenType::RIGHT_PAREN);
 	}*/
 	
-	if (isTypeIdentifier(p.current())) {
-		// TODO: Support more than 1 return type
+	if (isTypeIdentifier(p.current()) || p.current().type == TokenType::LEFT_BRACKET) {
+		// Multiple values are separated by commas, e.g. fn f() i32, bool
 		std::vector<ExprAST*> arguments;
 		arguments.push_back(variableExpr());
+		while (p.current().type == TokenType::COMMA) {
+			p.eat();
+			assert2(isTypeIdentifier(p.current()) || p.current().type == TokenType::LEFT_BRACKET, p.current(), "Expected return type after ,");
+			arguments.push_back(variableExpr());
+		}
 		returnList = createAst<ArgumentListAST>(arguments);
 		//returnList = argumentsDefinitionList(TokenType::LEFT_CURLY); // NOTE: does not work for externs as it doesn't have a terminator symbol (e.g. '{' )
 	}
@@ -339,24 +979,128 @@ ExprAST* parseFunction(bool isExternal) {
 		body = codeBlock();
 	}
 
-	auto* def = createAst<FunctionSignatureAST>(name.span.string, args, returnList);
+	p.typeParameters = outerTypeParameters;
+
+	auto* def = createAst<FunctionSignatureAST>(std::string(name.span.string), args, returnList);
 	def->isExternal = isExternal;
 
-	return createAst<FunctionAST>(def, body);
+	auto* fn = createAst<FunctionAST>(def, body);
+	if (typeParameters.empty() == false) {
+		fn->typeParameters = typeParameters;
+		fn->templateTokens.assign(p.tokens.begin() + firstToken, p.tokens.begin() + p.index);
+	}
+
+	return fn;
 }
 
-ExprAST* lang::parser::expression() {
+// Name in <> after a generic name, e.g. the T of trait AddTrait<T> or the Vec3 of impl AddTrait<Vec3>.
+static std::string parseAngleBracketName(const char* expected) {
+	assert2(p.current().type == TokenType::LEFT_ANGLE, p.current(), "Expected <");
+	p.eat(); // eat <
+	assert2(isTypeIdentifier(p.current()) || p.current().type == TokenType::IDENTIFIER, p.current(), expected);
+	std::string name = std::string(p.current(true).span.string);
+	assert2(p.current().type == TokenType::RIGHT_ANGLE, p.current(), "Expected >");
+	p.eat(); // eat >
+	return name;
+}
 
-	if (p.index >= p.tokens.size()) {
-		throw new std::exception("escape recursion");
-		//std::abort();
+// trait Name<T> { fn signatures }
+ExprAST* parseTrait() {
+	p.eat(); // eat trait
+	assert2(p.current().type == TokenType::IDENTIFIER, p.current(), "Expected trait name");
+	std::string name = std::string(p.current(true).span.string);
+	std::string typeParameter = parseAngleBracketName("Expected type parameter name");
+
+	p.typeParameters.push_back(typeParameter);
+
+	assert2(p.current().type == TokenType::LEFT_CURLY, p.current(), "Expected {");
+	p.eat();
+
+	std::vector<FunctionSignatureAST*> methods;
+	while (p.current().type != TokenType::RIGHT_CURLY) {
+		if (p.current().type == TokenType::COMMENT || p.current().type == TokenType::SEMICOLON) {
+			p.eat();
+			continue;
+		}
+
+		assert2(p.current().type == TokenType::KEYWORD_FUNC, p.current(), "Expected fn in trait");
+		auto* fn = static_cast<FunctionAST*>(parseFunction(true));
+		methods.push_back(fn->getSignature());
 	}
+	p.eat(); // eat }
 
-	switch (p.current().type)
-	{
-	case TokenType::IDENTIFIER: {
-		return identifier();
+	p.typeParameters.pop_back();
+
+	return createAst<TraitAST>(name, typeParameter, methods);
+}
+
+// impl Trait<Type> in Self { fns }
+ExprAST* parseImpl() {
+	p.eat(); // eat impl
+	assert2(p.current().type == TokenType::IDENTIFIER, p.current(), "Expected trait name");
+	std::string traitName = std::string(p.current(true).span.string);
+	std::string typeArgument = parseAngleBracketName("Expected type name");
+
+	std::string selfType = typeArgument;
+	if (p.current().type == TokenType::IDENTIFIER && p.current().span.string == "in") {
+		p.eat(); // eat in
+		assert2(isTypeIdentifier(p.current()) || p.current().type == TokenType::IDENTIFIER, p.current(), "Expected type name after in");
+		selfType = std::string(p.current(true).span.string);
 	}
+
+	assert2(p.current().type == TokenType::LEFT_CURLY, p.current(), "Expected {");
+	p.eat();
+
+	std::vector<FunctionAST*> methods;
+	while (p.current().type != TokenType::RIGHT_CURLY) {
+		if (p.current().type == TokenType::COMMENT || p.current().type == TokenType::SEMICOLON) {
+			p.eat();
+			continue;
+		}
+
+		assert2(p.current().type == TokenType::KEYWORD_FUNC, p.current(), "Expected fn in impl");
+		lang::source::Offset offset = p.current().span.offset;
+		auto* fn = static_cast<FunctionAST*>(parseFunction(false));
+		fn->offset = offset;
+		assert2(fn->isGeneric() == false, p.prev(), "Impl methods can't be generic");
+		methods.push_back(fn);
+	}
+	p.eat(); // eat }
+
+	auto* impl = createAst<ImplAST>(traitName, typeArgument, selfType, methods);
+	for (auto* m : methods) {
+		m->getSignature()->name = impl->implementedTrait() + "." + m->getSignature()->name;
+	}
+
+	return impl;
+}
+
+ExprAST* lang::parser::expression() {
+
+	if (p.index >= p.tokens.size()) {
+		assert2(false, p.tokens.empty() ? p.current() : p.tokens.back(), "Unexpected end of file");
+	}
+
+	switch (p.current().type)
+	{
+	case TokenType::IDENTIFIER: {
+		if (isTypeIdentifier(p.current()) && p.next().type == TokenType::IDENTIFIER) {
+			return variableExpr(); // Declaration with a struct type, e.g. Vec3 v
+		}
+		return binaryExpression();
+	}
+	case TokenType::LEFT_BRACKET:
+		if (isArrayTypeStart()) {
+			return variableExpr(); // Array or slice declaration, e.g. [4]f32 v
+		}
+		return binaryExpression();
+	case TokenType::KEYWORD_SIZEOF:
+	case TokenType::KEYWORD_TRUE:
+	case TokenType::KEYWORD_FALSE:
+	case TokenType::LEFT_PAREN:
+	case TokenType::MINUS:
+	case TokenType::EXCLAMATION:
+		return binaryExpression();
 	case TokenType::KEYWORD_FLOAT32:
 	case TokenType::KEYWORD_FLOAT64:
 	case TokenType::KEYWORD_UINT8:
@@ -367,19 +1111,52 @@ ExprAST* lang::parser::expression() {
 	case TokenType::KEYWORD_INT16:
 	case TokenType::KEYWORD_INT32:
 	case TokenType::KEYWORD_INT64:
+		if (p.next().type == TokenType::LEFT_PAREN) {
+			return binaryExpression(); // Conversion, e.g. i32(x) * 2
+		}
+		return variableExpr();
 	case TokenType::KEYWORD_BOOL:
 	case TokenType::KEYWORD_STRING:
 		return variableExpr();
+	case TokenType::KEYWORD_VAR:
+		if (p.next().type == TokenType::IDENTIFIER && p.next(2).type == TokenType::COMMA) {
+			return parseDestructuring(true); // var a, b = f()
+		}
+		return variableExpr();
+	case TokenType::KEYWORD_VECTOR:
+		if (p.next().type == TokenType::LEFT_PAREN) {
+			return binaryExpression(); // Constructor, e.g. f32x4(1, 2, 3, 4)
+		}
+		return variableExpr();
 	case TokenType::COMMENT:
+	case TokenType::SEMICOLON:
 		p.eat();
 		return expression();
+	case TokenType::KEYWORD_WHILE:
+	case TokenType::KEYWORD_FOR:
+		return parseLoop();
+	case TokenType::KEYWORD_BREAK:
+	case TokenType::KEYWORD_CONTINUE: {
+		auto& keyword = p.current(true);
+		return createAst<LoopControlAST>(keyword.type == TokenType::KEYWORD_BREAK);
+	}
 	case TokenType::KEYWORD_RETURN: {
 
 		ExprAST* value = nullptr;
-		if (p.current().span.line == p.next().span.line) {
+		if (p.next().span.startsLine == false) {
 			// There's a return value
 			p.eat(); // Eat return keyword
 			value = expression();
+
+			// Multiple values, e.g. return a, false
+			if (p.current().type == TokenType::COMMA) {
+				std::vector<ExprAST*> values{ value };
+				while (p.current().type == TokenType::COMMA) {
+					p.eat();
+					values.push_back(expression());
+				}
+				value = createAst<TupleExprAST>(values);
+			}
 		}
 		else {
 			p.eat(); // Eat return keyword
@@ -387,49 +1164,37 @@ ExprAST* lang::parser::expression() {
 
 		return createAst<ReturnAST>(value);
 	}
-	case TokenType::KEYWORD_TRUE: {
-		p.eat();
-		auto* a = createAst<VariableExprAST>("bool", "1", nullptr);
-		a->isConstant = true;
-		return a;
-	}
-	case TokenType::KEYWORD_FALSE: {
-		p.eat();
-		auto* a = createAst<VariableExprAST>("bool", "0", nullptr);
-		a->isConstant = true;
-		return a;
-	}
-	case TokenType::EQUALS:
-	case TokenType::PLUS:
-	case TokenType::MINUS:
-	case TokenType::STAR:
-	case TokenType::SLASH:
-	case TokenType::PERCENT:
-	case TokenType::VERTICAL_BAR:
-	case TokenType::CARET:
-	case TokenType::AMPERSAND:
-	{
-		auto* left = p.astNodesFlat.back();
-		
-		if (p.astNodes.size() > 0) {
-			p.astNodes.resize(p.astNodes.size() - 1);
-		}
-		p.astNodesFlat.resize(p.astNodesFlat.size() - 1);
-
-		auto& op = p.current(true);
-		auto* right = expression();
-
-		return createAst<BinaryExprAST>(op.type, left, right);
-	}
 	case TokenType::KEYWORD_IF: {
 		p.eat(); // eat if
 
-		auto* condition = binaryExpression(TokenType::LEFT_CURLY);
-		std::vector<IfAST::ConditionAndBody> v;
+		std::vector<IfAST::ConditionAndBody> chain;
+		CodeBlockAST* elseBody = nullptr;
+		while (true) {
+			IfAST::ConditionAndBody arm(binaryExpression(), nullptr);
+
+			// Branch hint between the condition and the body
+			if (p.current().type == TokenType::IDENTIFIER && (p.current().span.string == "likely" || p.current().span.string == "unlikely")) {
+				arm.likelihood = p.current(true).span.string == "likely" ? IfAST::Likelihood::Likely : IfAST::Likelihood::Unlikely;
+			}
+
+			arm.body = codeBlock();
+			chain.push_back(arm);
+
+			if (p.current().type != TokenType::KEYWORD_ELSE) {
+				break;
+			}
+			p.eat(); // eat else
+
+			if (p.current().type == TokenType::KEYWORD_IF) {
+				p.eat(); // eat if
+				continue;
+			}
+
+			elseBody = codeBlock();
+			break;
+		}
 
-		auto* body = codeBlock();
-		v.push_back(IfAST::ConditionAndBody(condition, body));
-		return createAst<IfAST>(v, false, nullptr);
+		return createAst<IfAST>(chain, elseBody != nullptr, elseBody);
 	}
 	case TokenType::KEYWORD_EXTERN: {
 		p.eat(); // Eat extern
@@ -439,6 +1204,51 @@ ExprAST* lang::parser::expression() {
 	case TokenType::KEYWORD_FUNC: {
 		return parseFunction(false);
 	}
+	case TokenType::KEYWORD_COMPTIME:
+	case TokenType::KEYWORD_EXPORT:
+	case TokenType::KEYWORD_INLINE:
+	case TokenType::KEYWORD_NOINLINE: {
+		// Modifiers in any order, e.g. export inline fn
+		bool isComptime = false;
+		bool isExported = false;
+		auto inlining = FunctionSignatureAST::Inlining::Default;
+		while (p.current().type != TokenType::KEYWORD_FUNC) {
+			const Token& modifier = p.current(true);
+			switch (modifier.type) {
+			case TokenType::KEYWORD_COMPTIME: isComptime = true; break;
+			case TokenType::KEYWORD_EXPORT: isExported = true; break;
+			case TokenType::KEYWORD_INLINE:
+			case TokenType::KEYWORD_NOINLINE: {
+				auto requested = modifier.type == TokenType::KEYWORD_INLINE ? FunctionSignatureAST::Inlining::Always : FunctionSignatureAST::Inlining::Never;
+				assert2(inlining == FunctionSignatureAST::Inlining::Default || inlining == requested, modifier, "A fn can't be both inline and noinline");
+				inlining = requested;
+				break;
+			}
+			default:
+				assert2(false, modifier, "Expected keyword func");
+				break;
+			}
+		}
+
+		auto* fn = static_cast<FunctionAST*>(parseFunction(false));
+		fn->getSignature()->isComptime = isComptime;
+		fn->getSignature()->isExported = isExported;
+		fn->getSignature()->inlining = inlining;
+		return fn;
+	}
+	case TokenType::KEYWORD_ENUM:
+		return parseEnum();
+	case TokenType::KEYWORD_SWITCH:
+		return parseSwitch();
+	case TokenType::KEYWORD_DEFER: {
+		p.eat(); // eat defer
+		ExprAST* statement = p.current().type == TokenType::LEFT_CURLY ? codeBlock() : expression();
+		return createAst<DeferAST>(statement);
+	}
+	case TokenType::KEYWORD_TRAIT:
+		return parseTrait();
+	case TokenType::KEYWORD_IMPL:
+		return parseImpl();
 	case TokenType::KEYWORD_STRUCT: {
 		//p.eat(); // Eat struct
 		assert2(p.next().type == TokenType::IDENTIFIER, p.current(), "Expected struct identifier");
@@ -449,7 +1259,7 @@ ExprAST* lang::parser::expression() {
 	}
 
 	if (isConstant(p.current().type)) {
-		return identifier();
+		return binaryExpression();
 	}
 
 
@@ -466,6 +1276,12 @@ ExprAST* lang::parser::expression() {
 	//assert2(next3.type == TokenType::IDENTIFIER || isConstant(next3.type), next3, "Expected identifier at line: %d and token: %d - %d");
 	//identifier(tokens, index + 1);
 
+	if (recoverFromErrors) {
+		p.diagnostics.push_back(Diagnostic{ p.current().span, std::string("Unexpected token ") + TokenType::spelling(p.current().type) });
+		skipStatement();
+		return nullptr;
+	}
+
 	std::cerr << "undefined token type:: " << TokenType::toString(p.current().type) << "\n";
 	p.eat();
 
@@ -483,343 +1299,2095 @@ llvm::Value* LogErrorV(const char* str) {
 	return nullptr;
 }
 
-std::vector<ExprAST*> lang::parser::parse(const std::vector<Token>& tokens)
-{
-	llvmModule = std::make_unique<llvm::Module>("potatoscript", llvmContext);
+// Strings are read-only slices, { ptr, len }, so passing and comparing them never scans for the terminator.
+static llvm::StructType* llvmStringType() {
+	return llvm::StructType::get(llvmContext, { llvm::Type::getInt8PtrTy(llvmContext), llvm::Type::getInt64Ty(llvmContext) });
+}
 
-	p.tokens = std::move(tokens);
-	p.index = 0;
+// Maps a type name as written in source to its LLVM type, nullptr if unknown.
+static llvm::Type* llvmTypeFromName(const std::string& type) {
+	if (type == "string") return llvmStringType();
+	if (type == "bool") return llvm::Type::getInt1Ty(llvmContext);
+	if (type == "i8" || type == "u8") return llvm::Type::getInt8Ty(llvmContext);
+	if (type == "i16" || type == "u16") return llvm::Type::getInt16Ty(llvmContext);
+	if (type == "i32" || type == "u32") return llvm::Type::getInt32Ty(llvmContext);
+	if (type == "i64" || type == "u64") return llvm::Type::getInt64Ty(llvmContext);
+	if (type == "f32") return llvm::Type::getFloatTy(llvmContext);
+	if (type == "f64") return llvm::Type::getDoubleTy(llvmContext);
+	if (type == "void") return llvm::Type::getVoidTy(llvmContext);
+	if (type == "Arena") return lang::runtime::arenaType(llvmContext);
+	if (type == "Allocator") return lang::runtime::allocatorType(llvmContext);
+
+	if (lang::typechecker::isVector(type)) {
+		llvm::Type* element = llvmTypeFromName(lang::typechecker::elementType(type));
+		return llvm::FixedVectorType::get(element, lang::typechecker::vectorLength(type));
+	}
 
-	try {
-		size_t i = 0;
-		while (p.index < p.tokens.size()) {
-			auto* t = expression();
-			p.astNodes.push_back(t);
+	// Slices have the same { ptr, len } layout as strings
+	if (lang::typechecker::isArray(type) || lang::typechecker::isSlice(type)) {
+		llvm::Type* element = llvmTypeFromName(lang::typechecker::indexedType(type));
+		if (element == nullptr) {
+			return nullptr;
 		}
-	}
-	catch (std::exception* e) {
-		// Ignored (used to escape parsing, kind of ugly...)
-	}
-	
-	// Index functions and structs first... 
-	for (auto* n : p.astNodes) {
-		auto* fn = dynamic_cast<FunctionAST*>(n);
-		if (fn) {
-			fn->codegen();
-			continue;
+
+		if (lang::typechecker::isSlice(type)) {
+			return llvm::StructType::get(llvmContext, { element->getPointerTo(), llvm::Type::getInt64Ty(llvmContext) });
 		}
+		return llvm::ArrayType::get(element, lang::typechecker::arrayLength(type));
+	}
 
-		auto* strukt = dynamic_cast<StructAST*>(n);
-		if (strukt) {
-			strukt->codegen();
-			continue;
+	// Multiple return values travel as a literal struct, small ones are returned in a register pair
+	if (lang::typechecker::isTuple(type)) {
+		std::vector<llvm::Type*> elements;
+		for (auto& e : lang::typechecker::tupleElements(type)) {
+			elements.push_back(llvmTypeFromName(e));
 		}
+		return llvm::StructType::get(llvmContext, elements);
 	}
 
-	for (auto* n : p.astNodes) {
-		n->codegen();
+	// Enums are their underlying integer
+	auto enumeration = knownEnums.find(type);
+	if (enumeration != knownEnums.end()) {
+		return llvmTypeFromName(enumeration->second->underlyingType);
 	}
 
-	LLVMOutputStream output("../ir_output.ll");
-	llvmModule->print(output, nullptr, false, true);
+	auto it = knownStructs.find(type);
+	if (it != knownStructs.end()) {
+		it->second->codegen(); // Make sure the body is set before it's used by value
+		return it->second->llvmType;
+	}
 
-	return std::move(p.astNodes);
+	if (knownStructTypes.contains(type)) {
+		return knownStructTypes[type];
+	}
+
+	return nullptr;
 }
 
-llvm::Value* lang::parser::NumberExprAST::codegen()
-{
-	switch (type) {
-	case TokenType::FLOAT32: return llvm::ConstantFP::get(llvmContext, llvm::APFloat(value.float32Value));
-	case TokenType::FLOAT64: return llvm::ConstantFP::get(llvmContext, llvm::APFloat(value.float64Value));
-	case TokenType::INTEGER32: return llvm::ConstantInt::get(llvmContext, llvm::APInt(32, value.int32Value, true));
-	case TokenType::INTEGER64: return llvm::ConstantInt::get(llvmContext, llvm::APInt(64, value.int64Value, true));
-	// TODO: Add unsigned integers
+// Alignment in bytes including align(N) on structs.
+static u64 alignmentOf(const std::string& typeName, llvm::Type* type) {
+	auto it = knownStructs.find(typeName);
+	if (it != knownStructs.end() && it->second->effectiveAlignment > 0) {
+		return it->second->effectiveAlignment;
 	}
-	
-	return LogErrorV("Value type not found");
+
+	return llvmModule->getDataLayout().getABITypeAlignment(type);
 }
 
-llvm::Value* lang::parser::ConstantStringExpr::codegen()
-{
-	llvm::Value* str = llvmBuilder.CreateGlobalStringPtr(stringValue);
-	return str;
+// Allocas in the entry block are what mem2reg promotes to registers.
+static llvm::AllocaInst* createEntryBlockAlloca(llvm::Function* function, const std::string& name, const std::string& typeName, llvm::Type* type) {
+	llvm::IRBuilder<> builder(&function->getEntryBlock(), function->getEntryBlock().begin());
+	llvm::AllocaInst* alloca = builder.CreateAlloca(type, nullptr, name);
+	alloca->setAlignment(llvm::Align(alignmentOf(typeName, type)));
+	return alloca;
 }
 
-llvm::Value* lang::parser::ReturnAST::codegen()
-{
-	auto* v = value->codegen();
-	
-	//llvmBuilder.SetInsertPoint()
-	llvm::ReturnInst* inst =  llvm::ReturnInst::Create(llvmContext, v);
-	llvmBuilder.Insert(inst); // Not sure why this is needed, but k
-	return inst;
+// Unnamed stack slot in the current function, e.g. for struct arguments and results passed in memory.
+static llvm::AllocaInst* createTemporary(llvm::Type* type, u64 alignment, const char* name) {
+	llvm::Function* function = llvmBuilder.GetInsertBlock()->getParent();
+	llvm::IRBuilder<> builder(&function->getEntryBlock(), function->getEntryBlock().begin());
+	llvm::AllocaInst* alloca = builder.CreateAlloca(type, nullptr, name);
+	alloca->setAlignment(llvm::Align(alignment));
+	return alloca;
 }
 
-llvm::Value* lang::parser::VariableExprAST::codegen()
-{
-	if (isConstant) {
-		if (type == "bool") {
-			return llvm::ConstantInt::get(llvmContext, llvm::APInt(1, std::stoi(name)));
-		}
+// Type as the debugger shows it, structs list their fields. Enums are shown by member name.
+static llvm::DIType* debugType(const std::string& typeName) {
+	auto cached = llvmDebugTypes.find(typeName);
+	if (cached != llvmDebugTypes.end()) {
+		return cached->second;
+	}
 
-		// Constant struct
+	using namespace lang::typechecker;
+	const llvm::DataLayout& layout = llvmModule->getDataLayout();
+	llvm::DIBuilder& di = *llvmDebugBuilder;
+	llvm::Type* type = llvmTypeFromName(typeName);
+	u64 size = type && type->isSized() ? layout.getTypeSizeInBits(type) : 0;
+	u32 alignment = type && type->isSized() ? static_cast<u32>(alignmentOf(typeName, type) * 8) : 0;
+
+	// Fields, placed where the LLVM struct has them
+	auto member = [&](llvm::DIScope* scope, llvm::StructType* strukt, unsigned index, const std::string& name, const std::string& fieldType) {
+		llvm::DIType* t = debugType(fieldType);
+		u64 offset = layout.getStructLayout(strukt)->getElementOffsetInBits(index);
+		return di.createMemberType(scope, name, llvmDebugFile, 0, t->getSizeInBits(), 0, offset, llvm::DINode::FlagZero, t);
+	};
+
+	llvm::DIType* result = nullptr;
+	if (typeName == "bool") {
+		result = di.createBasicType(typeName, 8, llvm::dwarf::DW_ATE_boolean);
+	}
+	else if (isFloat(typeName)) {
+		result = di.createBasicType(typeName, size, llvm::dwarf::DW_ATE_float);
+	}
+	else if (isInteger(typeName)) {
+		result = di.createBasicType(typeName, size, isSignedInteger(typeName) ? llvm::dwarf::DW_ATE_signed : llvm::dwarf::DW_ATE_unsigned);
+	}
+	else if (isVector(typeName)) {
+		llvm::Metadata* range = di.getOrCreateSubrange(0, vectorLength(typeName));
+		result = di.createVectorType(size, alignment, debugType(elementType(typeName)), di.getOrCreateArray(range));
+	}
+	else if (isArray(typeName)) {
+		llvm::Metadata* range = di.getOrCreateSubrange(0, arrayLength(typeName));
+		result = di.createArrayType(size, alignment, debugType(indexedType(typeName)), di.getOrCreateArray(range));
+	}
+	else if (knownEnums.contains(typeName)) {
+		EnumAST* enumeration = knownEnums.at(typeName);
+		std::vector<llvm::Metadata*> members;
+		for (auto& m : enumeration->members) {
+			members.push_back(di.createEnumerator(m.name, m.value, isSignedInteger(enumeration->underlyingType) == false));
+		}
+		result = di.createEnumerationType(llvmDebugFile, typeName, llvmDebugFile, 0, size, alignment, di.getOrCreateArray(members), debugType(enumeration->underlyingType));
+	}
+	else if (type && type->isStructTy()) {
+		// Cached before its fields, a struct can hold slices of itself
+		auto* strukt = llvm::cast<llvm::StructType>(type);
+		llvm::DICompositeType* composite = di.createStructType(llvmDebugFile, typeName, llvmDebugFile, 0, size, alignment, llvm::DINode::FlagZero, nullptr, llvm::DINodeArray());
+		llvmDebugTypes[typeName] = composite;
+
+		std::vector<llvm::Metadata*> members;
+		if (typeName == "string" || isSlice(typeName)) {
+			std::string element = typeName == "string" ? "u8" : indexedType(typeName);
+			members.push_back(member(composite, strukt, 0, "data", "*" + element));
+			members.push_back(member(composite, strukt, 1, "len", "u64"));
+		}
+		else if (isTuple(typeName)) {
+			std::vector<std::string> elements = tupleElements(typeName);
+			for (unsigned i = 0; i < elements.size(); i++) {
+				members.push_back(member(composite, strukt, i, std::to_string(i), elements[i]));
+			}
+		}
+		else if (knownStructs.contains(typeName)) {
+			for (auto& f : knownStructs.at(typeName)->fields) {
+				members.push_back(member(composite, strukt, static_cast<unsigned>(f.elementIndex), f.name, f.type));
+			}
+		}
 
-		return LogErrorV("Couldn't determine constant type");
+		di.replaceArrays(composite, di.getOrCreateArray(members));
+		return composite;
+	}
+	else if (typeName.starts_with("*")) {
+		// Only used for the data of strings and slices, the language has no pointer types of its own
+		result = di.createPointerType(debugType(typeName.substr(1)), layout.getPointerSizeInBits());
 	}
 	else {
-		llvm::Value* v = llvmNamedValues.at(name);
-		assert(v != nullptr);
+		result = di.createUnspecifiedType(typeName);
+	}
 
-		return v;
+	llvmDebugTypes[typeName] = result;
+	return result;
+}
+
+// Attaches the line of the statement starting at offset to the instructions generated next.
+static void setDebugLocation(lang::source::Offset offset) {
+	if (llvmSubprogram == nullptr) {
+		return;
 	}
+
+	lang::source::Location location = sourceFile->locate(offset);
+	llvmBuilder.SetCurrentDebugLocation(llvm::DILocation::get(llvmContext, location.line + 1, location.column + 1, llvmSubprogram));
 }
 
-llvm::Value* lang::parser::ArgumentListAST::codegen()
-{
-	return LogErrorV("Not imlemented");
+// Tells the debugger where a local or argument lives, argument is its 1 based position or 0 for locals. Only with -g.
+static void declareDebugVariable(const std::string& name, const std::string& typeName, llvm::Value* address, unsigned argument) {
+	if (llvmSubprogram == nullptr || debugInfo != lang::source::DebugInfo::Full) {
+		return;
+	}
 
-	//for (auto* t : arguments) {
-	//	llvmNamedValues[t->name] = t->codegen();
-	//}
+	const llvm::DebugLoc& location = llvmBuilder.getCurrentDebugLocation();
+	llvm::DILocalVariable* variable = argument > 0
+		? llvmDebugBuilder->createParameterVariable(llvmSubprogram, name, argument, llvmDebugFile, location.getLine(), debugType(typeName))
+		: llvmDebugBuilder->createAutoVariable(llvmSubprogram, name, llvmDebugFile, location.getLine(), debugType(typeName));
+	llvmDebugBuilder->insertDeclare(address, variable, llvmDebugBuilder->createExpression(), location.get(), llvmBuilder.GetInsertBlock());
+}
 
+// Blocks are appended when generation reaches them so the IR reads top to bottom.
+static void beginBlock(llvm::Function* function, llvm::BasicBlock* block) {
+	function->getBasicBlockList().push_back(block);
+	llvmBuilder.SetInsertPoint(block);
 }
 
-llvm::Value* lang::parser::BinaryExprAST::codegen()
-{
-	llvm::Value* l = left->codegen();
-	llvm::Value* r = right->codegen();
-	if (!l || !r)
-	{
-		return LogErrorV("Binary expression failed, couldn't find left and/or righgt");
+// Weights of the true and false edge of a conditional branch, the same ratio clang uses for __builtin_expect.
+static llvm::MDNode* branchWeights(IfAST::Likelihood likelihood) {
+	const u32 likelyWeight = 2000;
+	const u32 unlikelyWeight = 1;
+
+	switch (likelihood) {
+	case IfAST::Likelihood::Likely: return llvm::MDBuilder(llvmContext).createBranchWeights(likelyWeight, unlikelyWeight);
+	case IfAST::Likelihood::Unlikely: return llvm::MDBuilder(llvmContext).createBranchWeights(unlikelyWeight, likelyWeight);
+	default:
+		return nullptr;
 	}
+}
 
-	switch (type) {
-	case TokenType::PLUS: return llvmBuilder.CreateFAdd(l, r, "addtmp");
-	case TokenType::MINUS: return llvmBuilder.CreateFSub(l, r, "subtmp");
-	case TokenType::STAR: return llvmBuilder.CreateFMul(l, r, "multmp");
-	case TokenType::SLASH: return llvmBuilder.CreateFDiv(l, r, "divtmp");
-	case TokenType::LEFT_ANGLE: return llvmBuilder.CreateICmpSLT(l, r, "lttmp"); // NOTE, FOR NOW ASSUMES INTS! FIX
-	case TokenType::RIGHT_ANGLE: return llvmBuilder.CreateICmpSGT(l, r, "gttmp"); // NOTE, FOR NOW ASSUMES INTS! FIX
-	case TokenType::EQ_OP: return llvmBuilder.CreateICmpEQ(l, r, "eqtmp"); // NOTE, FOR NOW ASSUMES INTS! FIX
-	case TokenType::NE_OP: return llvmBuilder.CreateICmpNE(l, r, "netmp"); // NOTE, FOR NOW ASSUMES INTS! FIX
+// Traps unless inBounds holds. The check is weighted as nearly always passing, which is also what lets
+// IRCE split loops so the checks are dropped from the iterations known to be in range.
+static void createBoundsCheck(llvm::Value* inBounds) {
+	auto* constant = llvm::dyn_cast<llvm::ConstantInt>(inBounds);
+	if (constant && constant->isOne()) {
+		return;
 	}
 
-	return LogErrorV("Binary expression failed, did not recognize binary op");
+	llvm::Function* function = llvmBuilder.GetInsertBlock()->getParent();
+	llvm::BasicBlock* failBlock = llvm::BasicBlock::Create(llvmContext, "outofbounds");
+	llvm::BasicBlock* continueBlock = llvm::BasicBlock::Create(llvmContext, "inbounds");
+	llvmBuilder.CreateCondBr(inBounds, continueBlock, failBlock, branchWeights(IfAST::Likelihood::Likely));
+
+	beginBlock(function, failBlock);
+	llvmBuilder.CreateCall(llvm::Intrinsic::getDeclaration(llvmModule.get(), llvm::Intrinsic::trap));
+	llvmBuilder.CreateUnreachable();
+
+	beginBlock(function, continueBlock);
 }
 
-llvm::Value* lang::parser::CallExprAST::codegen()
-{
-	llvm::Function* function = llvmModule->getFunction(callee);
-	if (function == nullptr) {
-		return LogErrorV("Couldn't find function in module");
+// Integer index widened to the 64-bit lengths. Negative indexes become huge and fail the unsigned bounds check.
+static llvm::Value* indexValue(ExprAST* index) {
+	llvm::Value* v = index->codegen();
+	if (v == nullptr) {
+		return nullptr;
 	}
 
-	if (function->arg_size() != args->arguments.size()) {
-		return LogErrorV("Argument list mismatch. Expected: %d, Given: %d");
+	return llvmBuilder.CreateIntCast(v, llvm::Type::getInt64Ty(llvmContext), lang::typechecker::isSignedInteger(index->resolvedType), "index");
+}
+
+// Returns v from the current function the way the calling convention passes its result.
+static llvm::Value* createReturn(llvm::Value* v) {
+	llvm::Function* function = llvmBuilder.GetInsertBlock()->getParent();
+	const lang::abi::PassInfo& result = loweredFunctions.at(function->getName().str()).abi.result;
+
+	switch (result.kind) {
+	case lang::abi::PassKind::Indirect:
+		llvmBuilder.CreateAlignedStore(v, function->getArg(0), llvm::Align(result.alignment));
+		return llvmBuilder.CreateRetVoid();
+	case lang::abi::PassKind::Coerced: {
+		llvm::AllocaInst* slot = createTemporary(result.type, result.alignment, "result");
+		llvmBuilder.CreateAlignedStore(v, slot, llvm::Align(result.alignment));
+		std::vector<llvm::Value*> parts = lang::abi::loadParts(llvmBuilder, slot, result);
+		if (parts.size() == 1) {
+			return llvmBuilder.CreateRet(parts[0]);
+		}
+
+		llvm::Value* pair = llvm::UndefValue::get(lang::abi::coercedResultType(llvmContext, result));
+		for (unsigned i = 0; i < parts.size(); i++) {
+			pair = llvmBuilder.CreateInsertValue(pair, parts[i], { i });
+		}
+		return llvmBuilder.CreateRet(pair);
+	}
+	default:
+		return llvmBuilder.CreateRet(v);
 	}
+}
 
-	std::vector<llvm::Value*> llvmArgs;
-	for (size_t i = 0; i < args->arguments.size(); i++) {
-		auto* a = args->arguments[i];
-		llvm::Value* arg = a->codegen();
-		if (arg == nullptr) {
-			LogError("Couldn't gen code for argument...");
+// Address of a field and the alignment it's known to have, fields of packed structs may be misaligned.
+static llvm::Value* fieldAddress(FieldExprAST* field, llvm::Align* outAlignment) {
+	const LocalVariable& local = llvmNamedValues.at(field->variable);
+	llvm::Value* address = local.address;
+	llvm::Align alignment(alignmentOf(field->structTypes[0], local.type));
+
+	for (size_t i = 0; i < field->fields.size(); i++) {
+		if (field->structTypes[i] == "string" || lang::typechecker::isSlice(field->structTypes[i])) {
+			auto* slice = llvm::cast<llvm::StructType>(llvmTypeFromName(field->structTypes[i]));
+			alignment = llvm::commonAlignment(alignment, llvmModule->getDataLayout().getStructLayout(slice)->getElementOffset(1));
+			address = llvmBuilder.CreateStructGEP(slice, address, 1, field->fields[i]);
+			continue;
 		}
 
-		llvmArgs.push_back(arg);
+		StructAST* strukt = knownStructs.at(field->structTypes[i]);
+		strukt->codegen();
+
+		auto& fields = strukt->fields;
+		auto it = std::find_if(fields.begin(), fields.end(), [&](const StructAST::Field& f) { return f.name == field->fields[i]; });
+		unsigned index = static_cast<unsigned>(it->elementIndex);
+
+		u64 offset = llvmModule->getDataLayout().getStructLayout(strukt->llvmType)->getElementOffset(index);
+		alignment = llvm::commonAlignment(alignment, offset);
+		address = llvmBuilder.CreateStructGEP(strukt->llvmType, address, index, field->fields[i]);
+	}
+
+	*outAlignment = alignment;
+	return address;
+}
+
+// Memory a reference argument can point at directly, nullptr if e doesn't name a variable or field.
+// Bool fields are bytes and not i1s, references to them get a copy (references are read only).
+static llvm::Value* addressOf(ExprAST* e) {
+	auto* variable = dynamic_cast<VariableExprAST*>(e);
+	if (variable && variable->isConstant == false && variable->isDeclaration() == false && variable->assignment == nullptr) {
+		return llvmNamedValues.at(variable->name).address;
 	}
 
-	if (function->getReturnType() == llvm::Type::getVoidTy(llvmContext)) {
-		return llvmBuilder.CreateCall(function, llvmArgs);
+	auto* field = dynamic_cast<FieldExprAST*>(e);
+	if (field && field->assignment == nullptr && field->resolvedType != "bool") {
+		llvm::Align alignment;
+		return fieldAddress(field, &alignment);
 	}
 
-	return llvmBuilder.CreateCall(function, llvmArgs, "calltmp");
+	return nullptr;
 }
 
-llvm::Function* lang::parser::FunctionSignatureAST::codegen()
-{
-	std::vector<llvm::Type*> params;
-	for (auto* t : args->arguments) {
-		
-		auto* v = static_cast<VariableExprAST*>(t);
-		if (v->type == "string") {
-			params.push_back(llvm::Type::getInt8PtrTy(llvmContext));
-		} else if (v->type == "f32") {
-			params.push_back(llvm::Type::getFloatTy(llvmContext));
-		} else if(v->type == "f64") {
-			params.push_back(llvm::Type::getDoubleTy(llvmContext));
+// Names of every struct and enum in tokens, collected before parsing so types can be used above their declaration.
+static void collectTypeNames(const std::vector<Token>& tokens) {
+	for (size_t i = 0; i + 1 < tokens.size(); i++) {
+		if (tokens[i + 1].type != TokenType::IDENTIFIER) {
+			continue;
+		}
+
+		if (tokens[i].type == TokenType::KEYWORD_STRUCT) {
+			p.structNames.push_back(std::string(tokens[i + 1].span.string));
 		}
-		else if (v->type == "i32") {
-			params.push_back(llvm::Type::getInt32Ty(llvmContext));
+		else if (tokens[i].type == TokenType::KEYWORD_ENUM) {
+			p.enumNames.push_back(std::string(tokens[i + 1].span.string));
 		}
-		else if (v->type == "i64") {
-			params.push_back(llvm::Type::getInt64Ty(llvmContext));
+	}
+}
+
+// Parses root nodes into p.astNodes until the tokens run out, optionally recording the token range of each node.
+// First token of a line that starts a declaration, e.g. fn or struct. Parsing goes on there after a syntax error.
+static bool isDeclarationStart(const Token& t) {
+	switch (t.type) {
+	case TokenType::KEYWORD_FUNC:
+	case TokenType::KEYWORD_STRUCT:
+	case TokenType::KEYWORD_ENUM:
+	case TokenType::KEYWORD_TRAIT:
+	case TokenType::KEYWORD_IMPL:
+	case TokenType::KEYWORD_EXTERN:
+	case TokenType::KEYWORD_EXPORT:
+	case TokenType::KEYWORD_COMPTIME:
+	case TokenType::KEYWORD_INLINE:
+	case TokenType::KEYWORD_NOINLINE:
+		return t.span.startsLine;
+	default:
+		return false;
+	}
+}
+
+static void parseTopLevel(std::vector<TopLevelNode>* outRanges, size_t tokenOffset) {
+	while (p.index < p.tokens.size()) {
+		if (p.current().type == TokenType::COMMENT || p.current().type == TokenType::SEMICOLON) {
+			p.eat(); // Here and not in expression(), a file can end in a comment
+			continue;
 		}
-		else if (knownStructTypes.contains(v->type)) {
-			params.push_back(knownStructTypes[v->type]);
+
+		size_t first = p.index;
+		size_t diagnosticsBefore = p.diagnostics.size();
+		lang::source::Offset offset = p.current().span.offset;
+		ExprAST* t = nullptr;
+		if (recoverFromErrors) {
+			try {
+				t = expression();
+			}
+			catch (SyntaxError& e) {
+				// Everything up to the next declaration after the error belongs to the broken one, it's parsed
+				// again as a whole once it's edited
+				p.diagnostics.push_back(e.diagnostic);
+				p.index = std::min(std::max(p.index, first + 1), p.tokens.size()); // It can be past the end after eating at it
+				while (p.index < p.tokens.size() && isDeclarationStart(p.current()) == false) {
+					p.eat();
+				}
+				p.scopeDepth = 0;
+				p.typeParameters.clear();
+			}
 		}
 		else {
-			LogErrorV("Couldn't determine type...");
+			t = expression();
 		}
 
-		//params.push_back(static_cast<VariableExprAST*>(t)->type);
-		//params.push_back(t->codegen()->getType()); // NOTE: Not sure if this is valid...?
-	}
+		if (t) {
+			t->offset = offset;
+			p.astNodes.push_back(t);
+		}
 
-	llvm::Type* returnType = nullptr;
-	if (returnList && returnList->arguments.size() > 0) {
-		assert(returnList->arguments.size() <= 1 && "argument lists only support 1 type at the moment");
-		returnType = llvm::Type::getInt32Ty(llvmContext);
-		//returnType = returnList->arguments[0]->codegen()->getType();
-	}
-	else {
-		returnType = llvm::Type::getVoidTy(llvmContext);
+		// Tokens that failed to parse get a node too, the language server's nodes cover every token
+		if (outRanges && (t || p.diagnostics.size() > diagnosticsBefore)) {
+			TopLevelNode range{ t, first + tokenOffset, p.index + tokenOffset };
+			range.diagnostics.assign(p.diagnostics.begin() + diagnosticsBefore, p.diagnostics.end());
+			outRanges->push_back(std::move(range));
+		}
 	}
+}
 
-	// TODO: REMOVE THIS << So functions returns their proper value type
-	//returnType = llvm::Type::getInt32Ty(llvmContext);
+std::vector<TopLevelNode> lang::parser::parseSyntax(const std::vector<Token>& tokens, size_t from, size_t to)
+{
+	p = ParserHelper{};
+	collectTypeNames(tokens); // All of them, the edited range can use types declared outside of it
+	p.tokens.assign(tokens.begin() + from, tokens.begin() + to);
+	p.endToken.span.offset = p.tokens.empty() ? 0 : p.tokens.back().span.end();
+	p.index = 0;
+	p.scopeDepth = 0;
 
-	llvm::FunctionType* ft = llvm::FunctionType::get(returnType, params, false);
-	llvm::Function* f = llvm::Function::Create(ft, llvm::GlobalValue::LinkageTypes::ExternalLinkage, name, llvmModule.get());
-	
-	size_t index = 0;
-	for (auto& arg : f->args()) {
-		arg.setName(static_cast<VariableExprAST*>(args->arguments[index])->name);
-		index++;
-	}
+	std::vector<TopLevelNode> ranges;
 
-	return f;
-}
+	recoverFromErrors = true;
+	parseTopLevel(&ranges, from);
+	recoverFromErrors = false;
 
-llvm::Value* createDefaultValueReturnNode(llvm::Type* type) {
-	if (type == llvm::Type::getVoidTy(llvmContext)) {
-		return llvmBuilder.CreateRetVoid();
+	for (auto& range : ranges) {
+		range.pool = p.pool;
 	}
 
-	llvm::Value* v = llvm::Constant::getNullValue(type);
-	return llvmBuilder.CreateRet(v);
-
+	// Nodes of a parse that produced no root node are freed right away
+	p = ParserHelper{};
+	return ranges;
 }
 
-llvm::Value* lang::parser::FunctionAST::codegen()
+std::vector<ExprAST*> lang::parser::parse(const std::vector<Token>& tokens)
 {
-	llvm::Function* f = llvmModule->getFunction(signature->name);
-	if (f == nullptr) {
-		f = signature->codegen();
-	}
+	llvmModule = std::make_unique<llvm::Module>("potatoscript", llvmContext);
 
-	if (f == nullptr) {
-		return LogErrorV("Couldn't generate function implementation");
+	// Reset state left behind by a previous parse, the compile server and language server parse many files per process.
+	p = ParserHelper{};
+	llvmNamedValues.clear();
+	loweredFunctions.clear();
+	knownStructTypes.clear();
+	knownStructs.clear();
+	knownEnums.clear();
+	llvmStringPool.clear();
+
+	if (targetMachine) {
+		llvmModule->setTargetTriple(targetMachine->getTargetTriple().str());
+		llvmModule->setDataLayout(targetMachine->createDataLayout());
 	}
 
-	llvmNamedValues.clear(); // Entering new scope, clear local variables list
-	
+	llvmDebugBuilder = nullptr;
+	llvmDebugTypes.clear();
+	if (debugInfo != lang::source::DebugInfo::None && sourceFile) {
+		llvmDebugBuilder = std::make_unique<llvm::DIBuilder>(*llvmModule);
 
-	if (signature->isExternal == false) {
-		llvm::BasicBlock* llvmBody = llvm::BasicBlock::Create(llvmContext, "entry", f);
-		llvmBuilder.SetInsertPoint(llvmBody);
+		llvm::SmallString<256> path(sourceFile->path);
+		llvm::sys::fs::make_absolute(path);
+		llvmDebugFile = llvmDebugBuilder->createFile(llvm::sys::path::filename(path), llvm::sys::path::parent_path(path));
 
-		// Add arguments
-		for (auto& arg : f->args()) {
-			llvmNamedValues.try_emplace(arg.getName().str(), &arg);
+		// There's no DWARF language code for potato, debuggers handle it best as C
+		auto kind = debugInfo == lang::source::DebugInfo::Full ? llvm::DICompileUnit::FullDebug : llvm::DICompileUnit::LineTablesOnly;
+		llvmDebugBuilder->createCompileUnit(llvm::dwarf::DW_LANG_C, llvmDebugFile, "potatoscript", false, "", 0, "", kind);
+
+		llvmModule->addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
+		if (llvm::Triple(llvmModule->getTargetTriple()).isOSWindows()) {
+			llvmModule->addModuleFlag(llvm::Module::Warning, "CodeView", 1);
+		}
+		else {
+			llvmModule->addModuleFlag(llvm::Module::Warning, "Dwarf Version", 4);
 		}
+	}
 
-		// Add local scope variables
-		//for (auto* v : body->body) {
-		//	auto* variable = dynamic_cast<VariableExprAST*>(v);
-		//	if (variable) {
-		//		llvmNamedValues.try_emplace(variable->name, variable->codegen()); // Not sure if this is valid...
-		//	}
+	// Locals are emitted as allocas, these turn them into SSA values
+	llvmFunctionPasses = std::make_unique<llvm::legacy::FunctionPassManager>(llvmModule.get());
+	llvmFunctionPasses->add(llvm::createSROAPass());
+	llvmFunctionPasses->add(llvm::createPromoteMemoryToRegisterPass());
+	llvmFunctionPasses->doInitialization();
+
+	p.tokens = std::move(tokens);
+	p.endToken.span.offset = p.tokens.empty() ? 0 : p.tokens.back().span.end();
+	p.index = 0;
+	p.scopeDepth = 0;
+
+	collectTypeNames(p.tokens);
+	parseTopLevel(nullptr, 0);
+	
+	// Structs can reference each other in any order, their bodies are filled in on demand
+	for (auto* n : p.astNodes) {
+		auto* strukt = dynamic_cast<StructAST*>(n);
+		if (strukt) {
+			knownStructs[strukt->name] = strukt;
+			strukt->llvmType = llvm::StructType::create(llvmContext, strukt->name);
+			knownStructTypes[strukt->name] = strukt->llvmType;
+		}
+
+		auto* enumeration = dynamic_cast<EnumAST*>(n);
+		if (enumeration) {
+			knownEnums[enumeration->name] = enumeration;
+		}
+	}
+
+	hasErrors = lang::typechecker::resolveTypes(p.astNodes, sourceFile) == false;
+	if (hasErrors) {
+		return std::move(p.astNodes);
+	}
+
+	lang::fold::foldConstants(p.astNodes);
+
+	// Index functions and structs first... 
+	for (auto* n : p.astNodes) {
+		auto* fn = dynamic_cast<FunctionAST*>(n);
+		if (fn) {
+			fn->declare();
+			continue;
+		}
+
+		auto* impl = dynamic_cast<ImplAST*>(n);
+		if (impl) {
+			for (auto* m : impl->methods) {
+				m->declare();
+			}
+			continue;
+		}
+
+		auto* strukt = dynamic_cast<StructAST*>(n);
+		if (strukt) {
+			strukt->codegen();
+			continue;
+		}
+	}
+
+	for (auto* n : p.astNodes) {
+		if (n == nullptr) { continue; }
+		n->codegen();
+	}
+
+	if (llvmDebugBuilder) {
+		llvmDebugBuilder->finalize();
+	}
+
+	return std::move(p.astNodes);
+}
+
+FunctionAST* lang::parser::instantiate(FunctionAST* generic, const std::vector<std::string>& typeArguments, const std::string& name)
+{
+	const auto& source = generic->templateTokens;
+
+	// fn, the instance's name, then everything after the type parameter list
+	std::vector<Token> tokens{ source[0], source[1] };
+	tokens[1].span.string = lang::lexer::intern(name);
+
+	size_t i = 2;
+	while (source[i].type != TokenType::RIGHT_ANGLE) {
+		i++;
+	}
+
+	for (i++; i < source.size(); i++) {
+		Token t = source[i];
+
+		// Type parameters become the type they're instantiated with, field names that happen to match stay
+		if (t.type == TokenType::IDENTIFIER && tokens.back().type != TokenType::DOT) {
+			for (size_t k = 0; k < generic->typeParameters.size(); k++) {
+				if (generic->typeParameters[k].name == t.span.string) {
+					t.type = lang::lexer::parse(typeArguments[k])[0].type;
+					t.span.string = lang::lexer::intern(typeArguments[k]);
+					break;
+				}
+			}
+		}
+
+		tokens.push_back(t);
+	}
+
+	ParserHelper outer = std::move(p);
+	p = ParserHelper{};
+	p.pool = outer.pool; // Instances live as long as the module they're generated for
+	p.tokens = std::move(tokens);
+	p.structNames = outer.structNames;
+	p.enumNames = outer.enumNames;
+	p.index = 0;
+	p.scopeDepth = 0;
+
+	auto* instance = static_cast<FunctionAST*>(expression());
+	instance->getSignature()->isInstance = true;
+	instance->offset = source[0].span.offset;
+
+	p = std::move(outer);
+
+	return instance;
+}
+
+bool lang::parser::hadErrors()
+{
+	return hasErrors;
+}
+
+void lang::parser::setTargetMachine(llvm::TargetMachine* machine)
+{
+	targetMachine = machine;
+}
+
+void lang::parser::setSourceFile(const lang::source::File* file)
+{
+	sourceFile = file;
+}
+
+void lang::parser::setDebugInfo(lang::source::DebugInfo level)
+{
+	debugInfo = level;
+}
+
+void lang::parser::setBoundsChecks(bool enabled)
+{
+	boundsChecks = enabled;
+}
+
+llvm::Module* lang::parser::currentModule()
+{
+	return llvmModule.get();
+}
+
+llvm::LLVMContext& lang::parser::currentContext()
+{
+	return llvmContext;
+}
+
+void lang::parser::setModule(std::unique_ptr<llvm::Module> module)
+{
+	llvmModule = std::move(module);
+}
+
+llvm::Value* lang::parser::NumberExprAST::codegen()
+{
+	// Literals are retyped by the type checker to whatever they're used as
+	if (lang::typechecker::isInteger(resolvedType)) {
+		u32 bits = lang::typechecker::bitWidth(resolvedType);
+		return llvm::ConstantInt::get(llvmContext, llvm::APInt(bits, static_cast<u64>(integerValue()), lang::typechecker::isSignedInteger(resolvedType)));
+	}
+
+	if (resolvedType == "f32") return llvm::ConstantFP::get(llvmContext, llvm::APFloat(static_cast<float>(floatValue())));
+	if (resolvedType == "f64") return llvm::ConstantFP::get(llvmContext, llvm::APFloat(floatValue()));
+
+	switch (type) {
+	case TokenType::FLOAT32: return llvm::ConstantFP::get(llvmContext, llvm::APFloat(value.float32Value));
+	case TokenType::FLOAT64: return llvm::ConstantFP::get(llvmContext, llvm::APFloat(value.float64Value));
+	case TokenType::INTEGER32: return llvm::ConstantInt::get(llvmContext, llvm::APInt(32, value.int32Value, true));
+	case TokenType::INTEGER64: return llvm::ConstantInt::get(llvmContext, llvm::APInt(64, value.int64Value, true));
+	// TODO: Add unsigned integers
+	}
+	
+	return LogErrorV("Value type not found");
+}
+
+// Identical strings share one global. The bytes stay NUL terminated so extern fns can take them as C strings.
+static llvm::Constant* internString(const std::string& stringValue) {
+	auto pooled = llvmStringPool.find(stringValue);
+	if (pooled != llvmStringPool.end()) {
+		return pooled->second;
+	}
+
+	llvm::Constant* bytes = llvm::ConstantDataArray::getString(llvmContext, stringValue, true);
+	auto* global = new llvm::GlobalVariable(*llvmModule, bytes->getType(), true, llvm::GlobalValue::PrivateLinkage, bytes, ".str");
+	global->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+	global->setAlignment(llvm::Align(1));
+
+	llvm::Constant* zero = llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext), 0);
+	llvm::Constant* data = llvm::ConstantExpr::getInBoundsGetElementPtr(bytes->getType(), global, llvm::ArrayRef<llvm::Constant*>{ zero, zero });
+	llvm::Constant* length = llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext), stringValue.size());
+	llvm::Constant* slice = llvm::ConstantStruct::get(llvmStringType(), { data, length });
+
+	llvmStringPool[stringValue] = slice;
+	return slice;
+}
+
+llvm::Value* lang::parser::ConstantStringExpr::codegen()
+{
+	return internString(stringValue);
+}
+
+// Generates the deferred statements of code blocks [firstScope, innermost], most recent first.
+static void generateDeferred(size_t firstScope) {
+	auto first = llvmDeferScopes.begin() + firstScope;
+	if (std::all_of(first, llvmDeferScopes.end(), [](const std::vector<DeferredStatement>& d) { return d.empty(); })) {
+		return;
+	}
+
+	// Copied, deferred code blocks push scopes of their own while they're generated
+	std::vector<std::vector<DeferredStatement>> scopes(first, llvmDeferScopes.end());
+	auto variables = llvmNamedValues;
+
+	for (auto scope = scopes.rbegin(); scope != scopes.rend(); scope++) {
+		for (auto it = scope->rbegin(); it != scope->rend(); it++) {
+			llvmNamedValues = it->variables;
+			it->statement->codegen();
+		}
+	}
+
+	llvmNamedValues = std::move(variables);
+}
+
+llvm::Value* lang::parser::ReturnAST::codegen()
+{
+	if (value == nullptr) {
+		generateDeferred(0);
+		return llvmBuilder.CreateRetVoid();
+	}
+
+	// The value is computed before deferred statements run, they can't change what's returned
+	auto* v = value->codegen();
+	if (v == nullptr) {
+		return LogErrorV("Couldn't gen code for return value");
+	}
+
+	generateDeferred(0);
+	return createReturn(v);
+}
+
+llvm::Value* lang::parser::DeferAST::codegen()
+{
+	// Nothing runs here, the statement is generated at the exits of the block
+	llvmDeferScopes.back().push_back(DeferredStatement{ statement, llvmNamedValues });
+	return nullptr;
+}
+
+llvm::Value* lang::parser::VariableExprAST::codegen()
+{
+	if (isConstant) {
+		if (type == "bool") {
+			return llvm::ConstantInt::get(llvmContext, llvm::APInt(1, std::stoi(name)));
+		}
+
+		// Constant struct
+
+		return LogErrorV("Couldn't determine constant type");
+	}
+	else if (isDeclaration()) {
+		llvm::Type* t = llvmTypeFromName(type);
+		llvm::Function* function = llvmBuilder.GetInsertBlock()->getParent();
+		llvm::AllocaInst* alloca = createEntryBlockAlloca(function, name, type, t);
+
+		// Locals without initializer start out zeroed
+		llvm::Value* v = assignment ? assignment->codegen() : llvm::Constant::getNullValue(t);
+		if (v == nullptr) {
+			return LogErrorV("Couldn't gen code for initializer");
+		}
+
+		llvmBuilder.CreateStore(v, alloca);
+		llvmNamedValues[name] = LocalVariable{ alloca, t };
+		declareDebugVariable(name, type, alloca, 0);
+		return v;
+	}
+	else {
+		const LocalVariable& local = llvmNamedValues.at(name);
+
+		if (assignment) {
+			llvm::Value* v = assignment->codegen();
+			if (v == nullptr) {
+				return LogErrorV("Couldn't gen code for assignment");
+			}
+
+			llvmBuilder.CreateStore(v, local.address);
+			return v;
+		}
+
+		return llvmBuilder.CreateLoad(local.type, local.address, name);
+	}
+}
+
+llvm::Value* lang::parser::TupleExprAST::codegen()
+{
+	llvm::Value* tuple = llvm::UndefValue::get(llvmTypeFromName(resolvedType));
+	for (unsigned i = 0; i < elements.size(); i++) {
+		llvm::Value* v = elements[i]->codegen();
+		if (v == nullptr) {
+			return LogErrorV("Couldn't gen code for tuple element");
+		}
+
+		tuple = llvmBuilder.CreateInsertValue(tuple, v, { i });
+	}
+
+	return tuple;
+}
+
+llvm::Value* lang::parser::ArrayExprAST::codegen()
+{
+	llvm::Value* array = llvm::UndefValue::get(llvmTypeFromName(resolvedType));
+	for (unsigned i = 0; i < elements.size(); i++) {
+		llvm::Value* v = elements[i]->codegen();
+		if (v == nullptr) {
+			return LogErrorV("Couldn't gen code for array element");
+		}
+
+		array = llvmBuilder.CreateInsertValue(array, v, { i });
+	}
+
+	return array;
+}
+
+llvm::Value* lang::parser::IndexExprAST::codegen()
+{
+	using namespace lang::typechecker;
+
+	// Arrays are indexed in place, slices and strings through their data pointer
+	const LocalVariable& local = llvmNamedValues.at(variable);
+	llvm::Value* data = nullptr;
+	llvm::Value* length = nullptr;
+	if (isArray(baseType)) {
+		data = llvmBuilder.CreateConstInBoundsGEP2_64(local.type, local.address, 0, 0, "data");
+		length = llvmBuilder.getInt64(arrayLength(baseType));
+	}
+	else {
+		llvm::Value* slice = llvmBuilder.CreateLoad(local.type, local.address, variable);
+		data = llvmBuilder.CreateExtractValue(slice, 0, "data");
+		length = llvmBuilder.CreateExtractValue(slice, 1, "len");
+	}
+
+	llvm::Value* first = indexValue(index);
+	if (first == nullptr) {
+		return LogErrorV("Couldn't gen code for index");
+	}
+
+	llvm::Type* elementType = llvmTypeFromName(indexedType(baseType));
+	bool needsCheck = isChecked && boundsChecks;
+
+	if (end) {
+		llvm::Value* last = indexValue(end);
+		if (last == nullptr) {
+			return LogErrorV("Couldn't gen code for end of slice");
+		}
+
+		if (needsCheck) {
+			createBoundsCheck(llvmBuilder.CreateAnd(llvmBuilder.CreateICmpULE(first, last), llvmBuilder.CreateICmpULE(last, length), "inbounds"));
+		}
+
+		llvm::Value* slice = llvm::UndefValue::get(llvmTypeFromName(resolvedType));
+		slice = llvmBuilder.CreateInsertValue(slice, llvmBuilder.CreateInBoundsGEP(elementType, data, first, "data"), { 0 });
+		return llvmBuilder.CreateInsertValue(slice, llvmBuilder.CreateSub(last, first, "len"), { 1 }, "slice");
+	}
+
+	if (needsCheck) {
+		createBoundsCheck(llvmBuilder.CreateICmpULT(first, length, "inbounds"));
+	}
+
+	llvm::Value* address = llvmBuilder.CreateInBoundsGEP(elementType, data, first, "element");
+	if (assignment) {
+		llvm::Value* v = assignment->codegen();
+		if (v == nullptr) {
+			return LogErrorV("Couldn't gen code for element assignment");
+		}
+
+		llvmBuilder.CreateStore(v, address);
+		return v;
+	}
+
+	return llvmBuilder.CreateLoad(elementType, address, variable + "[]");
+}
+
+llvm::Value* lang::parser::DestructureAST::codegen()
+{
+	llvm::Value* tuple = value->codegen();
+	if (tuple == nullptr) {
+		return LogErrorV("Couldn't gen code for destructured value");
+	}
+
+	llvm::Function* function = llvmBuilder.GetInsertBlock()->getParent();
+	for (unsigned i = 0; i < names.size(); i++) {
+		if (names[i] == "_") {
+			continue;
+		}
+
+		llvm::Value* v = llvmBuilder.CreateExtractValue(tuple, { i }, names[i]);
+		if (isDeclaration) {
+			llvm::Type* type = llvmTypeFromName(types[i]);
+			llvm::AllocaInst* alloca = createEntryBlockAlloca(function, names[i], types[i], type);
+			llvmBuilder.CreateStore(v, alloca);
+			llvmNamedValues[names[i]] = LocalVariable{ alloca, type };
+			declareDebugVariable(names[i], types[i], alloca, 0);
+		}
+		else {
+			llvmBuilder.CreateStore(v, llvmNamedValues.at(names[i]).address);
+		}
+	}
+
+	return tuple;
+}
+
+llvm::Value* lang::parser::FieldExprAST::codegen()
+{
+	if (constantValue) {
+		return constantValue->codegen();
+	}
+
+	llvm::Align alignment;
+	llvm::Value* address = fieldAddress(this, &alignment);
+
+	if (assignment) {
+		llvm::Value* v = assignment->codegen();
+		if (v == nullptr) {
+			return LogErrorV("Couldn't gen code for field assignment");
+		}
+
+		llvm::Value* stored = resolvedType == "bool" ? llvmBuilder.CreateZExt(v, llvmBuilder.getInt8Ty()) : v;
+		llvmBuilder.CreateAlignedStore(stored, address, alignment);
+		return v;
+	}
+
+	if (resolvedType == "bool") {
+		llvm::Value* byte = llvmBuilder.CreateAlignedLoad(llvmBuilder.getInt8Ty(), address, alignment, fields.back());
+		return llvmBuilder.CreateTrunc(byte, llvmBuilder.getInt1Ty(), fields.back());
+	}
+
+	return llvmBuilder.CreateAlignedLoad(llvmTypeFromName(resolvedType), address, alignment, fields.back());
+}
+
+llvm::Value* lang::parser::ArgumentListAST::codegen()
+{
+	return LogErrorV("Not imlemented");
+
+	//for (auto* t : arguments) {
+	//	llvmNamedValues[t->name] = t->codegen();
+	//}
+
+}
+
+// Equal lengths first, the bytes are only compared when those match.
+static llvm::Value* stringsEqual(llvm::Value* l, llvm::Value* r) {
+	llvm::Value* length = llvmBuilder.CreateExtractValue(l, 1, "len");
+	llvm::Value* sameLength = llvmBuilder.CreateICmpEQ(length, llvmBuilder.CreateExtractValue(r, 1, "len"), "samelen");
+
+	llvm::Function* function = llvmBuilder.GetInsertBlock()->getParent();
+	llvm::BasicBlock* lengthBlock = llvmBuilder.GetInsertBlock();
+	llvm::BasicBlock* compareBlock = llvm::BasicBlock::Create(llvmContext, "strcompare");
+	llvm::BasicBlock* endBlock = llvm::BasicBlock::Create(llvmContext, "strequal");
+	llvmBuilder.CreateCondBr(sameLength, compareBlock, endBlock);
+
+	beginBlock(function, compareBlock);
+	llvm::Type* bytePointer = llvm::Type::getInt8PtrTy(llvmContext);
+	llvm::FunctionCallee memcmp = llvmModule->getOrInsertFunction("memcmp", llvm::Type::getInt32Ty(llvmContext), bytePointer, bytePointer, length->getType());
+	llvm::Value* difference = llvmBuilder.CreateCall(memcmp, { llvmBuilder.CreateExtractValue(l, 0), llvmBuilder.CreateExtractValue(r, 0), length }, "memcmp");
+	llvm::Value* sameBytes = llvmBuilder.CreateICmpEQ(difference, llvmBuilder.getInt32(0), "samebytes");
+	llvmBuilder.CreateBr(endBlock);
+
+	beginBlock(function, endBlock);
+	llvm::PHINode* equal = llvmBuilder.CreatePHI(llvmBuilder.getInt1Ty(), 2, "eqtmp");
+	equal->addIncoming(llvmBuilder.getFalse(), lengthBlock);
+	equal->addIncoming(sameBytes, compareBlock);
+	return equal;
+}
+
+llvm::Value* lang::parser::BinaryExprAST::codegen()
+{
+	llvm::Value* l = left->codegen();
+	llvm::Value* r = right->codegen();
+	if (!l || !r)
+	{
+		return LogErrorV("Binary expression failed, couldn't find left and/or righgt");
+	}
+
+	if (left->resolvedType == "string") {
+		llvm::Value* equal = stringsEqual(l, r);
+		return type == TokenType::NE_OP ? llvmBuilder.CreateNot(equal, "netmp") : equal;
+	}
+
+	// Both operands have the same type after type checking, vectors use the same instructions lane-wise
+	const std::string operandType = lang::typechecker::elementType(left->resolvedType);
+
+	if (lang::typechecker::isFloat(operandType)) {
+		switch (type) {
+		case TokenType::PLUS: return llvmBuilder.CreateFAdd(l, r, "addtmp");
+		case TokenType::MINUS: return isNegation ? llvmBuilder.CreateFNeg(r, "negtmp") : llvmBuilder.CreateFSub(l, r, "subtmp");
+		case TokenType::STAR: return llvmBuilder.CreateFMul(l, r, "multmp");
+		case TokenType::SLASH: return llvmBuilder.CreateFDiv(l, r, "divtmp");
+		case TokenType::PERCENT: return llvmBuilder.CreateFRem(l, r, "remtmp");
+		case TokenType::LEFT_ANGLE: return llvmBuilder.CreateFCmpOLT(l, r, "lttmp");
+		case TokenType::RIGHT_ANGLE: return llvmBuilder.CreateFCmpOGT(l, r, "gttmp");
+		case TokenType::LE_OP: return llvmBuilder.CreateFCmpOLE(l, r, "letmp");
+		case TokenType::GE_OP: return llvmBuilder.CreateFCmpOGE(l, r, "getmp");
+		case TokenType::EQ_OP: return llvmBuilder.CreateFCmpOEQ(l, r, "eqtmp");
+		case TokenType::NE_OP: return llvmBuilder.CreateFCmpUNE(l, r, "netmp");
+		default:
+			return LogErrorV("Binary expression failed, operator not supported on floats");
+		}
+	}
+
+	bool isSigned = lang::typechecker::isSignedInteger(operandType);
+
+	switch (type) {
+	case TokenType::PLUS: return llvmBuilder.CreateAdd(l, r, "addtmp", false, isStep && isSigned);
+	case TokenType::MINUS: return llvmBuilder.CreateSub(l, r, "subtmp", false, isStep && isSigned);
+	case TokenType::STAR: return llvmBuilder.CreateMul(l, r, "multmp");
+	case TokenType::SLASH: return isSigned ? llvmBuilder.CreateSDiv(l, r, "divtmp") : llvmBuilder.CreateUDiv(l, r, "divtmp");
+	case TokenType::PERCENT: return isSigned ? llvmBuilder.CreateSRem(l, r, "remtmp") : llvmBuilder.CreateURem(l, r, "remtmp");
+	case TokenType::AMPERSAND:
+	case TokenType::AND_OP: return llvmBuilder.CreateAnd(l, r, "andtmp");
+	case TokenType::VERTICAL_BAR:
+	case TokenType::OR_OP: return llvmBuilder.CreateOr(l, r, "ortmp");
+	case TokenType::CARET:
+	case TokenType::XOR_OP: return llvmBuilder.CreateXor(l, r, "xortmp");
+	case TokenType::DEREFERENCE_OR_SHIFT: return llvmBuilder.CreateShl(l, r, "shltmp");
+	case TokenType::RIGHT_SHIFT: return isSigned ? llvmBuilder.CreateAShr(l, r, "shrtmp") : llvmBuilder.CreateLShr(l, r, "shrtmp");
+	case TokenType::LEFT_ANGLE: return isSigned ? llvmBuilder.CreateICmpSLT(l, r, "lttmp") : llvmBuilder.CreateICmpULT(l, r, "lttmp");
+	case TokenType::RIGHT_ANGLE: return isSigned ? llvmBuilder.CreateICmpSGT(l, r, "gttmp") : llvmBuilder.CreateICmpUGT(l, r, "gttmp");
+	case TokenType::LE_OP: return isSigned ? llvmBuilder.CreateICmpSLE(l, r, "letmp") : llvmBuilder.CreateICmpULE(l, r, "letmp");
+	case TokenType::GE_OP: return isSigned ? llvmBuilder.CreateICmpSGE(l, r, "getmp") : llvmBuilder.CreateICmpUGE(l, r, "getmp");
+	case TokenType::EQ_OP: return llvmBuilder.CreateICmpEQ(l, r, "eqtmp");
+	case TokenType::NE_OP: return llvmBuilder.CreateICmpNE(l, r, "netmp");
+	default:
+		break;
+	}
+
+	return LogErrorV("Binary expression failed, did not recognize binary op");
+}
+
+llvm::Value* lang::parser::CastExprAST::codegen()
+{
+	using namespace lang::typechecker;
+
+	// Array to slice, the slice points at the array itself. Arrays without an address are copied to the stack first.
+	if (isSlice(resolvedType) && isArray(value->resolvedType)) {
+		llvm::Type* arrayType = llvmTypeFromName(value->resolvedType);
+		llvm::Value* address = addressOf(value);
+		if (address == nullptr) {
+			llvm::Value* array = value->codegen();
+			if (array == nullptr) {
+				return nullptr;
+			}
+
+			address = createTemporary(arrayType, alignmentOf(value->resolvedType, arrayType), "array");
+			llvmBuilder.CreateStore(array, address);
+		}
+
+		llvm::Value* slice = llvm::UndefValue::get(llvmTypeFromName(resolvedType));
+		slice = llvmBuilder.CreateInsertValue(slice, llvmBuilder.CreateConstInBoundsGEP2_64(arrayType, address, 0, 0, "data"), { 0 });
+		return llvmBuilder.CreateInsertValue(slice, llvmBuilder.getInt64(arrayLength(value->resolvedType)), { 1 }, "slice");
+	}
+
+	llvm::Value* v = value->codegen();
+	if (v == nullptr) {
+		return nullptr;
+	}
+
+	llvm::Type* toType = llvmTypeFromName(resolvedType);
+
+	// Scalar to vector, the type checker already converted it to the lane type
+	if (isVector(resolvedType) && isVector(value->resolvedType) == false) {
+		return llvmBuilder.CreateVectorSplat(vectorLength(resolvedType), v, "splat");
+	}
+
+	// Lane-wise conversions use the same instructions as their scalar counterparts, enums convert as their underlying type
+	auto enumeration = knownEnums.find(value->resolvedType);
+	const std::string from = enumeration != knownEnums.end() ? enumeration->second->underlyingType : elementType(value->resolvedType);
+	const std::string to = elementType(resolvedType);
+
+	if ((isInteger(from) || from == "bool") && isInteger(to)) {
+		// bool is unsigned, true becomes 1 rather than -1
+		return llvmBuilder.CreateIntCast(v, toType, isSignedInteger(from), "casttmp");
+	}
+
+	if ((isInteger(from) || from == "bool") && isFloat(to)) {
+		return isSignedInteger(from) ? llvmBuilder.CreateSIToFP(v, toType, "casttmp") : llvmBuilder.CreateUIToFP(v, toType, "casttmp");
+	}
+
+	if (isFloat(from) && isInteger(to)) {
+		return isSignedInteger(to) ? llvmBuilder.CreateFPToSI(v, toType, "casttmp") : llvmBuilder.CreateFPToUI(v, toType, "casttmp");
+	}
+
+	if (isFloat(from) && isFloat(to)) {
+		return llvmBuilder.CreateFPCast(v, toType, "casttmp");
+	}
+
+	return LogErrorV("Unsupported cast");
+}
+
+// Strings are literals or slices of them, so the byte after one can always be read and is a NUL unless the
+// string was cut short. Those, and zeroed strings without data, are copied: short ones into a buffer on the
+// stack that every call reuses, longer ones to the heap.
+static const u64 cStringBufferSize = 256;
+
+struct CString {
+	llvm::Value* data;
+	llvm::Value* heapCopy; // To free after the call, null when there is none
+	llvm::AllocaInst* buffer; // Its lifetime ends after the call, so calls can share their stack slots
+};
+
+static CString cString(llvm::Value* string) {
+	llvm::Function* function = llvmBuilder.GetInsertBlock()->getParent();
+	llvm::Value* data = llvmBuilder.CreateExtractValue(string, 0, "data");
+	llvm::Value* length = llvmBuilder.CreateExtractValue(string, 1, "len");
+
+	auto* check = llvm::BasicBlock::Create(llvmContext, "cstr.check", function);
+	auto* copy = llvm::BasicBlock::Create(llvmContext, "cstr.copy", function);
+	auto* copySmall = llvm::BasicBlock::Create(llvmContext, "cstr.small", function);
+	auto* copyLarge = llvm::BasicBlock::Create(llvmContext, "cstr.large", function);
+	auto* done = llvm::BasicBlock::Create(llvmContext, "cstr.done", function);
+	llvm::MDNode* likely = llvm::MDBuilder(llvmContext).createBranchWeights(2000, 1);
+
+	llvmBuilder.CreateCondBr(llvmBuilder.CreateIsNull(data), copy, check);
+
+	llvmBuilder.SetInsertPoint(check);
+	llvm::Value* after = llvmBuilder.CreateLoad(llvmBuilder.getInt8Ty(), llvmBuilder.CreateInBoundsGEP(llvmBuilder.getInt8Ty(), data, length));
+	llvmBuilder.CreateCondBr(llvmBuilder.CreateICmpEQ(after, llvmBuilder.getInt8(0)), done, copy, likely);
+
+	llvmBuilder.SetInsertPoint(copy);
+	llvmBuilder.CreateCondBr(llvmBuilder.CreateICmpULT(length, llvmBuilder.getInt64(cStringBufferSize)), copySmall, copyLarge, likely);
+
+	llvmBuilder.SetInsertPoint(copySmall);
+	llvm::AllocaInst* slot = createTemporary(llvm::ArrayType::get(llvmBuilder.getInt8Ty(), cStringBufferSize), 1, "cstr.buffer");
+	llvmBuilder.CreateLifetimeStart(slot, llvmBuilder.getInt64(cStringBufferSize));
+	llvm::Value* buffer = llvmBuilder.CreateBitCast(slot, llvmBuilder.getInt8PtrTy());
+	llvmBuilder.CreateMemCpy(buffer, llvm::MaybeAlign(1), data, llvm::MaybeAlign(1), length);
+	llvmBuilder.CreateStore(llvmBuilder.getInt8(0), llvmBuilder.CreateInBoundsGEP(llvmBuilder.getInt8Ty(), buffer, length));
+	llvmBuilder.CreateBr(done);
+
+	// Alloc zeroes the memory, so the copy is NUL terminated already
+	llvmBuilder.SetInsertPoint(copyLarge);
+	llvm::Value* heap = llvmBuilder.CreateCall(lang::runtime::memoryFunction(*llvmModule, lang::runtime::MemoryFunction::Alloc),
+		{ llvmBuilder.CreateAdd(length, llvmBuilder.getInt64(1)), llvmBuilder.getInt64(1) }, "cstr.heap");
+	llvmBuilder.CreateMemCpy(heap, llvm::MaybeAlign(1), data, llvm::MaybeAlign(1), length);
+	llvmBuilder.CreateBr(done);
+
+	llvmBuilder.SetInsertPoint(done);
+	llvm::Value* none = llvm::ConstantPointerNull::get(llvmBuilder.getInt8PtrTy());
+	llvm::PHINode* result = llvmBuilder.CreatePHI(llvmBuilder.getInt8PtrTy(), 3, "cstr");
+	result->addIncoming(data, check);
+	result->addIncoming(buffer, copySmall);
+	result->addIncoming(heap, copyLarge);
+	llvm::PHINode* heapResult = llvmBuilder.CreatePHI(llvmBuilder.getInt8PtrTy(), 3, "cstr.free");
+	heapResult->addIncoming(none, check);
+	heapResult->addIncoming(none, copySmall);
+	heapResult->addIncoming(heap, copyLarge);
+	return { result, heapResult, slot };
+}
+
+llvm::Value* lang::parser::CallExprAST::codegen()
+{
+	// Struct constructor, fields are inserted at their (possibly reordered) element index
+	auto strukt = knownStructs.find(callee);
+	if (strukt != knownStructs.end()) {
+		strukt->second->codegen();
+
+		llvm::Value* v = llvm::UndefValue::get(strukt->second->llvmType);
+		for (size_t i = 0; i < args->arguments.size(); i++) {
+			llvm::Value* field = args->arguments[i]->codegen();
+			if (field == nullptr) {
+				return LogErrorV("Couldn't gen code for struct field");
+			}
+
+			if (strukt->second->fields[i].type == "bool") {
+				field = llvmBuilder.CreateZExt(field, llvmBuilder.getInt8Ty());
+			}
+
+			unsigned index = static_cast<unsigned>(strukt->second->fields[i].elementIndex);
+			v = llvmBuilder.CreateInsertValue(v, field, { index });
+		}
+
+		return v;
+	}
+
+	if (comptimeValue) {
+		return comptimeValue->codegen();
+	}
+
+	if (lang::typechecker::isNumeric(callee)) {
+		return args->arguments[0]->codegen(); // Conversion, the type checker made the argument a cast
+	}
+
+	if (lang::typechecker::isVector(callee)) {
+		if (args->arguments.size() == 1) {
+			llvm::Value* v = args->arguments[0]->codegen();
+			return v ? llvmBuilder.CreateVectorSplat(lang::typechecker::vectorLength(callee), v, "splat") : nullptr;
+		}
+
+		llvm::Value* v = llvm::UndefValue::get(llvmTypeFromName(callee));
+		for (size_t i = 0; i < args->arguments.size(); i++) {
+			llvm::Value* lane = args->arguments[i]->codegen();
+			if (lane == nullptr) {
+				return LogErrorV("Couldn't gen code for vector lane");
+			}
+
+			v = llvmBuilder.CreateInsertElement(v, lane, llvmBuilder.getInt32(static_cast<u32>(i)));
+		}
+
+		return v;
+	}
+
+	if (isBuiltin) {
+		if (callee == "print" || callee == "println" || callee == "flush") {
+			return codegenFormatBuiltin();
+		}
+		if (callee == "alloc" || callee == "free" || callee == "reset" || callee == "release" || callee == "temp_alloc" || callee == "temp_reset"
+			|| callee == "heap_allocator" || callee == "arena_allocator") {
+			return codegenMemoryBuiltin();
+		}
+		return codegenVectorBuiltin();
+	}
+
+	llvm::Function* function = llvmModule->getFunction(callee);
+	if (function == nullptr) {
+		return LogErrorV("Couldn't find function in module");
+	}
+
+	const LoweredFunction& lowered = loweredFunctions.at(callee);
+	const lang::abi::FunctionInfo& abi = lowered.abi;
+	if (abi.arguments.size() != args->arguments.size()) {
+		return LogErrorV("Argument list mismatch. Expected: %d, Given: %d");
+	}
+
+	std::vector<llvm::Value*> llvmArgs;
+	std::vector<CString> cStrings; // Copies of strings passed to an extern fn, cleaned up after the call
+	llvm::AllocaInst* resultSlot = nullptr;
+	if (abi.result.kind == lang::abi::PassKind::Indirect) {
+		resultSlot = createTemporary(abi.result.type, abi.result.alignment, "result");
+		llvmArgs.push_back(resultSlot);
+	}
+
+	for (size_t i = 0; i < args->arguments.size(); i++) {
+		auto* a = args->arguments[i];
+		auto* parameter = static_cast<VariableExprAST*>(lowered.signature->args->arguments[i]);
+		const lang::abi::PassInfo& pass = abi.arguments[i];
+
+		// Variables and fields are passed by address, anything else is materialized first
+		if (lang::typechecker::isReference(parameter->type)) {
+			llvm::Value* address = addressOf(a);
+			if (address == nullptr) {
+				llvm::Value* v = a->codegen();
+				if (v == nullptr) {
+					return LogErrorV("Couldn't gen code for argument...");
+				}
+
+				address = createTemporary(v->getType(), alignmentOf(a->resolvedType, v->getType()), "ref");
+				llvmBuilder.CreateStore(v, address);
+			}
+
+			llvmArgs.push_back(address);
+			continue;
+		}
+
+		llvm::Value* arg = a->codegen();
+		if (arg == nullptr) {
+			return LogErrorV("Couldn't gen code for argument...");
+		}
+
+		// Literals end in a NUL, other strings are checked for one, see cString
+		if (lowered.signature->isExternal && parameter->type == "string") {
+			if (dynamic_cast<ConstantStringExpr*>(a)) {
+				arg = llvmBuilder.CreateExtractValue(arg, 0, "cstr");
+			}
+			else {
+				cStrings.push_back(cString(arg));
+				arg = cStrings.back().data;
+			}
+		}
+
+		if (pass.kind == lang::abi::PassKind::Direct) {
+			llvmArgs.push_back(arg);
+			continue;
+		}
+
+		llvm::AllocaInst* copy = createTemporary(pass.type, pass.alignment, "arg");
+		llvmBuilder.CreateAlignedStore(arg, copy, llvm::Align(pass.alignment));
+		if (pass.kind == lang::abi::PassKind::Indirect) {
+			llvmArgs.push_back(copy);
+		}
+		else {
+			for (auto* part : lang::abi::loadParts(llvmBuilder, copy, pass)) {
+				llvmArgs.push_back(part);
+			}
+		}
+	}
+
+	llvm::CallInst* call = function->getReturnType()->isVoidTy() ? llvmBuilder.CreateCall(function, llvmArgs) : llvmBuilder.CreateCall(function, llvmArgs, "calltmp");
+	call->setAttributes(function->getAttributes());
+
+	for (auto& s : cStrings) {
+		llvmBuilder.CreateLifetimeEnd(s.buffer, llvmBuilder.getInt64(cStringBufferSize));
+		llvmBuilder.CreateCall(lang::runtime::memoryFunction(*llvmModule, lang::runtime::MemoryFunction::Free), { s.heapCopy });
+	}
+
+	switch (abi.result.kind) {
+	case lang::abi::PassKind::Indirect:
+		return llvmBuilder.CreateAlignedLoad(abi.result.type, resultSlot, llvm::Align(abi.result.alignment), "result");
+	case lang::abi::PassKind::Coerced: {
+		std::vector<llvm::Value*> parts;
+		if (abi.result.parts.size() == 1) {
+			parts.push_back(call);
+		}
+		else {
+			for (unsigned i = 0; i < abi.result.parts.size(); i++) {
+				parts.push_back(llvmBuilder.CreateExtractValue(call, { i }));
+			}
+		}
+
+		llvm::AllocaInst* slot = createTemporary(abi.result.type, abi.result.alignment, "result");
+		lang::abi::storeParts(llvmBuilder, slot, abi.result, parts);
+		return llvmBuilder.CreateAlignedLoad(abi.result.type, slot, llvm::Align(abi.result.alignment), "result");
+	}
+	default:
+		return call;
+	}
+}
+
+// Each piece of the format and each value is a call into the core.fmt runtime, numbers skip the format parsing of printf
+llvm::Value* lang::parser::CallExprAST::codegenFormatBuiltin()
+{
+	using lang::runtime::FormatFunction;
+
+	if (callee == "flush") {
+		return llvmBuilder.CreateCall(lang::runtime::formatFunction(*llvmModule, FormatFunction::Flush));
+	}
+
+	llvm::Function* write = lang::runtime::formatFunction(*llvmModule, FormatFunction::Write);
+	auto writeString = [&](llvm::Value* s) {
+		return llvmBuilder.CreateCall(write, { llvmBuilder.CreateExtractValue(s, 0), llvmBuilder.CreateExtractValue(s, 1) });
+	};
+
+	// Arguments are evaluated before anything is written, so output from a call in them comes first like with printf
+	std::vector<llvm::Value*> values;
+	for (size_t i = 1; i < formatPieces.size(); i++) {
+		llvm::Value* v = args->arguments[i]->codegen();
+		if (v == nullptr) {
+			return LogErrorV("Couldn't gen code for argument...");
+		}
+		values.push_back(v);
+	}
+
+	llvm::Value* result = nullptr;
+	for (size_t i = 0; i < formatPieces.size(); i++) {
+		if (formatPieces[i].empty() == false) {
+			result = writeString(internString(formatPieces[i]));
+		}
+
+		if (i + 1 == formatPieces.size()) {
+			break;
+		}
+
+		llvm::Value* v = values[i];
+		const std::string& type = args->arguments[i + 1]->resolvedType;
+		if (type == "string") {
+			result = writeString(v);
+		}
+		else if (type == "bool") {
+			result = writeString(llvmBuilder.CreateSelect(v, internString("true"), internString("false")));
+		}
+		else if (type == "f32" || type == "f64") {
+			llvm::Value* number = llvmBuilder.CreateFPCast(v, llvmBuilder.getDoubleTy());
+			result = llvmBuilder.CreateCall(lang::runtime::formatFunction(*llvmModule, FormatFunction::Float), { number });
+		}
+		else {
+			bool isSigned = lang::typechecker::isSignedInteger(type);
+			llvm::Value* number = llvmBuilder.CreateIntCast(v, llvmBuilder.getInt64Ty(), isSigned);
+			result = llvmBuilder.CreateCall(lang::runtime::formatFunction(*llvmModule, isSigned ? FormatFunction::Signed : FormatFunction::Unsigned), { number });
+		}
+	}
+
+	return result;
+}
+
+// Allocation goes through the runtime, arenas are passed by address so the runtime can bump them in place.
+// Allocators call their hooks indirectly, with self as the first argument.
+llvm::Value* lang::parser::CallExprAST::codegenMemoryBuiltin()
+{
+	using lang::runtime::MemoryFunction;
+
+	auto& arguments = args->arguments;
+	auto call = [&](MemoryFunction function, std::vector<llvm::Value*> values) {
+		return llvmBuilder.CreateCall(lang::runtime::memoryFunction(*llvmModule, function), values);
+	};
+	auto makeAllocator = [&](llvm::Value* self, MemoryFunction allocHook, MemoryFunction freeHook) {
+		llvm::Value* allocator = llvm::UndefValue::get(lang::runtime::allocatorType(llvmContext));
+		allocator = llvmBuilder.CreateInsertValue(allocator, self, 0);
+		allocator = llvmBuilder.CreateInsertValue(allocator, lang::runtime::memoryFunction(*llvmModule, allocHook), 1);
+		return llvmBuilder.CreateInsertValue(allocator, lang::runtime::memoryFunction(*llvmModule, freeHook), 2, "allocator");
+	};
+
+	if (callee == "temp_reset") {
+		return call(MemoryFunction::ArenaReset, { lang::runtime::threadArena(*llvmModule) });
+	}
+
+	if (callee == "heap_allocator") {
+		return makeAllocator(llvm::ConstantPointerNull::get(llvmBuilder.getInt8PtrTy()), MemoryFunction::HeapAllocHook, MemoryFunction::HeapFreeHook);
+	}
+
+	llvm::Value* allocator = nullptr;
+	if (arguments.size() == 2 && arguments[0]->resolvedType == "Allocator") {
+		allocator = arguments[0]->codegen();
+		if (allocator == nullptr) {
+			return LogErrorV("Couldn't gen code for argument...");
+		}
+	}
+
+	if (callee == "free") {
+		llvm::Value* slice = arguments.back()->codegen();
+		if (slice == nullptr) {
+			return LogErrorV("Couldn't gen code for argument...");
+		}
+		llvm::Value* memory = llvmBuilder.CreateBitCast(llvmBuilder.CreateExtractValue(slice, 0), llvmBuilder.getInt8PtrTy());
+		if (allocator) {
+			llvm::FunctionType* hookType = lang::runtime::memoryFunction(*llvmModule, MemoryFunction::HeapFreeHook)->getFunctionType();
+			return llvmBuilder.CreateCall(hookType, llvmBuilder.CreateExtractValue(allocator, 2), { llvmBuilder.CreateExtractValue(allocator, 0), memory });
+		}
+		return call(MemoryFunction::Free, { memory });
+	}
+
+	llvm::Value* arena = nullptr;
+	if (callee == "temp_alloc") {
+		arena = lang::runtime::threadArena(*llvmModule);
+	}
+	else if (callee == "reset" || callee == "release" || callee == "arena_allocator" || (arguments.size() == 2 && allocator == nullptr)) {
+		arena = addressOf(arguments[0]);
+		if (arena == nullptr) {
+			return LogErrorV("Couldn't find the arena");
+		}
+	}
+
+	if (callee == "reset" || callee == "release") {
+		return call(callee == "reset" ? MemoryFunction::ArenaReset : MemoryFunction::ArenaRelease, { arena });
+	}
+
+	if (callee == "arena_allocator") {
+		return makeAllocator(llvmBuilder.CreateBitCast(arena, llvmBuilder.getInt8PtrTy()), MemoryFunction::ArenaAllocHook, MemoryFunction::ArenaFreeHook);
+	}
+
+	// alloc and temp_alloc
+	const std::string& elementName = typeArguments[0];
+	llvm::Type* element = llvmTypeFromName(elementName);
+	u64 size = llvmModule->getDataLayout().getTypeAllocSize(element);
+	u64 alignment = alignmentOf(elementName, element);
+
+	llvm::Value* count = arguments.back()->codegen();
+	if (count == nullptr) {
+		return LogErrorV("Couldn't gen code for argument...");
+	}
+	count = llvmBuilder.CreateIntCast(count, llvmBuilder.getInt64Ty(), lang::typechecker::isSignedInteger(arguments.back()->resolvedType));
+
+	llvm::Value* memory = nullptr;
+	if (allocator) {
+		llvm::FunctionType* hookType = lang::runtime::memoryFunction(*llvmModule, MemoryFunction::HeapAllocHook)->getFunctionType();
+		memory = llvmBuilder.CreateCall(hookType, llvmBuilder.CreateExtractValue(allocator, 1),
+			{ llvmBuilder.CreateExtractValue(allocator, 0), count, llvmBuilder.getInt64(size), llvmBuilder.getInt64(alignment) });
+	}
+	else if (arena) {
+		memory = call(MemoryFunction::ArenaAlloc, { arena, count, llvmBuilder.getInt64(size), llvmBuilder.getInt64(alignment) });
+	}
+	else {
+		memory = call(MemoryFunction::Alloc, { count, llvmBuilder.getInt64(size) });
+	}
+
+	llvm::Type* sliceType = llvmTypeFromName(resolvedType);
+	llvm::Value* slice = llvm::UndefValue::get(sliceType);
+	slice = llvmBuilder.CreateInsertValue(slice, llvmBuilder.CreateBitCast(memory, element->getPointerTo()), 0);
+	return llvmBuilder.CreateInsertValue(slice, count, 1, "slice");
+}
+
+llvm::Value* lang::parser::CallExprAST::codegenVectorBuiltin()
+{
+	using namespace lang::typechecker;
+
+	std::vector<llvm::Value*> values;
+	for (auto* a : args->arguments) {
+		values.push_back(a->codegen());
+		if (values.back() == nullptr) {
+			return LogErrorV("Couldn't gen code for argument...");
+		}
+	}
+
+	// Lanes come from consecutive elements, the slice has to hold all of them
+	if (callee == "load" || callee == "store") {
+		auto* vectorType = llvm::cast<llvm::FixedVectorType>(llvmTypeFromName(callee == "load" ? resolvedType : args->arguments[2]->resolvedType));
+		llvm::Value* data = llvmBuilder.CreateExtractValue(values[0], 0, "data");
+		llvm::Value* length = llvmBuilder.CreateExtractValue(values[0], 1, "len");
+		llvm::Value* first = llvmBuilder.CreateIntCast(values[1], llvmBuilder.getInt64Ty(), isSignedInteger(args->arguments[1]->resolvedType), "index");
+
+		if (boundsChecks) {
+			llvm::Value* lanes = llvmBuilder.getInt64(vectorType->getNumElements());
+			llvm::Value* fits = llvmBuilder.CreateICmpULE(lanes, length);
+			llvm::Value* inBounds = llvmBuilder.CreateICmpULE(first, llvmBuilder.CreateSub(length, lanes));
+			createBoundsCheck(llvmBuilder.CreateAnd(fits, inBounds, "inbounds"));
+		}
+
+		llvm::Type* elementType = vectorType->getElementType();
+		llvm::Value* element = llvmBuilder.CreateInBoundsGEP(elementType, data, first, "element");
+		llvm::Value* address = llvmBuilder.CreateBitCast(element, vectorType->getPointerTo(), "lanes");
+		llvm::Align alignment(llvmModule->getDataLayout().getABITypeAlignment(elementType));
+
+		if (callee == "load") {
+			return llvmBuilder.CreateAlignedLoad(vectorType, address, alignment, "load");
+		}
+		return llvmBuilder.CreateAlignedStore(values[2], address, alignment);
+	}
+
+	llvm::Value* v = values[0];
+	const std::string element = elementType(args->arguments[0]->resolvedType);
+	bool isFloatVector = isFloat(element);
+	bool isSigned = isSignedInteger(element);
+
+	if (callee == "extract") return llvmBuilder.CreateExtractElement(v, values[1], "extracttmp");
+	if (callee == "insert") return llvmBuilder.CreateInsertElement(v, values[2], values[1], "inserttmp");
+
+	if (callee == "shuffle") {
+		size_t firstIndex = args->arguments[1]->resolvedType == args->arguments[0]->resolvedType ? 2 : 1;
+		llvm::Value* second = firstIndex == 2 ? values[1] : llvm::UndefValue::get(v->getType());
+
+		std::vector<int> mask;
+		for (size_t i = firstIndex; i < args->arguments.size(); i++) {
+			mask.push_back(static_cast<int>(static_cast<NumberExprAST*>(args->arguments[i])->integerValue()));
+		}
+
+		return llvmBuilder.CreateShuffleVector(v, second, mask, "shuffletmp");
+	}
+
+	// Float sums and products may be reassociated so they become a log2(lanes) tree instead of a serial chain
+	llvm::Type* elementTy = v->getType()->getScalarType();
+	if (callee == "reduce_add" && isFloatVector) {
+		auto* r = llvmBuilder.CreateFAddReduce(llvm::ConstantFP::getNegativeZero(elementTy), v);
+		r->setHasAllowReassoc(true);
+		return r;
+	}
+	if (callee == "reduce_mul" && isFloatVector) {
+		auto* r = llvmBuilder.CreateFMulReduce(llvm::ConstantFP::get(elementTy, 1.0), v);
+		r->setHasAllowReassoc(true);
+		return r;
+	}
+	if (callee == "reduce_min" && isFloatVector) return llvmBuilder.CreateFPMinReduce(v);
+	if (callee == "reduce_max" && isFloatVector) return llvmBuilder.CreateFPMaxReduce(v);
+
+	if (callee == "reduce_add") return llvmBuilder.CreateAddReduce(v);
+	if (callee == "reduce_mul") return llvmBuilder.CreateMulReduce(v);
+	if (callee == "reduce_min") return llvmBuilder.CreateIntMinReduce(v, isSigned);
+	if (callee == "reduce_max") return llvmBuilder.CreateIntMaxReduce(v, isSigned);
+	if (callee == "reduce_and") return llvmBuilder.CreateAndReduce(v);
+	if (callee == "reduce_or") return llvmBuilder.CreateOrReduce(v);
+	if (callee == "reduce_xor") return llvmBuilder.CreateXorReduce(v);
+
+	return LogErrorV("Unknown vector builtin");
+}
+
+llvm::Function* lang::parser::FunctionSignatureAST::codegen()
+{
+	std::vector<llvm::Type*> params;
+	std::vector<u64> alignments;
+	for (auto* t : args->arguments) {
+		
+		auto* v = static_cast<VariableExprAST*>(t);
+		std::string typeName = lang::typechecker::referencedType(v->type);
+		llvm::Type* type = llvmTypeFromName(typeName);
+		if (type == nullptr) {
+			LogErrorV("Couldn't determine type...");
+			type = llvm::Type::getInt8Ty(llvmContext);
+		}
+
+		// References are plain pointers as far as the calling convention is concerned
+		if (lang::typechecker::isReference(v->type)) {
+			type = type->getPointerTo();
+			typeName.clear();
+		}
+
+		// Extern fns take strings as C strings, the pooled bytes are NUL terminated
+		if (isExternal && v->type == "string") {
+			type = llvm::Type::getInt8PtrTy(llvmContext);
+		}
+
+		params.push_back(type);
+		alignments.push_back(alignmentOf(typeName, type));
+	}
+
+	llvm::Type* returnType = llvmTypeFromName(returnTypeName());
+	if (returnType == nullptr) {
+		LogErrorV("Couldn't determine return type...");
+		returnType = llvm::Type::getVoidTy(llvmContext);
+	}
+
+	// Fns C can see pass structs the way C does on the target, so extern fns can take and return them.
+	// Calls between potato fns pass large aggregates in memory too, on every target.
+	const llvm::DataLayout& dataLayout = llvmModule->getDataLayout();
+	u64 returnAlignment = returnType->isVoidTy() ? 1 : alignmentOf(returnTypeName(), returnType);
+	lang::abi::FunctionInfo abi = isExternal || isExported
+		? lang::abi::classify(dataLayout, llvm::Triple(llvmModule->getTargetTriple()), returnType, returnAlignment, params, alignments)
+		: lang::abi::internal(dataLayout, returnType, returnAlignment, params, alignments);
+
+	llvm::FunctionType* ft = lang::abi::loweredType(llvmContext, abi);
+	// Every module using an instance gets its own copy, the linker keeps one. Fns that aren't exported are only
+	// called from this module, so the optimizer may inline them everywhere and drop the original.
+	auto linkage = llvm::GlobalValue::LinkageTypes::InternalLinkage;
+	if (isInstance) {
+		linkage = llvm::GlobalValue::LinkageTypes::LinkOnceODRLinkage;
+	}
+	else if (isExternal || isExported || name == "main") {
+		linkage = llvm::GlobalValue::LinkageTypes::ExternalLinkage;
+	}
+
+	llvm::Function* f = llvm::Function::Create(ft, linkage, name, llvmModule.get());
+	lang::abi::addAttributes(f, abi);
+
+	if (inlining == Inlining::Always) {
+		f->addFnAttr(llvm::Attribute::AlwaysInline);
+	}
+	else if (inlining == Inlining::Never) {
+		f->addFnAttr(llvm::Attribute::NoInline);
+	}
+
+	if (abi.result.kind == lang::abi::PassKind::Indirect) {
+		f->getArg(0)->setName("result");
+	}
+
+	for (size_t i = 0; i < args->arguments.size(); i++) {
+		auto* v = static_cast<VariableExprAST*>(args->arguments[i]);
+		unsigned index = abi.loweredIndex(i);
+
+		if (abi.arguments[i].kind == lang::abi::PassKind::Coerced) {
+			for (unsigned part = 0; part < abi.arguments[i].parts.size(); part++) {
+				f->getArg(index + part)->setName(v->name + ".coerce" + std::to_string(part));
+			}
+			continue;
+		}
+
+		f->getArg(index)->setName(v->name);
+
+		// The callee only reads through references and can't keep them
+		if (lang::typechecker::isReference(v->type)) {
+			llvm::Type* referenced = llvmTypeFromName(lang::typechecker::referencedType(v->type));
+			f->addParamAttr(index, llvm::Attribute::NonNull);
+			f->addParamAttr(index, llvm::Attribute::ReadOnly);
+			f->addParamAttr(index, llvm::Attribute::NoCapture);
+			f->addParamAttr(index, llvm::Attribute::getWithDereferenceableBytes(llvmContext, dataLayout.getTypeStoreSize(referenced)));
+			f->addParamAttr(index, llvm::Attribute::getWithAlignment(llvmContext, llvm::Align(alignmentOf(lang::typechecker::referencedType(v->type), referenced))));
+		}
+	}
+
+	loweredFunctions[name] = LoweredFunction{ this, abi };
+	return f;
+}
+
+llvm::Value* createDefaultValueReturnNode(llvm::Type* type) {
+	if (type == llvm::Type::getVoidTy(llvmContext)) {
+		return llvmBuilder.CreateRetVoid();
+	}
+
+	llvm::Value* v = llvm::Constant::getNullValue(type);
+	return createReturn(v);
+
+}
+
+std::string lang::parser::FunctionSignatureAST::returnTypeName() const
+{
+	if (returnList == nullptr || returnList->arguments.size() == 0) {
+		return "void";
+	}
+
+	if (returnList->arguments.size() == 1) {
+		return static_cast<VariableExprAST*>(returnList->arguments[0])->type;
+	}
+
+	std::vector<std::string> types;
+	for (auto* r : returnList->arguments) {
+		types.push_back(static_cast<VariableExprAST*>(r)->type);
+	}
+	return lang::typechecker::tupleType(types);
+}
+
+llvm::Function* lang::parser::FunctionAST::declare()
+{
+	if (signature->isComptime) {
+		return nullptr; // Calls were replaced by their results
+	}
+
+	if (isGeneric()) {
+		return nullptr; // Only its instances are generated
+	}
+
+	llvm::Function* f = llvmModule->getFunction(signature->name);
+	if (f == nullptr) {
+		f = signature->codegen();
+	}
+
+	return f;
+}
+
+llvm::Value* lang::parser::FunctionAST::codegen()
+{
+	if (signature->isComptime || isGeneric()) {
+		return nullptr;
+	}
+
+	llvm::Function* f = declare();
+
+	if (f == nullptr) {
+		return LogErrorV("Couldn't generate function implementation");
+	}
+
+	llvmNamedValues.clear(); // Entering new scope, clear local variables list
+	llvmDeferScopes.clear();
+	
+
+	if (signature->isExternal == false) {
+		llvm::BasicBlock* llvmBody = llvm::BasicBlock::Create(llvmContext, "entry", f);
+		llvmBuilder.SetInsertPoint(llvmBody);
+
+		if (llvmDebugBuilder) {
+			// Line tables don't need the signature, -g describes the declared types
+			std::vector<llvm::Metadata*> types;
+			if (debugInfo == lang::source::DebugInfo::Full) {
+				std::string returnType = signature->returnTypeName();
+				types.push_back(returnType == "void" ? nullptr : debugType(returnType));
+				for (auto* a : signature->args->arguments) {
+					types.push_back(debugType(lang::typechecker::referencedType(static_cast<VariableExprAST*>(a)->type)));
+				}
+			}
+
+			u32 line = sourceFile->locate(offset).line + 1;
+			auto flags = f->hasLocalLinkage() ? llvm::DISubprogram::SPFlagLocalToUnit : llvm::DISubprogram::SPFlagZero;
+			llvm::DISubroutineType* type = llvmDebugBuilder->createSubroutineType(llvmDebugBuilder->getOrCreateTypeArray(types));
+			llvm::StringRef linkageName = f->getName() == signature->name ? "" : f->getName();
+			llvmSubprogram = llvmDebugBuilder->createFunction(llvmDebugFile, signature->name, linkageName, llvmDebugFile, line, type, line,
+				llvm::DINode::FlagPrototyped, flags | llvm::DISubprogram::SPFlagDefinition);
+			f->setSubprogram(llvmSubprogram);
+			setDebugLocation(offset);
+		}
+
+		const lang::abi::FunctionInfo& abi = loweredFunctions.at(signature->name).abi;
+		for (size_t i = 0; i < signature->args->arguments.size(); i++) {
+			auto* v = static_cast<VariableExprAST*>(signature->args->arguments[i]);
+			const lang::abi::PassInfo& pass = abi.arguments[i];
+			llvm::Argument* arg = f->getArg(abi.loweredIndex(i));
+
+			// References and structs passed in memory are used in place
+			std::string typeName = lang::typechecker::referencedType(v->type);
+			llvm::Type* type = llvmTypeFromName(typeName);
+			if (lang::typechecker::isReference(v->type) || pass.kind == lang::abi::PassKind::Indirect) {
+				llvmNamedValues[v->name] = LocalVariable{ arg, type };
+				declareDebugVariable(v->name, typeName, arg, static_cast<unsigned>(i + 1));
+				continue;
+			}
+
+			// Other arguments get a stack slot too so they can be assigned to
+			llvm::AllocaInst* alloca = createEntryBlockAlloca(f, v->name, typeName, type);
+			if (pass.kind == lang::abi::PassKind::Coerced) {
+				std::vector<llvm::Value*> parts;
+				for (unsigned part = 0; part < pass.parts.size(); part++) {
+					parts.push_back(f->getArg(abi.loweredIndex(i) + part));
+				}
+				lang::abi::storeParts(llvmBuilder, alloca, pass, parts);
+			}
+			else {
+				llvmBuilder.CreateStore(arg, alloca);
+			}
+			llvmNamedValues[v->name] = LocalVariable{ alloca, type };
+			declareDebugVariable(v->name, typeName, alloca, static_cast<unsigned>(i + 1));
+		}
+
+		// Add local scope variables
+		//for (auto* v : body->body) {
+		//	auto* variable = dynamic_cast<VariableExprAST*>(v);
+		//	if (variable) {
+		//		llvmNamedValues.try_emplace(variable->name, variable->codegen()); // Not sure if this is valid...
+		//	}
 		//}
 
 		llvm::Value* retValue = body->codegen();
 		if (retValue == nullptr) {
-			llvm::Type* returnType = f->getFunctionType()->getReturnType();
+			llvm::Type* returnType = loweredFunctions.at(signature->name).abi.result.type;
 			createDefaultValueReturnNode(returnType);
 		}
 
+		// Instructions generated outside of fns can't point into this one
+		llvmSubprogram = nullptr;
+		llvmBuilder.SetCurrentDebugLocation(llvm::DebugLoc());
+
 		//if (retValue) {
 		//	//llvmBuilder.CreateRet(retValue);
 		//}
 
 		llvm::verifyFunction(*f);
+		llvmFunctionPasses->run(*f);
 		return f;
 	}
 
 	return f;
 }
 
-llvm::Value* lang::parser::IfAST::codegen()
+llvm::Value* lang::parser::EnumAST::codegen()
+{
+	return nullptr; // Members are constants, the type is its underlying integer
+}
+
+llvm::Value* lang::parser::TraitAST::codegen()
+{
+	return nullptr; // Calls are bound to impl methods by the type checker
+}
+
+llvm::Value* lang::parser::ImplAST::codegen()
 {
-	llvm::Function* parentFunction = llvmBuilder.GetInsertBlock()->getParent();
-	llvm::BasicBlock* startBlock = llvmBuilder.GetInsertBlock();
+	for (auto* m : methods) {
+		m->codegen();
+	}
 
-	assert(chain.size() <= 1); // TODO: Add more later...
-	assert(hasElseAtEnd == false);
+	return nullptr;
+}
 
-	llvm::BasicBlock* trueBlock = llvm::BasicBlock::Create(llvmContext, "trueblock");
-	llvm::BasicBlock* falseBlock = llvm::BasicBlock::Create(llvmContext, "falseblock");
+llvm::Value* lang::parser::IfAST::codegen()
+{
+	llvm::Function* function = llvmBuilder.GetInsertBlock()->getParent();
 	llvm::BasicBlock* continueBlock = llvm::BasicBlock::Create(llvmContext, "ifcontinue");
 
-	auto& blockList = parentFunction->getBasicBlockList();
-	blockList.push_back(trueBlock);
-	blockList.push_back(falseBlock);
-	blockList.push_back(continueBlock);
+	for (size_t i = 0; i < chain.size(); i++) {
+		auto& arm = chain[i];
+		bool isLast = i + 1 == chain.size();
 
-	//llvm::PHINode* pn = llvmBuilder.CreatePHI(llvm::Type::getInt32Ty(llvmContext), 2, "iftmp");
+		// A false condition goes straight to the next condition, the else or past the if
+		llvm::BasicBlock* trueBlock = llvm::BasicBlock::Create(llvmContext, "iftrue");
+		llvm::BasicBlock* falseBlock = continueBlock;
+		if (isLast == false) {
+			falseBlock = llvm::BasicBlock::Create(llvmContext, "elseif");
+		}
+		else if (elseBody) {
+			falseBlock = llvm::BasicBlock::Create(llvmContext, "else");
+		}
 
-	// Branching
-	auto& a = chain[0];
-	{
-		llvm::Value* cond = a.condition->codegen();
-		llvm::Value* val = llvmBuilder.CreateCondBr(cond, trueBlock, falseBlock, nullptr, nullptr);
-	}
-	
-	// True block
-	{
-		llvmBuilder.SetInsertPoint(trueBlock);
-		llvm::Value* returnValue = a.body->codegen();
-		//if (trueBody == nullptr) {
-		//	return LogErrorV("Couldn't generate code block for true branch of if statement");
-		//}
-		if (returnValue == nullptr) {
+		llvm::Value* condition = arm.condition->codegen();
+		if (condition == nullptr) {
+			return LogErrorV("Couldn't gen code for if condition");
+		}
+		llvmBuilder.CreateCondBr(condition, trueBlock, falseBlock, branchWeights(arm.likelihood));
+
+		beginBlock(function, trueBlock);
+		if (arm.body->codegen() == nullptr) {
 			llvmBuilder.CreateBr(continueBlock);
 		}
 
-		//pn->addIncoming(trueBody, trueBlock);
-		trueBlock = llvmBuilder.GetInsertBlock(); // Generation might change block pointer, update...
+		if (falseBlock != continueBlock) {
+			beginBlock(function, falseBlock);
+		}
 	}
 
-	// False block
-	{
-		llvmBuilder.SetInsertPoint(falseBlock);
-
-		// TODO:: Create false statement
+	if (elseBody && elseBody->codegen() == nullptr) {
 		llvmBuilder.CreateBr(continueBlock);
-
-		//pn->addIncoming(nullptr, trueBlock);
-		falseBlock = llvmBuilder.GetInsertBlock(); // Generation might change block pointer, update...
 	}
-	
-	llvmBuilder.SetInsertPoint(continueBlock); // Bind continue block so future emissions end up here..
+
+	beginBlock(function, continueBlock); // Bind continue block so future emissions end up here..
 	return continueBlock;
 }
 
+// !llvm.loop attached to the backedge, carries the vectorize and unroll hints of the loop. nullptr without hints.
+static llvm::MDNode* loopMetadata(const LoopAST& loop) {
+	std::vector<llvm::Metadata*> operands;
+	operands.push_back(nullptr); // Loop id refers to itself, filled in below
+
+	auto hint = [](const char* name, llvm::Constant* value) {
+		std::vector<llvm::Metadata*> v{ llvm::MDString::get(llvmContext, name) };
+		if (value) {
+			v.push_back(llvm::ConstantAsMetadata::get(value));
+		}
+		return llvm::MDNode::get(llvmContext, v);
+	};
+
+	// Without an attribute the vectorizer's cost model decides, forcing it on would also vectorize loops where it doesn't pay off
+	if (loop.vectorize != LoopAST::Vectorize::CostModel) {
+		operands.push_back(hint("llvm.loop.vectorize.enable", llvm::ConstantInt::get(llvm::Type::getInt1Ty(llvmContext), loop.vectorize == LoopAST::Vectorize::Always)));
+	}
+
+	if (loop.unroll == false) {
+		operands.push_back(hint("llvm.loop.unroll.disable", nullptr));
+	}
+	else if (loop.unrollCount > 0) {
+		operands.push_back(hint("llvm.loop.unroll.count", llvm::ConstantInt::get(llvm::Type::getInt32Ty(llvmContext), loop.unrollCount)));
+	}
+
+	if (operands.size() == 1) {
+		return nullptr;
+	}
+
+	llvm::MDNode* id = llvm::MDNode::getDistinct(llvmContext, operands);
+	id->replaceOperandWith(0, id);
+	return id;
+}
+
+llvm::Value* lang::parser::LoopAST::codegen()
+{
+	llvm::Function* function = llvmBuilder.GetInsertBlock()->getParent();
+
+	// Variables declared by init are only visible inside the loop
+	auto outerScope = llvmNamedValues;
+	if (init) {
+		init->codegen();
+	}
+
+	llvm::BasicBlock* header = llvm::BasicBlock::Create(llvmContext, "loopheader");
+	llvm::BasicBlock* bodyBlock = llvm::BasicBlock::Create(llvmContext, "loopbody");
+	llvm::BasicBlock* latch = llvm::BasicBlock::Create(llvmContext, "looplatch");
+	llvm::BasicBlock* exit = llvm::BasicBlock::Create(llvmContext, "loopexit");
+
+	// The current block only falls through into the header, which makes it the preheader
+	llvmBuilder.CreateBr(header);
+
+	beginBlock(function, header);
+	if (condition) {
+		llvm::Value* cond = condition->codegen();
+		llvmBuilder.CreateCondBr(cond, bodyBlock, exit);
+	}
+	else {
+		llvmBuilder.CreateBr(bodyBlock);
+	}
+
+	beginBlock(function, bodyBlock);
+	llvmLoops.push_back(LoopBlocks{ latch, exit, llvmDeferScopes.size() });
+	llvm::Value* returnValue = body->codegen();
+	llvmLoops.pop_back();
+
+	if (returnValue == nullptr) {
+		llvmBuilder.CreateBr(latch);
+	}
+
+	// Single latch holding the step and the only backedge
+	beginBlock(function, latch);
+	if (step) {
+		step->codegen();
+	}
+	llvm::BranchInst* backedge = llvmBuilder.CreateBr(header);
+	backedge->setMetadata(llvm::LLVMContext::MD_loop, loopMetadata(*this));
+
+	beginBlock(function, exit);
+	llvmNamedValues = std::move(outerScope);
+	return exit;
+}
+
+llvm::Value* lang::parser::LoopControlAST::codegen()
+{
+	if (llvmLoops.empty()) {
+		return LogErrorV("break or continue outside of a loop");
+	}
+
+	auto& loop = llvmLoops.back();
+	generateDeferred(loop.deferScopes);
+	llvm::BranchInst* branch = llvmBuilder.CreateBr(isBreak() ? loop.exit : loop.latch);
+
+	// Anything after break or continue is unreachable, but still needs a block to be emitted into
+	llvm::Function* function = llvmBuilder.GetInsertBlock()->getParent();
+	beginBlock(function, llvm::BasicBlock::Create(llvmContext, isBreak() ? "afterbreak" : "aftercontinue"));
+	return branch;
+}
+
+llvm::Value* lang::parser::SwitchAST::codegen()
+{
+	llvm::Function* function = llvmBuilder.GetInsertBlock()->getParent();
+
+	llvm::Value* v = value->codegen();
+	if (v == nullptr) {
+		return LogErrorV("Couldn't gen code for switch value");
+	}
+
+	llvm::BasicBlock* end = llvm::BasicBlock::Create(llvmContext, "switchend");
+
+	// Values an exhaustive switch doesn't handle can't occur, LLVM drops the range check of the jump table
+	llvm::BasicBlock* defaultBlock = end;
+	if (isExhaustive) {
+		defaultBlock = llvm::BasicBlock::Create(llvmContext, "switchunreachable");
+	}
+	else if (defaultBody) {
+		defaultBlock = llvm::BasicBlock::Create(llvmContext, "switchdefault");
+	}
+
+	size_t caseCount = 0;
+	for (auto& c : cases) {
+		caseCount += c.constants.size();
+	}
+
+	auto* type = llvm::cast<llvm::IntegerType>(v->getType());
+	llvm::SwitchInst* instruction = llvmBuilder.CreateSwitch(v, defaultBlock, static_cast<unsigned>(caseCount));
+
+	for (auto& c : cases) {
+		llvm::BasicBlock* block = llvm::BasicBlock::Create(llvmContext, "case");
+		for (int64_t constant : c.constants) {
+			instruction->addCase(llvm::ConstantInt::get(type, static_cast<u64>(constant), true), block);
+		}
+
+		beginBlock(function, block);
+		if (c.body->codegen() == nullptr) {
+			llvmBuilder.CreateBr(end);
+		}
+	}
+
+	if (defaultBlock != end) {
+		beginBlock(function, defaultBlock);
+		if (isExhaustive) {
+			llvmBuilder.CreateUnreachable();
+		}
+		else if (defaultBody->codegen() == nullptr) {
+			llvmBuilder.CreateBr(end);
+		}
+	}
+
+	beginBlock(function, end);
+	return end;
+}
+
 llvm::Value* lang::parser::StructAST::codegen()
 {
-	std::vector<llvm::Type*> members;
-	members.push_back(llvm::Type::getFloatTy(llvmContext));
-	members.push_back(llvm::Type::getFloatTy(llvmContext));
-	members.push_back(llvm::Type::getFloatTy(llvmContext));
-	
-	llvm::ArrayRef<llvm::Type*> m(members);
+	if (llvmType == nullptr) {
+		llvmType = llvm::StructType::create(llvmContext, this->name);
+		knownStructTypes[this->name] = llvmType;
+		knownStructs[this->name] = this;
+	}
+
+	if (llvmType->isOpaque() == false) {
+		return llvm::Constant::getNullValue(llvmType);
+	}
+
+	if (effectiveAlignment != 0) {
+		return LogErrorV("Struct contains itself by value");
+	}
+	effectiveAlignment = 1; // Marks the layout as in progress
+
+	const llvm::DataLayout& dataLayout = llvmModule->getDataLayout();
+
+	struct Member {
+		size_t field;
+		llvm::Type* type;
+		u64 alignment;
+	};
+
+	std::vector<Member> members;
+	bool hasOverAlignedMember = false;
+	for (size_t i = 0; i < fields.size(); i++) {
+		// A bool field is a byte holding 0 or 1 like C's _Bool, i1 only lives in registers
+		llvm::Type* type = fields[i].type == "bool" ? llvm::Type::getInt8Ty(llvmContext) : llvmTypeFromName(fields[i].type);
+		if (type == nullptr || type->isVoidTy()) {
+			return LogErrorV("Couldn't determine type of struct field");
+		}
+
+		u64 fieldAlignment = alignmentOf(fields[i].type, type);
+		hasOverAlignedMember |= fieldAlignment > dataLayout.getABITypeAlignment(type);
+		members.push_back(Member{ i, type, fieldAlignment });
+	}
+
+	// Largest alignment first leaves no padding between fields as alignments are powers of 2
+	if (reorderFields && isPacked == false) {
+		std::stable_sort(members.begin(), members.end(), [](const Member& a, const Member& b) { return a.alignment > b.alignment; });
+	}
+
+	u64 structAlignment = 1;
+	for (auto& m : members) {
+		if (isPacked == false && m.alignment > structAlignment) {
+			structAlignment = m.alignment;
+		}
+	}
+	if (alignment > structAlignment) {
+		structAlignment = alignment;
+	}
 
-	auto* structType = llvm::StructType::create(llvmContext, m, this->name, false);
-	knownStructTypes[this->name] = structType;
+	auto* i8 = llvm::Type::getInt8Ty(llvmContext);
+	std::vector<llvm::Type*> elements;
+	u64 offset = 0;
+
+	// Over-aligned members need explicit padding, LLVM only knows about natural alignment.
+	// Such structs are emitted packed with the padding spelled out as i8 arrays.
+	bool explicitLayout = isPacked || hasOverAlignedMember;
+	for (auto& m : members) {
+		if (explicitLayout && isPacked == false) {
+			u64 padding = (m.alignment - offset % m.alignment) % m.alignment;
+			if (padding > 0) {
+				elements.push_back(llvm::ArrayType::get(i8, padding));
+				offset += padding;
+			}
+		}
+
+		fields[m.field].elementIndex = elements.size();
+		elements.push_back(m.type);
+		offset += dataLayout.getTypeAllocSize(m.type);
+	}
+
+	// Round the size up so arrays of this struct keep every element aligned
+	u64 naturalSize = explicitLayout ? offset : dataLayout.getTypeAllocSize(llvm::StructType::get(llvmContext, elements, false)).getFixedSize();
+	u64 size = llvm::alignTo(naturalSize, structAlignment);
+	if (size > naturalSize) {
+		elements.push_back(llvm::ArrayType::get(i8, size - naturalSize));
+	}
+
+	llvmType->setBody(elements, explicitLayout);
+	effectiveAlignment = structAlignment;
+
+	return llvm::Constant::getNullValue(llvmType);
+}
 
+llvm::Value* lang::parser::SizeofExprAST::codegen()
+{
+	llvm::Type* type = llvmTypeFromName(typeName);
+	if (type == nullptr || type->isVoidTy()) {
+		return LogErrorV("sizeof of unknown type");
+	}
 
-	return llvm::Constant::getNullValue(structType);
-	//return nullptr;
+	u64 size = llvmModule->getDataLayout().getTypeAllocSize(type);
+	return llvm::ConstantInt::get(llvmContext, llvm::APInt(64, size, false));
 }
 
 
@@ -831,18 +3399,40 @@ llvm::Value* lang::parser::CodeBlockAST::codegen()
 	assert(block != nullptr && "If block can be empty create a new one... ");
 	assert(block->getParent() != nullptr && "Code block is only allowed to live inside of a function. Is the code block you're writing to inserted yet?");
 
+	// Locals declared in this block shadow outer ones until the block ends
+	auto outerScope = llvmNamedValues;
+	llvmDeferScopes.emplace_back();
+	llvm::DebugLoc outerLocation = llvmBuilder.getCurrentDebugLocation(); // Code after the block belongs to the statement holding it
+
 	for (auto* n : body) {
 		//auto& list = block->getInstList();
 		//list.addNodeToList(n->codegen());
 		
 		assert(n->type != "Return" && "return type should not be part of codeblock body. Set returnValue instead");
+		setDebugLocation(n->offset);
 		auto* val = n->codegen();
+
+		// A nested block that returned ends this one too
+		if (llvmBuilder.GetInsertBlock()->getTerminator()) {
+			llvmDeferScopes.pop_back();
+			llvmNamedValues = std::move(outerScope);
+			llvmBuilder.SetCurrentDebugLocation(outerLocation);
+			return llvmBuilder.GetInsertBlock()->getTerminator();
+		}
 	}
 
+	llvm::Value* result = nullptr;
 	if (returnValue) {
-		// Codeblock has return value
-		return returnValue->codegen();
+		// Codeblock has return value, the return runs the deferred statements
+		setDebugLocation(returnValue->offset);
+		result = returnValue->codegen();
+	}
+	else {
+		generateDeferred(llvmDeferScopes.size() - 1);
 	}
 
-	return nullptr;
+	llvmDeferScopes.pop_back();
+	llvmNamedValues = std::move(outerScope);
+	llvmBuilder.SetCurrentDebugLocation(outerLocation);
+	return result;
 }
@@ -11,10 +11,25 @@ using namespace lang::lexer;
 namespace llvm {
 	class Value;
 	class Function;
+	class Module;
+	class LLVMContext;
+	class StructType;
+	class TargetMachine;
+}
+
+namespace lang::typechecker {
+	class TypeScope;
+}
+
+namespace lang::comptime {
+	struct Value;
+	class Evaluator;
 }
 
 namespace lang::parser {
 
+	using lang::typechecker::TypeScope;
+
 	class AstPrinter {
 	public:
 		size_t indentation = 0;
@@ -43,6 +58,8 @@ namespace lang::parser {
 	class ExprAST {
 	public:
 		std::string type;
+		std::string resolvedType; // Value type name (e.g. "i32", "Vec3"), set by the type checker
+		lang::source::Offset offset = 0; // Start of the statement or root node this is, type errors point there
 
 		ExprAST(const std::string& type) 
 			: type{ type } 
@@ -55,6 +72,15 @@ namespace lang::parser {
 		virtual void print(AstPrinter& printer) = 0;
 		virtual llvm::Value* codegen() = 0;
 
+		// Resolves and stores the type of this node and its children, inserting casts where needed.
+		virtual void resolveTypes(TypeScope& scope) {}
+
+		// Runs the node in the compile-time interpreter, fails for anything that can't run at compile time.
+		virtual lang::comptime::Value evaluate(lang::comptime::Evaluator& evaluator);
+
+		// Returns the constant folded replacement for this node, this if nothing changed or nullptr if the node is dead.
+		virtual ExprAST* fold() { return this; }
+
 
 		virtual std::string prettyName() {
 			return type;
@@ -81,6 +107,12 @@ namespace lang::parser {
 		NumberExprAST(int32_t val) : ExprAST("Number"), value({ .int32Value = val }), type(TokenType::INTEGER32) {}
 		NumberExprAST(int64_t val) : ExprAST("Number"), value({ .int64Value = val}), type(TokenType::INTEGER64) {}
 
+		std::string suffix; // Explicit type of the literal, e.g. "u8" for 255u8. Suffixed literals don't adapt to their use.
+
+		bool isInteger() const { return type == TokenType::INTEGER32 || type == TokenType::INTEGER64; }
+		int64_t integerValue() const { return type == TokenType::INTEGER32 ? value.int32Value : type == TokenType::INTEGER64 ? value.int64Value : 0; }
+		double floatValue() const { return type == TokenType::FLOAT32 ? value.float32Value : type == TokenType::FLOAT64 ? value.float64Value : static_cast<double>(integerValue()); }
+
 		virtual void print(AstPrinter& printer) override {
 			switch (type)
 			{
@@ -102,6 +134,8 @@ namespace lang::parser {
 		}
 
 		virtual llvm::Value* codegen() override;
+		virtual void resolveTypes(TypeScope& scope) override;
+		virtual lang::comptime::Value evaluate(lang::comptime::Evaluator& evaluator) override;
 	};
 
 	class ConstantStringExpr : public ExprAST {
@@ -110,6 +144,8 @@ namespace lang::parser {
 	public:
 		ConstantStringExpr(std::string val) : ExprAST("Number"), stringValue(val) {}
 
+		const std::string& value() const { return stringValue; }
+
 		virtual void print(AstPrinter& printer) override {
 			printer.buffer += "\"";
 			printer.buffer += stringValue.c_str();
@@ -117,6 +153,7 @@ namespace lang::parser {
 		}
 
 		virtual llvm::Value* codegen() override;
+		virtual void resolveTypes(TypeScope& scope) override;
 	};
 
 	class ReturnAST : public ExprAST {
@@ -133,6 +170,55 @@ namespace lang::parser {
 		}
 
 		virtual llvm::Value* codegen() override;
+		virtual void resolveTypes(TypeScope& scope) override;
+		virtual lang::comptime::Value evaluate(lang::comptime::Evaluator& evaluator) override;
+		virtual ExprAST* fold() override;
+	};
+
+	/// TupleExprAST - Values of a multi-value return, e.g. return a + 1, false.
+	class TupleExprAST : public ExprAST {
+	public:
+		std::vector<ExprAST*> elements;
+
+		TupleExprAST(std::vector<ExprAST*> elements) : ExprAST("Tuple"), elements(std::move(elements)) {}
+
+		virtual void print(AstPrinter& printer) override {
+			for (auto* e : elements) {
+				e->print(printer);
+			}
+		}
+
+		virtual llvm::Value* codegen() override;
+		virtual void resolveTypes(TypeScope& scope) override;
+		virtual ExprAST* fold() override;
+	};
+
+	/// DestructureAST - Unpacks a multi-value return. var a, b = f() declares a and b, a, b = f() assigns
+	/// existing variables. _ discards a value.
+	class DestructureAST : public ExprAST {
+	public:
+		std::vector<std::string> names;
+		ExprAST* value;
+		bool isDeclaration;
+
+		std::vector<std::string> types; // Of each value, set by the type checker
+
+		DestructureAST(std::vector<std::string> names, ExprAST* value, bool isDeclaration)
+			: ExprAST("Destructure"),
+			names(std::move(names)),
+			value(value),
+			isDeclaration(isDeclaration) {}
+
+		virtual void print(AstPrinter& printer) override {
+			for (auto& n : names) {
+				printer.print(n.c_str());
+			}
+			value->print(printer);
+		}
+
+		virtual llvm::Value* codegen() override;
+		virtual void resolveTypes(TypeScope& scope) override;
+		virtual ExprAST* fold() override;
 	};
 
 	class VariableExprAST : public ExprAST {
@@ -150,6 +236,9 @@ namespace lang::parser {
 			assignment(assignment),
 			isConstant(false) {}
 
+		// Declarations carry their type ("i32 a"), references use the name as type ("a").
+		bool isDeclaration() const { return isConstant == false && type != name; }
+
 		virtual void print(AstPrinter& printer) override {
 			//printer.print(type.c_str());
 			printer.print(name.c_str());
@@ -163,6 +252,100 @@ namespace lang::parser {
 		}
 
 		virtual llvm::Value* codegen() override;
+		virtual void resolveTypes(TypeScope& scope) override;
+		virtual lang::comptime::Value evaluate(lang::comptime::Evaluator& evaluator) override;
+		virtual ExprAST* fold() override;
+	};
+
+	/// FieldExprAST - Struct field of a variable, e.g. v.x or p.position.y. Reads and writes go straight to
+	/// the field's memory, fields of references and large structs aren't copied out first.
+	class FieldExprAST : public ExprAST {
+	public:
+		std::string variable;
+		std::vector<std::string> fields;
+		ExprAST* assignment;
+
+		std::vector<std::string> structTypes; // Struct each field is looked up in, set by the type checker
+		ExprAST* constantValue = nullptr; // Enum member, e.g. Color.Red, or the length of an array, set by the type checker
+
+		FieldExprAST(const std::string& variable, std::vector<std::string> fields, ExprAST* assignment)
+			: ExprAST("Field"),
+			variable(variable),
+			fields(std::move(fields)),
+			assignment(assignment) {}
+
+		virtual void print(AstPrinter& printer) override {
+			std::string path = variable;
+			for (auto& f : fields) {
+				path += "." + f;
+			}
+			printer.print(path.c_str());
+
+			if (assignment) {
+				assignment->print(printer);
+			}
+		}
+
+		virtual llvm::Value* codegen() override;
+		virtual void resolveTypes(TypeScope& scope) override;
+		virtual lang::comptime::Value evaluate(lang::comptime::Evaluator& evaluator) override;
+		virtual ExprAST* fold() override;
+	};
+
+	/// ArrayExprAST - Array literal, e.g. [1, 2, 3]. Takes the element type it's used as, like number literals.
+	class ArrayExprAST : public ExprAST {
+	public:
+		std::vector<ExprAST*> elements;
+
+		ArrayExprAST(std::vector<ExprAST*> elements) : ExprAST("Array"), elements(std::move(elements)) {}
+
+		virtual void print(AstPrinter& printer) override {
+			printer.print("[");
+			for (auto* e : elements) {
+				e->print(printer);
+			}
+			printer.print("]");
+		}
+
+		virtual llvm::Value* codegen() override;
+		virtual void resolveTypes(TypeScope& scope) override;
+		virtual ExprAST* fold() override;
+	};
+
+	/// IndexExprAST - Element of an array, slice or string variable, e.g. a[i] or a[i] = 1, or a sub-slice
+	/// when there's an end, e.g. a[1:n]. The index is checked against the length unless that's proven redundant.
+	class IndexExprAST : public ExprAST {
+	public:
+		std::string variable;
+		ExprAST* index;
+		ExprAST* end; // Exclusive end of a sub-slice, nullptr for a single element
+		ExprAST* assignment;
+
+		std::string baseType; // Type of variable, set by the type checker
+		bool isChecked = true; // Cleared by the type checker when a loop condition already guarantees the index is in range
+
+		IndexExprAST(const std::string& variable, ExprAST* index, ExprAST* end, ExprAST* assignment)
+			: ExprAST("Index"),
+			variable(variable),
+			index(index),
+			end(end),
+			assignment(assignment) {}
+
+		virtual void print(AstPrinter& printer) override {
+			printer.print(variable.c_str());
+			index->print(printer);
+			if (end) {
+				end->print(printer);
+			}
+
+			if (assignment) {
+				assignment->print(printer);
+			}
+		}
+
+		virtual llvm::Value* codegen() override;
+		virtual void resolveTypes(TypeScope& scope) override;
+		virtual ExprAST* fold() override;
 	};
 
 	class ArgumentListAST : public ExprAST {
@@ -192,6 +375,8 @@ namespace lang::parser {
 		TokenType::Type type;
 		ExprAST* left;
 		ExprAST* right;
+		bool isNegation = false; // -x parsed as 0 - x, floats negate instead so -0.0 keeps its sign
+		bool isStep = false; // i++ or i--, overflowing a signed counter is undefined like in C so loops over it can be widened
 
 		BinaryExprAST(TokenType::Type type, ExprAST* left, ExprAST* right)
 			: ExprAST("Binary expression"), 
@@ -206,6 +391,33 @@ namespace lang::parser {
 		}
 
 		virtual llvm::Value* codegen() override;
+		virtual void resolveTypes(TypeScope& scope) override;
+		virtual lang::comptime::Value evaluate(lang::comptime::Evaluator& evaluator) override;
+		virtual ExprAST* fold() override;
+	};
+
+	/// CastExprAST - Conversion between value types, inserted by the type checker.
+	class CastExprAST : public ExprAST {
+	public:
+		ExprAST* value;
+
+		CastExprAST(ExprAST* value, const std::string& toType)
+			: ExprAST("Cast"),
+			value(value)
+		{
+			resolvedType = toType;
+		}
+
+		virtual void print(AstPrinter& printer) override {
+			printer.print("(");
+			printer.print(resolvedType.c_str());
+			printer.print(")");
+			value->print(printer);
+		}
+
+		virtual llvm::Value* codegen() override;
+		virtual lang::comptime::Value evaluate(lang::comptime::Evaluator& evaluator) override;
+		virtual ExprAST* fold() override;
 	};
 
 	/// CallExprAST - Expression class for function calls.
@@ -213,7 +425,19 @@ namespace lang::parser {
 		std::string callee;
 		ArgumentListAST* args;
 
+		bool resolveVectorBuiltin(TypeScope& scope);
+		bool resolveFormatBuiltin(TypeScope& scope);
+		bool resolveMemoryBuiltin(TypeScope& scope);
+		llvm::Value* codegenVectorBuiltin();
+		llvm::Value* codegenFormatBuiltin();
+		llvm::Value* codegenMemoryBuiltin();
+
 	public:
+		std::vector<std::string> typeArguments; // Of a generic fn, e.g. sum<f32>(a, b). Inferred from the arguments when empty.
+		bool isBuiltin = false; // Vector operations, print, println, flush and allocation, set by the type checker
+		std::vector<std::string> formatPieces; // print and println, text around the {} of the format, set by the type checker
+		ExprAST* comptimeValue = nullptr; // Result of a comptime fn call, generated instead of the call
+
 		CallExprAST(const std::string& callee, ArgumentListAST* args)
 			: ExprAST("Function call"),
 			callee(callee),
@@ -225,6 +449,12 @@ namespace lang::parser {
 		}
 
 		virtual llvm::Value* codegen() override;
+		virtual void resolveTypes(TypeScope& scope) override;
+		virtual lang::comptime::Value evaluate(lang::comptime::Evaluator& evaluator) override;
+		virtual ExprAST* fold() override;
+
+		// alloc on an Arena or temp_alloc, once resolved
+		bool allocatesFromArena() const;
 	};
 
 	/// CodeBlockAST - Anything inside of {} is considered a code block
@@ -248,13 +478,31 @@ namespace lang::parser {
 		}
 
 		virtual llvm::Value* codegen() override;
+		virtual void resolveTypes(TypeScope& scope) override;
+		virtual lang::comptime::Value evaluate(lang::comptime::Evaluator& evaluator) override;
+		virtual ExprAST* fold() override;
 	};
 
 	/// StructAST - A struct definition
+	/// struct Name [packed] [reorder] [align(N)] { fields }
 	class StructAST : public ExprAST {
 	public:
+		struct Field {
+			std::string type;
+			std::string name;
+			size_t elementIndex; // Index into the LLVM struct, differs from declaration order when reordered or padded
+		};
+
 		std::string name;
 		CodeBlockAST* body;
+		std::vector<Field> fields;
+
+		bool isPacked = false; // No padding between fields
+		bool reorderFields = false; // Opt-in, sorts fields by alignment to minimize padding (changes the C layout)
+		u64 alignment = 0; // align(N), 0 means natural alignment
+
+		llvm::StructType* llvmType = nullptr;
+		u64 effectiveAlignment = 0;
 
 		StructAST(std::string name, CodeBlockAST* body)
 			: ExprAST("Struct"),
@@ -274,6 +522,66 @@ namespace lang::parser {
 	};
 
 
+	/// EnumAST - Named integer constants, e.g. enum Color: u8 { Red = 1, Green = 2 }. Values are stored as the
+	/// underlying integer type, i32 unless given, and are referred to as Color.Red.
+	class EnumAST : public ExprAST {
+	public:
+		struct Member {
+			std::string name;
+			int64_t value;
+		};
+
+		std::string name;
+		std::string underlyingType;
+		std::vector<Member> members;
+
+		EnumAST(const std::string& name, const std::string& underlyingType, std::vector<Member> members)
+			: ExprAST("Enum"),
+			name(name),
+			underlyingType(underlyingType),
+			members(std::move(members)) {}
+
+		const Member* member(const std::string& memberName) const {
+			for (auto& m : members) {
+				if (m.name == memberName) {
+					return &m;
+				}
+			}
+			return nullptr;
+		}
+
+		virtual void print(AstPrinter& printer) override {
+			printer.print("enum");
+			printer.print(name.c_str());
+			for (auto& m : members) {
+				printer.print(m.name.c_str());
+			}
+		}
+
+		virtual llvm::Value* codegen() override;
+	};
+
+	/// SizeofExprAST - sizeof(T), the allocation size of T in bytes as a u64 constant.
+	class SizeofExprAST : public ExprAST {
+	public:
+		std::string typeName;
+
+		SizeofExprAST(const std::string& typeName)
+			: ExprAST("Sizeof"),
+			typeName(typeName)
+		{
+			resolvedType = "u64";
+		}
+
+		virtual void print(AstPrinter& printer) override {
+			printer.print("sizeof(");
+			printer.print(typeName.c_str());
+			printer.print(")");
+		}
+
+		virtual llvm::Value* codegen() override;
+	};
+
 	/// FunctionSignatureAST - This class represents the "prototype" or "signature" for a function,
 	/// which captures its name, and its argument names (thus implicitly the number
 	/// of arguments the function takes).
@@ -281,9 +589,18 @@ namespace lang::parser {
 	public:
 		std::string name;
 		ArgumentListAST* args;
-		ArgumentListAST* returnList; // TODO: Convert to tuple?
+		ArgumentListAST* returnList; // One entry per returned value
 		bool isExternal;
-		// TODO: Add return list?
+		bool isComptime = false; // Only runs in the compile-time evaluator, no code is generated for it
+		bool isInstance = false; // Generated from a generic fn for one set of type arguments
+		bool isExported = false; // export fn, visible to other modules. Other fns get internal linkage.
+
+		enum class Inlining {
+			Default, // Up to the optimizer
+			Always, // inline fn
+			Never, // noinline fn
+		};
+		Inlining inlining = Inlining::Default;
 
 		FunctionSignatureAST(const std::string& name, ArgumentListAST* args, ArgumentListAST* returnList)
 			: name(name),
@@ -292,6 +609,9 @@ namespace lang::parser {
 
 		const std::string& getName() const { return name; }
 
+		// Declared return type, "void" when there is none and a tuple such as (i32,bool) for multiple values.
+		std::string returnTypeName() const;
+
 		llvm::Function* codegen();
 	};
 
@@ -301,11 +621,29 @@ namespace lang::parser {
 		CodeBlockAST* body;
 
 	public:
+		struct TypeParameter {
+			std::string name;
+			std::string bound; // Trait the type has to implement, e.g. T: AddTrait, empty if there is none
+		};
+
+		// Generic fns are templates, e.g. fn sum<T>(T a, T b) T. They aren't checked or generated themselves,
+		// each set of type arguments they're called with gets its own instance re-parsed from templateTokens.
+		std::vector<TypeParameter> typeParameters;
+		std::vector<lang::lexer::Token> templateTokens;
+
 		FunctionAST(FunctionSignatureAST* sig, CodeBlockAST* body)
 			: ExprAST("Function"),
 			signature(sig),
 			body(body) {}
 
+		bool isGeneric() const { return typeParameters.empty() == false; }
+
+		FunctionSignatureAST* getSignature() { return signature; }
+		CodeBlockAST* getBody() { return body; }
+
+		// Declares the function in the module without generating its body.
+		llvm::Function* declare();
+
 		virtual void print(AstPrinter& printer) override {
 			printer.print(signature->getName().c_str());
 			printer.print("(");
@@ -333,17 +671,94 @@ namespace lang::parser {
 			printer.print("}");
 		}
 
+		virtual llvm::Value* codegen() override;
+		virtual void resolveTypes(TypeScope& scope) override;
+		virtual ExprAST* fold() override;
+	};
+
+	/// TraitAST - Functions a type has to provide, e.g. trait AddTrait<T> { fn add(&T a, &T b) T }.
+	/// Traits have no runtime representation, calls to their methods are bound to an impl at compile time.
+	class TraitAST : public ExprAST {
+	public:
+		std::string name;
+		std::string typeParameter;
+		std::vector<FunctionSignatureAST*> methods;
+
+		TraitAST(const std::string& name, const std::string& typeParameter, std::vector<FunctionSignatureAST*> methods)
+			: ExprAST("Trait"),
+			name(name),
+			typeParameter(typeParameter),
+			methods(std::move(methods)) {}
+
+		FunctionSignatureAST* method(const std::string& methodName) const {
+			for (auto* m : methods) {
+				if (m->name == methodName) {
+					return m;
+				}
+			}
+			return nullptr;
+		}
+
+		virtual void print(AstPrinter& printer) override {
+			printer.print("trait");
+			printer.print(name.c_str());
+			for (auto* m : methods) {
+				printer.print(m->name.c_str());
+			}
+		}
+
 		virtual llvm::Value* codegen() override;
 	};
 
+	/// ImplAST - A trait implemented for one type, e.g. impl AddTrait<Vec3> in Vec3 { fn add(...) Vec3 { } }.
+	/// The methods are plain functions named after the impl, e.g. AddTrait<Vec3>.add, calls go straight to them.
+	class ImplAST : public ExprAST {
+	public:
+		std::string traitName;
+		std::string typeArgument;
+		std::string selfType; // Type the impl is declared in
+		std::vector<FunctionAST*> methods;
+
+		ImplAST(const std::string& traitName, const std::string& typeArgument, const std::string& selfType, std::vector<FunctionAST*> methods)
+			: ExprAST("Impl"),
+			traitName(traitName),
+			typeArgument(typeArgument),
+			selfType(selfType),
+			methods(std::move(methods)) {}
+
+		// Trait with its type argument, e.g. AddTrait<Vec3>
+		std::string implementedTrait() const { return traitName + "<" + typeArgument + ">"; }
+
+		virtual void print(AstPrinter& printer) override {
+			printer.print("impl");
+			printer.print(implementedTrait().c_str());
+			for (auto* m : methods) {
+				m->print(printer);
+			}
+		}
+
+		virtual llvm::Value* codegen() override;
+		virtual void resolveTypes(TypeScope& scope) override;
+		virtual ExprAST* fold() override;
+	};
+
+	/// IfAST - if a { } else if b { } else { }. A condition can be marked likely or unlikely in front of its
+	/// body, e.g. if error != 0 unlikely { }, which sets the branch weights the backend lays out code by.
 	class IfAST : public ExprAST {
 	public:
 		
+		enum class Likelihood {
+			Unknown,
+			Likely,
+			Unlikely,
+		};
+
 		struct ConditionAndBody {
-			BinaryExprAST* condition;
+			ExprAST* condition;
 			CodeBlockAST* body;
+			Likelihood likelihood = Likelihood::Unknown;
 
-			ConditionAndBody(BinaryExprAST* condition, CodeBlockAST* body)
+			ConditionAndBody(ExprAST* condition, CodeBlockAST* body)
 				: condition(condition),
 				body(body) {}
 		};
@@ -394,13 +809,174 @@ namespace lang::parser {
 		}
 
 		virtual llvm::Value* codegen() override;
+		virtual void resolveTypes(TypeScope& scope) override;
+		virtual lang::comptime::Value evaluate(lang::comptime::Evaluator& evaluator) override;
+		virtual ExprAST* fold() override;
+	};
+
+	/// SwitchAST - switch value { case A, B { } default { } } on an integer or enum, generated as a single LLVM
+	/// switch so dense cases become a jump table. Each case runs only its own block, there's no fallthrough.
+	class SwitchAST : public ExprAST {
+	public:
+		struct Case {
+			std::vector<ExprAST*> values; // Constant expressions, e.g. 1, -1 or Color.Red
+			CodeBlockAST* body;
+			std::vector<int64_t> constants; // Of values, set by the type checker
+		};
+
+		ExprAST* value;
+		std::vector<Case> cases;
+		CodeBlockAST* defaultBody;
+
+		// Cases cover every member of the enum switched on, nothing is left for the default. Set by the type checker.
+		bool isExhaustive = false;
+
+		SwitchAST(ExprAST* value, std::vector<Case> cases, CodeBlockAST* defaultBody)
+			: ExprAST("Switch"),
+			value(value),
+			cases(std::move(cases)),
+			defaultBody(defaultBody) {}
+
+		virtual void print(AstPrinter& printer) override {
+			printer.print("switch");
+			value->print(printer);
+			for (auto& c : cases) {
+				printer.print("case");
+				for (auto* v : c.values) {
+					v->print(printer);
+				}
+				c.body->print(printer);
+			}
+
+			if (defaultBody) {
+				printer.print("default");
+				defaultBody->print(printer);
+			}
+		}
+
+		virtual llvm::Value* codegen() override;
+		virtual void resolveTypes(TypeScope& scope) override;
+		virtual lang::comptime::Value evaluate(lang::comptime::Evaluator& evaluator) override;
+		virtual ExprAST* fold() override;
+	};
+
+	/// LoopAST - while and for loops. Everything but the body is optional, a loop without condition runs until break.
+	class LoopAST : public ExprAST {
+	public:
+		ExprAST* init;
+		ExprAST* condition;
+		ExprAST* step;
+		CodeBlockAST* body;
+
+		// Loop hints from attributes in front of the body, e.g. for ... unroll(4) novectorize { }
+		enum class Vectorize { CostModel, Always, Never };
+		Vectorize vectorize = Vectorize::CostModel;
+		bool unroll = true;
+		u32 unrollCount = 0; // 0 leaves the count to the unroller
+
+		LoopAST(ExprAST* init, ExprAST* condition, ExprAST* step, CodeBlockAST* body)
+			: ExprAST("Loop"),
+			init(init),
+			condition(condition),
+			step(step),
+			body(body) {}
+
+		virtual void print(AstPrinter& printer) override {
+			printer.print("for");
+			if (init) {
+				init->print(printer);
+				printer.print(";");
+			}
+			if (condition) {
+				condition->print(printer);
+			}
+			if (step) {
+				printer.print(";");
+				step->print(printer);
+			}
+
+			printer.println("{");
+			printer.indentation++;
+			body->print(printer);
+			printer.indentation--;
+			printer.println("");
+			printer.println("}");
+		}
+
+		virtual llvm::Value* codegen() override;
+		virtual void resolveTypes(TypeScope& scope) override;
+		virtual lang::comptime::Value evaluate(lang::comptime::Evaluator& evaluator) override;
+		virtual ExprAST* fold() override;
+	};
+
+	/// LoopControlAST - break or continue, jumps out of or to the next iteration of the innermost loop.
+	class LoopControlAST : public ExprAST {
+	public:
+		LoopControlAST(bool isBreak)
+			: ExprAST(isBreak ? "Break" : "Continue") {}
+
+		bool isBreak() const { return type == "Break"; }
+
+		virtual void print(AstPrinter& printer) override {
+			printer.print(isBreak() ? "break" : "continue");
+		}
+
+		virtual llvm::Value* codegen() override;
+		virtual void resolveTypes(TypeScope& scope) override;
+		virtual lang::comptime::Value evaluate(lang::comptime::Evaluator& evaluator) override;
+	};
+
+	/// DeferAST - defer statement or defer { statements }, runs when the enclosing block is left. The statement is
+	/// generated again at every exit of the block (end of the block, return, break and continue), most recent defer
+	/// first, so nothing is tracked at runtime.
+	class DeferAST : public ExprAST {
+	public:
+		ExprAST* statement;
+
+		DeferAST(ExprAST* statement)
+			: ExprAST("Defer"),
+			statement(statement) {}
+
+		virtual void print(AstPrinter& printer) override {
+			printer.print("defer");
+			statement->print(printer);
+		}
+
+		virtual llvm::Value* codegen() override;
+		virtual void resolveTypes(TypeScope& scope) override;
+		virtual ExprAST* fold() override;
+	};
+
+	struct Diagnostic {
+		TextSpan span;
+		std::string message;
+	};
+
+	// Owns every node made by one parse, freeing it frees the whole tree.
+	struct AstPool {
+		std::vector<std::unique_ptr<ExprAST>> nodes;
+		std::vector<std::unique_ptr<FunctionSignatureAST>> signatures;
+	};
+
+	// Root node together with the token range [firstToken, lastToken) it was parsed from.
+	struct TopLevelNode {
+		ExprAST* node; // nullptr for tokens that failed to parse
+		size_t firstToken;
+		size_t lastToken;
+		std::shared_ptr<AstPool> pool; // Of the parse that made node, freed once no root node of that parse is left
+		std::vector<Diagnostic> diagnostics; // Syntax errors in its tokens
 	};
 
 	class ParserHelper {
 	public:
 		std::vector<lang::lexer::Token> tokens;
+		std::vector<Diagnostic> diagnostics;
+		lang::lexer::Token endToken{ .type = TokenType::END, .span = { .startsLine = true } }; // Located at the end of the last token
 		std::vector<ExprAST*> astNodes; // Root nodes (e.g. if with all child nodes)
-		std::vector<ExprAST*> astNodesFlat; // Flattened representation where all nodes are just added one after another.
+		std::shared_ptr<AstPool> pool = std::make_shared<AstPool>(); // Every node made so far, the next parse frees them
+		std::vector<std::string> structNames; // Declared anywhere in the file, lets the parser tell "Vec3 v" declarations apart from expressions
+		std::vector<std::string> enumNames; // Declared anywhere in the file, like structNames
+		std::vector<std::string> typeParameters; // Of the generic fn or trait being parsed, used as type names inside of it
 
 		size_t index;
 
@@ -413,7 +989,7 @@ namespace lang::parser {
 		}
 
 		const lang::lexer::Token& next(size_t forward = 1, bool eat = false) {
-			auto& t = tokens[index + forward];
+			auto& t = index + forward < tokens.size() ? tokens[index + forward] : endToken;
 			if (eat) {
 				this->eat(forward);
 			}
@@ -425,7 +1001,7 @@ namespace lang::parser {
 		}
 
 		const lang::lexer::Token& current(bool eat = false) {
-			auto& t = tokens[index];
+			auto& t = index < tokens.size() ? tokens[index] : endToken;
 			if (eat) {
 				this->eat(1);
 			}
@@ -434,12 +1010,60 @@ namespace lang::parser {
 	};
 
 
+	// Pool of the parse in progress. Nodes made after parsing, like implicit casts and folded constants, go in there too.
+	AstPool& currentPool();
+
+	template <typename T, class ...Args>
+	T* createAst(Args&&... args) {
+		auto owned = std::make_unique<T>(std::forward<Args>(args)...);
+		T* a = owned.get();
+		if constexpr (std::is_base_of_v<ExprAST, T>) {
+			currentPool().nodes.push_back(std::move(owned));
+		}
+		else {
+			currentPool().signatures.push_back(std::move(owned));
+		}
+		return a;
+	}
+
 	ExprAST* identifier();
-	BinaryExprAST* binaryExpression(TokenType::Type terminator);
+	ExprAST* binaryExpression();
 	ArgumentListAST* argumentsDefinitionList(TokenType::Type terminator);
 	ArgumentListAST* argumentsList(TokenType::Type terminator);
 	ExprAST* expression();
 	CodeBlockAST* codeBlock();
 
 	std::vector<ExprAST*> parse(const std::vector<lang::lexer::Token>& tokens);
+
+	// Parses a copy of generic named name with its type parameters replaced by typeArguments.
+	FunctionAST* instantiate(FunctionAST* generic, const std::vector<std::string>& typeArguments, const std::string& name);
+
+	// Parses tokens[from, to) without generating code, syntax errors are kept with the node they're in instead of aborting.
+	// Every token but comments belongs to one of the returned nodes. Their token ranges are indices into the full token vector.
+	std::vector<TopLevelNode> parseSyntax(const std::vector<lang::lexer::Token>& tokens, size_t from, size_t to);
+
+	// Target the module is generated for, sets the data layout used for struct layout and sizeof.
+	void setTargetMachine(llvm::TargetMachine* targetMachine);
+
+	// File the tokens given to parse() come from, errors are reported as file:line:column when it's set.
+	// The parser doesn't take ownership, file has to outlive the parse.
+	void setSourceFile(const lang::source::File* file);
+
+	// DWARF (CodeView on Windows) for the following parse() calls, needs the source file to be set.
+	void setDebugInfo(lang::source::DebugInfo level);
+
+	// Turns off the bounds checks of array and slice indexing, --no-bounds-checks. On by default.
+	void setBoundsChecks(bool enabled);
+
+	// True when the last call to parse() reported errors, no code was generated in that case.
+	bool hadErrors();
+
+	// Module generated by the last call to parse(), owned by the parser. lang::backend optimizes and writes it.
+	llvm::Module* currentModule();
+
+	// Context every module the parser generates lives in, modules linked with it have to use it too.
+	llvm::LLVMContext& currentContext();
+
+	// Replaces the current module, e.g. with the one lang::backend::linkModules links.
+	void setModule(std::unique_ptr<llvm::Module> module);
 }
\ No newline at end of file
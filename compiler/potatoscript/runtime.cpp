@@ -0,0 +1,780 @@
+#include "runtime.h"
+
+#include <cstring>
+
+#include "llvm/ADT/Triple.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include "types.h"
+
+using namespace lang::runtime;
+
+static constexpr u64 bufferCapacity = 8192;
+static constexpr u64 firstChunkSize = 64 * 1024;
+static constexpr u64 chunkHeaderSize = 16;
+
+using BodyBuilder = void (*)(llvm::Module& module, llvm::Function* function);
+
+// Shared between modules: one definition survives linking, and it isn't exported from the executable.
+static void share(llvm::Module& module, llvm::GlobalObject* global) {
+	global->setLinkage(llvm::GlobalValue::LinkOnceODRLinkage);
+	global->setVisibility(llvm::GlobalValue::HiddenVisibility);
+	if (llvm::Triple(module.getTargetTriple()).supportsCOMDAT()) {
+		global->setComdat(module.getOrInsertComdat(global->getName()));
+	}
+}
+
+static llvm::Function* getOrDefine(llvm::Module& module, const char* name, llvm::FunctionType* type, BodyBuilder build) {
+	if (llvm::Function* existing = module.getFunction(name)) {
+		return existing;
+	}
+
+	auto* function = llvm::Function::Create(type, llvm::GlobalValue::LinkOnceODRLinkage, name, module);
+	function->addFnAttr(llvm::Attribute::NoUnwind);
+	share(module, function);
+	build(module, function);
+	return function;
+}
+
+static llvm::GlobalVariable* threadLocal(llvm::Module& module, const char* name, llvm::Type* type) {
+	if (llvm::GlobalVariable* existing = module.getNamedGlobal(name)) {
+		return existing;
+	}
+
+	auto* global = new llvm::GlobalVariable(module, type, false, llvm::GlobalValue::LinkOnceODRLinkage, llvm::Constant::getNullValue(type),
+		name, nullptr, llvm::GlobalValue::GeneralDynamicTLSModel);
+	share(module, global);
+	return global;
+}
+
+static llvm::GlobalVariable* buffer(llvm::Module& module) {
+	return threadLocal(module, "potato.fmt.buffer", llvm::ArrayType::get(llvm::Type::getInt8Ty(module.getContext()), bufferCapacity));
+}
+
+static llvm::GlobalVariable* bufferLength(llvm::Module& module) {
+	return threadLocal(module, "potato.fmt.length", llvm::Type::getInt64Ty(module.getContext()));
+}
+
+// Pointer to the first byte of a private constant holding text.
+static llvm::Value* constantBytes(llvm::IRBuilder<>& b, llvm::Module& module, const std::string& text) {
+	std::string name = "potato.fmt.text." + text;
+	llvm::GlobalVariable* global = module.getNamedGlobal(name);
+	if (global == nullptr) {
+		llvm::Constant* bytes = llvm::ConstantDataArray::getString(module.getContext(), text, false);
+		global = new llvm::GlobalVariable(module, bytes->getType(), true, llvm::GlobalValue::PrivateLinkage, bytes, name);
+		global->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+		global->setAlignment(llvm::Align(1));
+	}
+
+	return b.CreateInBoundsGEP(global->getValueType(), global, { b.getInt64(0), b.getInt64(0) });
+}
+
+// "00" to "99", integers are converted two digits at a time
+static std::string digitPairs() {
+	std::string pairs;
+	for (int i = 0; i < 100; i++) {
+		pairs += static_cast<char>('0' + i / 10);
+		pairs += static_cast<char>('0' + i % 10);
+	}
+	return pairs;
+}
+
+// write(1, data, length) on posix, _write on Windows, which takes and returns an i32 count
+static llvm::FunctionCallee systemWrite(llvm::Module& module, bool* outIsWindows) {
+	llvm::LLVMContext& context = module.getContext();
+	*outIsWindows = llvm::Triple(module.getTargetTriple()).isOSWindows();
+
+	llvm::Type* size = *outIsWindows ? llvm::Type::getInt32Ty(context) : llvm::Type::getInt64Ty(context);
+	auto* type = llvm::FunctionType::get(size, { llvm::Type::getInt32Ty(context), llvm::Type::getInt8PtrTy(context), size }, false);
+	return module.getOrInsertFunction(*outIsWindows ? "_write" : "write", type);
+}
+
+static llvm::Function* writeAllFunction(llvm::Module& module);
+static llvm::Function* fixedFunction(llvm::Module& module);
+
+// Writes all of data to stdout, retrying short writes, gives up on errors.
+static void buildWriteAll(llvm::Module& module, llvm::Function* function) {
+	llvm::LLVMContext& context = module.getContext();
+	llvm::IRBuilder<> b(context);
+
+	bool isWindows = false;
+	llvm::FunctionCallee write = systemWrite(module, &isWindows);
+
+	auto* entry = llvm::BasicBlock::Create(context, "entry", function);
+	auto* loop = llvm::BasicBlock::Create(context, "loop", function);
+	auto* body = llvm::BasicBlock::Create(context, "body", function);
+	auto* advance = llvm::BasicBlock::Create(context, "advance", function);
+	auto* done = llvm::BasicBlock::Create(context, "done", function);
+
+	b.SetInsertPoint(entry);
+	b.CreateBr(loop);
+
+	b.SetInsertPoint(loop);
+	llvm::PHINode* data = b.CreatePHI(b.getInt8PtrTy(), 2, "data");
+	llvm::PHINode* length = b.CreatePHI(b.getInt64Ty(), 2, "length");
+	data->addIncoming(function->getArg(0), entry);
+	length->addIncoming(function->getArg(1), entry);
+	b.CreateCondBr(b.CreateICmpSGT(length, b.getInt64(0)), body, done);
+
+	b.SetInsertPoint(body);
+	llvm::Value* count = length;
+	if (isWindows) {
+		count = b.CreateTrunc(b.CreateSelect(b.CreateICmpUGT(length, b.getInt64(1 << 30)), b.getInt64(1 << 30), length), b.getInt32Ty());
+	}
+	llvm::Value* written = b.CreateSExt(b.CreateCall(write, { b.getInt32(1), data, count }), b.getInt64Ty(), "written");
+	b.CreateCondBr(b.CreateICmpSGT(written, b.getInt64(0)), advance, done);
+
+	b.SetInsertPoint(advance);
+	data->addIncoming(b.CreateInBoundsGEP(b.getInt8Ty(), data, written), advance);
+	length->addIncoming(b.CreateSub(length, written), advance);
+	b.CreateBr(loop);
+
+	b.SetInsertPoint(done);
+	b.CreateRetVoid();
+}
+
+static void buildFlush(llvm::Module& module, llvm::Function* function) {
+	llvm::LLVMContext& context = module.getContext();
+	llvm::IRBuilder<> b(context);
+
+	auto* entry = llvm::BasicBlock::Create(context, "entry", function);
+	auto* flush = llvm::BasicBlock::Create(context, "flush", function);
+	auto* done = llvm::BasicBlock::Create(context, "done", function);
+
+	b.SetInsertPoint(entry);
+	llvm::Value* length = b.CreateLoad(b.getInt64Ty(), bufferLength(module), "length");
+	b.CreateCondBr(b.CreateICmpEQ(length, b.getInt64(0)), done, flush);
+
+	b.SetInsertPoint(flush);
+	llvm::Value* data = b.CreateInBoundsGEP(buffer(module)->getValueType(), buffer(module), { b.getInt64(0), b.getInt64(0) });
+	b.CreateCall(writeAllFunction(module), { data, length });
+	b.CreateStore(b.getInt64(0), bufferLength(module));
+	b.CreateBr(done);
+
+	b.SetInsertPoint(done);
+	b.CreateRetVoid();
+}
+
+// Registers flush with atexit, so whatever the main thread buffered is written when the program ends.
+static void buildInit(llvm::Module& module, llvm::Function* function) {
+	llvm::LLVMContext& context = module.getContext();
+	llvm::IRBuilder<> b(llvm::BasicBlock::Create(context, "entry", function));
+
+	llvm::Function* flush = formatFunction(module, FormatFunction::Flush);
+	auto* type = llvm::FunctionType::get(b.getInt32Ty(), { flush->getType() }, false);
+	b.CreateCall(module.getOrInsertFunction("atexit", type), { flush });
+	b.CreateRetVoid();
+}
+
+// Copies into the buffer, flushing first if it doesn't fit. Writes larger than the buffer skip it.
+static void buildWrite(llvm::Module& module, llvm::Function* function) {
+	llvm::LLVMContext& context = module.getContext();
+	llvm::IRBuilder<> b(context);
+
+	auto* init = getOrDefine(module, "potato.fmt.init", llvm::FunctionType::get(b.getVoidTy(), false), buildInit);
+	llvm::appendToGlobalCtors(module, init, 65535);
+
+	auto* entry = llvm::BasicBlock::Create(context, "entry", function);
+	auto* full = llvm::BasicBlock::Create(context, "full", function);
+	auto* direct = llvm::BasicBlock::Create(context, "direct", function);
+	auto* copy = llvm::BasicBlock::Create(context, "copy", function);
+
+	llvm::Value* data = function->getArg(0);
+	llvm::Value* length = function->getArg(1);
+	llvm::Value* capacity = b.getInt64(bufferCapacity);
+
+	b.SetInsertPoint(entry);
+	llvm::Value* used = b.CreateLoad(b.getInt64Ty(), bufferLength(module), "used");
+	llvm::Value* fits = b.CreateICmpULE(length, b.CreateSub(capacity, used));
+	b.CreateCondBr(fits, copy, full, llvm::MDBuilder(context).createBranchWeights(2000, 1));
+
+	b.SetInsertPoint(full);
+	b.CreateCall(formatFunction(module, FormatFunction::Flush));
+	b.CreateCondBr(b.CreateICmpUGT(length, capacity), direct, copy);
+
+	b.SetInsertPoint(direct);
+	b.CreateCall(writeAllFunction(module), { data, length });
+	b.CreateRetVoid();
+
+	b.SetInsertPoint(copy);
+	llvm::PHINode* offset = b.CreatePHI(b.getInt64Ty(), 2, "offset");
+	offset->addIncoming(used, entry);
+	offset->addIncoming(b.getInt64(0), full);
+	llvm::Value* destination = b.CreateInBoundsGEP(buffer(module)->getValueType(), buffer(module), { b.getInt64(0), offset });
+	b.CreateMemCpy(destination, llvm::MaybeAlign(1), data, llvm::MaybeAlign(1), length);
+	b.CreateStore(b.CreateAdd(offset, length), bufferLength(module));
+	b.CreateRetVoid();
+}
+
+// Digits are produced back to front into a small stack buffer, two at a time from a table, then written in one go.
+static void buildUnsigned(llvm::Module& module, llvm::Function* function) {
+	llvm::LLVMContext& context = module.getContext();
+	llvm::IRBuilder<> b(context);
+
+	auto* entry = llvm::BasicBlock::Create(context, "entry", function);
+	auto* loop = llvm::BasicBlock::Create(context, "loop", function);
+	auto* body = llvm::BasicBlock::Create(context, "body", function);
+	auto* last = llvm::BasicBlock::Create(context, "last", function);
+	auto* pair = llvm::BasicBlock::Create(context, "pair", function);
+	auto* single = llvm::BasicBlock::Create(context, "single", function);
+	auto* done = llvm::BasicBlock::Create(context, "done", function);
+
+	const u64 maxDigits = 20;
+	auto* digitsType = llvm::ArrayType::get(b.getInt8Ty(), maxDigits);
+
+	b.SetInsertPoint(entry);
+	llvm::Value* digits = b.CreateAlloca(digitsType, nullptr, "digits");
+	llvm::Value* pairs = constantBytes(b, module, digitPairs());
+	b.CreateBr(loop);
+
+	auto digitAt = [&](llvm::Value* position) {
+		return b.CreateInBoundsGEP(digitsType, digits, { b.getInt64(0), position });
+	};
+
+	b.SetInsertPoint(loop);
+	llvm::PHINode* value = b.CreatePHI(b.getInt64Ty(), 2, "value");
+	llvm::PHINode* position = b.CreatePHI(b.getInt64Ty(), 2, "position");
+	value->addIncoming(function->getArg(0), entry);
+	position->addIncoming(b.getInt64(maxDigits), entry);
+	b.CreateCondBr(b.CreateICmpUGE(value, b.getInt64(100)), body, last);
+
+	b.SetInsertPoint(body);
+	llvm::Value* remainder = b.CreateURem(value, b.getInt64(100));
+	llvm::Value* next = b.CreateSub(position, b.getInt64(2));
+	b.CreateMemCpy(digitAt(next), llvm::MaybeAlign(1), b.CreateInBoundsGEP(b.getInt8Ty(), pairs, b.CreateShl(remainder, 1)), llvm::MaybeAlign(1), 2);
+	value->addIncoming(b.CreateUDiv(value, b.getInt64(100)), body);
+	position->addIncoming(next, body);
+	b.CreateBr(loop);
+
+	b.SetInsertPoint(last);
+	b.CreateCondBr(b.CreateICmpUGE(value, b.getInt64(10)), pair, single);
+
+	b.SetInsertPoint(pair);
+	llvm::Value* pairStart = b.CreateSub(position, b.getInt64(2));
+	b.CreateMemCpy(digitAt(pairStart), llvm::MaybeAlign(1), b.CreateInBoundsGEP(b.getInt8Ty(), pairs, b.CreateShl(value, 1)), llvm::MaybeAlign(1), 2);
+	b.CreateBr(done);
+
+	b.SetInsertPoint(single);
+	llvm::Value* singleStart = b.CreateSub(position, b.getInt64(1));
+	b.CreateStore(b.CreateAdd(b.CreateTrunc(value, b.getInt8Ty()), b.getInt8('0')), digitAt(singleStart));
+	b.CreateBr(done);
+
+	b.SetInsertPoint(done);
+	llvm::PHINode* start = b.CreatePHI(b.getInt64Ty(), 2, "start");
+	start->addIncoming(pairStart, pair);
+	start->addIncoming(singleStart, single);
+	b.CreateCall(formatFunction(module, FormatFunction::Write), { digitAt(start), b.CreateSub(b.getInt64(maxDigits), start) });
+	b.CreateRetVoid();
+}
+
+static void buildSigned(llvm::Module& module, llvm::Function* function) {
+	llvm::LLVMContext& context = module.getContext();
+	llvm::IRBuilder<> b(context);
+
+	auto* entry = llvm::BasicBlock::Create(context, "entry", function);
+	auto* minus = llvm::BasicBlock::Create(context, "minus", function);
+	auto* magnitude = llvm::BasicBlock::Create(context, "magnitude", function);
+
+	llvm::Value* value = function->getArg(0);
+
+	b.SetInsertPoint(entry);
+	b.CreateCondBr(b.CreateICmpSLT(value, b.getInt64(0)), minus, magnitude);
+
+	b.SetInsertPoint(minus);
+	b.CreateCall(formatFunction(module, FormatFunction::Write), { constantBytes(b, module, "-"), b.getInt64(1) });
+	llvm::Value* negated = b.CreateSub(b.getInt64(0), value); // Wraps for the minimum, which is the right unsigned magnitude
+	b.CreateBr(magnitude);
+
+	b.SetInsertPoint(magnitude);
+	llvm::PHINode* absolute = b.CreatePHI(b.getInt64Ty(), 2, "absolute");
+	absolute->addIncoming(value, entry);
+	absolute->addIncoming(negated, minus);
+	b.CreateCall(formatFunction(module, FormatFunction::Unsigned), { absolute });
+	b.CreateRetVoid();
+}
+
+// Non-negative value below 2^64 as the integer part followed by up to 6 decimals, trailing zeros dropped.
+static void buildFixed(llvm::Module& module, llvm::Function* function) {
+	llvm::LLVMContext& context = module.getContext();
+	llvm::IRBuilder<> b(context);
+
+	auto* entry = llvm::BasicBlock::Create(context, "entry", function);
+	auto* trim = llvm::BasicBlock::Create(context, "trim", function);
+	auto* trimmed = llvm::BasicBlock::Create(context, "trimmed", function);
+	auto* digit = llvm::BasicBlock::Create(context, "digit", function);
+	auto* emit = llvm::BasicBlock::Create(context, "emit", function);
+	auto* done = llvm::BasicBlock::Create(context, "done", function);
+
+	const u64 decimals = 6;
+	const u64 scale = 1'000'000;
+	auto* fractionType = llvm::ArrayType::get(b.getInt8Ty(), decimals + 1);
+	llvm::Value* value = function->getArg(0);
+
+	b.SetInsertPoint(entry);
+	llvm::Value* text = b.CreateAlloca(fractionType, nullptr, "fraction");
+	llvm::Value* whole = b.CreateFPToUI(value, b.getInt64Ty(), "whole");
+	llvm::Value* rest = b.CreateFSub(value, b.CreateUIToFP(whole, b.getDoubleTy()));
+	llvm::Value* fraction = b.CreateFPToUI(b.CreateFAdd(b.CreateFMul(rest, llvm::ConstantFP::get(b.getDoubleTy(), scale)), llvm::ConstantFP::get(b.getDoubleTy(), 0.5)), b.getInt64Ty());
+
+	// Rounding up the decimals can carry into the integer part, e.g. 1.9999999
+	llvm::Value* carry = b.CreateICmpUGE(fraction, b.getInt64(scale));
+	whole = b.CreateSelect(carry, b.CreateAdd(whole, b.getInt64(1)), whole);
+	fraction = b.CreateSelect(carry, b.CreateSub(fraction, b.getInt64(scale)), fraction);
+	b.CreateCall(formatFunction(module, FormatFunction::Unsigned), { whole });
+	b.CreateCondBr(b.CreateICmpEQ(fraction, b.getInt64(0)), done, trim);
+
+	b.SetInsertPoint(trim);
+	llvm::PHINode* significant = b.CreatePHI(b.getInt64Ty(), 2, "significant");
+	llvm::PHINode* count = b.CreatePHI(b.getInt64Ty(), 2, "count");
+	significant->addIncoming(fraction, entry);
+	count->addIncoming(b.getInt64(decimals), entry);
+	llvm::Value* isTrailingZero = b.CreateICmpEQ(b.CreateURem(significant, b.getInt64(10)), b.getInt64(0));
+	significant->addIncoming(b.CreateUDiv(significant, b.getInt64(10)), trim);
+	count->addIncoming(b.CreateSub(count, b.getInt64(1)), trim);
+	b.CreateCondBr(isTrailingZero, trim, trimmed);
+
+	b.SetInsertPoint(trimmed);
+	b.CreateStore(b.getInt8('.'), b.CreateInBoundsGEP(fractionType, text, { b.getInt64(0), b.getInt64(0) }));
+	b.CreateBr(digit);
+
+	b.SetInsertPoint(digit);
+	llvm::PHINode* remaining = b.CreatePHI(b.getInt64Ty(), 2, "remaining");
+	llvm::PHINode* position = b.CreatePHI(b.getInt64Ty(), 2, "position");
+	remaining->addIncoming(significant, trimmed);
+	position->addIncoming(count, trimmed);
+	llvm::Value* character = b.CreateAdd(b.CreateTrunc(b.CreateURem(remaining, b.getInt64(10)), b.getInt8Ty()), b.getInt8('0'));
+	b.CreateStore(character, b.CreateInBoundsGEP(fractionType, text, { b.getInt64(0), position }));
+	llvm::Value* previous = b.CreateSub(position, b.getInt64(1));
+	remaining->addIncoming(b.CreateUDiv(remaining, b.getInt64(10)), digit);
+	position->addIncoming(previous, digit);
+	b.CreateCondBr(b.CreateICmpUGT(previous, b.getInt64(0)), digit, emit);
+
+	b.SetInsertPoint(emit);
+	llvm::Value* start = b.CreateInBoundsGEP(fractionType, text, { b.getInt64(0), b.getInt64(0) });
+	b.CreateCall(formatFunction(module, FormatFunction::Write), { start, b.CreateAdd(count, b.getInt64(1)) });
+	b.CreateBr(done);
+
+	b.SetInsertPoint(done);
+	b.CreateRetVoid();
+}
+
+static void buildFloat(llvm::Module& module, llvm::Function* function) {
+	llvm::LLVMContext& context = module.getContext();
+	llvm::IRBuilder<> b(context);
+
+	auto* entry = llvm::BasicBlock::Create(context, "entry", function);
+	auto* nan = llvm::BasicBlock::Create(context, "nan", function);
+	auto* number = llvm::BasicBlock::Create(context, "number", function);
+	auto* minus = llvm::BasicBlock::Create(context, "minus", function);
+	auto* magnitude = llvm::BasicBlock::Create(context, "magnitude", function);
+	auto* infinite = llvm::BasicBlock::Create(context, "infinite", function);
+	auto* finite = llvm::BasicBlock::Create(context, "finite", function);
+	auto* fixed = llvm::BasicBlock::Create(context, "fixed", function);
+	auto* scientific = llvm::BasicBlock::Create(context, "scientific", function);
+
+	llvm::Function* write = formatFunction(module, FormatFunction::Write);
+	auto writeText = [&](const char* text) {
+		b.CreateCall(write, { constantBytes(b, module, text), b.getInt64(strlen(text)) });
+	};
+	auto constant = [&](f64 v) {
+		return llvm::ConstantFP::get(b.getDoubleTy(), v);
+	};
+
+	llvm::Value* value = function->getArg(0);
+
+	b.SetInsertPoint(entry);
+	b.CreateCondBr(b.CreateFCmpUNO(value, value), nan, number);
+
+	b.SetInsertPoint(nan);
+	writeText("nan");
+	b.CreateRetVoid();
+
+	// The sign bit and not < 0, so -0 keeps its sign
+	b.SetInsertPoint(number);
+	b.CreateCondBr(b.CreateICmpSLT(b.CreateBitCast(value, b.getInt64Ty()), b.getInt64(0)), minus, magnitude);
+
+	b.SetInsertPoint(minus);
+	writeText("-");
+	llvm::Value* negated = b.CreateFNeg(value);
+	b.CreateBr(magnitude);
+
+	b.SetInsertPoint(magnitude);
+	llvm::PHINode* absolute = b.CreatePHI(b.getDoubleTy(), 2, "absolute");
+	absolute->addIncoming(value, number);
+	absolute->addIncoming(negated, minus);
+	b.CreateCondBr(b.CreateFCmpOEQ(absolute, llvm::ConstantFP::getInfinity(b.getDoubleTy())), infinite, finite);
+
+	b.SetInsertPoint(infinite);
+	writeText("inf");
+	b.CreateRetVoid();
+
+	// Magnitudes the fixed form can't show, too many digits or all zeros, are written as m.mmmmmmeN
+	b.SetInsertPoint(finite);
+	llvm::Value* isLarge = b.CreateFCmpOGE(absolute, constant(1e15));
+	llvm::Value* isSmall = b.CreateAnd(b.CreateFCmpOLT(absolute, constant(1e-4)), b.CreateFCmpONE(absolute, constant(0.0)));
+	b.CreateCondBr(b.CreateOr(isLarge, isSmall), scientific, fixed);
+
+	b.SetInsertPoint(fixed);
+	b.CreateCall(fixedFunction(module), { absolute });
+	b.CreateRetVoid();
+
+	b.SetInsertPoint(scientific);
+	llvm::Value* exponent = b.CreateUnaryIntrinsic(llvm::Intrinsic::floor, b.CreateUnaryIntrinsic(llvm::Intrinsic::log10, absolute));
+	llvm::Value* mantissa = b.CreateFDiv(absolute, b.CreateBinaryIntrinsic(llvm::Intrinsic::pow, constant(10.0), exponent));
+
+	// log10 can be off by one near powers of ten
+	llvm::Value* tooLarge = b.CreateFCmpOGE(mantissa, constant(10.0));
+	llvm::Value* tooSmall = b.CreateFCmpOLT(mantissa, constant(1.0));
+	mantissa = b.CreateSelect(tooLarge, b.CreateFDiv(mantissa, constant(10.0)), b.CreateSelect(tooSmall, b.CreateFMul(mantissa, constant(10.0)), mantissa));
+	exponent = b.CreateSelect(tooLarge, b.CreateFAdd(exponent, constant(1.0)), b.CreateSelect(tooSmall, b.CreateFSub(exponent, constant(1.0)), exponent));
+
+	// A mantissa rounding up to 10 at 6 decimals, e.g. 9.9999999 from 1e-6, is written as 1 with the next exponent
+	llvm::Value* roundsUp = b.CreateFCmpOGE(b.CreateUnaryIntrinsic(llvm::Intrinsic::round, b.CreateFMul(mantissa, constant(1e6))), constant(1e7));
+	mantissa = b.CreateSelect(roundsUp, b.CreateFDiv(mantissa, constant(10.0)), mantissa);
+	exponent = b.CreateSelect(roundsUp, b.CreateFAdd(exponent, constant(1.0)), exponent);
+
+	b.CreateCall(fixedFunction(module), { mantissa });
+	writeText("e");
+	b.CreateCall(formatFunction(module, FormatFunction::Signed), { b.CreateFPToSI(exponent, b.getInt64Ty()) });
+	b.CreateRetVoid();
+}
+
+static llvm::Function* writeAllFunction(llvm::Module& module) {
+	llvm::LLVMContext& context = module.getContext();
+	auto* type = llvm::FunctionType::get(llvm::Type::getVoidTy(context), { llvm::Type::getInt8PtrTy(context), llvm::Type::getInt64Ty(context) }, false);
+	return getOrDefine(module, "potato.fmt.write_all", type, buildWriteAll);
+}
+
+static llvm::Function* fixedFunction(llvm::Module& module) {
+	llvm::LLVMContext& context = module.getContext();
+	auto* type = llvm::FunctionType::get(llvm::Type::getVoidTy(context), { llvm::Type::getDoubleTy(context) }, false);
+	return getOrDefine(module, "potato.fmt.fixed", type, buildFixed);
+}
+
+static llvm::FunctionCallee libcFunction(llvm::Module& module, const char* name, llvm::Type* result, llvm::ArrayRef<llvm::Type*> arguments) {
+	return module.getOrInsertFunction(name, llvm::FunctionType::get(result, arguments, false));
+}
+
+static void createTrap(llvm::IRBuilder<>& b, llvm::Module& module) {
+	b.CreateCall(llvm::Intrinsic::getDeclaration(&module, llvm::Intrinsic::trap));
+	b.CreateUnreachable();
+}
+
+// Heap memory starts with a header holding its own address xor this, Free traps when it's missing. Memory from
+// anywhere else, like an arena or the stack, or memory that was already freed, doesn't have it.
+static constexpr u64 heapTag = 0x706f7461746f4d4dull;
+static constexpr u64 heapHeaderSize = 16; // Keeps the memory after it aligned like calloc's
+
+static void buildAlloc(llvm::Module& module, llvm::Function* function) {
+	llvm::LLVMContext& context = module.getContext();
+	llvm::IRBuilder<> b(context);
+
+	auto* entry = llvm::BasicBlock::Create(context, "entry", function);
+	auto* allocate = llvm::BasicBlock::Create(context, "allocate", function);
+	auto* fail = llvm::BasicBlock::Create(context, "fail", function);
+	auto* done = llvm::BasicBlock::Create(context, "done", function);
+
+	llvm::Value* count = function->getArg(0);
+	llvm::Value* size = function->getArg(1);
+
+	b.SetInsertPoint(entry);
+	llvm::Value* product = b.CreateBinaryIntrinsic(llvm::Intrinsic::umul_with_overflow, count, size);
+	llvm::Value* bytes = b.CreateExtractValue(product, 0, "bytes");
+	llvm::Value* total = b.CreateAdd(bytes, b.getInt64(heapHeaderSize), "total");
+	llvm::Value* tooLarge = b.CreateOr(b.CreateExtractValue(product, 1), b.CreateICmpULT(total, bytes));
+	b.CreateCondBr(tooLarge, fail, allocate, llvm::MDBuilder(context).createBranchWeights(1, 2000));
+
+	b.SetInsertPoint(allocate);
+	llvm::Value* block = b.CreateCall(libcFunction(module, "calloc", b.getInt8PtrTy(), { b.getInt64Ty(), b.getInt64Ty() }), { b.getInt64(1), total }, "block");
+	b.CreateCondBr(b.CreateIsNull(block), fail, done, llvm::MDBuilder(context).createBranchWeights(1, 2000));
+
+	b.SetInsertPoint(fail);
+	createTrap(b, module);
+
+	b.SetInsertPoint(done);
+	llvm::Value* memory = b.CreateInBoundsGEP(b.getInt8Ty(), block, b.getInt64(heapHeaderSize), "memory");
+	llvm::Value* tag = b.CreateXor(b.CreatePtrToInt(memory, b.getInt64Ty()), b.getInt64(heapTag));
+	b.CreateStore(tag, b.CreateBitCast(block, b.getInt64Ty()->getPointerTo()));
+	b.CreateRet(memory);
+}
+
+static void buildFree(llvm::Module& module, llvm::Function* function) {
+	llvm::LLVMContext& context = module.getContext();
+	llvm::IRBuilder<> b(context);
+
+	auto* entry = llvm::BasicBlock::Create(context, "entry", function);
+	auto* check = llvm::BasicBlock::Create(context, "check", function);
+	auto* release = llvm::BasicBlock::Create(context, "release", function);
+	auto* fail = llvm::BasicBlock::Create(context, "fail", function);
+	auto* done = llvm::BasicBlock::Create(context, "done", function);
+
+	llvm::Value* memory = function->getArg(0);
+
+	// Null like free(NULL), a zeroed slice has no memory
+	b.SetInsertPoint(entry);
+	b.CreateCondBr(b.CreateIsNull(memory), done, check);
+
+	b.SetInsertPoint(check);
+	llvm::Value* block = b.CreateInBoundsGEP(b.getInt8Ty(), memory, b.getInt64(-static_cast<i64>(heapHeaderSize)), "block");
+	llvm::Value* tagField = b.CreateBitCast(block, b.getInt64Ty()->getPointerTo());
+	llvm::Value* tag = b.CreateLoad(b.getInt64Ty(), tagField, "tag");
+	llvm::Value* expected = b.CreateXor(b.CreatePtrToInt(memory, b.getInt64Ty()), b.getInt64(heapTag));
+	b.CreateCondBr(b.CreateICmpEQ(tag, expected), release, fail, llvm::MDBuilder(context).createBranchWeights(2000, 1));
+
+	b.SetInsertPoint(release);
+	b.CreateStore(b.getInt64(0), tagField); // A second free traps
+	b.CreateCall(libcFunction(module, "free", b.getVoidTy(), { b.getInt8PtrTy() }), { block });
+	b.CreateBr(done);
+
+	b.SetInsertPoint(fail);
+	createTrap(b, module);
+
+	b.SetInsertPoint(done);
+	b.CreateRetVoid();
+}
+
+static void buildHeapAllocHook(llvm::Module& module, llvm::Function* function) {
+	llvm::IRBuilder<> b(llvm::BasicBlock::Create(module.getContext(), "entry", function));
+	b.CreateRet(b.CreateCall(memoryFunction(module, MemoryFunction::Alloc), { function->getArg(1), function->getArg(2) }));
+}
+
+static void buildHeapFreeHook(llvm::Module& module, llvm::Function* function) {
+	llvm::IRBuilder<> b(llvm::BasicBlock::Create(module.getContext(), "entry", function));
+	b.CreateCall(memoryFunction(module, MemoryFunction::Free), { function->getArg(1) });
+	b.CreateRetVoid();
+}
+
+static void buildArenaAllocHook(llvm::Module& module, llvm::Function* function) {
+	llvm::IRBuilder<> b(llvm::BasicBlock::Create(module.getContext(), "entry", function));
+	llvm::Value* arena = b.CreateBitCast(function->getArg(0), arenaType(module.getContext())->getPointerTo());
+	b.CreateRet(b.CreateCall(memoryFunction(module, MemoryFunction::ArenaAlloc), { arena, function->getArg(1), function->getArg(2), function->getArg(3) }));
+}
+
+static void buildArenaFreeHook(llvm::Module& module, llvm::Function* function) {
+	llvm::IRBuilder<> b(llvm::BasicBlock::Create(module.getContext(), "entry", function));
+	b.CreateRetVoid();
+}
+
+// Bumps the offset in the current chunk. When the allocation doesn't fit a new chunk, twice as large as the last one,
+// is linked in front and the allocation is tried again.
+static void buildArenaAlloc(llvm::Module& module, llvm::Function* function) {
+	llvm::LLVMContext& context = module.getContext();
+	llvm::IRBuilder<> b(context);
+	llvm::StructType* arena = arenaType(context);
+
+	auto* entry = llvm::BasicBlock::Create(context, "entry", function);
+	auto* check = llvm::BasicBlock::Create(context, "check", function);
+	auto* bump = llvm::BasicBlock::Create(context, "bump", function);
+	auto* grow = llvm::BasicBlock::Create(context, "grow", function);
+	auto* link = llvm::BasicBlock::Create(context, "link", function);
+	auto* fail = llvm::BasicBlock::Create(context, "fail", function);
+
+	llvm::Value* self = function->getArg(0);
+	llvm::Value* count = function->getArg(1);
+	llvm::Value* size = function->getArg(2);
+	llvm::Value* alignment = function->getArg(3);
+
+	b.SetInsertPoint(entry);
+	llvm::Value* product = b.CreateBinaryIntrinsic(llvm::Intrinsic::umul_with_overflow, count, size);
+	llvm::Value* bytes = b.CreateExtractValue(product, 0, "bytes");
+	llvm::Value* overflow = b.CreateExtractValue(product, 1, "overflow");
+	llvm::Value* chunkField = b.CreateStructGEP(arena, self, 0);
+	llvm::Value* usedField = b.CreateStructGEP(arena, self, 1);
+	llvm::Value* capacityField = b.CreateStructGEP(arena, self, 2);
+	b.CreateBr(check);
+
+	// Aligned on the address rather than the offset, so align(N) above what malloc guarantees still holds
+	b.SetInsertPoint(check);
+	llvm::Value* chunk = b.CreateLoad(b.getInt8PtrTy(), chunkField, "chunk");
+	llvm::Value* used = b.CreateLoad(b.getInt64Ty(), usedField, "used");
+	llvm::Value* capacity = b.CreateLoad(b.getInt64Ty(), capacityField, "capacity");
+	llvm::Value* base = b.CreatePtrToInt(chunk, b.getInt64Ty());
+	llvm::Value* mask = b.CreateSub(alignment, b.getInt64(1));
+	llvm::Value* start = b.CreateSub(b.CreateAnd(b.CreateAdd(b.CreateAdd(base, used), mask), b.CreateNot(mask)), base, "start");
+	llvm::Value* end = b.CreateAdd(start, bytes, "end");
+	llvm::Value* fits = b.CreateAnd(b.CreateNot(overflow), b.CreateICmpULE(end, capacity));
+	b.CreateCondBr(fits, bump, grow, llvm::MDBuilder(context).createBranchWeights(2000, 1));
+
+	b.SetInsertPoint(bump);
+	b.CreateStore(end, usedField);
+	llvm::Value* memory = b.CreateInBoundsGEP(b.getInt8Ty(), chunk, start, "memory");
+	b.CreateMemSet(memory, b.getInt8(0), bytes, llvm::MaybeAlign(1));
+	b.CreateRet(memory);
+
+	b.SetInsertPoint(grow);
+	llvm::Value* needed = b.CreateAdd(bytes, b.CreateAdd(alignment, b.getInt64(chunkHeaderSize)), "needed");
+	llvm::Value* tooLarge = b.CreateOr(overflow, b.CreateICmpULT(needed, bytes));
+	b.CreateCondBr(tooLarge, fail, link, llvm::MDBuilder(context).createBranchWeights(1, 2000));
+
+	b.SetInsertPoint(link);
+	llvm::Value* doubled = b.CreateShl(capacity, 1);
+	llvm::Value* chunkSize = b.CreateSelect(b.CreateICmpUGT(doubled, b.getInt64(firstChunkSize)), doubled, b.getInt64(firstChunkSize));
+	chunkSize = b.CreateSelect(b.CreateICmpUGT(needed, chunkSize), needed, chunkSize, "size");
+	llvm::Value* block = b.CreateCall(libcFunction(module, "malloc", b.getInt8PtrTy(), { b.getInt64Ty() }), { chunkSize }, "block");
+	llvm::BasicBlock* allocated = llvm::BasicBlock::Create(context, "allocated", function);
+	b.CreateCondBr(b.CreateIsNull(block), fail, allocated, llvm::MDBuilder(context).createBranchWeights(1, 2000));
+
+	b.SetInsertPoint(allocated);
+	b.CreateStore(chunk, b.CreateBitCast(block, b.getInt8PtrTy()->getPointerTo()));
+	b.CreateStore(chunkSize, b.CreateBitCast(b.CreateInBoundsGEP(b.getInt8Ty(), block, b.getInt64(8)), b.getInt64Ty()->getPointerTo()));
+	b.CreateStore(block, chunkField);
+	b.CreateStore(b.getInt64(chunkHeaderSize), usedField);
+	b.CreateStore(chunkSize, capacityField);
+	b.CreateBr(check);
+
+	b.SetInsertPoint(fail);
+	createTrap(b, module);
+}
+
+// Frees the chunks in the list starting at first, following the previous pointers in their headers.
+static void freeChunks(llvm::IRBuilder<>& b, llvm::Module& module, llvm::Function* function, llvm::Value* first, llvm::BasicBlock* done) {
+	llvm::LLVMContext& context = module.getContext();
+	llvm::BasicBlock* from = b.GetInsertBlock();
+	auto* loop = llvm::BasicBlock::Create(context, "loop", function, done);
+	auto* body = llvm::BasicBlock::Create(context, "free", function, done);
+	b.CreateBr(loop);
+
+	b.SetInsertPoint(loop);
+	llvm::PHINode* chunk = b.CreatePHI(b.getInt8PtrTy(), 2, "chunk");
+	chunk->addIncoming(first, from);
+	b.CreateCondBr(b.CreateIsNull(chunk), done, body);
+
+	b.SetInsertPoint(body);
+	llvm::Value* previous = b.CreateLoad(b.getInt8PtrTy(), b.CreateBitCast(chunk, b.getInt8PtrTy()->getPointerTo()), "previous");
+	b.CreateCall(libcFunction(module, "free", b.getVoidTy(), { b.getInt8PtrTy() }), { chunk });
+	chunk->addIncoming(previous, body);
+	b.CreateBr(loop);
+}
+
+static void buildArenaReset(llvm::Module& module, llvm::Function* function) {
+	llvm::LLVMContext& context = module.getContext();
+	llvm::IRBuilder<> b(context);
+	llvm::StructType* arena = arenaType(context);
+
+	auto* entry = llvm::BasicBlock::Create(context, "entry", function);
+	auto* keep = llvm::BasicBlock::Create(context, "keep", function);
+	auto* done = llvm::BasicBlock::Create(context, "done", function);
+
+	llvm::Value* self = function->getArg(0);
+
+	b.SetInsertPoint(entry);
+	llvm::Value* chunk = b.CreateLoad(b.getInt8PtrTy(), b.CreateStructGEP(arena, self, 0), "chunk");
+	b.CreateCondBr(b.CreateIsNull(chunk), done, keep);
+
+	// With a steady workload everything fits the newest chunk after a few rounds, and this is O(1)
+	b.SetInsertPoint(keep);
+	llvm::Value* previousField = b.CreateBitCast(chunk, b.getInt8PtrTy()->getPointerTo());
+	llvm::Value* previous = b.CreateLoad(b.getInt8PtrTy(), previousField, "previous");
+	b.CreateStore(llvm::Constant::getNullValue(b.getInt8PtrTy()), previousField);
+	b.CreateStore(b.getInt64(chunkHeaderSize), b.CreateStructGEP(arena, self, 1));
+	freeChunks(b, module, function, previous, done);
+
+	b.SetInsertPoint(done);
+	b.CreateRetVoid();
+}
+
+static void buildArenaRelease(llvm::Module& module, llvm::Function* function) {
+	llvm::LLVMContext& context = module.getContext();
+	llvm::IRBuilder<> b(context);
+	llvm::StructType* arena = arenaType(context);
+
+	auto* entry = llvm::BasicBlock::Create(context, "entry", function);
+	auto* done = llvm::BasicBlock::Create(context, "done", function);
+
+	llvm::Value* self = function->getArg(0);
+
+	b.SetInsertPoint(entry);
+	llvm::Value* chunk = b.CreateLoad(b.getInt8PtrTy(), b.CreateStructGEP(arena, self, 0), "chunk");
+	freeChunks(b, module, function, chunk, done);
+
+	b.SetInsertPoint(done);
+	b.CreateStore(llvm::Constant::getNullValue(arena), self);
+	b.CreateRetVoid();
+}
+
+llvm::Function* lang::runtime::formatFunction(llvm::Module& module, FormatFunction function)
+{
+	llvm::LLVMContext& context = module.getContext();
+	llvm::Type* voidType = llvm::Type::getVoidTy(context);
+	llvm::Type* i64 = llvm::Type::getInt64Ty(context);
+
+	switch (function) {
+	case FormatFunction::Write:
+		return getOrDefine(module, "potato.fmt.write", llvm::FunctionType::get(voidType, { llvm::Type::getInt8PtrTy(context), i64 }, false), buildWrite);
+	case FormatFunction::Flush:
+		return getOrDefine(module, "potato.fmt.flush", llvm::FunctionType::get(voidType, false), buildFlush);
+	case FormatFunction::Signed:
+		return getOrDefine(module, "potato.fmt.i64", llvm::FunctionType::get(voidType, { i64 }, false), buildSigned);
+	case FormatFunction::Unsigned:
+		return getOrDefine(module, "potato.fmt.u64", llvm::FunctionType::get(voidType, { i64 }, false), buildUnsigned);
+	case FormatFunction::Float:
+		return getOrDefine(module, "potato.fmt.f64", llvm::FunctionType::get(voidType, { llvm::Type::getDoubleTy(context) }, false), buildFloat);
+	}
+
+	return nullptr;
+}
+
+llvm::StructType* lang::runtime::arenaType(llvm::LLVMContext& context)
+{
+	return llvm::StructType::get(context, { llvm::Type::getInt8PtrTy(context), llvm::Type::getInt64Ty(context), llvm::Type::getInt64Ty(context) });
+}
+
+static llvm::FunctionType* allocHookType(llvm::LLVMContext& context) {
+	llvm::Type* bytes = llvm::Type::getInt8PtrTy(context);
+	llvm::Type* i64 = llvm::Type::getInt64Ty(context);
+	return llvm::FunctionType::get(bytes, { bytes, i64, i64, i64 }, false);
+}
+
+static llvm::FunctionType* freeHookType(llvm::LLVMContext& context) {
+	llvm::Type* bytes = llvm::Type::getInt8PtrTy(context);
+	return llvm::FunctionType::get(llvm::Type::getVoidTy(context), { bytes, bytes }, false);
+}
+
+llvm::StructType* lang::runtime::allocatorType(llvm::LLVMContext& context)
+{
+	return llvm::StructType::get(context, { llvm::Type::getInt8PtrTy(context), allocHookType(context)->getPointerTo(), freeHookType(context)->getPointerTo() });
+}
+
+llvm::Function* lang::runtime::memoryFunction(llvm::Module& module, MemoryFunction function)
+{
+	llvm::LLVMContext& context = module.getContext();
+	llvm::Type* voidType = llvm::Type::getVoidTy(context);
+	llvm::Type* bytes = llvm::Type::getInt8PtrTy(context);
+	llvm::Type* i64 = llvm::Type::getInt64Ty(context);
+	llvm::Type* arena = arenaType(context)->getPointerTo();
+
+	switch (function) {
+	case MemoryFunction::Alloc:
+		return getOrDefine(module, "potato.mem.alloc", llvm::FunctionType::get(bytes, { i64, i64 }, false), buildAlloc);
+	case MemoryFunction::Free:
+		return getOrDefine(module, "potato.mem.free", llvm::FunctionType::get(voidType, { bytes }, false), buildFree);
+	case MemoryFunction::ArenaAlloc:
+		return getOrDefine(module, "potato.mem.arena_alloc", llvm::FunctionType::get(bytes, { arena, i64, i64, i64 }, false), buildArenaAlloc);
+	case MemoryFunction::ArenaReset:
+		return getOrDefine(module, "potato.mem.arena_reset", llvm::FunctionType::get(voidType, { arena }, false), buildArenaReset);
+	case MemoryFunction::ArenaRelease:
+		return getOrDefine(module, "potato.mem.arena_release", llvm::FunctionType::get(voidType, { arena }, false), buildArenaRelease);
+	case MemoryFunction::HeapAllocHook:
+		return getOrDefine(module, "potato.mem.heap_alloc_hook", allocHookType(context), buildHeapAllocHook);
+	case MemoryFunction::HeapFreeHook:
+		return getOrDefine(module, "potato.mem.heap_free_hook", freeHookType(context), buildHeapFreeHook);
+	case MemoryFunction::ArenaAllocHook:
+		return getOrDefine(module, "potato.mem.arena_alloc_hook", allocHookType(context), buildArenaAllocHook);
+	case MemoryFunction::ArenaFreeHook:
+		return getOrDefine(module, "potato.mem.arena_free_hook", freeHookType(context), buildArenaFreeHook);
+	}
+
+	return nullptr;
+}
+
+llvm::GlobalVariable* lang::runtime::threadArena(llvm::Module& module)
+{
+	return threadLocal(module, "potato.mem.thread_arena", arenaType(module.getContext()));
+}
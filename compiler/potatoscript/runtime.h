@@ -0,0 +1,55 @@
+#pragma once
+
+namespace llvm {
+	class Function;
+	class GlobalVariable;
+	class LLVMContext;
+	class Module;
+	class StructType;
+}
+
+namespace lang::runtime {
+
+	// core.fmt, the runtime behind print, println and flush. Output collects in a thread-local buffer that's
+	// written to stdout when it fills up, on flush() and when the program exits, so a print is a memcpy in the common case.
+	enum class FormatFunction {
+		Write, // void (i8* data, i64 length), raw bytes
+		Flush, // void (), writes out the calling thread's buffer
+		Signed, // void (i64)
+		Unsigned, // void (u64)
+		Float, // void (f64), up to 6 decimals, scientific notation for very large and small magnitudes. Calls log10 and pow, so needs libm
+	};
+
+	// Returns the runtime fn, defining it and whatever it uses in module on first use. Everything is linkonce_odr,
+	// so modules linked together end up sharing one buffer and one copy of each fn.
+	llvm::Function* formatFunction(llvm::Module& module, FormatFunction function);
+
+	// Allocation behind alloc, free and arenas. An arena hands out memory from chunks it gets from malloc by bumping an
+	// offset and frees all of it at once. Each chunk starts with a { i8* previous, i64 size } header linking it to the one before.
+	enum class MemoryFunction {
+		Alloc, // i8* (i64 count, i64 size), zeroed memory from the heap, traps when out of memory
+		Free, // void (i8*), gives memory from Alloc back to the heap, traps for anything else, e.g. arena memory
+		ArenaAlloc, // i8* (Arena*, i64 count, i64 size, i64 alignment), zeroed, traps when out of memory
+		ArenaReset, // void (Arena*), frees everything allocated so far, the newest and largest chunk is kept for reuse
+		ArenaRelease, // void (Arena*), frees all chunks, leaving an empty arena
+
+		// Hooks of the Allocator implementations, i8* (i8* self, i64 count, i64 size, i64 alignment) and void (i8* self, i8* memory)
+		HeapAllocHook,
+		HeapFreeHook,
+		ArenaAllocHook, // self is the Arena*
+		ArenaFreeHook, // Does nothing, arena memory is freed all at once by reset or release
+	};
+
+	// Arena as { i8* chunk, i64 used, i64 capacity }, all zeros is an empty arena that allocates its first chunk on use.
+	llvm::StructType* arenaType(llvm::LLVMContext& context);
+
+	// Allocator as { i8* self, alloc hook, free hook }, alloc<T>(allocator, n) and free(allocator, s) call through it.
+	// The heap and arenas implement it, see the hooks in MemoryFunction.
+	llvm::StructType* allocatorType(llvm::LLVMContext& context);
+
+	// Same as formatFunction, for allocation.
+	llvm::Function* memoryFunction(llvm::Module& module, MemoryFunction function);
+
+	// Arena of the calling thread, behind temp_alloc and temp_reset. It isn't released when the thread exits.
+	llvm::GlobalVariable* threadArena(llvm::Module& module);
+}
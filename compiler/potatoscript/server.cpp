@@ -0,0 +1,464 @@
+#include "server.h"
+
+#include <iostream>
+#include <map>
+
+#include "driver.h"
+
+#ifdef _WIN32
+
+int lang::server::run(const std::string& socketPath)
+{
+	std::cerr << "compile server is only supported on unix platforms\n";
+	return -1;
+}
+
+int lang::server::request(const std::string& socketPath, const std::vector<std::string>& args)
+{
+	std::cerr << "compile server is only supported on unix platforms\n";
+	return -1;
+}
+
+#else
+
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+// Protocol: the client writes its working directory and then one argument per line, followed by an empty line.
+// Relative paths in the arguments are relative to that directory, the server changes to it for the request.
+// The server answers with "ok <output path>" or "error" on the first line, followed by the diagnostics,
+// and closes the connection.
+
+// Identifies a version of a file. Saving twice within a second keeps st_mtime, so the nanoseconds and size are compared too.
+struct FileStamp {
+	time_t seconds = 0;
+	long nanoseconds = 0;
+	off_t size = 0;
+
+	bool operator==(const FileStamp& other) const { return seconds == other.seconds && nanoseconds == other.nanoseconds && size == other.size; }
+};
+
+struct CacheEntry {
+	FileStamp input;
+	std::string response;
+};
+
+static bool writeAll(int fd, const std::string& s) {
+#ifdef MSG_NOSIGNAL
+	constexpr int flags = MSG_NOSIGNAL; // A client that went away is an error here, not a SIGPIPE
+#else
+	constexpr int flags = 0;
+#endif
+	size_t written = 0;
+	while (written < s.size()) {
+		ssize_t n = send(fd, s.data() + written, s.size() - written, flags);
+		if (n <= 0) {
+			return false;
+		}
+
+		written += static_cast<size_t>(n);
+	}
+
+	return true;
+}
+
+static std::string readAll(int fd) {
+	std::string result;
+	char buffer[4096];
+	ssize_t n;
+	while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+		result.append(buffer, static_cast<size_t>(n));
+	}
+
+	return result;
+}
+
+// Splits a complete request into its lines, false while the empty line that ends it hasn't arrived.
+static bool parseRequest(const std::string& text, std::vector<std::string>* outLines) {
+	size_t end = text.find("\n\n");
+	if (end == std::string::npos) {
+		return false;
+	}
+
+	size_t lineStart = 0;
+	while (lineStart <= end) {
+		size_t lineEnd = text.find('\n', lineStart);
+		outLines->push_back(text.substr(lineStart, lineEnd - lineStart));
+		lineStart = lineEnd + 1;
+	}
+
+	return true;
+}
+
+static bool tryGetFileStamp(const std::string& path, FileStamp* outStamp) {
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) {
+		return false;
+	}
+
+#ifdef __APPLE__
+	outStamp->seconds = st.st_mtimespec.tv_sec;
+	outStamp->nanoseconds = st.st_mtimespec.tv_nsec;
+#else
+	outStamp->seconds = st.st_mtim.tv_sec;
+	outStamp->nanoseconds = st.st_mtim.tv_nsec;
+#endif
+	outStamp->size = st.st_size;
+	return true;
+}
+
+static std::string currentDirectory() {
+	char buffer[PATH_MAX];
+	return getcwd(buffer, sizeof(buffer)) ? std::string(buffer) : std::string();
+}
+
+static int openSocket(const std::string& socketPath, sockaddr_un* outAddress) {
+	if (socketPath.size() >= sizeof(outAddress->sun_path)) {
+		std::cerr << "socket path is too long: " << socketPath << "\n";
+		return -1;
+	}
+
+	std::memset(outAddress, 0, sizeof(sockaddr_un));
+	outAddress->sun_family = AF_UNIX;
+	std::strncpy(outAddress->sun_path, socketPath.c_str(), sizeof(outAddress->sun_path) - 1);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		std::cerr << "couldn't create socket: " << std::strerror(errno) << "\n";
+	}
+
+	return fd;
+}
+
+// Starts compiling in a forked child so an abort() in the parser only kills the child. Everything the child writes
+// to stdout/stderr can be read from *outOutput, the diagnostics of the request. Returns the child, -1 on failure.
+static pid_t startCompile(const lang::driver::Options& options, int* outOutput, std::string* outError) {
+	int pipeFds[2];
+	if (pipe(pipeFds) != 0) {
+		*outError = std::string("couldn't create pipe: ") + std::strerror(errno) + "\n";
+		return -1;
+	}
+
+	// Anything still buffered would be written again by the child
+	std::cout.flush();
+	std::cerr.flush();
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		close(pipeFds[0]);
+		close(pipeFds[1]);
+		*outError = std::string("couldn't fork: ") + std::strerror(errno) + "\n";
+		return -1;
+	}
+
+	if (pid == 0) {
+		close(pipeFds[0]);
+		dup2(pipeFds[1], STDOUT_FILENO);
+		dup2(pipeFds[1], STDERR_FILENO);
+		close(pipeFds[1]);
+
+		int result = lang::driver::compile(options);
+		std::cout.flush();
+		std::cerr.flush();
+		std::fflush(nullptr);
+		_exit(result == 0 ? 0 : 1);
+	}
+
+	close(pipeFds[1]);
+	*outOutput = pipeFds[0];
+	return pid;
+}
+
+using Clock = std::chrono::steady_clock;
+
+// A client can't take longer than this to send its request, it would hold on to a connection for nothing.
+constexpr auto requestTimeout = std::chrono::seconds(10);
+
+// A client connection, from reading its request to answering it once the compile is done.
+struct Connection {
+	int fd = -1;
+	std::string request; // Read so far
+	Clock::time_point deadline; // For the whole request to arrive
+
+	// While compiling
+	pid_t child = -1;
+	int output = -1; // The child's stdout and stderr, -1 once the child closed it
+	std::string diagnostics;
+	std::string key;
+	FileStamp input;
+	bool hasInput = false;
+	std::string outputPath;
+};
+
+static volatile sig_atomic_t stopSignal = 0;
+
+static void onStopSignal(int signal) {
+	stopSignal = signal;
+}
+
+// Handles a complete request. Either answers it right away or starts compiling it in a child, false once the
+// connection is done with.
+static bool handleRequest(Connection& c, const std::vector<std::string>& lines, std::map<std::string, CacheEntry>& cache, bool* outShutdown) {
+	const std::string& workingDirectory = lines[0];
+	std::vector<std::string> args(lines.begin() + 1, lines.end());
+	if (args.size() == 1 && args[0] == "shutdown") {
+		writeAll(c.fd, "ok\n");
+		*outShutdown = true;
+		return false;
+	}
+
+	if (chdir(workingDirectory.c_str()) != 0) {
+		writeAll(c.fd, "error\ncouldn't change to " + workingDirectory + ": " + std::strerror(errno) + "\n");
+		return false;
+	}
+
+	lang::driver::Options options;
+	std::string error;
+	if (lang::driver::parseArguments(args, &options, &error) == false) {
+		writeAll(c.fd, "error\n" + error + "\n");
+		return false;
+	}
+
+	options.verbose = false;
+
+	for (auto& line : lines) {
+		c.key += line;
+		c.key += '\n';
+	}
+
+	c.hasInput = tryGetFileStamp(options.inputPath, &c.input);
+	FileStamp output;
+
+	auto it = cache.find(c.key);
+	if (c.hasInput && it != cache.end() && it->second.input == c.input && tryGetFileStamp(options.outputPath, &output)) {
+		writeAll(c.fd, it->second.response);
+		return false;
+	}
+
+	c.outputPath = options.outputPath;
+	c.child = startCompile(options, &c.output, &error);
+	if (c.child < 0) {
+		writeAll(c.fd, "error\n" + error);
+		return false;
+	}
+
+	return true;
+}
+
+// Answers a connection whose child exited with status and caches the response when it compiled.
+static void finishCompile(Connection& c, int status, std::map<std::string, CacheEntry>& cache) {
+	bool success = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	if (WIFSIGNALED(status)) {
+		c.diagnostics += "compilation aborted (signal " + std::to_string(WTERMSIG(status)) + ")\n";
+	}
+
+	std::string response = success ? "ok " + c.outputPath + "\n" : "error\n";
+	response += c.diagnostics;
+
+	if (success && c.hasInput) {
+		cache[c.key] = CacheEntry{ c.input, response };
+	}
+	else {
+		cache.erase(c.key);
+	}
+
+	writeAll(c.fd, response);
+}
+
+int lang::server::run(const std::string& relativeSocketPath)
+{
+	// Warm up everything that doesn't depend on the request before accepting connections.
+	lang::driver::initializeTarget();
+
+	// Requests change the working directory, the socket is removed by its absolute path at the end
+	std::string socketPath = relativeSocketPath;
+	if (socketPath.empty() == false && socketPath[0] != '/') {
+		socketPath = currentDirectory() + "/" + socketPath;
+	}
+
+	sockaddr_un address;
+	int serverFd = openSocket(socketPath, &address);
+	if (serverFd < 0) {
+		return -1;
+	}
+
+	unlink(socketPath.c_str());
+	if (bind(serverFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(serverFd, 16) != 0) {
+		std::cerr << "couldn't listen on " << socketPath << ": " << std::strerror(errno) << "\n";
+		close(serverFd);
+		return -1;
+	}
+
+	// Clients that disconnect early are reported by send, SIGINT and SIGTERM stop the loop so the socket gets removed
+	signal(SIGPIPE, SIG_IGN);
+	struct sigaction stop = {};
+	stop.sa_handler = onStopSignal;
+	sigaction(SIGINT, &stop, nullptr);
+	sigaction(SIGTERM, &stop, nullptr);
+
+	std::cout << "compile server listening on " << socketPath << "\n";
+
+	// Keyed on the working directory and arguments, invalidated when the source file changes.
+	std::map<std::string, CacheEntry> cache;
+
+	// Requests are read and compiled concurrently, one poll loop waits for new connections, request data and the
+	// output of the compiling children.
+	std::vector<Connection> connections;
+	bool accepting = true;
+	while (accepting || connections.empty() == false) {
+		if (stopSignal != 0) {
+			accepting = false;
+		}
+
+		std::vector<pollfd> fds;
+		fds.push_back(pollfd{ accepting ? serverFd : -1, POLLIN, 0 });
+		bool reaping = false;
+		for (auto& c : connections) {
+			fds.push_back(pollfd{ c.child < 0 ? c.fd : c.output, POLLIN, 0 });
+			reaping |= c.child >= 0 && c.output < 0;
+		}
+
+		// Children that closed their output are about to exit, they're checked for often until they're reaped
+		if (poll(fds.data(), fds.size(), reaping ? 10 : 1000) < 0 && errno != EINTR) {
+			std::cerr << "poll failed: " << std::strerror(errno) << "\n";
+			break;
+		}
+
+		Clock::time_point now = Clock::now();
+		std::vector<Connection> open;
+		for (size_t i = 0; i < connections.size(); i++) {
+			Connection& c = connections[i];
+			short events = fds[i + 1].revents;
+			bool keep = true;
+
+			if (c.child < 0) {
+				if (events & (POLLIN | POLLHUP | POLLERR)) {
+					char buffer[1024];
+					ssize_t n = read(c.fd, buffer, sizeof(buffer));
+					std::vector<std::string> lines;
+					bool shutdown = false;
+					if (n <= 0) {
+						keep = false;
+					}
+					else if (c.request.append(buffer, static_cast<size_t>(n)); parseRequest(c.request, &lines)) {
+						keep = handleRequest(c, lines, cache, &shutdown);
+						accepting &= shutdown == false;
+					}
+				}
+
+				if (keep && c.child < 0 && (now > c.deadline || accepting == false)) {
+					keep = false; // Gave up on the request, or stopping and only finishing compiles
+				}
+			}
+			else {
+				if (c.output >= 0 && (events & (POLLIN | POLLHUP | POLLERR))) {
+					char buffer[4096];
+					ssize_t n = read(c.output, buffer, sizeof(buffer));
+					if (n > 0) {
+						c.diagnostics.append(buffer, static_cast<size_t>(n));
+					}
+					else {
+						close(c.output);
+						c.output = -1;
+					}
+				}
+
+				int status = 0;
+				if (c.output < 0 && waitpid(c.child, &status, WNOHANG) == c.child) {
+					finishCompile(c, status, cache);
+					keep = false;
+				}
+			}
+
+			if (keep) {
+				open.push_back(std::move(c));
+			}
+			else {
+				close(c.fd);
+			}
+		}
+		connections = std::move(open);
+
+		if (accepting && (fds[0].revents & POLLIN)) {
+			int clientFd = accept(serverFd, nullptr, nullptr);
+			if (clientFd >= 0) {
+				Connection c;
+				c.fd = clientFd;
+				c.deadline = now + requestTimeout;
+				connections.push_back(std::move(c));
+			}
+			else if (errno != EINTR && errno != ECONNABORTED) {
+				std::cerr << "accept failed: " << std::strerror(errno) << "\n";
+				accepting = false;
+			}
+		}
+	}
+
+	close(serverFd);
+	unlink(socketPath.c_str());
+	return 0;
+}
+
+int lang::server::request(const std::string& socketPath, const std::vector<std::string>& args)
+{
+	sockaddr_un address;
+	int fd = openSocket(socketPath, &address);
+	if (fd < 0) {
+		return -1;
+	}
+
+	if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+		std::cerr << "couldn't connect to compile server at " << socketPath << ": " << std::strerror(errno) << "\n";
+		close(fd);
+		return -1;
+	}
+
+	std::string workingDirectory = currentDirectory();
+	if (workingDirectory.empty()) {
+		std::cerr << "couldn't get the working directory: " << std::strerror(errno) << "\n";
+		close(fd);
+		return -1;
+	}
+
+	std::string message = workingDirectory + "\n";
+	for (auto& a : args) {
+		message += a;
+		message += '\n';
+	}
+	message += '\n';
+
+	if (writeAll(fd, message) == false) {
+		std::cerr << "couldn't send request to compile server\n";
+		close(fd);
+		return -1;
+	}
+
+	std::string response = readAll(fd);
+	close(fd);
+
+	size_t firstLineEnd = response.find('\n');
+	std::string status = response.substr(0, firstLineEnd);
+	std::string diagnostics = firstLineEnd == std::string::npos ? "" : response.substr(firstLineEnd + 1);
+
+	std::cerr << diagnostics;
+
+	if (status.rfind("ok", 0) == 0) {
+		if (status.size() > 3) {
+			std::cout << status.substr(3) << "\n";
+		}
+		return 0;
+	}
+
+	return 1;
+}
+
+#endif
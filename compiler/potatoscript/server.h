@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace lang::server {
+
+	constexpr const char* defaultSocketPath = "/tmp/potatoscript.sock";
+
+	// Runs a compile server on a unix domain socket until a "shutdown" request, SIGINT or SIGTERM comes in.
+	// LLVM and the target machine are initialized once and every request is compiled in a forked
+	// child, so the warm state is shared copy-on-write and a crashing compile can't take the server down.
+	// Requests are served concurrently, the socket file is removed when the server stops.
+	int run(const std::string& socketPath);
+
+	// Thin client, forwards compiler flags to a running server and prints its response.
+	int request(const std::string& socketPath, const std::vector<std::string>& args);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+namespace lang::source {
+
+	// Byte offset into a source file, tokens and nodes only keep this. Files are limited to 4 GiB.
+	using Offset = u32;
+
+	// How much of the mapping back to the source ends up in the binary, -gline-tables-only and -g.
+	enum class DebugInfo {
+		None,
+		LineTablesOnly, // Fns and line numbers, enough for symbolized profiles and stack traces
+		Full, // Also types and the locations of arguments and locals
+	};
+
+	// Zero based, the column counts bytes from the start of the line.
+	struct Location {
+		u32 line;
+		u32 column;
+	};
+
+	// Offset of the start of each line in a text, built with one memchr scan for line breaks.
+	class LineTable {
+	public:
+		LineTable() = default;
+		explicit LineTable(const std::string& text);
+
+		// Binary search for the line holding offset, offsets past the end land on the last line.
+		Location locate(Offset offset) const;
+
+		// Updates the table after [from, oldTo) of the text was replaced, text holds the result with the new part at
+		// [from, newTo). Only the new part is scanned, lines after it are shifted.
+		void replace(const std::string& text, Offset from, Offset oldTo, Offset newTo);
+		Offset lineStart(u32 line) const { return starts[line]; }
+		u32 lineCount() const { return static_cast<u32>(starts.size()); }
+
+	private:
+		std::vector<Offset> starts; // Always holds at least line 0
+	};
+
+	// A file being compiled. Lines are only counted once something asks for a location, which is usually never.
+	class File {
+	public:
+		std::string path;
+		std::string text;
+
+		File(std::string path, std::string text);
+
+		Location locate(Offset offset) const;
+
+		// "path:line:column" with one based line and column, the way compilers print them.
+		std::string describe(Offset offset) const;
+
+	private:
+		mutable std::unique_ptr<LineTable> lines;
+	};
+}
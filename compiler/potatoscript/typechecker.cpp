@@ -0,0 +1,1796 @@
+#include "typechecker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <utility>
+
+#include "parser.h"
+#include "comptime.h"
+
+using namespace lang::parser;
+using namespace lang::typechecker;
+
+bool lang::typechecker::isSignedInteger(const std::string& type)
+{
+	return type == "i8" || type == "i16" || type == "i32" || type == "i64";
+}
+
+bool lang::typechecker::isUnsignedInteger(const std::string& type)
+{
+	return type == "u8" || type == "u16" || type == "u32" || type == "u64";
+}
+
+bool lang::typechecker::isInteger(const std::string& type)
+{
+	return isSignedInteger(type) || isUnsignedInteger(type);
+}
+
+bool lang::typechecker::isFloat(const std::string& type)
+{
+	return type == "f32" || type == "f64";
+}
+
+bool lang::typechecker::isNumeric(const std::string& type)
+{
+	return isInteger(type) || isFloat(type);
+}
+
+u32 lang::typechecker::bitWidth(const std::string& type)
+{
+	if (type == "bool") return 1;
+	if (type == "i8" || type == "u8") return 8;
+	if (type == "i16" || type == "u16") return 16;
+	if (type == "i32" || type == "u32" || type == "f32") return 32;
+	if (type == "i64" || type == "u64" || type == "f64") return 64;
+	return 0;
+}
+
+bool lang::typechecker::isVector(const std::string& type)
+{
+	return vectorLength(type) != 0;
+}
+
+u32 lang::typechecker::vectorLength(const std::string& type)
+{
+	size_t x = type.rfind('x');
+	if (x == std::string::npos || isNumeric(type.substr(0, x)) == false) {
+		return 0;
+	}
+
+	const std::string lanes = type.substr(x + 1);
+	for (u32 n : { 2, 4, 8, 16, 32, 64 }) {
+		if (lanes == std::to_string(n)) {
+			return n;
+		}
+	}
+
+	return 0;
+}
+
+std::string lang::typechecker::elementType(const std::string& type)
+{
+	if (isVector(type)) {
+		return type.substr(0, type.rfind('x'));
+	}
+
+	return type;
+}
+
+bool lang::typechecker::isReference(const std::string& type)
+{
+	return type.starts_with("&");
+}
+
+std::string lang::typechecker::referencedType(const std::string& type)
+{
+	return isReference(type) ? type.substr(1) : type;
+}
+
+bool lang::typechecker::isTuple(const std::string& type)
+{
+	return type.starts_with("(");
+}
+
+std::vector<std::string> lang::typechecker::tupleElements(const std::string& type)
+{
+	std::vector<std::string> elements;
+	if (isTuple(type) == false) {
+		return elements;
+	}
+
+	size_t start = 1;
+	while (start < type.size()) {
+		size_t end = type.find_first_of(",)", start);
+		elements.push_back(type.substr(start, end - start));
+		start = end + 1;
+	}
+
+	return elements;
+}
+
+std::string lang::typechecker::tupleType(const std::vector<std::string>& elements)
+{
+	std::string type = "(";
+	for (size_t i = 0; i < elements.size(); i++) {
+		type += (i > 0 ? "," : "") + elements[i];
+	}
+
+	return type + ")";
+}
+
+bool lang::typechecker::isArray(const std::string& type)
+{
+	return type.size() > 2 && type[0] == '[' && type[1] != ']';
+}
+
+bool lang::typechecker::isSlice(const std::string& type)
+{
+	return type.starts_with("[]");
+}
+
+u64 lang::typechecker::arrayLength(const std::string& type)
+{
+	return isArray(type) ? std::stoull(type.substr(1, type.find(']') - 1)) : 0;
+}
+
+std::string lang::typechecker::indexedType(const std::string& type)
+{
+	if (type == "string") {
+		return "u8";
+	}
+
+	return type.substr(type.find(']') + 1);
+}
+
+void TypeScope::declare(const std::string& name, const std::string& type, bool fromArena)
+{
+	assigned(name);
+	variables.back()[name] = { type, fromArena };
+}
+
+void TypeScope::assigned(const std::string& name)
+{
+	for (auto& fact : inBoundsFacts) {
+		if (fact.index == name || fact.base == name) {
+			fact.holds = false;
+		}
+	}
+}
+
+TypeScope::Variable* TypeScope::find(const std::string& name)
+{
+	return const_cast<Variable*>(std::as_const(*this).find(name));
+}
+
+const TypeScope::Variable* TypeScope::find(const std::string& name) const
+{
+	for (auto it = variables.rbegin(); it != variables.rend(); it++) {
+		auto found = it->find(name);
+		if (found != it->end()) {
+			return &found->second;
+		}
+	}
+
+	return nullptr;
+}
+
+std::string TypeScope::lookup(const std::string& name) const
+{
+	const Variable* variable = find(name);
+	return variable ? variable->type : "";
+}
+
+// Whether e is memory from an arena, as far as the variables it comes from tell. Arena memory that went through an
+// Allocator or a fn isn't tracked, Free traps on it at runtime instead.
+static bool holdsArenaMemory(const TypeScope& scope, ExprAST* e)
+{
+	if (auto* call = dynamic_cast<CallExprAST*>(e)) {
+		return call->allocatesFromArena();
+	}
+	if (auto* variable = dynamic_cast<VariableExprAST*>(e)) {
+		const TypeScope::Variable* found = scope.find(variable->name);
+		return variable->isDeclaration() == false && variable->assignment == nullptr && found && found->fromArena;
+	}
+
+	return false;
+}
+
+void TypeScope::error(const std::string& message)
+{
+	if (file) {
+		std::cerr << file->describe(location) << ": ";
+	}
+	std::cerr << "type error: " << message << "\n";
+	errorCount++;
+}
+
+// Whether the literal number can be represented as type. Float types hold any integer literal, a float literal
+// doesn't fit f32 when it rounds to infinity. Magnitudes too small for f32 round to 0 like they do for f64 in the lexer.
+static bool literalFits(NumberExprAST* number, const std::string& type) {
+	if (number->isInteger() == false) {
+		return type != "f32" || std::isinf(static_cast<float>(number->floatValue())) == false;
+	}
+
+	if (isInteger(type) == false) {
+		return true;
+	}
+
+	u32 bits = bitWidth(type);
+	u64 max = isUnsignedInteger(type) ? ~u64(0) >> (64 - bits) : ~u64(0) >> (65 - bits);
+	return static_cast<u64>(number->integerValue()) <= max;
+}
+
+// Whether -number can be represented as the integer type, unsigned types only hold -0.
+static bool negatedLiteralFits(NumberExprAST* number, const std::string& type) {
+	u64 magnitude = static_cast<u64>(number->integerValue());
+	if (isUnsignedInteger(type)) {
+		return magnitude == 0;
+	}
+
+	return magnitude <= u64(1) << (bitWidth(type) - 1);
+}
+
+// Integer literal x of a negation -x, nullptr if e is anything else.
+static NumberExprAST* negatedLiteral(ExprAST* e) {
+	auto* negation = dynamic_cast<BinaryExprAST*>(e);
+	auto* number = negation && negation->isNegation ? dynamic_cast<NumberExprAST*>(negation->right) : nullptr;
+	return number && number->isInteger() ? number : nullptr;
+}
+
+// The literal as written in errors, e.g. 3.5e+38.
+static std::string literalText(NumberExprAST* number) {
+	if (number->isInteger()) {
+		return std::to_string(static_cast<u64>(number->integerValue()));
+	}
+
+	std::ostringstream text;
+	text << number->floatValue();
+	return text.str();
+}
+
+void TypeScope::coerce(ExprAST*& e, const std::string& to)
+{
+	if (e == nullptr || to.empty()) {
+		return;
+	}
+
+	const std::string& from = e->resolvedType;
+	if (from == to || from.empty()) {
+		return; // Nothing to do, or an error was already reported for e
+	}
+
+	// Each returned value is converted on its own
+	if (isTuple(to)) {
+		auto* tuple = dynamic_cast<TupleExprAST*>(e);
+		auto elements = tupleElements(to);
+		if (tuple == nullptr || tuple->elements.size() != elements.size()) {
+			error("cannot convert " + from + " to " + to);
+			return;
+		}
+
+		for (size_t i = 0; i < elements.size(); i++) {
+			coerce(tuple->elements[i], elements[i]);
+		}
+		e->resolvedType = to;
+		return;
+	}
+
+	if (isVector(to)) {
+		if (isVector(from)) {
+			if (vectorLength(from) != vectorLength(to)) {
+				error("cannot convert " + from + " to " + to + ", lane counts differ");
+				return;
+			}
+
+			e = createAst<CastExprAST>(e, to); // Lane-wise conversion
+			return;
+		}
+
+		// Scalar is converted to the lane type first and then broadcast to every lane
+		size_t errorsBefore = errorCount;
+		coerce(e, elementType(to));
+		if (errorCount == errorsBefore) {
+			e = createAst<CastExprAST>(e, to);
+		}
+		return;
+	}
+
+	// Array literals take the element type they're used as
+	auto* array = dynamic_cast<ArrayExprAST*>(e);
+	if (array && isArray(to) && isArray(from) && arrayLength(from) == arrayLength(to)) {
+		for (auto*& element : array->elements) {
+			coerce(element, indexedType(to));
+		}
+		e->resolvedType = to;
+		return;
+	}
+
+	// Arrays are passed to slices as a view of the array itself
+	if (isArray(from) && isSlice(to) && indexedType(from) == indexedType(to)) {
+		e = createAst<CastExprAST>(e, to);
+		return;
+	}
+
+	// Literals take the type they're used as, integer literals can become floats but not the other way around
+	auto* number = dynamic_cast<NumberExprAST*>(e);
+	if (number && number->suffix.empty() && isNumeric(to) && (number->isInteger() || isFloat(to))) {
+		if (literalFits(number, to) == false) {
+			error(literalText(number) + " doesn't fit in " + to);
+			return;
+		}
+
+		e->resolvedType = to;
+		return;
+	}
+
+	// Negated literals are converted like any other value, but are range checked like literals first
+	NumberExprAST* negated = negatedLiteral(e);
+	if (negated && negated->suffix.empty() && isInteger(to) && negatedLiteralFits(negated, to) == false) {
+		error("-" + literalText(negated) + " doesn't fit in " + to);
+		return;
+	}
+
+	// Floats lose their fraction as integers, that has to be asked for with a conversion, e.g. i32(x)
+	if (isFloat(from) && isInteger(to)) {
+		error("cannot convert " + from + " to " + to + " implicitly, convert it with " + to + "(...)");
+		return;
+	}
+
+	if ((isNumeric(from) || from == "bool" || enums.contains(from)) && isNumeric(to)) {
+		e = createAst<CastExprAST>(e, to);
+		return;
+	}
+
+	error("cannot convert " + from + " to " + to);
+}
+
+std::string TypeScope::commonType(ExprAST* left, ExprAST* right)
+{
+	const std::string& l = left->resolvedType;
+	const std::string& r = right->resolvedType;
+	if (l == r) {
+		return l;
+	}
+
+	// Scalars are broadcast to the vector operand
+	if (isVector(l) || isVector(r)) {
+		if (isVector(l) && isVector(r)) {
+			error("mismatched vector types " + l + " and " + r);
+			return l;
+		}
+
+		return isVector(l) ? l : r;
+	}
+
+	// A literal adapts to the other operand as long as it can represent it
+	auto* leftNumber = dynamic_cast<NumberExprAST*>(left);
+	auto* rightNumber = dynamic_cast<NumberExprAST*>(right);
+	if (leftNumber && leftNumber->suffix.empty() && rightNumber == nullptr && isNumeric(r) && (leftNumber->isInteger() || isFloat(r)) && literalFits(leftNumber, r)) {
+		return r;
+	}
+	if (rightNumber && rightNumber->suffix.empty() && leftNumber == nullptr && isNumeric(l) && (rightNumber->isInteger() || isFloat(l)) && literalFits(rightNumber, l)) {
+		return l;
+	}
+
+	if (isNumeric(l) && isNumeric(r)) {
+		if (isFloat(l) && isFloat(r)) {
+			return bitWidth(l) >= bitWidth(r) ? l : r;
+		}
+		if (isFloat(l)) return l;
+		if (isFloat(r)) return r;
+
+		// Both integers, the wider one wins. Unsigned wins at equal width.
+		if (bitWidth(l) != bitWidth(r)) {
+			return bitWidth(l) > bitWidth(r) ? l : r;
+		}
+		return isUnsignedInteger(l) ? l : r;
+	}
+
+	if (l == "bool" && isNumeric(r)) return r;
+	if (r == "bool" && isNumeric(l)) return l;
+
+	if (l.empty() == false && r.empty() == false) {
+		error("mismatched operand types " + l + " and " + r);
+	}
+
+	return l;
+}
+
+static bool isKnownType(const TypeScope& scope, const std::string& type) {
+	if (isTuple(type)) {
+		auto elements = tupleElements(type);
+		return std::all_of(elements.begin(), elements.end(), [&](const std::string& e) { return e != "void" && isKnownType(scope, e); });
+	}
+
+	if (isArray(type) || isSlice(type)) {
+		const std::string element = indexedType(type);
+		return (isSlice(type) || arrayLength(type) > 0) && element != "void" && isKnownType(scope, element);
+	}
+
+	return isNumeric(type) || isVector(type) || type == "bool" || type == "string" || type == "void" || type == "Arena" || type == "Allocator"
+		|| scope.structs.contains(type) || scope.enums.contains(type);
+}
+
+// Whether integer type can represent value.
+static bool fitsIn(int64_t value, const std::string& type) {
+	u32 bits = bitWidth(type);
+	if (bits == 64) {
+		return isSignedInteger(type) || value >= 0;
+	}
+
+	if (isUnsignedInteger(type)) {
+		return value >= 0 && value < (int64_t(1) << bits);
+	}
+
+	return value >= -(int64_t(1) << (bits - 1)) && value < (int64_t(1) << (bits - 1));
+}
+
+// type with the type parameter replaced by argument, e.g. &T becomes &Vec3.
+static std::string substitute(const std::string& type, const std::string& parameter, const std::string& argument) {
+	if (isTuple(type)) {
+		auto elements = tupleElements(type);
+		for (auto& e : elements) {
+			e = substitute(e, parameter, argument);
+		}
+		return tupleType(elements);
+	}
+
+	if (referencedType(type) == parameter) {
+		return (isReference(type) ? "&" : "") + argument;
+	}
+
+	return type;
+}
+
+// Type a call binds parameter to, taken from the arguments declared as parameter or &parameter. Unsuffixed literals
+// only decide when nothing else does, so add(v, 1) with an f64 v binds f64. Empty if no argument has that type.
+static std::string inferTypeArgument(const std::string& parameter, ArgumentListAST* declared, const std::vector<ExprAST*>& arguments, std::string* outConflict) {
+	std::string type;
+	std::string literalType;
+	for (size_t i = 0; i < declared->arguments.size() && i < arguments.size(); i++) {
+		auto* v = static_cast<VariableExprAST*>(declared->arguments[i]);
+		const std::string& argumentType = arguments[i]->resolvedType;
+		if (referencedType(v->type) != parameter || argumentType.empty()) {
+			continue;
+		}
+
+		// Every other argument has to agree, literals take the type they agree on
+		auto* number = dynamic_cast<NumberExprAST*>(arguments[i]);
+		if (number == nullptr || number->suffix.empty() == false) {
+			if (type.empty() == false && type != argumentType) {
+				*outConflict = type + " and " + argumentType;
+				return "";
+			}
+			type = argumentType;
+		}
+		// Without them the widest literal wins, an integer next to a float becomes a float, e.g. max(3, 2.5) is f64
+		else if (literalType.empty() || isFloat(argumentType) > isFloat(literalType) ||
+			(isFloat(argumentType) == isFloat(literalType) && bitWidth(argumentType) > bitWidth(literalType))) {
+			literalType = argumentType;
+		}
+	}
+
+	return type.empty() ? literalType : type;
+}
+
+// Makes fn callable, checking its argument and return types.
+static void declareFunction(TypeScope& scope, FunctionAST* fn) {
+	auto* signature = fn->getSignature();
+
+	FunctionType functionType;
+	functionType.returnType = signature->returnTypeName();
+	for (auto* a : signature->args->arguments) {
+		auto* v = static_cast<VariableExprAST*>(a);
+		if (isKnownType(scope, referencedType(v->type)) == false || referencedType(v->type) == "void") {
+			scope.error("unknown type " + v->type + " for argument " + v->name + " of " + signature->name);
+		}
+		functionType.argumentTypes.push_back(v->type);
+	}
+
+	if (isKnownType(scope, functionType.returnType) == false) {
+		scope.error("unknown return type " + functionType.returnType + " of " + signature->name);
+	}
+
+	// Strings are passed to C as their bytes, a C string coming back has no length
+	if (signature->isExternal && functionType.returnType == "string") {
+		scope.error("extern fn " + signature->name + " can't return a string");
+	}
+
+	// Results are folded into literals, so only scalars can cross the compile-time boundary
+	functionType.isComptime = signature->isComptime;
+	if (signature->isComptime) {
+		if (fn->getBody() == nullptr) {
+			scope.error("comptime fn " + signature->name + " needs a body");
+		}
+
+		for (auto& t : functionType.argumentTypes) {
+			if (isNumeric(t) == false && t != "bool") {
+				scope.error("comptime fn " + signature->name + " can only take numbers and bools, got " + t);
+			}
+		}
+
+		if (isNumeric(functionType.returnType) == false && functionType.returnType != "bool") {
+			scope.error("comptime fn " + signature->name + " has to return a number or bool");
+		}
+	}
+
+	scope.functions[signature->name] = functionType;
+}
+
+// Checks that impl provides each method of its trait with the trait's signature, the type parameter replaced by the impl's type.
+static void checkImpl(TypeScope& scope, ImplAST* impl) {
+	const std::string implemented = impl->implementedTrait();
+
+	auto trait = scope.traits.find(impl->traitName);
+	if (trait == scope.traits.end()) {
+		scope.error("unknown trait " + impl->traitName);
+		return;
+	}
+
+	if (isKnownType(scope, impl->typeArgument) == false || impl->typeArgument == "void") {
+		scope.error("unknown type " + impl->typeArgument + " in impl " + implemented);
+		return;
+	}
+
+	if (scope.impls.insert(implemented).second == false) {
+		scope.error(implemented + " is implemented more than once");
+		return;
+	}
+
+	const std::string& parameter = trait->second->typeParameter;
+	const std::string prefix = implemented + ".";
+	for (auto* m : impl->methods) {
+		auto* signature = m->getSignature();
+		std::string name = signature->name.substr(prefix.size());
+
+		auto* required = trait->second->method(name);
+		if (required == nullptr) {
+			scope.error(name + " isn't part of " + impl->traitName);
+			continue;
+		}
+
+		auto& arguments = signature->args->arguments;
+		auto& requiredArguments = required->args->arguments;
+		bool matches = arguments.size() == requiredArguments.size()
+			&& signature->returnTypeName() == substitute(required->returnTypeName(), parameter, impl->typeArgument);
+		for (size_t i = 0; matches && i < arguments.size(); i++) {
+			const std::string& type = static_cast<VariableExprAST*>(arguments[i])->type;
+			matches = type == substitute(static_cast<VariableExprAST*>(requiredArguments[i])->type, parameter, impl->typeArgument);
+		}
+
+		if (matches == false) {
+			scope.error(signature->name + " doesn't match the signature of " + name + " in " + impl->traitName);
+		}
+	}
+
+	for (auto* required : trait->second->methods) {
+		bool isImplemented = std::any_of(impl->methods.begin(), impl->methods.end(), [&](FunctionAST* m) { return m->getSignature()->name == prefix + required->name; });
+		if (isImplemented == false) {
+			scope.error(implemented + " is missing " + required->name);
+		}
+	}
+}
+
+std::string TypeScope::instantiate(FunctionAST* generic, const std::vector<std::string>& typeArguments)
+{
+	auto& parameters = generic->typeParameters;
+	const std::string& name = generic->getSignature()->name;
+	if (typeArguments.size() != parameters.size()) {
+		error(name + " expects " + std::to_string(parameters.size()) + " type arguments, got " + std::to_string(typeArguments.size()));
+		return "";
+	}
+
+	auto cached = instantiations.find({ generic, typeArguments });
+	if (cached != instantiations.end()) {
+		return cached->second;
+	}
+
+	std::string instanceName = name + "<";
+	for (size_t i = 0; i < parameters.size(); i++) {
+		const std::string& type = typeArguments[i];
+		if (isKnownType(*this, type) == false || type == "void" || isTuple(type)) {
+			error("can't use " + type + " as " + parameters[i].name + " of " + name);
+			return "";
+		}
+
+		if (parameters[i].bound.empty() == false && impls.contains(parameters[i].bound + "<" + type + ">") == false) {
+			error(type + " doesn't implement " + parameters[i].bound + ", required by " + parameters[i].name + " of " + name);
+			return "";
+		}
+
+		instanceName += (i > 0 ? "," : "") + type;
+	}
+	instanceName += ">";
+
+	// Cached before the body is checked, recursive calls find the instance that is being checked
+	FunctionAST* instance = lang::parser::instantiate(generic, typeArguments, instanceName);
+	instantiations[{ generic, typeArguments }] = instanceName;
+	instances.push_back(instance);
+	declareFunction(*this, instance);
+
+	// The body is checked on its own, not in the scope of the call that needs it
+	std::string callerReturnType = returnType;
+	auto callerVariables = std::move(variables);
+	u32 callerLoopDepth = loopDepth;
+	bool callerInComptimeFunction = inComptimeFunction;
+	bool callerInDefer = inDefer;
+	variables.clear();
+	loopDepth = 0;
+	inDefer = false;
+
+	size_t errorsBefore = errorCount;
+	instance->resolveTypes(*this);
+	if (errorCount != errorsBefore) {
+		std::cerr << "note: in " << instanceName << "\n";
+	}
+
+	returnType = callerReturnType;
+	variables = std::move(callerVariables);
+	loopDepth = callerLoopDepth;
+	inComptimeFunction = callerInComptimeFunction;
+	inDefer = callerInDefer;
+
+	return instanceName;
+}
+
+void NumberExprAST::resolveTypes(TypeScope& scope)
+{
+	if (suffix.empty() == false) {
+		resolvedType = suffix;
+		if (literalFits(this, suffix) == false) {
+			scope.error(literalText(this) + " doesn't fit in " + suffix);
+		}
+		return;
+	}
+
+	switch (type) {
+	case TokenType::FLOAT32: resolvedType = "f32"; break;
+	case TokenType::FLOAT64: resolvedType = "f64"; break; // Unsuffixed, f64 unless it's used as f32
+	case TokenType::INTEGER32: resolvedType = "i32"; break;
+	case TokenType::INTEGER64: resolvedType = integerValue() < 0 ? "u64" : "i64"; break; // Only values above i64's range are negative here
+	default: break;
+	}
+}
+
+void ConstantStringExpr::resolveTypes(TypeScope& scope)
+{
+	resolvedType = "string";
+}
+
+void VariableExprAST::resolveTypes(TypeScope& scope)
+{
+	if (isConstant) {
+		resolvedType = type;
+		return;
+	}
+
+	if (isDeclaration()) {
+		// var takes the type of its initializer
+		if (type == "var") {
+			if (assignment == nullptr) {
+				scope.error("var " + name + " needs an initializer to infer its type from");
+				return;
+			}
+
+			assignment->resolveTypes(scope);
+			type = assignment->resolvedType;
+			scope.declare(name, type, holdsArenaMemory(scope, assignment));
+			resolvedType = type;
+			return;
+		}
+
+		if (isKnownType(scope, type) == false || type == "void") {
+			scope.error("unknown type " + type + " for " + name);
+		}
+
+		if (assignment) {
+			assignment->resolveTypes(scope);
+			scope.coerce(assignment, type);
+		}
+
+		scope.declare(name, type, assignment && holdsArenaMemory(scope, assignment));
+		resolvedType = type;
+		return;
+	}
+
+	resolvedType = scope.lookup(name);
+	if (resolvedType.empty()) {
+		scope.error("unknown variable " + name);
+	}
+
+	if (isReference(resolvedType)) {
+		resolvedType = referencedType(resolvedType);
+		if (assignment) {
+			scope.error("can't assign to reference " + name);
+		}
+	}
+
+	if (assignment) {
+		assignment->resolveTypes(scope);
+		scope.coerce(assignment, resolvedType);
+		scope.assigned(name);
+
+		if (TypeScope::Variable* variable = scope.find(name)) {
+			variable->fromArena = holdsArenaMemory(scope, assignment);
+		}
+	}
+}
+
+void FieldExprAST::resolveTypes(TypeScope& scope)
+{
+	std::string type = scope.lookup(variable);
+
+	// Enum member, e.g. Color.Red, unless a variable hides the enum
+	auto enumeration = scope.enums.find(variable);
+	if (type.empty() && enumeration != scope.enums.end()) {
+		auto* member = fields.size() == 1 ? enumeration->second->member(fields[0]) : nullptr;
+		if (member == nullptr) {
+			scope.error(variable + " has no member " + fields[0]);
+			return;
+		}
+
+		if (assignment) {
+			scope.error("can't assign to enum member " + variable + "." + fields[0]);
+		}
+
+		auto* constant = createAst<NumberExprAST>(member->value);
+		constant->resolvedType = enumeration->second->underlyingType;
+		constantValue = constant;
+		resolvedType = variable;
+		return;
+	}
+
+	if (type.empty()) {
+		scope.error("unknown variable " + variable);
+		return;
+	}
+
+	bool throughReference = isReference(type);
+	type = referencedType(type);
+
+	for (auto& f : fields) {
+		// The length is the only field of strings, slices and arrays. It can't be assigned.
+		if (type == "string" || isSlice(type) || isArray(type)) {
+			if (f != "len") {
+				scope.error(type + " has no field " + f);
+				return;
+			}
+
+			if (assignment) {
+				scope.error("can't assign to the length of " + variable);
+			}
+
+			if (isArray(type) && fields.size() == 1) {
+				auto* length = createAst<NumberExprAST>(static_cast<int64_t>(arrayLength(type)));
+				length->resolvedType = "u64";
+				constantValue = length;
+			}
+
+			structTypes.push_back(type);
+			type = "u64";
+			continue;
+		}
+
+		auto strukt = scope.structs.find(type);
+		if (strukt == scope.structs.end()) {
+			scope.error(type + " has no fields, can't access " + f);
+			return;
+		}
+
+		auto& structFields = strukt->second->fields;
+		auto field = std::find_if(structFields.begin(), structFields.end(), [&](const StructAST::Field& sf) { return sf.name == f; });
+		if (field == structFields.end()) {
+			scope.error(type + " has no field " + f);
+			return;
+		}
+
+		structTypes.push_back(type);
+		type = field->type;
+	}
+
+	resolvedType = type;
+
+	if (assignment) {
+		if (throughReference) {
+			scope.error("can't assign to a field of reference " + variable);
+		}
+
+		assignment->resolveTypes(scope);
+		scope.coerce(assignment, resolvedType);
+	}
+}
+
+void ArrayExprAST::resolveTypes(TypeScope& scope)
+{
+	for (auto* e : elements) {
+		e->resolveTypes(scope);
+	}
+
+	if (elements.empty()) {
+		scope.error("array literals need at least one element");
+		return;
+	}
+
+	// Typed after the first element until the declaration or argument it's used as retypes it
+	std::string element = elements[0]->resolvedType;
+	for (auto*& e : elements) {
+		scope.coerce(e, element);
+	}
+
+	resolvedType = "[" + std::to_string(elements.size()) + "]" + element;
+}
+
+void IndexExprAST::resolveTypes(TypeScope& scope)
+{
+	index->resolveTypes(scope);
+	if (end) {
+		end->resolveTypes(scope);
+	}
+
+	baseType = referencedType(scope.lookup(variable));
+	if (baseType.empty()) {
+		scope.error("unknown variable " + variable);
+		return;
+	}
+
+	if (isArray(baseType) == false && isSlice(baseType) == false && baseType != "string") {
+		scope.error("can't index " + variable + " of type " + baseType);
+		return;
+	}
+
+	for (auto* bound : { index, end }) {
+		if (bound && isInteger(bound->resolvedType) == false) {
+			scope.error("index has to be an integer, got " + bound->resolvedType);
+		}
+	}
+
+	// Literal indexes into arrays are checked right away
+	for (auto* bound : { index, end }) {
+		auto* number = dynamic_cast<NumberExprAST*>(bound);
+		u64 limit = arrayLength(baseType) + (bound == end ? 1 : 0);
+		if (number && isArray(baseType) && static_cast<u64>(number->integerValue()) >= limit) {
+			scope.error("index " + std::to_string(number->integerValue()) + " is out of range for " + baseType);
+		}
+	}
+
+	if (end) {
+		resolvedType = baseType == "string" ? "string" : "[]" + indexedType(baseType);
+	}
+	else {
+		resolvedType = indexedType(baseType);
+	}
+
+	if (assignment) {
+		if (end) {
+			scope.error("can't assign to a sub-slice of " + variable);
+		}
+		else if (baseType == "string") {
+			scope.error("can't assign to the bytes of string " + variable);
+		}
+		else if (isReference(scope.lookup(variable))) {
+			scope.error("can't assign to an element of reference " + variable);
+		}
+
+		assignment->resolveTypes(scope);
+		scope.coerce(assignment, resolvedType);
+	}
+
+	// Checked once the body of the loop proves the index in range
+	auto* indexVariable = dynamic_cast<VariableExprAST*>(index);
+	if (end == nullptr && indexVariable && indexVariable->isConstant == false && indexVariable->assignment == nullptr) {
+		for (auto& fact : scope.inBoundsFacts) {
+			if (fact.index == indexVariable->name && fact.base == variable) {
+				fact.uses.push_back(this);
+			}
+		}
+	}
+}
+
+void TupleExprAST::resolveTypes(TypeScope& scope)
+{
+	std::vector<std::string> types;
+	for (auto* e : elements) {
+		e->resolveTypes(scope);
+		types.push_back(e->resolvedType);
+	}
+
+	resolvedType = tupleType(types);
+}
+
+void DestructureAST::resolveTypes(TypeScope& scope)
+{
+	value->resolveTypes(scope);
+
+	types = tupleElements(value->resolvedType);
+	if (types.size() != names.size()) {
+		scope.error("unpacking " + std::to_string(names.size()) + " values, got " + (value->resolvedType.empty() ? "none" : value->resolvedType));
+		return;
+	}
+
+	for (size_t i = 0; i < names.size(); i++) {
+		if (names[i] == "_") {
+			continue;
+		}
+
+		if (isDeclaration) {
+			scope.declare(names[i], types[i]);
+			continue;
+		}
+
+		scope.assigned(names[i]);
+		std::string type = scope.lookup(names[i]);
+		if (type.empty()) {
+			scope.error("unknown variable " + names[i]);
+		}
+		else if (isReference(type)) {
+			scope.error("can't assign to reference " + names[i]);
+		}
+		else if (type != types[i]) {
+			scope.error("can't assign " + types[i] + " to " + names[i] + " of type " + type);
+		}
+	}
+}
+
+void BinaryExprAST::resolveTypes(TypeScope& scope)
+{
+	left->resolveTypes(scope);
+	right->resolveTypes(scope);
+
+	// -1u8 would wrap around to 255
+	NumberExprAST* negated = negatedLiteral(this);
+	if (negated && negated->suffix.empty() == false && isInteger(negated->resolvedType) && negatedLiteralFits(negated, negated->resolvedType) == false) {
+		scope.error("-" + literalText(negated) + " doesn't fit in " + negated->resolvedType);
+	}
+
+	const char* op = TokenType::spelling(type);
+
+	switch (type) {
+	case TokenType::LEFT_ANGLE:
+	case TokenType::RIGHT_ANGLE:
+	case TokenType::LE_OP:
+	case TokenType::GE_OP:
+	case TokenType::EQ_OP:
+	case TokenType::NE_OP: {
+		// Only types codegen compares with a single instruction, or memcmp for strings. References compare the values
+		// they refer to, everything else (structs, arrays, slices, tuples) has no comparison.
+		std::string common = scope.commonType(left, right);
+		bool isEquality = type == TokenType::EQ_OP || type == TokenType::NE_OP;
+		if (isVector(common)) {
+			scope.error(std::string(op) + " can't compare vectors, compare lanes with extract or a reduction");
+		}
+		else if (scope.enums.contains(common) && isEquality == false) {
+			scope.error(std::string(op) + " can't compare " + common + ", enums only support == and !=");
+		}
+		else if (common == "string" && isEquality == false) {
+			scope.error(std::string(op) + " can't compare strings, strings only support == and !=");
+		}
+		else if (common == "bool" && isEquality == false) {
+			scope.error(std::string(op) + " can't compare bools, bools only support == and !=");
+		}
+		else if (isNumeric(common) == false && common != "bool" && common != "string" && scope.enums.contains(common) == false) {
+			scope.error(std::string(op) + " can't compare " + common + ", only numbers, bools, enums and strings can be compared");
+		}
+		scope.coerce(left, common);
+		scope.coerce(right, common);
+		resolvedType = "bool";
+		return;
+	}
+	case TokenType::AND_OP:
+	case TokenType::OR_OP:
+	case TokenType::XOR_OP:
+		scope.coerce(left, "bool");
+		scope.coerce(right, "bool");
+		resolvedType = "bool";
+		return;
+	case TokenType::DEREFERENCE_OR_SHIFT:
+	case TokenType::RIGHT_SHIFT:
+		if (isInteger(elementType(left->resolvedType)) == false) {
+			scope.error(std::string(op) + " expects an integer, got " + left->resolvedType);
+		}
+		scope.coerce(right, left->resolvedType);
+		resolvedType = left->resolvedType;
+		return;
+	default:
+		break;
+	}
+
+	std::string common = scope.commonType(left, right);
+	scope.coerce(left, common);
+	scope.coerce(right, common);
+	resolvedType = common;
+
+	// Vector operators work lane-wise, so they're checked on the lane type
+	const std::string element = elementType(common);
+	bool isBitwise = type == TokenType::AMPERSAND || type == TokenType::VERTICAL_BAR || type == TokenType::CARET;
+	if (isBitwise && isInteger(element) == false && element != "bool") {
+		scope.error(std::string(op) + " expects integers, got " + common);
+	}
+	else if (isBitwise == false && isNumeric(element) == false) {
+		scope.error(std::string(op) + " expects numbers, got " + common);
+	}
+}
+
+// Integer literal argument, e.g. a shuffle lane index. -1 if a isn't one.
+static int64_t literalIndex(ExprAST* a) {
+	auto* number = dynamic_cast<NumberExprAST*>(a);
+	if (number == nullptr || number->isInteger() == false || number->integerValue() < 0) {
+		return -1;
+	}
+
+	return number->integerValue();
+}
+
+// Built-in vector operations, arguments are already resolved. Returns false if callee isn't one of them.
+//   shuffle(v, lanes...) / shuffle(a, b, lanes...)  picks lanes by constant index, b's lanes continue after a's
+//   extract(v, i) / insert(v, i, x)                 reads or replaces a single lane
+//   reduce_add/mul/min/max/and/or/xor(v)            combines all lanes into a scalar
+//   load<f32x4>(s, i) / store(s, i, v)              reads or writes s[i] up to s[i + lanes - 1] of a slice or array
+bool CallExprAST::resolveVectorBuiltin(TypeScope& scope)
+{
+	auto& arguments = args->arguments;
+
+	if (callee == "load" || callee == "store") {
+		size_t expected = callee == "load" ? 2 : 3;
+		if (arguments.size() != expected) {
+			scope.error(callee + " expects " + std::to_string(expected) + " arguments");
+			return true;
+		}
+
+		const std::string vector = callee == "load" ? (typeArguments.size() == 1 ? typeArguments[0] : "") : arguments[2]->resolvedType;
+		if (isVector(vector) == false) {
+			scope.error(callee == "load" ? "load expects a vector type, e.g. load<f32x4>(s, i)" : "store expects a vector to store");
+			return true;
+		}
+
+		const std::string slice = "[]" + elementType(vector);
+		const std::string from = referencedType(arguments[0]->resolvedType);
+		if (from != slice && (isArray(from) == false || indexedType(from) != elementType(vector))) {
+			scope.error(callee + " expects a " + slice + " or an array of " + elementType(vector) + ", got " + from);
+			return true;
+		}
+		scope.coerce(arguments[0], slice);
+
+		if (isInteger(arguments[1]->resolvedType) == false) {
+			scope.error("index has to be an integer, got " + arguments[1]->resolvedType);
+		}
+
+		resolvedType = callee == "load" ? vector : "void";
+		return true;
+	}
+	bool isReduction = callee == "reduce_add" || callee == "reduce_mul" || callee == "reduce_min" || callee == "reduce_max"
+		|| callee == "reduce_and" || callee == "reduce_or" || callee == "reduce_xor";
+
+	if (callee != "shuffle" && callee != "extract" && callee != "insert" && isReduction == false) {
+		return false;
+	}
+
+	if (arguments.empty() || isVector(arguments[0]->resolvedType) == false) {
+		scope.error(callee + " expects a vector as first argument");
+		return true;
+	}
+
+	const std::string& vector = arguments[0]->resolvedType;
+	const std::string element = elementType(vector);
+
+	if (isReduction) {
+		bool isBitwise = callee == "reduce_and" || callee == "reduce_or" || callee == "reduce_xor";
+		if (arguments.size() != 1) {
+			scope.error(callee + " expects 1 argument");
+		}
+		else if (isBitwise && isInteger(element) == false) {
+			scope.error(callee + " expects an integer vector, got " + vector);
+		}
+
+		resolvedType = element;
+		return true;
+	}
+
+	if (callee == "extract" || callee == "insert") {
+		size_t expected = callee == "extract" ? 2 : 3;
+		if (arguments.size() != expected) {
+			scope.error(callee + " expects " + std::to_string(expected) + " arguments");
+			return true;
+		}
+
+		int64_t lane = literalIndex(arguments[1]);
+		if (lane >= static_cast<int64_t>(vectorLength(vector))) {
+			scope.error(callee + " lane " + std::to_string(lane) + " is out of range for " + vector);
+		}
+
+		scope.coerce(arguments[1], "u32");
+		if (callee == "insert") {
+			scope.coerce(arguments[2], element);
+		}
+
+		resolvedType = callee == "extract" ? element : vector;
+		return true;
+	}
+
+	// shuffle
+	size_t firstIndex = arguments.size() > 1 && isVector(arguments[1]->resolvedType) ? 2 : 1;
+	if (firstIndex == 2 && arguments[1]->resolvedType != vector) {
+		scope.error("shuffle expects two vectors of the same type, got " + vector + " and " + arguments[1]->resolvedType);
+		return true;
+	}
+
+	size_t laneCount = arguments.size() - firstIndex;
+	int64_t available = static_cast<int64_t>(vectorLength(vector) * firstIndex);
+	for (size_t i = firstIndex; i < arguments.size(); i++) {
+		int64_t lane = literalIndex(arguments[i]);
+		if (lane < 0 || lane >= available) {
+			scope.error("shuffle lanes have to be integer literals below " + std::to_string(available));
+		}
+	}
+
+	resolvedType = element + "x" + std::to_string(laneCount);
+	if (isVector(resolvedType) == false) {
+		scope.error("shuffle can't produce " + std::to_string(laneCount) + " lanes");
+	}
+
+	return true;
+}
+
+// Splits a format into the text around its {} placeholders, {{ and }} stand for literal braces.
+static bool splitFormat(const std::string& format, std::vector<std::string>* outPieces, std::string* outError) {
+	outPieces->assign(1, "");
+	for (size_t i = 0; i < format.size(); i++) {
+		char c = format[i];
+		char next = i + 1 < format.size() ? format[i + 1] : '\0';
+
+		if (c == '{' && next == '}') {
+			outPieces->emplace_back();
+			i++;
+		}
+		else if ((c == '{' || c == '}') && next == c) {
+			outPieces->back() += c;
+			i++;
+		}
+		else if (c == '{' || c == '}') {
+			*outError = std::string("unmatched ") + c + " in format, write " + c + c + " for a literal brace";
+			return false;
+		}
+		else {
+			outPieces->back() += c;
+		}
+	}
+
+	return true;
+}
+
+// core.fmt, arguments are already resolved. Returns false if callee isn't one of them.
+//   print(format, values...) / println(format, values...)  writes format with each {} replaced by the next value
+//   flush()                                                  writes out what this thread printed so far
+// The format has to be a string literal, so placeholders and value types are checked here instead of at runtime.
+bool CallExprAST::resolveFormatBuiltin(TypeScope& scope)
+{
+	auto& arguments = args->arguments;
+
+	if (callee == "flush") {
+		if (arguments.empty() == false) {
+			scope.error("flush expects no arguments");
+		}
+
+		resolvedType = "void";
+		return true;
+	}
+
+	if (callee != "print" && callee != "println") {
+		return false;
+	}
+
+	resolvedType = "void";
+
+	auto* format = arguments.empty() ? nullptr : dynamic_cast<ConstantStringExpr*>(arguments[0]);
+	if (format == nullptr) {
+		scope.error(callee + " expects a string literal as format, e.g. " + callee + "(\"{}\", x)");
+		return true;
+	}
+
+	std::string error;
+	if (splitFormat(format->value(), &formatPieces, &error) == false) {
+		scope.error(error);
+		return true;
+	}
+
+	size_t placeholders = formatPieces.size() - 1;
+	if (placeholders != arguments.size() - 1) {
+		scope.error("format has " + std::to_string(placeholders) + " {} but " + std::to_string(arguments.size() - 1) + " values were passed to " + callee);
+		return true;
+	}
+
+	for (size_t i = 1; i < arguments.size(); i++) {
+		const std::string& type = arguments[i]->resolvedType;
+		if (type.empty() == false && isInteger(type) == false && type != "f32" && type != "f64" && type != "bool" && type != "string") {
+			scope.error(callee + " can't format " + type + ", only integers, floats, bools and strings");
+		}
+	}
+
+	if (callee == "println") {
+		formatPieces.back() += "\n";
+	}
+
+	return true;
+}
+
+// Allocation, arguments are already resolved. Returns false if callee isn't one of them.
+//   alloc<T>(n) / alloc<T>(arena, n)  n zeroed T from the heap or from an Arena, as a []T
+//   free(s)                            gives a slice from alloc<T>(n) back to the heap
+//   reset(arena)                       frees everything allocated from arena at once, keeping its memory for reuse
+//   release(arena)                     frees everything and gives arena's memory back to the heap
+//   temp_alloc<T>(n) / temp_reset()    the same on an arena that belongs to the calling thread
+//   heap_allocator() / arena_allocator(arena)
+//                                      Allocator of the heap or of an arena, which has to outlive it
+//   alloc<T>(allocator, n) / free(allocator, s)
+//                                      the same through an Allocator, free does nothing for arenas
+bool CallExprAST::allocatesFromArena() const
+{
+	auto& arguments = args->arguments;
+	return isBuiltin && (callee == "temp_alloc" || (callee == "alloc" && arguments.size() == 2 && referencedType(arguments[0]->resolvedType) == "Arena"));
+}
+
+bool CallExprAST::resolveMemoryBuiltin(TypeScope& scope)
+{
+	auto& arguments = args->arguments;
+
+	// Arenas are used in place, copying one would lose track of what it allocated
+	auto checkArena = [&](ExprAST* a) {
+		auto* variable = dynamic_cast<VariableExprAST*>(a);
+		auto* field = dynamic_cast<FieldExprAST*>(a);
+		bool isPlace = (variable && variable->isDeclaration() == false && variable->assignment == nullptr) || (field && field->assignment == nullptr);
+		if (referencedType(a->resolvedType) != "Arena" || isPlace == false) {
+			scope.error(callee + " expects an Arena variable" + (callee == "alloc" ? " or an Allocator" : "") + ", got " + a->resolvedType);
+		}
+	};
+
+	if (callee == "alloc" || callee == "temp_alloc") {
+		size_t expected = callee == "alloc" && arguments.size() == 2 ? 2 : 1;
+		if (typeArguments.size() != 1 || arguments.size() != expected) {
+			scope.error(callee + " expects the element type and a count, e.g. " + callee + "<i32>(" + (callee == "alloc" ? "[arena, ]" : "") + "n)");
+			return true;
+		}
+
+		const std::string& element = typeArguments[0];
+		if (element == "void" || isKnownType(scope, element) == false) {
+			scope.error(callee + " can't allocate " + element);
+			return true;
+		}
+
+		if (expected == 2 && arguments[0]->resolvedType != "Allocator") {
+			checkArena(arguments[0]);
+		}
+		if (isInteger(arguments.back()->resolvedType) == false) {
+			scope.error(callee + " count has to be an integer, got " + arguments.back()->resolvedType);
+		}
+
+		resolvedType = "[]" + element;
+		return true;
+	}
+
+	if (callee == "free") {
+		if ((arguments.size() != 1 && arguments.size() != 2) || isSlice(arguments.back()->resolvedType) == false) {
+			scope.error("free expects a slice from alloc, e.g. free(s) or free(allocator, s)");
+		}
+		else if (referencedType(arguments[0]->resolvedType) == "Arena" || (arguments.size() == 1 && holdsArenaMemory(scope, arguments[0]))) {
+			scope.error("free can't free memory from an arena, reset or release the arena instead");
+		}
+		else if (arguments.size() == 2 && arguments[0]->resolvedType != "Allocator") {
+			scope.error("free expects an Allocator, got " + arguments[0]->resolvedType);
+		}
+
+		resolvedType = "void";
+		return true;
+	}
+
+	if (callee == "heap_allocator") {
+		if (arguments.empty() == false) {
+			scope.error("heap_allocator expects no arguments");
+		}
+
+		resolvedType = "Allocator";
+		return true;
+	}
+
+	if (callee == "arena_allocator") {
+		if (arguments.size() != 1) {
+			scope.error("arena_allocator expects 1 argument");
+		}
+		else {
+			checkArena(arguments[0]);
+		}
+
+		resolvedType = "Allocator";
+		return true;
+	}
+
+	if (callee == "reset" || callee == "release") {
+		if (arguments.size() != 1) {
+			scope.error(callee + " expects 1 argument");
+		}
+		else {
+			checkArena(arguments[0]);
+		}
+
+		resolvedType = "void";
+		return true;
+	}
+
+	if (callee == "temp_reset") {
+		if (arguments.empty() == false) {
+			scope.error("temp_reset expects no arguments");
+		}
+
+		resolvedType = "void";
+		return true;
+	}
+
+	return false;
+}
+
+void CallExprAST::resolveTypes(TypeScope& scope)
+{
+	for (auto* a : args->arguments) {
+		a->resolveTypes(scope);
+	}
+
+	// Struct constructor, e.g. Vec3(1, 2, 3), arguments are the fields in declaration order
+	auto strukt = scope.structs.find(callee);
+	if (strukt != scope.structs.end()) {
+		auto& fields = strukt->second->fields;
+		if (fields.size() != args->arguments.size()) {
+			scope.error(callee + " expects " + std::to_string(fields.size()) + " fields, got " + std::to_string(args->arguments.size()));
+			return;
+		}
+
+		for (size_t i = 0; i < fields.size(); i++) {
+			scope.coerce(args->arguments[i], fields[i].type);
+		}
+
+		resolvedType = callee;
+		return;
+	}
+
+	// Vector constructor, either one value per lane or a single value for all of them, e.g. f32x4(1, 2, 3, 4) or f32x4(0)
+	if (isVector(callee)) {
+		size_t count = args->arguments.size();
+		if (count != 1 && count != vectorLength(callee)) {
+			scope.error(callee + " expects 1 or " + std::to_string(vectorLength(callee)) + " values, got " + std::to_string(count));
+			return;
+		}
+
+		for (auto*& a : args->arguments) {
+			scope.coerce(a, elementType(callee));
+		}
+
+		resolvedType = callee;
+		return;
+	}
+
+	// Explicit conversion, the only way to turn a float into an integer, e.g. i32(x)
+	if (isNumeric(callee)) {
+		if (args->arguments.size() != 1) {
+			scope.error(callee + "(...) converts 1 value, got " + std::to_string(args->arguments.size()));
+			return;
+		}
+
+		ExprAST*& value = args->arguments[0];
+		if (isNumeric(value->resolvedType) == false && value->resolvedType != "bool" && scope.enums.contains(value->resolvedType) == false) {
+			scope.error("cannot convert " + value->resolvedType + " to " + callee);
+			return;
+		}
+
+		if (value->resolvedType != callee) {
+			value = createAst<CastExprAST>(value, callee);
+		}
+		resolvedType = callee;
+		return;
+	}
+
+	auto generic = scope.generics.find(callee);
+	bool takesTypeArgument = callee == "load" || callee == "alloc" || callee == "temp_alloc";
+	if (typeArguments.empty() == false && generic == scope.generics.end() && takesTypeArgument == false) {
+		scope.error(callee + " isn't generic, it takes no type arguments");
+		return;
+	}
+
+	// Generic fns are called through the instance for their type arguments, e.g. sum(a, b) with f32 a calls sum<f32>
+	if (generic != scope.generics.end()) {
+		std::vector<std::string> types = typeArguments;
+		if (types.empty()) {
+			for (auto& parameter : generic->second->typeParameters) {
+				std::string conflict;
+				std::string type = inferTypeArgument(parameter.name, generic->second->getSignature()->args, args->arguments, &conflict);
+				if (conflict.empty() == false) {
+					scope.error(parameter.name + " of " + callee + " is both " + conflict + ", pass it as " + callee + "<type>(...)");
+					return;
+				}
+				if (type.empty()) {
+					scope.error("can't infer " + parameter.name + " of " + callee + ", pass it as " + callee + "<type>(...)");
+					return;
+				}
+				types.push_back(type);
+			}
+		}
+
+		std::string instance = scope.instantiate(generic->second, types);
+		if (instance.empty()) {
+			return;
+		}
+		callee = instance;
+	}
+	// Trait methods are bound to the impl for the argument type here, the call goes straight to it
+	else if (scope.traitMethods.contains(callee) && scope.functions.contains(callee) == false) {
+		TraitAST* trait = scope.traitMethods.at(callee);
+		std::string conflict;
+		std::string type = inferTypeArgument(trait->typeParameter, trait->method(callee)->args, args->arguments, &conflict);
+		if (conflict.empty() == false) {
+			scope.error(trait->typeParameter + " of " + callee + " is both " + conflict);
+			return;
+		}
+		if (type.empty()) {
+			scope.error("can't tell which " + trait->name + " impl " + callee + " calls, no argument is a " + trait->typeParameter);
+			return;
+		}
+
+		std::string implemented = trait->name + "<" + type + ">";
+		if (scope.impls.contains(implemented) == false) {
+			scope.error(type + " doesn't implement " + trait->name + ", can't call " + callee);
+			return;
+		}
+		callee = implemented + "." + callee;
+	}
+
+	auto function = scope.functions.find(callee);
+	if (function == scope.functions.end()) {
+		if (resolveVectorBuiltin(scope) || resolveFormatBuiltin(scope) || resolveMemoryBuiltin(scope)) {
+			isBuiltin = true;
+			return;
+		}
+
+		scope.error("unknown function " + callee);
+		return;
+	}
+
+	auto& argumentTypes = function->second.argumentTypes;
+	if (argumentTypes.size() != args->arguments.size()) {
+		scope.error(callee + " expects " + std::to_string(argumentTypes.size()) + " arguments, got " + std::to_string(args->arguments.size()));
+		return;
+	}
+
+	// References take the caller's value as is, temporaries are materialized by codegen
+	for (size_t i = 0; i < argumentTypes.size(); i++) {
+		scope.coerce(args->arguments[i], referencedType(argumentTypes[i]));
+	}
+
+	resolvedType = function->second.returnType;
+
+	if (function->second.isComptime && scope.inComptimeFunction == false) {
+		offset = scope.location; // They're evaluated after checking, errors still point at the statement
+		scope.comptimeCalls.push_back(this);
+	}
+}
+
+void CodeBlockAST::resolveTypes(TypeScope& scope)
+{
+	scope.push();
+	lang::source::Offset outerLocation = scope.location; // Errors after the block belong to the statement holding it
+
+	for (auto* n : body) {
+		if (n) {
+			scope.location = n->offset;
+			n->resolveTypes(scope);
+		}
+	}
+
+	if (returnValue) {
+		scope.location = returnValue->offset;
+		returnValue->resolveTypes(scope);
+	}
+
+	scope.location = outerLocation;
+	scope.pop();
+}
+
+void ReturnAST::resolveTypes(TypeScope& scope)
+{
+	if (scope.inDefer) {
+		scope.error("can't return from a defer");
+	}
+
+	if (value == nullptr) {
+		if (scope.returnType != "void") {
+			scope.error("missing return value, expected " + scope.returnType);
+		}
+		resolvedType = "void";
+		return;
+	}
+
+	value->resolveTypes(scope);
+	if (scope.returnType == "void") {
+		scope.error("returning a value from a function without return type");
+		return;
+	}
+
+	scope.coerce(value, scope.returnType);
+	resolvedType = scope.returnType;
+}
+
+void FunctionAST::resolveTypes(TypeScope& scope)
+{
+	resolvedType = signature->returnTypeName();
+
+	if (body == nullptr || isGeneric()) {
+		return;
+	}
+
+	scope.returnType = resolvedType;
+	scope.inComptimeFunction = signature->isComptime;
+	scope.push();
+
+	for (auto* a : signature->args->arguments) {
+		auto* v = static_cast<VariableExprAST*>(a);
+		scope.declare(v->name, v->type);
+	}
+
+	body->resolveTypes(scope);
+	scope.pop();
+	scope.inComptimeFunction = false;
+}
+
+void ImplAST::resolveTypes(TypeScope& scope)
+{
+	for (auto* m : methods) {
+		m->resolveTypes(scope);
+	}
+}
+
+void IfAST::resolveTypes(TypeScope& scope)
+{
+	for (auto& c : chain) {
+		c.condition->resolveTypes(scope);
+		if (c.condition->resolvedType != "bool" && c.condition->resolvedType.empty() == false) {
+			scope.error("if condition has to be a bool, got " + c.condition->resolvedType);
+		}
+
+		c.body->resolveTypes(scope);
+	}
+
+	if (elseBody) {
+		elseBody->resolveTypes(scope);
+	}
+}
+
+void SwitchAST::resolveTypes(TypeScope& scope)
+{
+	value->resolveTypes(scope);
+	const std::string& type = value->resolvedType;
+
+	auto enumeration = scope.enums.find(type);
+	if (isInteger(type) == false && enumeration == scope.enums.end()) {
+		if (type.empty() == false) {
+			scope.error("switch needs an integer or enum, got " + type);
+		}
+		return;
+	}
+
+	std::set<int64_t> handled;
+	for (auto& c : cases) {
+		for (auto*& v : c.values) {
+			v->resolveTypes(scope);
+
+			size_t errorsBefore = scope.errorCount;
+			scope.coerce(v, type);
+			if (scope.errorCount != errorsBefore) {
+				continue;
+			}
+
+			// Case values go into the jump table, so they're evaluated now
+			lang::comptime::Evaluator evaluator;
+			evaluator.frames.emplace_back();
+			evaluator.pushScope();
+
+			int64_t constant = 0;
+			try {
+				constant = v->evaluate(evaluator).integer;
+			}
+			catch (const lang::comptime::EvaluationError&) {
+				scope.error("case values have to be constants");
+				continue;
+			}
+
+			if (handled.insert(constant).second == false) {
+				scope.error("case " + std::to_string(constant) + " is handled more than once");
+			}
+			c.constants.push_back(constant);
+		}
+
+		c.body->resolveTypes(scope);
+	}
+
+	if (defaultBody) {
+		defaultBody->resolveTypes(scope);
+	}
+
+	if (enumeration != scope.enums.end()) {
+		std::string missing;
+		for (auto& m : enumeration->second->members) {
+			if (handled.contains(m.value) == false) {
+				missing += (missing.empty() ? "" : ", ") + m.name;
+			}
+		}
+
+		isExhaustive = missing.empty();
+		if (isExhaustive == false && defaultBody == nullptr) {
+			scope.error("switch over " + type + " doesn't handle " + missing + ", add cases for them or a default");
+		}
+	}
+}
+
+void LoopAST::resolveTypes(TypeScope& scope)
+{
+	scope.push(); // For variables declared in init
+
+	if (init) {
+		init->resolveTypes(scope);
+	}
+
+	if (condition) {
+		condition->resolveTypes(scope);
+		if (condition->resolvedType != "bool" && condition->resolvedType.empty() == false) {
+			scope.error("loop condition has to be a bool, got " + condition->resolvedType);
+		}
+	}
+
+	if (step) {
+		step->resolveTypes(scope);
+	}
+
+	// for ...; i < a.len; ... keeps every a[i] in the body in range. The comparison is unsigned, so a negative i
+	// fails it just like it would fail the bounds check.
+	auto* compare = dynamic_cast<BinaryExprAST*>(condition);
+	auto* length = compare && compare->type == TokenType::LEFT_ANGLE ? dynamic_cast<FieldExprAST*>(compare->right) : nullptr;
+	auto* cast = compare ? dynamic_cast<CastExprAST*>(compare->left) : nullptr;
+	auto* index = dynamic_cast<VariableExprAST*>(cast ? cast->value : compare ? compare->left : nullptr);
+	bool isRangeCondition = length && length->fields.size() == 1 && length->fields[0] == "len" && length->structTypes.size() == 1
+		&& (isArray(length->structTypes[0]) || isSlice(length->structTypes[0]) || length->structTypes[0] == "string") && index && index->isConstant == false && index->assignment == nullptr && isInteger(index->resolvedType);
+	if (isRangeCondition) {
+		scope.inBoundsFacts.push_back(TypeScope::InBoundsFact{ index->name, length->variable });
+	}
+
+	scope.loopDepth++;
+	body->resolveTypes(scope);
+	scope.loopDepth--;
+
+	if (isRangeCondition) {
+		if (scope.inBoundsFacts.back().holds) {
+			for (auto* use : scope.inBoundsFacts.back().uses) {
+				use->isChecked = false;
+			}
+		}
+		scope.inBoundsFacts.pop_back();
+	}
+
+	scope.pop();
+}
+
+void LoopControlAST::resolveTypes(TypeScope& scope)
+{
+	if (scope.loopDepth == 0) {
+		scope.error(std::string(isBreak() ? "break" : "continue") + (scope.inDefer ? " can't leave a defer" : " outside of a loop"));
+	}
+}
+
+void DeferAST::resolveTypes(TypeScope& scope)
+{
+	// Loops around the defer don't count, break and continue would jump out of the deferred code
+	u32 outerLoopDepth = scope.loopDepth;
+	bool outerInDefer = scope.inDefer;
+	scope.loopDepth = 0;
+	scope.inDefer = true;
+
+	statement->resolveTypes(scope);
+
+	scope.loopDepth = outerLoopDepth;
+	scope.inDefer = outerInDefer;
+}
+
+bool lang::typechecker::resolveTypes(std::vector<ExprAST*>& nodes, const lang::source::File* file)
+{
+	TypeScope scope;
+	scope.file = file;
+
+	for (auto* n : nodes) {
+		if (n) {
+			scope.location = n->offset;
+		}
+
+		auto* strukt = dynamic_cast<StructAST*>(n);
+		if (strukt) {
+			scope.structs[strukt->name] = strukt;
+			continue;
+		}
+
+		auto* enumeration = dynamic_cast<EnumAST*>(n);
+		if (enumeration) {
+			scope.enums[enumeration->name] = enumeration;
+			if (isInteger(enumeration->underlyingType) == false) {
+				scope.error("enum " + enumeration->name + " has to be an integer type, got " + enumeration->underlyingType);
+				continue;
+			}
+
+			std::set<std::string> names;
+			for (auto& m : enumeration->members) {
+				if (names.insert(m.name).second == false) {
+					scope.error(enumeration->name + "." + m.name + " is declared more than once");
+				}
+				if (fitsIn(m.value, enumeration->underlyingType) == false) {
+					scope.error(enumeration->name + "." + m.name + " = " + std::to_string(m.value) + " doesn't fit in " + enumeration->underlyingType);
+				}
+			}
+			continue;
+		}
+
+		auto* trait = dynamic_cast<TraitAST*>(n);
+		if (trait) {
+			scope.traits[trait->name] = trait;
+			for (auto* m : trait->methods) {
+				auto [existing, isNew] = scope.traitMethods.try_emplace(m->name, trait);
+				if (isNew == false) {
+					scope.error(m->name + " is declared by both " + existing->second->name + " and " + trait->name);
+				}
+			}
+		}
+	}
+
+	for (auto* n : nodes) {
+		if (n) {
+			scope.location = n->offset;
+		}
+
+		auto* fn = dynamic_cast<FunctionAST*>(n);
+		if (fn && fn->isGeneric()) {
+			for (auto& parameter : fn->typeParameters) {
+				if (parameter.bound.empty() == false && scope.traits.contains(parameter.bound) == false) {
+					scope.error("unknown trait " + parameter.bound + " bounding " + parameter.name + " of " + fn->getSignature()->name);
+				}
+			}
+
+			if (fn->getSignature()->isComptime) {
+				scope.error("comptime fn " + fn->getSignature()->name + " can't be generic");
+			}
+
+			scope.generics[fn->getSignature()->name] = fn;
+			continue;
+		}
+
+		if (fn) {
+			declareFunction(scope, fn);
+			continue;
+		}
+
+		auto* impl = dynamic_cast<ImplAST*>(n);
+		if (impl) {
+			checkImpl(scope, impl);
+			for (auto* m : impl->methods) {
+				declareFunction(scope, m);
+			}
+		}
+	}
+
+	for (auto* n : nodes) {
+		if (n) {
+			scope.location = n->offset;
+			n->resolveTypes(scope);
+		}
+	}
+
+	// Instances are generated like any other fn
+	nodes.insert(nodes.end(), scope.instances.begin(), scope.instances.end());
+
+	if (scope.errorCount == 0) {
+		lang::comptime::foldCalls(scope, nodes);
+	}
+
+	return scope.errorCount == 0;
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "types.h"
+#include "source.h"
+
+namespace lang::parser {
+	class ExprAST;
+	class StructAST;
+	class EnumAST;
+	class CallExprAST;
+	class FunctionAST;
+	class TraitAST;
+	class IndexExprAST;
+}
+
+namespace lang::typechecker {
+
+	bool isSignedInteger(const std::string& type);
+	bool isUnsignedInteger(const std::string& type);
+	bool isInteger(const std::string& type);
+	bool isFloat(const std::string& type);
+	bool isNumeric(const std::string& type);
+
+	// Size in bits of integer and float types, 1 for bool and 0 for anything else.
+	u32 bitWidth(const std::string& type);
+
+	// SIMD vector types are named <element>x<lanes>, e.g. f32x4 or i32x8.
+	bool isVector(const std::string& type);
+	u32 vectorLength(const std::string& type);
+
+	// Lane type of a vector, the type itself for scalars.
+	std::string elementType(const std::string& type);
+
+	// Reference arguments are typed &T. They are read-only and passed as a pointer to the caller's value.
+	bool isReference(const std::string& type);
+
+	// T of &T, the type itself for everything else.
+	std::string referencedType(const std::string& type);
+
+	// Functions returning multiple values have a tuple type listing them, e.g. (i32,bool).
+	bool isTuple(const std::string& type);
+	std::vector<std::string> tupleElements(const std::string& type);
+	std::string tupleType(const std::vector<std::string>& elements);
+
+	// Fixed arrays are typed [N]T, e.g. [4]f32. Slices []T are a pointer and length into an array or another slice.
+	bool isArray(const std::string& type);
+	bool isSlice(const std::string& type);
+	u64 arrayLength(const std::string& type);
+
+	// T of [N]T and []T, u8 for string.
+	std::string indexedType(const std::string& type);
+
+	struct FunctionType {
+		std::string returnType;
+		std::vector<std::string> argumentTypes;
+		bool isComptime = false;
+	};
+
+	class TypeScope {
+	public:
+		std::map<std::string, FunctionType> functions;
+		std::map<std::string, lang::parser::StructAST*> structs;
+		std::map<std::string, lang::parser::EnumAST*> enums;
+		std::map<std::string, lang::parser::FunctionAST*> generics; // Generic fns by name, only their instances are checked
+		std::map<std::string, lang::parser::TraitAST*> traits;
+		std::map<std::string, lang::parser::TraitAST*> traitMethods; // Trait declaring each method name
+		std::set<std::string> impls; // Implemented traits, e.g. AddTrait<Vec3>
+		struct Variable {
+			std::string type;
+			bool fromArena = false; // Holds memory from an arena, which free can't take
+		};
+		std::vector<std::map<std::string, Variable>> variables; // Innermost scope last
+
+		std::string returnType; // Of the function being checked
+		u32 loopDepth = 0; // Loops around the node being checked, break and continue need one
+		bool inComptimeFunction = false; // Calls in there are interpreted along with the function
+		bool inDefer = false; // Deferred statements can't leave their block with return, break or continue
+
+		// Loop whose condition is index < base.len. Indexing base with index in its body can't be out of range,
+		// unless the body assigns or redeclares either of them.
+		struct InBoundsFact {
+			std::string index;
+			std::string base;
+			std::vector<lang::parser::IndexExprAST*> uses;
+			bool holds = true;
+		};
+		std::vector<InBoundsFact> inBoundsFacts; // Of the loops around the node being checked
+
+		// Breaks the in-bounds facts about name, called for every assignment and declaration.
+		void assigned(const std::string& name);
+
+		// Instance of each generic fn and type arguments it was used with, so every combination is generated once
+		std::map<std::pair<lang::parser::FunctionAST*, std::vector<std::string>>, std::string> instantiations;
+		std::vector<lang::parser::FunctionAST*> instances; // In the order they were created
+
+		// Comptime fn calls in runtime code, evaluated once all types are resolved
+		std::vector<lang::parser::CallExprAST*> comptimeCalls;
+		size_t errorCount = 0;
+
+		const lang::source::File* file = nullptr; // Errors print where they are when it's set
+		lang::source::Offset location = 0; // Start of the statement being checked
+
+		void push() { variables.emplace_back(); }
+		void pop() { variables.pop_back(); }
+
+		void declare(const std::string& name, const std::string& type, bool fromArena = false);
+
+		// Visible variable called name, nullptr if there is none.
+		Variable* find(const std::string& name);
+		const Variable* find(const std::string& name) const;
+
+		// Type of a visible variable, empty if there is none.
+		std::string lookup(const std::string& name) const;
+
+		void error(const std::string& message);
+
+		// Makes e produce a value of type to. Integer literals are retyped in place,
+		// everything else is wrapped in a CastExprAST. Scalars are splatted when to is a vector,
+		// enums convert to numbers but not the other way around.
+		// Reports an error if there is no conversion.
+		void coerce(lang::parser::ExprAST*& e, const std::string& to);
+
+		// Type both operands of an arithmetic or comparison operator are converted to.
+		std::string commonType(lang::parser::ExprAST* left, lang::parser::ExprAST* right);
+
+		// Name of the instance of generic for typeArguments, e.g. sum<f32>. The first use creates and checks it,
+		// later uses get the cached instance. Empty if typeArguments don't satisfy the type parameters.
+		std::string instantiate(lang::parser::FunctionAST* generic, const std::vector<std::string>& typeArguments);
+	};
+
+	// Annotates every expression in the module with its resolved type, appending the instances of generic fns
+	// to nodes. Returns false on type errors, which are located in file when it isn't null.
+	bool resolveTypes(std::vector<lang::parser::ExprAST*>& nodes, const lang::source::File* file);
+}
@@ -3,8 +3,20 @@
 #include <iostream>
 #include <fstream>
 
-std::string lang::fsutil::readTextFile(const std::string& path) noexcept
+bool lang::fsutil::tryReadTextFile(const std::string& path, std::string* outText) noexcept
 {
 	std::ifstream file(path);
-	return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());;
+	if (file.is_open() == false) {
+		return false;
+	}
+
+	// libstdc++ throws from the iterator when a read fails, e.g. on a directory
+	try {
+		outText->assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+	catch (const std::ios_base::failure&) {
+		return false;
+	}
+
+	return file.bad() == false;
 }
@@ -4,7 +4,8 @@
 
 namespace lang::fsutil
 {
-	std::string readTextFile(const std::string& path) noexcept;
+	// False if the file can't be opened or read, an empty file is read fine.
+	bool tryReadTextFile(const std::string& path, std::string* outText) noexcept;
 
 };
 
@@ -0,0 +1,27 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+struct IB {
+	int32_t a;
+	bool b;
+};
+
+// The byte behind b must hold exactly 0 or 1, anything else is a different bool to C
+static unsigned char boolByte(const struct IB* v)
+{
+	unsigned char byte;
+	memcpy(&byte, &v->b, 1);
+	return byte;
+}
+
+int c_ib(struct IB v)
+{
+	return boolByte(&v) == 1 && v.a == 41 ? 0 : 2;
+}
+
+struct IB c_flip(struct IB v)
+{
+	v.b = boolByte(&v) == 0;
+	return v;
+}
@@ -0,0 +1,12 @@
+#include <string.h>
+
+// Strings reach C NUL terminated at their length, also when they're a slice of a longer one
+int c_is(const char* s, const char* expected)
+{
+	return strcmp(s, expected) == 0 ? 0 : 1;
+}
+
+int c_length_is(const char* s, unsigned long long expected)
+{
+	return strlen(s) == expected ? 0 : 1;
+}
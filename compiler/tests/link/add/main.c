@@ -0,0 +1,13 @@
+// Both export fns have to stay callable after --link internalized everything else
+int potato_add(int a, int b);
+int potato_twice(int a);
+
+int main(void) {
+	if (potato_add(2, 3) != 5) {
+		return 1;
+	}
+	if (potato_twice(21) != 42) {
+		return 2;
+	}
+	return 0;
+}
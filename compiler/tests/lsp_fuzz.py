@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+# Feeds broken documents to --lsp and checks the server answers every request and exits cleanly.
+# lsp_fuzz.py <potatoscript> <file.potato>...
+#
+# Every document is opened whole, then edited one small change at a time through ranged didChange,
+# which exercises both the full and the incremental parse. Cuts, deleted lines and stray tokens all
+# leave the source broken in ways an editor does while typing. Every few edits the symbols and diagnostics are
+# compared against those of a freshly opened copy, which catches line tables going stale across edits and
+# incremental parses that disagree with a full one. Malformed JSON has to be answered with a parse error.
+
+import json
+import random
+import subprocess
+import sys
+
+MALFORMED = [b'{"id": 1, "method": "initialize", "params": {"x": 1e}}', b'{"id": 1, "method": "\\uZZZZ"}', b'[1, 2', b'{"id" 1}', b'-']
+
+STRAY = [",", "{", "}", "(", ")", "[", "]", "=", "fn", "struct", "return", "if", "else", ".", "\"", "1.", "<", ">", "+", "var", "for"]
+
+
+def message(body):
+    data = json.dumps(body).encode()
+    return b"Content-Length: %d\r\n\r\n" % len(data) + data
+
+
+def position(text, offset):
+    line = text.count("\n", 0, offset)
+    return {"line": line, "character": offset - (text.rfind("\n", 0, offset) + 1)}
+
+
+def responses(stdout):
+    result = {}
+    diagnostics = []  # Of every publishDiagnostics, in the order they were sent
+    while stdout:
+        header, _, rest = stdout.partition(b"\r\n\r\n")
+        length = int(header.split(b":")[1])
+        body = json.loads(rest[:length])
+        if "id" in body:
+            result[body["id"]] = body.get("result", body.get("error"))
+        elif body.get("method") == "textDocument/publishDiagnostics":
+            diagnostics.append(body["params"])
+        stdout = rest[length:]
+    return result, diagnostics
+
+
+def broken_documents(text, rng):
+    lines = text.split("\n")
+    for i in range(len(lines)):
+        yield "\n".join(lines[:i])  # Cut after a line
+        yield "\n".join(lines[:i] + lines[i + 1:])  # One line missing
+    for _ in range(200):
+        offset = rng.randrange(len(text) + 1)
+        yield text[:offset]  # Cut anywhere, e.g. in the middle of a token
+        yield text[:offset] + rng.choice(STRAY) + text[offset:]
+
+
+def main():
+    compiler, paths = sys.argv[1], sys.argv[2:]
+    rng = random.Random(1234)
+    requests = [b"Content-Length: %d\r\n\r\n" % len(body) + body for body in MALFORMED]
+    requests.append(message({"jsonrpc": "2.0", "id": 0, "method": "initialize", "params": {}}))
+    next_id = 1
+    compared = []  # Pairs of documentSymbol ids that have to give the same answer
+
+    for path in paths:
+        with open(path) as f:
+            original = f.read()
+
+        uri = "file:///" + path
+        requests.append(message({"jsonrpc": "2.0", "method": "textDocument/didOpen", "params": {"textDocument": {"uri": uri, "text": original}}}))
+        text = original
+
+        for i, broken in enumerate(broken_documents(original, rng)):
+            # Replace whatever differs from the last state with a single ranged edit
+            start = 0
+            while start < min(len(text), len(broken)) and text[start] == broken[start]:
+                start += 1
+            end_old, end_new = len(text), len(broken)
+            while end_old > start and end_new > start and text[end_old - 1] == broken[end_new - 1]:
+                end_old -= 1
+                end_new -= 1
+
+            change = {"range": {"start": position(text, start), "end": position(text, end_old)}, "text": broken[start:end_new]}
+            requests.append(message({"jsonrpc": "2.0", "method": "textDocument/didChange", "params": {"textDocument": {"uri": uri}, "contentChanges": [change]}}))
+            text = broken
+
+            requests.append(message({"jsonrpc": "2.0", "id": next_id, "method": "textDocument/documentSymbol", "params": {"textDocument": {"uri": uri}}}))
+            requests.append(message({"jsonrpc": "2.0", "id": next_id + 1, "method": "textDocument/definition", "params": {"textDocument": {"uri": uri}, "position": position(text, rng.randrange(len(text) + 1))}}))
+            next_id += 2
+
+            if i % 10 == 0:
+                fresh = uri + ".fresh"
+                requests.append(message({"jsonrpc": "2.0", "method": "textDocument/didOpen", "params": {"textDocument": {"uri": fresh, "text": text}}}))
+                requests.append(message({"jsonrpc": "2.0", "id": next_id, "method": "textDocument/documentSymbol", "params": {"textDocument": {"uri": fresh}}}))
+                requests.append(message({"jsonrpc": "2.0", "method": "textDocument/didClose", "params": {"textDocument": {"uri": fresh}}}))
+                compared.append((next_id - 2, next_id))
+                next_id += 1
+
+        requests.append(message({"jsonrpc": "2.0", "method": "textDocument/didClose", "params": {"textDocument": {"uri": uri}}}))
+
+    requests.append(message({"jsonrpc": "2.0", "id": next_id, "method": "shutdown"}))
+    requests.append(message({"jsonrpc": "2.0", "method": "exit"}))
+
+    result = subprocess.run([compiler, "--lsp"], input=b"".join(requests), capture_output=True, timeout=600)
+    answered = result.stdout.count(b'"id":')
+    if result.returncode != 0 or answered != next_id + 1 + len(MALFORMED):
+        print("lsp: exit code %d, answered %d of %d requests" % (result.returncode, answered, next_id + 1 + len(MALFORMED)))
+        return 1
+
+    answers, diagnostics = responses(result.stdout)
+    if answers.get(None) != {"code": -32700, "message": "parse error"}:
+        print("lsp: malformed JSON wasn't answered with a parse error, got %s" % answers.get(None))
+        return 1
+
+    for edited, fresh in compared:
+        if answers[edited] != answers[fresh]:
+            print("lsp: symbols of request %d differ from those of the same text opened fresh" % edited)
+            return 1
+
+    # A fresh copy is published right after the edit to the document it copies
+    for i, published in enumerate(diagnostics):
+        if published["uri"].endswith(".fresh") and published["diagnostics"] != diagnostics[i - 1]["diagnostics"]:
+            print("lsp: diagnostics of %s differ from those of the same text opened fresh" % diagnostics[i - 1]["uri"])
+            return 1
+
+    print("lsp: %d requests over %d documents answered" % (next_id + 1, len(paths)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
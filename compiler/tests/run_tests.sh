@@ -0,0 +1,190 @@
+#!/usr/bin/env bash
+# Compiler tests, run from anywhere: tests/run_tests.sh <path to potatoscript>
+# Needs python3, and a C compiler (cc) for the C interop tests.
+
+set -u
+
+POTATO=$(realpath "$1")
+TESTS=$(cd "$(dirname "$0")" && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+failures=0
+fail() {
+	echo "FAIL: $*"
+	failures=$((failures + 1))
+}
+
+# Language server: broken documents must never take it down
+python3 "$TESTS/lsp_fuzz.py" "$POTATO" "$TESTS"/../potatoscript/files/2.potato "$TESTS"/../potatoscript/files/3.potato || fail "lsp_fuzz.py"
+
+# C interop: c/<name>.potato is compiled at -O2 and linked against c/<name>.c, main returns 0 on success
+for source in "$TESTS"/c/*.potato; do
+	name=$(basename "$source" .potato)
+	if ! "$POTATO" "$source" --quiet -O2 -o "$WORK/$name.o" || ! cc -c "$TESTS/c/$name.c" -o "$WORK/$name.c.o" || ! cc "$WORK/$name.o" "$WORK/$name.c.o" -o "$WORK/$name"; then
+		fail "c/$name: doesn't build"
+		continue
+	fi
+
+	"$WORK/$name" || fail "c/$name: exit code $?"
+done
+
+# Linked modules: every link/<name>/*.potato is compiled to bitcode, the modules are joined with --link at -O2 and
+# linked against link/<name>/main.c, main returns 0 on success
+for directory in "$TESTS"/link/*/; do
+	name=$(basename "$directory")
+	modules=()
+	for source in "$directory"*.potato; do
+		module="$WORK/link_${name}_$(basename "$source" .potato).bc"
+		"$POTATO" "$source" --quiet -O2 --thin-lto -o "$module" >/dev/null || fail "link/$name: $(basename "$source") doesn't build"
+		modules+=("$module")
+	done
+
+	if ! "$POTATO" --link "${modules[@]}" --quiet -O2 -o "$WORK/link_$name.o" || ! cc "$WORK/link_$name.o" "$directory/main.c" -o "$WORK/link_$name"; then
+		fail "link/$name: doesn't link"
+		continue
+	fi
+
+	"$WORK/link_$name" || fail "link/$name: exit code $?"
+done
+
+# Programs: run/<name>.potato is compiled to an executable and has to print run/<name>.out
+for source in "$TESTS"/run/*.potato; do
+	name=$(basename "$source" .potato)
+	if ! "$POTATO" "$source" --quiet -O2 -o "$WORK/$name" >/dev/null; then
+		fail "run/$name: doesn't build"
+		continue
+	fi
+
+	"$WORK/$name" > "$WORK/$name.out" || fail "run/$name: exit code $?"
+	diff -u "$TESTS/run/$name.out" "$WORK/$name.out" || fail "run/$name: output differs"
+done
+
+# Every "// ir: <regex>" line of a test has to match the IR and no "// ir-not: <regex>" line may.
+# "// ir-order: <regex>" lines match in order like FileCheck's CHECK, each on a line after the previous match, and
+# "// ir-next: <regex>" on the line right after it like CHECK-NEXT.
+checkIr() { # <test name> <source> <.ll>
+	while IFS= read -r pattern; do
+		grep -qE -- "$pattern" "$3" || fail "$1: no match for $pattern"
+	done < <(sed -n 's|^// ir: ||p' "$2")
+
+	while IFS= read -r pattern; do
+		grep -qE -- "$pattern" "$3" && fail "$1: unexpected match for $pattern"
+	done < <(sed -n 's|^// ir-not: ||p' "$2")
+
+	local line=0 found
+	while IFS= read -r directive; do
+		local pattern=${directive#*: }
+		if [[ $directive == ir-next:* ]]; then
+			found=$(sed -n "$((line + 1))p" "$3" | grep -qE -- "$pattern" && echo $((line + 1)))
+		else
+			found=$(tail -n +$((line + 1)) "$3" | grep -nE -m 1 -- "$pattern" | cut -d : -f 1)
+			[ -n "$found" ] && found=$((line + found))
+		fi
+
+		if [ -z "$found" ]; then
+			fail "$1: no match for ${directive%%:*} $pattern after line $line"
+			return
+		fi
+		line=$found
+	done < <(sed -n 's|^// \(ir-order: .*\)|\1|p; s|^// \(ir-next: .*\)|\1|p' "$2")
+}
+
+# IR: ir/<name>.potato is compiled at -O2, or with the flags of its "// ir-flags:" line, and checked with checkIr
+for source in "$TESTS"/ir/*.potato; do
+	name=$(basename "$source" .potato)
+	flags=$(sed -n 's|^// ir-flags: ||p' "$source")
+	if ! "$POTATO" "$source" --quiet ${flags:--O2} -o "$WORK/$name.ll" >/dev/null; then
+		fail "ir/$name: doesn't build"
+		continue
+	fi
+
+	checkIr "ir/$name" "$source" "$WORK/$name.ll"
+done
+
+# Profiles: pgo/<name>.potato is built with --profile-generate and run, the profile is merged with llvm-profdata and
+# the -O2 IR built with --profile-use is checked with checkIr. Skipped without compiler-rt or llvm-profdata.
+PROFDATA=$(command -v llvm-profdata || ls /usr/lib/llvm-*/bin/llvm-profdata 2>/dev/null | tail -n 1)
+for source in "$TESTS"/pgo/*.potato; do
+	name=$(basename "$source" .potato)
+	if [ -z "$PROFDATA" ]; then
+		echo "skipped pgo/$name: llvm-profdata not found"
+		continue
+	fi
+
+	if ! "$POTATO" "$source" --quiet -O2 --profile-generate="$WORK/$name.profraw" -o "$WORK/$name.instrumented" >"$WORK/$name.err" 2>&1; then
+		if grep -qF "libclang_rt.profile" "$WORK/$name.err"; then
+			echo "skipped pgo/$name: compiler-rt's profile runtime not found"
+		else
+			fail "pgo/$name: instrumented build failed: $(head -n 3 "$WORK/$name.err")"
+		fi
+		continue
+	fi
+
+	"$WORK/$name.instrumented" >/dev/null || fail "pgo/$name: exit code $?"
+	if ! "$PROFDATA" merge -o "$WORK/$name.profdata" "$WORK/$name.profraw"; then
+		fail "pgo/$name: llvm-profdata merge failed"
+		continue
+	fi
+
+	if ! "$POTATO" "$source" --quiet -O2 --profile-use="$WORK/$name.profdata" -o "$WORK/$name.ll" >/dev/null; then
+		fail "pgo/$name: doesn't build with the profile"
+		continue
+	fi
+
+	checkIr "pgo/$name" "$source" "$WORK/$name.ll"
+done
+
+# Errors: errors/<name>.potato has to fail to compile with the message in its first line, "// error: <message>"
+for source in "$TESTS"/errors/*.potato; do
+	name=$(basename "$source" .potato)
+	expected=$(head -n 1 "$source" | sed 's|^// error: ||')
+	# Syntax errors abort, the subshell keeps bash's report of that out of the output
+	if ("$POTATO" "$source" --quiet -o "$WORK/$name.ll"; exit $?) >"$WORK/$name.err" 2>&1; then
+		fail "errors/$name: compiled"
+	elif ! grep -qF -- "$expected" "$WORK/$name.err"; then
+		fail "errors/$name: expected \"$expected\", got: $(head -n 3 "$WORK/$name.err")"
+	fi
+done
+
+# Compile server: paths are relative to the client, edits within a second are seen, unreadable input fails. Idle clients
+# and clients that hang up early don't hold up others or take the server down, the socket is removed when it stops.
+mkdir -p "$WORK/server" "$WORK/client"
+(cd "$WORK/server" && exec "$POTATO" --server="$WORK/server/s.sock" >/dev/null 2>&1) &
+server=$!
+for _ in $(seq 50); do [ -S "$WORK/server/s.sock" ] && break; sleep 0.1; done
+cd "$WORK/client"
+
+# Connects without sending anything for a while / sends a compile request and hangs up without reading the answer
+python3 -c 'import socket, sys, time; s = socket.socket(socket.AF_UNIX); s.connect(sys.argv[1]); time.sleep(5)' "$WORK/server/s.sock" &
+idle=$!
+python3 -c 'import os, socket, sys; s = socket.socket(socket.AF_UNIX); s.connect(sys.argv[1]); s.sendall((os.getcwd() + "\nmissing.potato\n\n").encode()); s.close()' "$WORK/server/s.sock"
+printf 'fn main() i32 {\n\treturn 1\n}\n' > a.potato
+"$POTATO" --connect="$WORK/server/s.sock" a.potato -o a.ll >/dev/null || fail "server: relative paths"
+grep -q "ret i32 1" a.ll || fail "server: output not written next to the client"
+
+printf 'fn main() i32 {\n\treturn 2\n}\n' > a.potato
+"$POTATO" --connect="$WORK/server/s.sock" a.potato -o a.ll >/dev/null || fail "server: recompile"
+grep -q "ret i32 2" a.ll || fail "server: stale cache entry after an edit"
+
+"$POTATO" --connect="$WORK/server/s.sock" missing.potato -o m.ll 2>/dev/null && fail "server: missing input compiled"
+kill -0 $idle 2>/dev/null || fail "server: requests waited for an idle client"
+cd - >/dev/null
+"$POTATO" --connect="$WORK/server/s.sock" shutdown >/dev/null 2>&1
+wait $server || fail "server: exit code $?"
+[ -e "$WORK/server/s.sock" ] && fail "server: socket left behind after shutdown"
+kill $idle 2>/dev/null
+
+(exec "$POTATO" --server="$WORK/server/t.sock" >/dev/null 2>&1) &
+server=$!
+for _ in $(seq 50); do [ -S "$WORK/server/t.sock" ] && break; sleep 0.1; done
+kill -TERM $server
+wait $server
+[ -e "$WORK/server/t.sock" ] && fail "server: socket left behind after SIGTERM"
+
+if [ $failures -ne 0 ]; then
+	echo "$failures failed"
+	exit 1
+fi
+
+echo "all passed"